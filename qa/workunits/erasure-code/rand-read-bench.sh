@@ -0,0 +1,54 @@
+#!/bin/bash
+#
+# Latency of random 4K reads from a 4+2 erasure coded pool, with and
+# without fast read.  Needs at least six osds.
+#
+#  qa/workunits/erasure-code/rand-read-bench.sh
+#
+# Partial reads show up in the ec_read_partial osd perf counter, fast
+# reads completing before every shard replied in ec_read_fast.
+#
+set -e
+
+: ${POOL:=ecbench}
+: ${NUM_OBJECTS:=64}
+: ${OBJECT_SIZE:=$((4 * 1024 * 1024))}
+: ${IO_SIZE:=4096}
+: ${DURATION:=60}
+: ${CONCURRENT_OPS:=16}
+: ${SMALLIOBENCH:=ceph_smalliobench}
+
+function bench() {
+    local fast_read=$1
+
+    ceph tell osd.\* injectargs -- --osd-ec-fast-read=$fast_read
+    echo "osd_ec_fast_read=$fast_read"
+    $SMALLIOBENCH \
+        --pool-name $POOL \
+        --num-objects $NUM_OBJECTS \
+        --object-size $OBJECT_SIZE \
+        --io-size $IO_SIZE \
+        --offset-align $IO_SIZE \
+        --write-ratio 0 \
+        --num-concurrent-ops $CONCURRENT_OPS \
+        --duration $DURATION \
+        --do-not-init true \
+        --disable-detailed-ops true
+}
+
+ceph osd erasure-code-profile set rand-read-bench k=4 m=2 \
+    ruleset-failure-domain=osd
+ceph osd pool create $POOL 64 64 erasure rand-read-bench
+
+$SMALLIOBENCH \
+    --pool-name $POOL \
+    --num-objects $NUM_OBJECTS \
+    --object-size $OBJECT_SIZE \
+    --init-only true
+
+bench false
+bench true
+
+ceph tell osd.\* injectargs -- --osd-ec-fast-read=false
+ceph osd pool delete $POOL $POOL --yes-i-really-really-mean-it
+ceph osd erasure-code-profile rm rand-read-bench
@@ -0,0 +1,59 @@
+#!/bin/bash
+#
+# Write latency while osds flap, with and without writes to degraded
+# objects.  Needs a replicated pool with size >= 3 and min_size 2.
+#
+#  qa/workunits/rados/degraded-write-bench.sh
+#
+# ceph_test_rados reports latency percentiles per op type; blocked
+# writes show up in the 99th percentile and max.  Writes let through
+# are counted in the degraded_write osd perf counter, writes that still
+# waited for recovery in degraded_wait.
+#
+set -e
+
+: ${POOL:=degradedbench}
+: ${OBJECTS:=200}
+: ${MAX_OPS:=4000}
+: ${MAX_IN_FLIGHT:=16}
+: ${THRASH_INTERVAL:=10}
+: ${TEST_RADOS:=ceph_test_rados}
+
+function thrash() {
+    local osds=$(ceph osd ls)
+    while true ; do
+        for osd in $osds ; do
+            sleep $THRASH_INTERVAL
+            ceph osd down $osd
+        done
+    done
+}
+
+function bench() {
+    local degraded_writes=$1
+
+    ceph tell osd.\* injectargs -- \
+        --osd-write-degraded-objects=$degraded_writes
+    echo "osd_write_degraded_objects=$degraded_writes"
+    thrash > /dev/null 2>&1 &
+    local thrasher=$!
+    $TEST_RADOS \
+        --pool $POOL \
+        --objects $OBJECTS \
+        --max-ops $MAX_OPS \
+        --max-in-flight $MAX_IN_FLIGHT \
+        --op write 80 \
+        --op read 20
+    kill $thrasher
+    wait $thrasher || true
+}
+
+ceph osd pool create $POOL 64 64
+ceph osd pool set $POOL size 3
+ceph osd pool set $POOL min_size 2
+
+bench false
+bench true
+
+ceph tell osd.\* injectargs -- --osd-write-degraded-objects=false
+ceph osd pool delete $POOL $POOL --yes-i-really-really-mean-it
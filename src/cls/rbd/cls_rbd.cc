@@ -37,6 +37,7 @@
 #include <sstream>
 #include <vector>
 
+#include "common/bit_vector.hpp"
 #include "common/errno.h"
 #include "objclass/objclass.h"
 #include "include/rbd_types.h"
@@ -82,6 +83,9 @@ cls_method_handle_t h_snapshot_add;
 cls_method_handle_t h_snapshot_remove;
 cls_method_handle_t h_get_all_features;
 cls_method_handle_t h_copyup;
+cls_method_handle_t h_object_map_load;
+cls_method_handle_t h_object_map_update;
+cls_method_handle_t h_object_map_resize;
 cls_method_handle_t h_get_id;
 cls_method_handle_t h_set_id;
 cls_method_handle_t h_dir_get_id;
@@ -1386,6 +1390,175 @@ int copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 }
 
 
+/********************* methods for rbd_object_map ************************/
+
+typedef ceph::BitVector<2> ObjectMap;
+
+/**
+ * Read an object map. Entries are packed two bits apiece; entries
+ * past the end of the object are RBD_OBJECT_NONEXISTENT.
+ *
+ * Input:
+ * @param in ignored
+ *
+ * Output:
+ * @param data the packed entries
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_load(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t size;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0)
+    return r;
+  if (size == 0)
+    return 0;
+
+  r = cls_cxx_read(hctx, 0, size, out);
+  if (r < 0) {
+    CLS_ERR("object_map_load: could not read object map: %d", r);
+    return r;
+  }
+  return 0;
+}
+
+/**
+ * Set the state of objects [start_object_no, end_object_no). Only the
+ * bytes holding those entries are read and rewritten.
+ *
+ * Input:
+ * @param start_object_no first object to update (uint64_t)
+ * @param end_object_no one past the last object to update (uint64_t)
+ * @param new_state the state to set (uint8_t)
+ * @param has_current_state whether to only update some objects (bool)
+ * @param current_state the state an object must be in to be updated (uint8_t)
+ *
+ * Output:
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_update(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t start_object_no, end_object_no;
+  uint8_t new_state, current_state;
+  bool has_current_state;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(start_object_no, iter);
+    ::decode(end_object_no, iter);
+    ::decode(new_state, iter);
+    ::decode(has_current_state, iter);
+    ::decode(current_state, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  if (start_object_no > end_object_no || (new_state & ~ObjectMap::MASK))
+    return -EINVAL;
+
+  uint64_t size = 0;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0 && r != -ENOENT)
+    return r;
+
+  // entries past the end of the object are nonexistent, so a
+  // conditional update for any other state can't match them
+  if (has_current_state && current_state != RBD_OBJECT_NONEXISTENT)
+    end_object_no = MIN(end_object_no, size * ObjectMap::ELEMENTS_PER_BYTE);
+  if (start_object_no >= end_object_no)
+    return 0;
+
+  uint64_t byte_offset = ObjectMap::get_byte_offset(start_object_no);
+  uint64_t byte_length = ObjectMap::get_byte_count(end_object_no) - byte_offset;
+  bufferlist data;
+  if (byte_offset < size) {
+    r = cls_cxx_read(hctx, byte_offset, MIN(byte_length, size - byte_offset),
+		     &data);
+    if (r < 0) {
+      CLS_ERR("object_map_update: could not read object map: %d", r);
+      return r;
+    }
+  }
+
+  ObjectMap object_map;
+  object_map.decode_data(data, byte_length * ObjectMap::ELEMENTS_PER_BYTE);
+  uint64_t first = byte_offset * ObjectMap::ELEMENTS_PER_BYTE;
+  bool updated = false;
+  for (uint64_t i = start_object_no - first; i < end_object_no - first; ++i) {
+    uint8_t state = object_map.get(i);
+    if (state == new_state ||
+	(has_current_state && state != current_state))
+      continue;
+    object_map.set(i, new_state);
+    updated = true;
+  }
+  if (!updated)
+    return 0;
+
+  CLS_LOG(20, "object_map_update: %llu~%llu -> %u",
+	  (unsigned long long)start_object_no,
+	  (unsigned long long)(end_object_no - start_object_no), new_state);
+  bufferlist write_bl;
+  object_map.encode_data(write_bl);
+  return cls_cxx_write(hctx, byte_offset, write_bl.length(), &write_bl);
+}
+
+/**
+ * Shrink an object map to num_objects entries. The objects dropped
+ * must already be RBD_OBJECT_NONEXISTENT. Growing is a no-op, since
+ * entries past the end are nonexistent.
+ *
+ * Input:
+ * @param num_objects the new number of objects (uint64_t)
+ *
+ * Output:
+ * @returns 0 on success, -ESTALE if a dropped object may still exist,
+ *          negative error code on other error
+ */
+int object_map_resize(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t num_objects;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(num_objects, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  uint64_t size;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0)
+    return r;
+
+  uint64_t stored_objects = size * ObjectMap::ELEMENTS_PER_BYTE;
+  if (num_objects >= stored_objects)
+    return 0;
+
+  bufferlist data;
+  r = cls_cxx_read(hctx, 0, size, &data);
+  if (r < 0) {
+    CLS_ERR("object_map_resize: could not read object map: %d", r);
+    return r;
+  }
+
+  ObjectMap object_map;
+  object_map.decode_data(data, stored_objects);
+  for (uint64_t i = num_objects; i < stored_objects; ++i) {
+    if (object_map.get(i) != RBD_OBJECT_NONEXISTENT) {
+      CLS_ERR("object_map_resize: object %llu may still exist",
+	      (unsigned long long)i);
+      return -ESTALE;
+    }
+  }
+
+  CLS_LOG(20, "object_map_resize: %llu -> %llu objects",
+	  (unsigned long long)stored_objects, (unsigned long long)num_objects);
+  object_map.resize(num_objects);
+  bufferlist write_bl;
+  object_map.encode_data(write_bl);
+  return cls_cxx_write_full(hctx, &write_bl);
+}
+
+
 /************************ rbd_id object methods **************************/
 
 /**
@@ -2046,6 +2219,17 @@ void __cls_init()
 			  CLS_METHOD_RD | CLS_METHOD_WR,
 			  set_stripe_unit_count, &h_set_stripe_unit_count);
 
+  /* methods for the rbd_object_map objects */
+  cls_register_cxx_method(h_class, "object_map_load",
+			  CLS_METHOD_RD,
+			  object_map_load, &h_object_map_load);
+  cls_register_cxx_method(h_class, "object_map_update",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_update, &h_object_map_update);
+  cls_register_cxx_method(h_class, "object_map_resize",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_resize, &h_object_map_resize);
+
   /* methods for the rbd_children object */
   cls_register_cxx_method(h_class, "add_child",
 			  CLS_METHOD_RD | CLS_METHOD_WR,
@@ -451,6 +451,49 @@ namespace librbd {
       return ioctx->exec(oid, "rbd", "copyup", data, out);
     }
 
+    int object_map_load(librados::IoCtx *ioctx, const std::string &oid,
+			uint64_t num_objects, ceph::BitVector<2> *object_map)
+    {
+      bufferlist in, out;
+      int r = ioctx->exec(oid, "rbd", "object_map_load", in, out);
+      if (r < 0)
+	return r;
+
+      object_map->decode_data(out, num_objects);
+      return 0;
+    }
+
+    void object_map_update(librados::ObjectWriteOperation *rados_op,
+			   uint64_t start_object_no, uint64_t end_object_no,
+			   uint8_t new_state, const uint8_t *current_state)
+    {
+      bufferlist in;
+      ::encode(start_object_no, in);
+      ::encode(end_object_no, in);
+      ::encode(new_state, in);
+      ::encode(current_state != NULL, in);
+      ::encode(current_state ? *current_state : (uint8_t)0, in);
+      rados_op->exec("rbd", "object_map_update", in);
+    }
+
+    int object_map_update(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t start_object_no, uint64_t end_object_no,
+			  uint8_t new_state, const uint8_t *current_state)
+    {
+      librados::ObjectWriteOperation op;
+      object_map_update(&op, start_object_no, end_object_no, new_state,
+			current_state);
+      return ioctx->operate(oid, &op);
+    }
+
+    int object_map_resize(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t num_objects)
+    {
+      bufferlist in, out;
+      ::encode(num_objects, in);
+      return ioctx->exec(oid, "rbd", "object_map_resize", in, out);
+    }
+
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status)
     {
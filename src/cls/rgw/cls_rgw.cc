@@ -27,6 +27,7 @@ cls_method_handle_t h_rgw_bucket_check_index;
 cls_method_handle_t h_rgw_bucket_rebuild_index;
 cls_method_handle_t h_rgw_bucket_prepare_op;
 cls_method_handle_t h_rgw_bucket_complete_op;
+cls_method_handle_t h_rgw_bucket_complete_ops;
 cls_method_handle_t h_rgw_bi_log_list_op;
 cls_method_handle_t h_rgw_dir_suggest_changes;
 cls_method_handle_t h_rgw_user_usage_log_add;
@@ -213,40 +214,71 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     return -EINVAL;
   }
 
-  bufferlist bl;
+  std::map<string, struct rgw_bucket_dir_entry>& m = new_dir.m;
+  string start_key = op.start_obj;
+  uint32_t count = 0;
+  bool done = false;
 
-  map<string, bufferlist> keys;
-  rc = get_obj_vals(hctx, op.start_obj, op.filter_prefix, op.num_entries + 1, &keys);
-  if (rc < 0)
-    return rc;
+  /*
+   * With a delimiter, a key that has it past the filter prefix is
+   * returned as a common prefix, and we seek the omap iterator past
+   * everything that shares that prefix, so a listing of a few big
+   * "directories" doesn't read all the entries within them.
+   */
+  while (!done) {
+    map<string, bufferlist> keys;
+    uint32_t num_keys = op.num_entries - count + 1;
+    rc = get_obj_vals(hctx, start_key, op.filter_prefix, num_keys, &keys);
+    if (rc < 0)
+      return rc;
 
-  std::map<string, struct rgw_bucket_dir_entry>& m = new_dir.m;
-  std::map<string, bufferlist>::iterator kiter = keys.begin();
-  uint32_t i;
+    bool seek = false;
+    std::map<string, bufferlist>::iterator kiter;
+    for (kiter = keys.begin(); kiter != keys.end(); ++kiter) {
+      if (!bi_is_objs_index(kiter->first)) {
+        done = true;
+        break;
+      }
 
-  bool done = false;
+      if (count >= op.num_entries) {
+        ret.is_truncated = true;
+        done = true;
+        break;
+      }
 
-  for (i = 0; i < op.num_entries && kiter != keys.end(); ++i, ++kiter) {
-    struct rgw_bucket_dir_entry entry;
+      if (!op.delimiter.empty()) {
+        size_t delim_pos = kiter->first.find(op.delimiter, op.filter_prefix.size());
+        if (delim_pos != string::npos) {
+          string prefix_key = kiter->first.substr(0, delim_pos + op.delimiter.size());
+          ret.common_prefixes.insert(prefix_key);
+          count++;
+
+          /* no valid utf8 name continues a prefix with 0xff */
+          start_key = prefix_key;
+          start_key.append(1, (char)0xff);
+          seek = true;
+          break;
+        }
+      }
 
-    if (!bi_is_objs_index(kiter->first)) {
-      done = true;
-      break;
-    }
+      struct rgw_bucket_dir_entry entry;
+      bufferlist& entrybl = kiter->second;
+      bufferlist::iterator eiter = entrybl.begin();
+      try {
+        ::decode(entry, eiter);
+      } catch (buffer::error& err) {
+        CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", kiter->first.c_str());
+        return -EINVAL;
+      }
 
-    bufferlist& entrybl = kiter->second;
-    bufferlist::iterator eiter = entrybl.begin();
-    try {
-      ::decode(entry, eiter);
-    } catch (buffer::error& err) {
-      CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", kiter->first.c_str());
-      return -EINVAL;
+      m[kiter->first] = entry;
+      count++;
+      start_key = kiter->first;
     }
-    
-    m[kiter->first] = entry;
-  }
 
-  ret.is_truncated = (kiter != keys.end() && !done);
+    if (!seek && keys.size() < num_keys)
+      break;
+  }
 
   ::encode(ret, *out);
   return 0;
@@ -520,39 +552,27 @@ static int read_index_entry(cls_method_context_t hctx, string& name, struct rgw_
   return 0;
 }
 
-int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+/*
+ * apply a single completion to the index; the header is updated in memory
+ * and *header_changed is set if the caller needs to write it back.  An op
+ * that is rejected returns before anything was changed; once *wrote is
+ * set, an error means the op may have been partly applied.
+ */
+static int complete_op(cls_method_context_t hctx, struct rgw_bucket_dir_header& header,
+                       rgw_cls_obj_complete_op& op, bool *header_changed, bool *wrote)
 {
-  // decode request
-  rgw_cls_obj_complete_op op;
-  bufferlist::iterator iter = in->begin();
-  try {
-    ::decode(op, iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
-    return -EINVAL;
-  }
   CLS_LOG(1, "rgw_bucket_complete_op(): request: op=%d name=%s ver=%lu:%llu tag=%s\n",
           op.op, op.name.c_str(),
           (unsigned long)op.ver.pool, (unsigned long long)op.ver.epoch,
           op.tag.c_str());
 
-  bufferlist header_bl;
-  struct rgw_bucket_dir_header header;
-  int rc = cls_cxx_map_read_header(hctx, &header_bl);
-  if (rc < 0)
-    return rc;
-  bufferlist::iterator header_iter = header_bl.begin();
-  try {
-    ::decode(header, header_iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode header\n");
-    return -EINVAL;
-  }
+  *header_changed = false;
+  *wrote = false;
 
   struct rgw_bucket_dir_entry entry;
   bool ondisk = true;
 
-  rc = read_index_entry(hctx, op.name, &entry);
+  int rc = read_index_entry(hctx, op.name, &entry);
   if (rc == -ENOENT) {
     entry.name = op.name;
     entry.ver = op.ver;
@@ -586,6 +606,11 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     cancel = true;
   }
 
+  if (!cancel && op.op == CLS_RGW_OP_DEL && !ondisk)
+    return -ENOENT;
+
+  *wrote = true;
+
   bufferlist op_bl;
   if (cancel) {
     if (op.log_op) {
@@ -624,8 +649,6 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
 	if (ret < 0)
 	  return ret;
       }
-    } else {
-      return -ENOENT;
     }
     break;
   case CLS_RGW_OP_ADD:
@@ -683,9 +706,108 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     }
   }
 
+  *header_changed = true;
+  return 0;
+}
+
+static int read_bucket_header(cls_method_context_t hctx, struct rgw_bucket_dir_header *header)
+{
+  bufferlist header_bl;
+  int rc = cls_cxx_map_read_header(hctx, &header_bl);
+  if (rc < 0)
+    return rc;
+  bufferlist::iterator header_iter = header_bl.begin();
+  try {
+    ::decode(*header, header_iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: read_bucket_header(): failed to decode header\n");
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_complete_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0)
+    return rc;
+
+  bool header_changed, wrote;
+  rc = complete_op(hctx, header, op, &header_changed, &wrote);
+  if (rc < 0 || !header_changed)
+    return rc;
+
   return write_bucket_header(hctx, &header);
 }
 
+/*
+ * Several completions against the same index object in one call.  They
+ * are applied in order, each as if it had been a separate
+ * bucket_complete_op.  The header version, which bi log keys are derived
+ * from, is bumped after every op that changed the header or logged, so
+ * no two ops in the batch end up with the same log key.  Reads within
+ * the call don't see its own writes, so the caller must not put two ops
+ * touching the same entry into a batch.  An op that is rejected (stale
+ * tag, deleting a missing entry) is logged and skipped rather than
+ * failing the ones that follow it.  An op that fails after it started
+ * writing fails the whole call, since its partial writes can't be taken
+ * back otherwise; the caller then resends the ops one at a time.
+ */
+int rgw_bucket_complete_ops(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_complete_ops call;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(call, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0)
+    return rc;
+
+  bool dirty = false;
+  list<rgw_cls_obj_complete_op>::iterator op_iter;
+  for (op_iter = call.ops.begin(); op_iter != call.ops.end(); ++op_iter) {
+    bool header_changed, wrote;
+    struct rgw_bucket_dir_header saved_header = header;
+    rc = complete_op(hctx, header, *op_iter, &header_changed, &wrote);
+    if (rc < 0) {
+      CLS_LOG(0, "ERROR: rgw_bucket_complete_ops(): op on name=%s returned %d\n", op_iter->name.c_str(), rc);
+      if (wrote)
+        return rc;
+      header = saved_header;
+      continue;
+    }
+    if (header_changed || op_iter->log_op) {
+      header.ver++;
+      dirty = true;
+    }
+  }
+
+  if (!dirty)
+    return 0;
+
+  bufferlist header_bl;
+  ::encode(header, header_bl);
+  return cls_cxx_map_write_header(hctx, &header_bl);
+}
+
 int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   CLS_LOG(1, "rgw_dir_suggest_changes()");
@@ -1608,6 +1730,7 @@ void __cls_init()
   cls_register_cxx_method(h_class, "bucket_rebuild_index", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_rebuild_index, &h_rgw_bucket_rebuild_index);
   cls_register_cxx_method(h_class, "bucket_prepare_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_prepare_op, &h_rgw_bucket_prepare_op);
   cls_register_cxx_method(h_class, "bucket_complete_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_op, &h_rgw_bucket_complete_op);
+  cls_register_cxx_method(h_class, "bucket_complete_ops", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_ops, &h_rgw_bucket_complete_ops);
   cls_register_cxx_method(h_class, "bi_log_list", CLS_METHOD_RD, rgw_bi_log_list, &h_rgw_bi_log_list_op);
   cls_register_cxx_method(h_class, "bi_log_trim", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bi_log_trim, &h_rgw_bi_log_list_op);
   cls_register_cxx_method(h_class, "dir_suggest_changes", CLS_METHOD_RD | CLS_METHOD_WR, rgw_dir_suggest_changes, &h_rgw_dir_suggest_changes);
@@ -42,8 +42,6 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string&
                                 rgw_bucket_entry_ver& ver, string& name, rgw_bucket_dir_entry_meta& dir_meta,
 				list<string> *remove_objs, bool log_op)
 {
-
-  bufferlist in;
   struct rgw_cls_obj_complete_op call;
   call.op = op;
   call.tag = tag;
@@ -53,10 +51,25 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string&
   call.log_op = log_op;
   if (remove_objs)
     call.remove_objs = *remove_objs;
+  cls_rgw_bucket_complete_op(o, call);
+}
+
+void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, rgw_cls_obj_complete_op& call)
+{
+  bufferlist in;
   ::encode(call, in);
   o.exec("rgw", "bucket_complete_op", in);
 }
 
+void cls_rgw_bucket_complete_ops(ObjectWriteOperation& o, list<rgw_cls_obj_complete_op>& ops)
+{
+  bufferlist in;
+  struct rgw_cls_obj_complete_ops call;
+  call.ops = ops;
+  ::encode(call, in);
+  o.exec("rgw", "bucket_complete_ops", in);
+}
+
 
 int cls_rgw_list_op(IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
@@ -158,6 +171,184 @@ int cls_rgw_get_dir_header(IoCtx& io_ctx, string& oid, rgw_bucket_dir_header *he
  return r;
 }
 
+/*
+ * Runs one op per bucket index shard object, with up to max_aio of them
+ * in flight; subclasses issue the op and look at its result.
+ */
+class BucketIndexShardsIO {
+protected:
+  IoCtx& io_ctx;
+  map<int, string>& objs;
+  uint32_t max_aio;
+
+  virtual int issue_op(int shard_id, const string& oid, AioCompletion *c) = 0;
+  virtual int complete_op(int shard_id, int r) { return r; }
+
+public:
+  BucketIndexShardsIO(IoCtx& _io_ctx, map<int, string>& _objs, uint32_t _max_aio)
+    : io_ctx(_io_ctx), objs(_objs), max_aio(_max_aio ? _max_aio : 1) {}
+  virtual ~BucketIndexShardsIO() {}
+
+  int run() {
+    int ret = 0;
+    list<pair<int, AioCompletion *> > pending;
+    map<int, string>::iterator iter = objs.begin();
+    while (iter != objs.end() || !pending.empty()) {
+      if (iter != objs.end() && ret >= 0 && pending.size() < max_aio) {
+        AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+        int r = issue_op(iter->first, iter->second, c);
+        if (r < 0) {
+          c->release();
+          ret = r;
+        } else {
+          pending.push_back(make_pair(iter->first, c));
+        }
+        ++iter;
+        continue;
+      }
+      if (pending.empty())
+        break;
+      AioCompletion *c = pending.front().second;
+      c->wait_for_safe();
+      int r = complete_op(pending.front().first, c->get_return_value());
+      c->release();
+      pending.pop_front();
+      if (r < 0 && ret >= 0)
+        ret = r;
+    }
+    return ret;
+  }
+};
+
+class BucketIndexInit : public BucketIndexShardsIO {
+protected:
+  int issue_op(int shard_id, const string& oid, AioCompletion *c) {
+    ObjectWriteOperation op;
+    op.create(true);
+    cls_rgw_bucket_init(op);
+    return io_ctx.aio_operate(oid, c, &op);
+  }
+  int complete_op(int shard_id, int r) {
+    return (r == -EEXIST ? 0 : r);
+  }
+public:
+  BucketIndexInit(IoCtx& _io_ctx, map<int, string>& _objs, uint32_t _max_aio)
+    : BucketIndexShardsIO(_io_ctx, _objs, _max_aio) {}
+};
+
+int cls_rgw_bucket_index_init_op(IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                 uint32_t max_aio)
+{
+  BucketIndexInit init(io_ctx, bucket_objs, max_aio);
+  return init.run();
+}
+
+class BucketSetTagTimeout : public BucketIndexShardsIO {
+  uint64_t tag_timeout;
+protected:
+  int issue_op(int shard_id, const string& oid, AioCompletion *c) {
+    ObjectWriteOperation op;
+    cls_rgw_bucket_set_tag_timeout(op, tag_timeout);
+    return io_ctx.aio_operate(oid, c, &op);
+  }
+public:
+  BucketSetTagTimeout(IoCtx& _io_ctx, map<int, string>& _objs, uint32_t _max_aio,
+                      uint64_t _tag_timeout)
+    : BucketIndexShardsIO(_io_ctx, _objs, _max_aio), tag_timeout(_tag_timeout) {}
+};
+
+int cls_rgw_bucket_set_tag_timeout(IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                   uint64_t tag_timeout, uint32_t max_aio)
+{
+  BucketSetTagTimeout op(io_ctx, bucket_objs, max_aio, tag_timeout);
+  return op.run();
+}
+
+/* exec()s a class method on every shard and decodes each reply into T */
+template <class T>
+class BucketIndexShardsExec : public BucketIndexShardsIO {
+  const char *method;
+  bufferlist in;
+  map<int, bufferlist> out;
+  map<int, T> *results;
+protected:
+  int issue_op(int shard_id, const string& oid, AioCompletion *c) {
+    return io_ctx.aio_exec(oid, c, "rgw", method, in, &out[shard_id]);
+  }
+  int complete_op(int shard_id, int r) {
+    if (r < 0 || !results)
+      return r;
+    try {
+      bufferlist::iterator iter = out[shard_id].begin();
+      ::decode((*results)[shard_id], iter);
+    } catch (buffer::error& err) {
+      return -EIO;
+    }
+    return r;
+  }
+public:
+  BucketIndexShardsExec(IoCtx& _io_ctx, map<int, string>& _objs, uint32_t _max_aio,
+                        const char *_method, bufferlist& _in, map<int, T> *_results)
+    : BucketIndexShardsIO(_io_ctx, _objs, _max_aio), method(_method), in(_in),
+      results(_results) {}
+};
+
+int cls_rgw_list_op(IoCtx& io_ctx, map<int, string>& bucket_objs,
+                    string& start_obj, string& filter_prefix, const string& delimiter,
+                    uint32_t num_entries, map<int, rgw_cls_list_ret>& list_results,
+                    uint32_t max_aio)
+{
+  bufferlist in;
+  struct rgw_cls_list_op call;
+  call.start_obj = start_obj;
+  call.filter_prefix = filter_prefix;
+  call.delimiter = delimiter;
+  call.num_entries = num_entries;
+  ::encode(call, in);
+  BucketIndexShardsExec<rgw_cls_list_ret> op(io_ctx, bucket_objs, max_aio,
+                                             "bucket_list", in, &list_results);
+  return op.run();
+}
+
+int cls_rgw_bucket_check_index_op(IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                  map<int, rgw_cls_check_index_ret>& results, uint32_t max_aio)
+{
+  bufferlist in;
+  BucketIndexShardsExec<rgw_cls_check_index_ret> op(io_ctx, bucket_objs, max_aio,
+                                                    "bucket_check_index", in, &results);
+  return op.run();
+}
+
+int cls_rgw_bucket_rebuild_index_op(IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                    uint32_t max_aio)
+{
+  bufferlist in;
+  BucketIndexShardsExec<rgw_cls_check_index_ret> op(io_ctx, bucket_objs, max_aio,
+                                                    "bucket_rebuild_index", in, NULL);
+  return op.run();
+}
+
+int cls_rgw_get_dir_header(IoCtx& io_ctx, map<int, string>& bucket_objs,
+                           map<int, rgw_bucket_dir_header>& headers, uint32_t max_aio)
+{
+  bufferlist in;
+  struct rgw_cls_list_op call;
+  call.num_entries = 0;
+  ::encode(call, in);
+  map<int, rgw_cls_list_ret> list_results;
+  BucketIndexShardsExec<rgw_cls_list_ret> op(io_ctx, bucket_objs, max_aio,
+                                             "bucket_list", in, &list_results);
+  int r = op.run();
+  if (r < 0)
+    return r;
+
+  map<int, rgw_cls_list_ret>::iterator iter;
+  for (iter = list_results.begin(); iter != list_results.end(); ++iter) {
+    headers[iter->first] = iter->second.dir.header;
+  }
+  return 0;
+}
+
 class GetDirHeaderCompletion : public ObjectOperationCompletion {
   RGWGetDirHeader_CB *ret_ctx;
 public:
@@ -4,6 +4,7 @@
 #include "include/types.h"
 #include "include/rados/librados.hpp"
 #include "cls_rgw_types.h"
+#include "cls_rgw_ops.h"
 #include "common/RefCountedObj.h"
 
 class RGWGetDirHeader_CB : public RefCountedObject {
@@ -23,6 +24,10 @@ void cls_rgw_bucket_prepare_op(librados::ObjectWriteOperation& o, RGWModifyOp op
 void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                 rgw_bucket_entry_ver& ver, string& name, rgw_bucket_dir_entry_meta& dir_meta,
 				list<string> *remove_objs, bool log_op);
+void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, rgw_cls_obj_complete_op& call);
+
+/* several completions for entries on the same index object, in one call */
+void cls_rgw_bucket_complete_ops(librados::ObjectWriteOperation& o, list<rgw_cls_obj_complete_op>& ops);
 
 int cls_rgw_list_op(librados::IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
@@ -40,6 +45,26 @@ void cls_rgw_encode_suggestion(char op, rgw_bucket_dir_entry& dirent, bufferlist
 
 void cls_rgw_suggest_changes(librados::ObjectWriteOperation& o, bufferlist& updates);
 
+/*
+ * sharded bucket index: these run the op against every index object in
+ * bucket_objs (keyed by shard id), keeping at most max_aio ops in flight,
+ * and return the first error seen.
+ */
+int cls_rgw_bucket_index_init_op(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                 uint32_t max_aio);
+int cls_rgw_bucket_set_tag_timeout(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                   uint64_t tag_timeout, uint32_t max_aio);
+int cls_rgw_list_op(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                    string& start_obj, string& filter_prefix, const string& delimiter,
+                    uint32_t num_entries, map<int, rgw_cls_list_ret>& list_results,
+                    uint32_t max_aio);
+int cls_rgw_bucket_check_index_op(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                  map<int, rgw_cls_check_index_ret>& results, uint32_t max_aio);
+int cls_rgw_bucket_rebuild_index_op(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                    uint32_t max_aio);
+int cls_rgw_get_dir_header(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                           map<int, rgw_bucket_dir_header>& headers, uint32_t max_aio);
+
 /* bucket index log */
 
 int cls_rgw_bi_log_list(librados::IoCtx& io_ctx, string& oid, string& marker, uint32_t max,
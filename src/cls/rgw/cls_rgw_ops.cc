@@ -141,12 +141,32 @@ void rgw_cls_obj_complete_op::dump(Formatter *f) const
   f->dump_string("tag", tag);
 }
 
+void rgw_cls_obj_complete_ops::generate_test_instances(list<rgw_cls_obj_complete_ops*>& o)
+{
+  rgw_cls_obj_complete_ops *ops = new rgw_cls_obj_complete_ops;
+  list<rgw_cls_obj_complete_op *> l;
+  rgw_cls_obj_complete_op::generate_test_instances(l);
+  for (list<rgw_cls_obj_complete_op *>::iterator iter = l.begin(); iter != l.end(); ++iter) {
+    ops->ops.push_back(**iter);
+    delete *iter;
+  }
+  o.push_back(ops);
+
+  o.push_back(new rgw_cls_obj_complete_ops);
+}
+
+void rgw_cls_obj_complete_ops::dump(Formatter *f) const
+{
+  encode_json("ops", ops, f);
+}
+
 void rgw_cls_list_op::generate_test_instances(list<rgw_cls_list_op*>& o)
 {
   rgw_cls_list_op *op = new rgw_cls_list_op;
   op->start_obj = "start_obj";
   op->num_entries = 100;
   op->filter_prefix = "filter_prefix";
+  op->delimiter = "/";
   o.push_back(op);
   o.push_back(new rgw_cls_list_op);
 }
@@ -155,6 +175,8 @@ void rgw_cls_list_op::dump(Formatter *f) const
 {
   f->dump_string("start_obj", start_obj);
   f->dump_unsigned("num_entries", num_entries);
+  f->dump_string("filter_prefix", filter_prefix);
+  f->dump_string("delimiter", delimiter);
 }
 
 void rgw_cls_list_ret::generate_test_instances(list<rgw_cls_list_ret*>& o)
@@ -168,6 +190,7 @@ void rgw_cls_list_ret::generate_test_instances(list<rgw_cls_list_ret*>& o)
     rgw_cls_list_ret *ret = new rgw_cls_list_ret;
     ret->dir = *d;
     ret->is_truncated = true;
+    ret->common_prefixes.insert("prefix/");
 
     o.push_back(ret);
 
@@ -183,6 +206,11 @@ void rgw_cls_list_ret::dump(Formatter *f) const
   dir.dump(f);
   f->close_section();
   f->dump_int("is_truncated", (int)is_truncated);
+  f->open_array_section("common_prefixes");
+  for (set<string>::const_iterator iter = common_prefixes.begin(); iter != common_prefixes.end(); ++iter) {
+    f->dump_string("prefix", *iter);
+  }
+  f->close_section();
 }
 
 void cls_rgw_bi_log_list_op::dump(Formatter *f) const
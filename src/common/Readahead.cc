@@ -0,0 +1,181 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/Readahead.h"
+#include "include/assert.h"
+
+#include <algorithm>
+
+using namespace std;
+
+Readahead::Readahead()
+  : m_lock("Readahead::m_lock"),
+    m_trigger_requests(10),
+    m_readahead_min_bytes(0),
+    m_readahead_max_bytes(1024 * 1024),
+    m_nr_consec_read(0),
+    m_consec_read_bytes(0),
+    m_last_pos(0),
+    m_readahead_pos(0),
+    m_readahead_trigger_pos(0),
+    m_readahead_size(0),
+    m_hit_bytes(0),
+    m_waste_bytes(0),
+    m_pending_lock("Readahead::m_pending_lock"),
+    m_pending(0)
+{
+}
+
+Readahead::~Readahead()
+{
+}
+
+Readahead::extent_t Readahead::update(const vector<extent_t>& extents,
+				      uint64_t limit)
+{
+  Mutex::Locker l(m_lock);
+  for (vector<extent_t>::const_iterator p = extents.begin();
+       p != extents.end(); ++p) {
+    _observe_read(p->first, p->second);
+  }
+  return _compute_readahead(limit);
+}
+
+Readahead::extent_t Readahead::update(uint64_t offset, uint64_t length,
+				      uint64_t limit)
+{
+  Mutex::Locker l(m_lock);
+  _observe_read(offset, length);
+  return _compute_readahead(limit);
+}
+
+void Readahead::_observe_read(uint64_t offset, uint64_t length)
+{
+  if (offset == m_last_pos) {
+    m_nr_consec_read++;
+    m_consec_read_bytes += length;
+    if (m_readahead_pos > offset)
+      m_hit_bytes += min(length, m_readahead_pos - offset);
+  } else {
+    if (m_readahead_pos > m_last_pos)
+      m_waste_bytes += m_readahead_pos - m_last_pos;
+    m_nr_consec_read = 0;
+    m_consec_read_bytes = 0;
+    m_readahead_trigger_pos = 0;
+    m_readahead_size = 0;
+    m_readahead_pos = 0;
+  }
+  m_last_pos = offset + length;
+}
+
+Readahead::extent_t Readahead::_compute_readahead(uint64_t limit)
+{
+  uint64_t readahead_offset = 0;
+  uint64_t readahead_length = 0;
+  if (m_nr_consec_read < m_trigger_requests ||
+      m_last_pos < m_readahead_trigger_pos)
+    return extent_t(0, 0);
+
+  if (m_readahead_size == 0) {
+    // start of a sequential run
+    m_readahead_size = m_consec_read_bytes;
+    m_readahead_pos = m_last_pos;
+  } else {
+    m_readahead_size *= 2;
+    if (m_last_pos > m_readahead_pos)
+      m_readahead_pos = m_last_pos;
+  }
+  m_readahead_size = max(m_readahead_size, m_readahead_min_bytes);
+  m_readahead_size = min(m_readahead_size, m_readahead_max_bytes);
+  readahead_offset = m_readahead_pos;
+  readahead_length = m_readahead_size;
+
+  // snap the end to the first alignment close enough to it
+  uint64_t readahead_end = readahead_offset + readahead_length;
+  for (vector<uint64_t>::const_iterator p = m_alignments.begin();
+       p != m_alignments.end(); ++p) {
+    uint64_t alignment = *p;
+    if (alignment == 0)
+      continue;
+    uint64_t align_prev = readahead_end / alignment * alignment;
+    uint64_t align_next = align_prev + alignment;
+    uint64_t dist_prev = readahead_end - align_prev;
+    uint64_t dist_next = align_next - readahead_end;
+    if (dist_prev < readahead_length / 2 && dist_prev < dist_next) {
+      readahead_length -= dist_prev;
+      break;
+    } else if (dist_next < readahead_length / 2) {
+      readahead_length += dist_next;
+      break;
+    }
+  }
+
+  if (readahead_offset >= limit)
+    readahead_length = 0;
+  else if (readahead_offset + readahead_length > limit)
+    readahead_length = limit - readahead_offset;
+
+  m_readahead_trigger_pos = readahead_offset + readahead_length / 2;
+  m_readahead_pos = readahead_offset + readahead_length;
+  return extent_t(readahead_offset, readahead_length);
+}
+
+void Readahead::inc_pending(int count)
+{
+  assert(count > 0);
+  Mutex::Locker l(m_pending_lock);
+  m_pending += count;
+}
+
+void Readahead::dec_pending(int count)
+{
+  assert(count > 0);
+  Mutex::Locker l(m_pending_lock);
+  assert(m_pending >= count);
+  m_pending -= count;
+  if (m_pending == 0)
+    m_pending_cond.Signal();
+}
+
+void Readahead::wait_for_pending()
+{
+  Mutex::Locker l(m_pending_lock);
+  while (m_pending > 0)
+    m_pending_cond.Wait(m_pending_lock);
+}
+
+void Readahead::set_trigger_requests(int trigger_requests)
+{
+  Mutex::Locker l(m_lock);
+  m_trigger_requests = trigger_requests;
+}
+
+void Readahead::set_min_readahead_size(uint64_t min_readahead_size)
+{
+  Mutex::Locker l(m_lock);
+  m_readahead_min_bytes = min_readahead_size;
+}
+
+void Readahead::set_max_readahead_size(uint64_t max_readahead_size)
+{
+  Mutex::Locker l(m_lock);
+  m_readahead_max_bytes = max_readahead_size;
+}
+
+void Readahead::set_alignments(const vector<uint64_t> &alignments)
+{
+  Mutex::Locker l(m_lock);
+  m_alignments = alignments;
+}
+
+uint64_t Readahead::get_hit_bytes()
+{
+  Mutex::Locker l(m_lock);
+  return m_hit_bytes;
+}
+
+uint64_t Readahead::get_waste_bytes()
+{
+  Mutex::Locker l(m_lock);
+  return m_waste_bytes;
+}
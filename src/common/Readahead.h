@@ -0,0 +1,93 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_READAHEAD_H
+#define CEPH_READAHEAD_H
+
+#include "include/int_types.h"
+
+#include <vector>
+
+#include "Mutex.h"
+#include "Cond.h"
+
+/**
+ * Detects sequential reads and decides what to prefetch.
+ *
+ * Once trigger_requests reads in a row have each started where the
+ * last one ended, every update returns an extent just past what has
+ * been read or prefetched so far, doubling in size (from the size of
+ * the sequential run, within min and max readahead size) each time
+ * the reader gets halfway through the previous one. Extents are
+ * snapped to the first alignment that moves their end by less than
+ * half their length, so prefetches don't straddle objects needlessly.
+ *
+ * It also counts the bytes of reads that landed in prefetched data
+ * (hits) and the prefetched bytes left unread when a sequential run
+ * ended (waste). Callers issue the prefetch themselves, bracketing it
+ * with inc_pending() and dec_pending() so wait_for_pending() can drain
+ * them before teardown.
+ */
+class Readahead {
+public:
+  typedef std::pair<uint64_t, uint64_t> extent_t;
+
+  Readahead();
+  ~Readahead();
+
+  /**
+   * Observe a read of the given extents and compute what to prefetch.
+   *
+   * @param extents reads, in order
+   * @param limit nothing at or past this offset will be prefetched
+   * @returns the extent to prefetch, with zero length if none
+   */
+  extent_t update(const std::vector<extent_t>& extents, uint64_t limit);
+  extent_t update(uint64_t offset, uint64_t length, uint64_t limit);
+
+  void inc_pending(int count = 1);
+  void dec_pending(int count = 1);
+  void wait_for_pending();
+
+  void set_trigger_requests(int trigger_requests);
+  void set_min_readahead_size(uint64_t min_readahead_size);
+  void set_max_readahead_size(uint64_t max_readahead_size);
+  /// largest first; an extent is snapped to at most one of them
+  void set_alignments(const std::vector<uint64_t> &alignments);
+
+  uint64_t get_hit_bytes();
+  uint64_t get_waste_bytes();
+
+private:
+  void _observe_read(uint64_t offset, uint64_t length);
+  extent_t _compute_readahead(uint64_t limit);
+
+  Mutex m_lock;
+
+  int m_trigger_requests;
+  uint64_t m_readahead_min_bytes;
+  uint64_t m_readahead_max_bytes;
+  std::vector<uint64_t> m_alignments;
+
+  /// reads in the current sequential run
+  int m_nr_consec_read;
+  /// bytes read in the current sequential run
+  uint64_t m_consec_read_bytes;
+  /// end of the last read
+  uint64_t m_last_pos;
+  /// end of what has been prefetched
+  uint64_t m_readahead_pos;
+  /// once reads get past this, prefetch more
+  uint64_t m_readahead_trigger_pos;
+  /// size of the last prefetch
+  uint64_t m_readahead_size;
+
+  uint64_t m_hit_bytes;
+  uint64_t m_waste_bytes;
+
+  Mutex m_pending_lock;
+  Cond m_pending_cond;
+  int m_pending;
+};
+
+#endif
@@ -0,0 +1,113 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_BIT_VECTOR_HPP
+#define CEPH_BIT_VECTOR_HPP
+
+#include "include/int_types.h"
+#include "include/assert.h"
+#include "include/buffer.h"
+#include <algorithm>
+#include <vector>
+
+namespace ceph {
+
+/**
+ * A vector of small unsigned values packed _bit_count bits apiece,
+ * lowest bits first.
+ *
+ * The packed bytes are exposed directly so that they can be stored
+ * as-is in a RADOS object and read or rewritten a byte range at a
+ * time. Bytes past the end of the stored data decode as zero.
+ */
+template <uint8_t _bit_count>
+class BitVector
+{
+public:
+  static const uint8_t ELEMENTS_PER_BYTE = 8 / _bit_count;
+  static const uint8_t MASK = (1 << _bit_count) - 1;
+
+  BitVector() : m_size(0) {}
+
+  uint64_t size() const {
+    return m_size;
+  }
+
+  void clear() {
+    m_data.clear();
+    m_size = 0;
+  }
+
+  /// grow with zeroed elements, or shrink and clear the unused bits
+  void resize(uint64_t elements) {
+    uint64_t bytes = get_byte_count(elements);
+    m_data.resize(bytes, 0);
+    uint64_t tail = elements % ELEMENTS_PER_BYTE;
+    if (tail != 0)
+      m_data[bytes - 1] &= (1 << (tail * _bit_count)) - 1;
+    m_size = elements;
+  }
+
+  uint8_t get(uint64_t i) const {
+    assert(i < m_size);
+    return (m_data[get_byte_offset(i)] >> get_shift(i)) & MASK;
+  }
+
+  void set(uint64_t i, uint8_t value) {
+    assert(i < m_size);
+    assert((value & ~MASK) == 0);
+    uint8_t &b = m_data[get_byte_offset(i)];
+    b = (b & ~(MASK << get_shift(i))) | (value << get_shift(i));
+  }
+
+  /// append the packed bytes [byte_offset, byte_offset + byte_length)
+  void encode_data(bufferlist &bl, uint64_t byte_offset,
+		   uint64_t byte_length) const {
+    assert(byte_offset + byte_length <= m_data.size());
+    if (byte_length > 0)
+      bl.append(reinterpret_cast<const char *>(&m_data[byte_offset]),
+		byte_length);
+  }
+
+  void encode_data(bufferlist &bl) const {
+    encode_data(bl, 0, m_data.size());
+  }
+
+  /// replace the contents with packed bytes, sized to @elements
+  void decode_data(bufferlist &bl, uint64_t elements) {
+    m_data.assign(get_byte_count(elements), 0);
+    uint64_t len = std::min<uint64_t>(bl.length(), m_data.size());
+    if (len > 0)
+      bl.copy(0, len, reinterpret_cast<char *>(&m_data[0]));
+    resize(elements);
+  }
+
+  static uint64_t get_byte_offset(uint64_t i) {
+    return i / ELEMENTS_PER_BYTE;
+  }
+
+  static uint64_t get_byte_count(uint64_t elements) {
+    return (elements + ELEMENTS_PER_BYTE - 1) / ELEMENTS_PER_BYTE;
+  }
+
+private:
+  static uint8_t get_shift(uint64_t i) {
+    return (i % ELEMENTS_PER_BYTE) * _bit_count;
+  }
+
+  std::vector<uint8_t> m_data;
+  uint64_t m_size;
+};
+
+}
+
+#endif
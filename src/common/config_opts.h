@@ -289,6 +289,9 @@ OPTION(objecter_timeout, OPT_DOUBLE, 10.0)    // before we ask for a map
 OPTION(objecter_inflight_op_bytes, OPT_U64, 1024*1024*100) // max in-flight data (both directions)
 OPTION(objecter_inflight_ops, OPT_U64, 1024)               // max in-flight ios
 OPTION(objecter_completion_locks_per_session, OPT_U64, 32) // num of completion locks per each session, for serializing same object responses
+OPTION(objecter_coalesce_writes, OPT_BOOL, false) // merge small writes queued behind an in-flight write to the same object
+OPTION(objecter_coalesce_max_ops, OPT_INT, 64)     // max client ops merged into one osd op
+OPTION(objecter_coalesce_max_bytes, OPT_U64, 64 << 10) // max data of a mergeable op, and of the merged op
 OPTION(journaler_allow_split_entries, OPT_BOOL, true)
 OPTION(journaler_write_head_interval, OPT_INT, 15)
 OPTION(journaler_prefetch_periods, OPT_INT, 10)   // * journal object size
@@ -488,6 +491,10 @@ OPTION(osd_op_thread_timeout, OPT_INT, 15)
 OPTION(osd_recovery_thread_timeout, OPT_INT, 30)
 OPTION(osd_snap_trim_thread_timeout, OPT_INT, 60*60*1)
 OPTION(osd_snap_trim_sleep, OPT_FLOAT, 0)
+OPTION(osd_write_degraded_objects, OPT_BOOL, false)  // write objects only some replicas are missing without waiting for recovery
+OPTION(osd_snap_trim_batch_size, OPT_INT, 4)     // clones a pg trims per pass before waiting for them to apply
+OPTION(osd_snap_trim_max_ops_per_sec, OPT_FLOAT, 0)   // osd-wide snap trim budget; 0 = unlimited
+OPTION(osd_snap_trim_max_bytes_per_sec, OPT_FLOAT, 0) // bytes of clones removed; 0 = unlimited
 OPTION(osd_scrub_thread_timeout, OPT_INT, 60)
 OPTION(osd_scrub_finalize_thread_timeout, OPT_INT, 60*10)
 OPTION(osd_scrub_invalid_stats, OPT_BOOL, true)
@@ -516,6 +523,8 @@ OPTION(osd_recovery_delay_start, OPT_FLOAT, 0)
 OPTION(osd_recovery_max_active, OPT_INT, 15)
 OPTION(osd_recovery_max_single_start, OPT_INT, 5)
 OPTION(osd_recovery_max_chunk, OPT_U64, 8<<20)  // max size of push chunk
+OPTION(osd_ec_extent_cache_size, OPT_U64, 4<<20) // per pg cache of recently written ec stripes, for read-modify-write
+OPTION(osd_ec_fast_read, OPT_BOOL, false) // read ec objects from all shards and complete with the first k replies
 OPTION(osd_copyfrom_max_chunk, OPT_U64, 8<<20)   // max size of a COPYFROM chunk
 OPTION(osd_push_per_object_cost, OPT_U64, 1000)  // push cost per object
 OPTION(osd_max_push_cost, OPT_U64, 8<<20)  // max size of push message
@@ -756,6 +765,8 @@ OPTION(journal_ignore_corruption, OPT_BOOL, false) // assume journal is not corr
 
 OPTION(rados_mon_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from the monitor before returning an error from a rados operation. 0 means on limit.
 OPTION(rados_osd_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from osds before returning an error from a rados operation. 0 means no limit.
+OPTION(rados_striper_lockless, OPT_BOOL, false) // whether libradosstriper data IO caches layouts and sizes instead of taking a shared lock on each striped object; truncate and remove must then not race with other clients' IO
+OPTION(rados_striper_object_cache_size, OPT_INT, 1024) // how many striped objects libradosstriper caches (and watches) in lockless mode
 
 OPTION(rbd_cache, OPT_BOOL, true) // whether to enable caching (writeback unless rbd_cache_max_dirty is 0)
 OPTION(rbd_cache_writethrough_until_flush, OPT_BOOL, true) // whether to make writeback caching writethrough until flush is called, to be sure the user of librbd will send flushs so that writeback is safe
@@ -764,12 +775,18 @@ OPTION(rbd_cache_max_dirty, OPT_LONGLONG, 24<<20)    // dirty limit in bytes - s
 OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in bytes
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
 OPTION(rbd_cache_max_dirty_object, OPT_INT, 0)       // dirty limit for objects - set to 0 for auto calculate from rbd_cache_size
+OPTION(rbd_cache_shards, OPT_INT, 1) // number of independently locked caches an image's objects are spread over
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
 OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
 OPTION(rbd_balance_parent_reads, OPT_BOOL, false)
 OPTION(rbd_localize_parent_reads, OPT_BOOL, true)
+OPTION(rbd_clone_copy_on_read, OPT_BOOL, false) // copy a clone's object from its parent when it is first read
+OPTION(rbd_clone_copy_on_read_max_in_flight, OPT_INT, 16) // copy-on-read copyups in flight per image; reads beyond this are not copied up
+OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requests necessary to trigger readahead
+OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
+OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled; set to 0 to never disable it
 
 /*
  * The following options change the behavior for librbd's image creation methods that
@@ -802,6 +819,10 @@ OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_obj_data_cache_size, OPT_U64, 0)   // bytes of small object data to cache, 0 disables
+OPTION(rgw_obj_data_cache_max_obj_size, OPT_U64, 64 * 1024)   // largest object the data cache holds
+OPTION(rgw_obj_data_cache_ttl, OPT_INT, 300)   // seconds an object stays in the data cache
+OPTION(rgw_obj_data_cache_invalidate, OPT_INT, -1)   // send data cache invalidations on writes: 1 always, 0 never, -1 if rgw_obj_data_cache_size > 0
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -848,6 +869,9 @@ OPTION(rgw_enable_usage_log, OPT_BOOL, false) // enable logging bandwidth usage
 OPTION(rgw_ops_log_rados, OPT_BOOL, true) // whether ops log should go to rados
 OPTION(rgw_ops_log_socket_path, OPT_STR, "") // path to unix domain socket where ops log can go
 OPTION(rgw_ops_log_data_backlog, OPT_INT, 5 << 20) // max data backlog for ops log
+OPTION(rgw_ops_log_flush_threshold, OPT_INT, 64 << 10) // pending ops log bytes that trigger a rados flush
+OPTION(rgw_ops_log_flush_interval, OPT_DOUBLE, 1.0) // flush pending ops log data every X seconds
+OPTION(rgw_ops_log_num_shards, OPT_INT, 1) // number of rados objects each ops log object is spread over
 OPTION(rgw_usage_log_flush_threshold, OPT_INT, 1024) // threshold to flush pending log data
 OPTION(rgw_usage_log_tick_interval, OPT_INT, 30) // flush pending log data every X seconds
 OPTION(rgw_intent_log_object_name, OPT_STR, "%Y-%m-%d-%i-%n")  // man date to see codes (a subset are supported)
@@ -858,9 +882,12 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_max_concurrent_io, OPT_INT, 10)  // max tail object removals in flight
+OPTION(rgw_gc_max_trim_chunk, OPT_INT, 16)  // max gc entries removed from a shard in one op
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
+OPTION(rgw_compression_block_size, OPT_U64, 512 * 1024) // uncompressed size of the blocks object data is compressed in, for placement targets that compress
 OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can be set on objects (beyond the default)
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
 OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request
@@ -895,6 +922,11 @@ OPTION(rgw_user_quota_sync_idle_users, OPT_BOOL, false) // whether stats for idl
 OPTION(rgw_user_quota_sync_wait_time, OPT_INT, 3600 * 24) // min time between two full stats syc for non-idle users
 
 OPTION(rgw_multipart_min_part_size, OPT_INT, 5 * 1024 * 1024) // min size for each part (except for last one) in multipart upload
+OPTION(rgw_multipart_complete_max_aio, OPT_U32, 8) // max concurrent reads of part info when completing a multipart upload
+
+OPTION(rgw_override_bucket_index_max_shards, OPT_U32, 0) // number of bucket index shard objects for new buckets (0 for a single unsharded index object)
+OPTION(rgw_bucket_index_max_aio, OPT_U32, 8) // max concurrent ops when operating on all shards of a bucket index
+OPTION(rgw_bucket_index_max_complete_batch, OPT_U32, 32) // max index completions sent to one index object in a single op (0 or 1 to disable batching)
 
 OPTION(mutex_perf_counter, OPT_BOOL, false) // enable/disable mutex perf counter
 OPTION(throttler_perf_counter, OPT_BOOL, true) // enable/disable throttler perf counter
@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <time.h>
+#include <sys/resource.h>
 #include <sstream>
 #include <vector>
 
@@ -51,6 +52,16 @@ static std::string generate_object_name(int objnum, int pid = 0)
   return oss.str();
 }
 
+/// user plus system cpu time used by this process so far, in seconds
+static double get_cpu_time()
+{
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) < 0)
+    return 0;
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+}
+
 static void sanitize_object_contents (bench_data *data, int length) {
   memset(data->object_contents, 'z', length);
 }
@@ -494,6 +505,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
   utime_t time_to_run;
   time_to_run.set_from_double(seconds_to_run);
   double total_latency = 0;
+  double cpu_start = 0;
   int r = 0;
   utime_t runtime;
   sanitize_object_contents(&data, data.object_size); //clean it up once; subsequent
@@ -512,6 +524,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
   lock.Lock();
   data.finished = 0;
   data.start_time = ceph_clock_now(cct);
+  cpu_start = get_cpu_time();
   lock.Unlock();
 
   pthread_t print_thread;
@@ -644,6 +657,10 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
   bandwidth = bandwidth/(1024*1024); // we want it in MB/sec
   char bw[20];
   snprintf(bw, sizeof(bw), "%.3lf \n", bandwidth);
+  double gb_read;
+  gb_read = ((double)data.finished)*((double)data.object_size)/(1024*1024*1024);
+  double cpu_per_gb;
+  cpu_per_gb = gb_read > 0 ? (get_cpu_time() - cpu_start) / gb_read : 0;
 
   out(cout) << "Total time run:        " << runtime << std::endl
        << "Total reads made:     " << data.finished << std::endl
@@ -651,7 +668,8 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
        << "Bandwidth (MB/sec):    " << bw << std::endl
        << "Average Latency:       " << data.avg_latency << std::endl
        << "Max latency:           " << data.max_latency << std::endl
-       << "Min latency:           " << data.min_latency << std::endl;
+       << "Min latency:           " << data.min_latency << std::endl
+       << "CPU sec per GB read:   " << cpu_per_gb << std::endl;
 
   completions_done();
 
@@ -678,6 +696,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
   utime_t time_to_run;
   time_to_run.set_from_double(seconds_to_run);
   double total_latency = 0;
+  double cpu_start = 0;
   int r = 0;
   utime_t runtime;
   sanitize_object_contents(&data, data.object_size); //clean it up once; subsequent
@@ -698,6 +717,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
   lock.Lock();
   data.finished = 0;
   data.start_time = ceph_clock_now(g_ceph_context);
+  cpu_start = get_cpu_time();
   lock.Unlock();
 
   pthread_t print_thread;
@@ -831,6 +851,10 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
   bandwidth = bandwidth/(1024*1024); // we want it in MB/sec
   char bw[20];
   snprintf(bw, sizeof(bw), "%.3lf \n", bandwidth);
+  double gb_read;
+  gb_read = ((double)data.finished)*((double)data.object_size)/(1024*1024*1024);
+  double cpu_per_gb;
+  cpu_per_gb = gb_read > 0 ? (get_cpu_time() - cpu_start) / gb_read : 0;
 
   out(cout) << "Total time run:        " << runtime << std::endl
        << "Total reads made:     " << data.finished << std::endl
@@ -838,7 +862,8 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
        << "Bandwidth (MB/sec):    " << bw << std::endl
        << "Average Latency:       " << data.avg_latency << std::endl
        << "Max latency:           " << data.max_latency << std::endl
-       << "Min latency:           " << data.min_latency << std::endl;
+       << "Min latency:           " << data.min_latency << std::endl
+       << "CPU sec per GB read:   " << cpu_per_gb << std::endl;
 
   completions_done();
 
@@ -344,6 +344,8 @@ public:
     bool contents_equal(buffer::list& other);
 
     bool can_zero_copy() const;
+    /// true if the data is one contiguous run starting at dst
+    bool is_provided_buffer(const char *dst) const;
     bool is_page_aligned() const;
     bool is_n_page_sized() const;
 
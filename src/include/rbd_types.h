@@ -27,11 +27,15 @@
  *   rbd_data.<id>.00000000
  *   rbd_data.<id>.00000001
  *   ...                     - data
+ *   rbd_object_map.<id>     - which data objects exist (with the
+ *                             object map feature), plus one
+ *   rbd_object_map.<id>.<snapid> per snapshot
  */
 
 #define RBD_HEADER_PREFIX      "rbd_header."
 #define RBD_DATA_PREFIX        "rbd_data."
 #define RBD_ID_PREFIX          "rbd_id."
+#define RBD_OBJECT_MAP_PREFIX  "rbd_object_map."
 
 /*
  * old-style rbd image 'foo' consists of objects
@@ -62,6 +66,16 @@
 #define RBD_CHILDREN		"rbd_children"
 #define RBD_LOCK_NAME		"rbd_lock"
 
+/*
+ * Object map entries are two bits per data object. PENDING marks an
+ * object that is being removed; EXISTS_CLEAN one that has not been
+ * written since the most recent snapshot.
+ */
+#define RBD_OBJECT_NONEXISTENT	0
+#define RBD_OBJECT_EXISTS	1
+#define RBD_OBJECT_PENDING	2
+#define RBD_OBJECT_EXISTS_CLEAN	3
+
 #define RBD_DEFAULT_OBJ_ORDER	22   /* 4MB */
 
 #define RBD_MAX_OBJ_NAME_SIZE	96
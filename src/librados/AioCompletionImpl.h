@@ -42,6 +42,8 @@ struct librados::AioCompletionImpl {
   bool is_read;
   bufferlist bl;
   bufferlist *blp;
+  /// caller's buffer, if the data didn't land there directly
+  char *out_buf;
 
   IoCtxImpl *io;
   ceph_tid_t aio_write_seq;
@@ -55,7 +57,7 @@ struct librados::AioCompletionImpl {
 			callback_safe(0),
 			callback_complete_arg(0),
 			callback_safe_arg(0),
-			is_read(false), blp(NULL),
+			is_read(false), blp(NULL), out_buf(NULL),
 			io(NULL), aio_write_seq(0), aio_write_list_item(this) { }
 
   int set_complete_callback(void *cb_arg, rados_callback_t cb) {
@@ -594,9 +594,12 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
 
   c->is_read = true;
   c->io = this;
+  // the Objecter posts this as the rx buffer, so the messenger can
+  // usually receive the data straight into buf
   c->bl.clear();
   c->bl.push_back(buffer::create_static(len, buf));
   c->blp = &c->bl;
+  c->out_buf = buf;
 
   c->tid = objecter->read(oid, oloc,
 		 off, len, snapid, &c->bl, 0,
@@ -1192,6 +1195,9 @@ void librados::IoCtxImpl::C_aio_Ack::finish(int r)
   c->cond.Signal();
 
   if (r == 0 && c->blp && c->blp->length() > 0) {
+    // the rx buffer wasn't used (e.g. the op was resent), so copy
+    if (c->out_buf && !c->blp->is_provided_buffer(c->out_buf))
+      c->blp->copy(0, c->blp->length(), c->out_buf);
     c->rval = c->blp->length();
   }
 
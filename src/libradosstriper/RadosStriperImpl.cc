@@ -24,6 +24,7 @@
 #include "include/uuid.h"
 #include "include/ceph_fs.h"
 #include "common/dout.h"
+#include "common/config.h"
 #include "common/strtol.h"
 #include "osdc/Striper.h"
 #include "libradosstriper/MultiAioCompletionImpl.h"
@@ -57,6 +58,17 @@
  * of a striped object does not change during data operation, which is essential for
  * data consistency.
  *
+ * With rados_striper_lockless set, data operations take no lock at all. The layout
+ * and size of each striped object are instead cached client side, and a watch on
+ * the first rados object lets truncate and remove notify other clients to
+ * invalidate their cache. Writes extending a striped object update its size attribute
+ * in parallel with the data, batching the updates of concurrent writes, and complete
+ * once both are done. Reads past the cached size reload it, as another client may
+ * have grown the object. This saves the lock and unlock round trips of every
+ * operation, but truncate and remove are then only safe when no other client is
+ * doing IO on the same striped object. Appends, which need the current size, still
+ * take the shared lock.
+ *
  * Still the writing to a striped object is not atomic. This means in particular that
  * the size of an object may not be in sync with its content at all times.
  * As the size is always garanteed to be updated first and in an atomic way, and as
@@ -196,11 +208,38 @@ libradosstriper::RadosStriperImpl::RadosExclusiveLock::~RadosExclusiveLock() {
   m_ioCtx->unlock(m_oid, RADOS_LOCK_NAME, m_lockCookie);
 }
 
+///////////////////////// ObjectInfoWatchCtx /////////////////////////////
+
+void libradosstriper::RadosStriperImpl::ObjectInfoWatchCtx::notify(uint8_t opcode,
+								    uint64_t ver,
+								    bufferlist& bl)
+{
+  m_striper->invalidateObjectInfo(m_soid);
+}
+
 ///////////////////////// constructor /////////////////////////////
 
 libradosstriper::RadosStriperImpl::RadosStriperImpl(librados::IoCtx& ioctx, librados::IoCtxImpl *ioctx_impl) :
   m_refCnt(0), m_radosCluster(ioctx), m_ioCtx(ioctx), m_ioCtxImpl(ioctx_impl),
-  m_layout(g_default_file_layout) {}
+  m_layout(g_default_file_layout),
+  m_lockless(cct()->_conf->rados_striper_lockless),
+  m_objectInfoLock("RadosStriperImpl::m_objectInfoLock") {}
+
+libradosstriper::RadosStriperImpl::~RadosStriperImpl()
+{
+  // drop the watches of cached striped objects. No size update can be
+  // in flight, as each holds a reference on us
+  for (std::map<std::string, ObjectInfo*>::iterator it = m_objectInfos.begin();
+       it != m_objectInfos.end();
+       ++it) {
+    ObjectInfo *info = it->second;
+    if (info->m_watchCtx) {
+      m_ioCtx.unwatch(getObjectId(it->first, 0), info->m_watchHandle);
+      delete info->m_watchCtx;
+    }
+    delete info;
+  }
+}
 
 ///////////////////////// layout /////////////////////////////
 
@@ -286,10 +325,16 @@ int libradosstriper::RadosStriperImpl::write(const std::string& soid,
 					     uint64_t off) 
 {
   // open the object. This will create it if needed, retrieve its layout
-  // and size and take a shared lock on it
+  // and size and take a shared lock on it (except in lockless mode)
   ceph_file_layout layout;
   std::string lockCookie;
-  int rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
+  int rc;
+  if (m_lockless) {
+    uint64_t size;
+    rc = getObjectInfo(soid, &layout, &size, 0, true);
+  } else {
+    rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
+  }
   if (rc) return rc;
   return write_in_open_object(soid, layout, lockCookie, bl, len, off);
 }
@@ -345,7 +390,13 @@ int libradosstriper::RadosStriperImpl::aio_write(const std::string& soid,
 {
   ceph_file_layout layout;
   std::string lockCookie;
-  int rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
+  int rc;
+  if (m_lockless) {
+    uint64_t size;
+    rc = getObjectInfo(soid, &layout, &size, 0, true);
+  } else {
+    rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
+  }
   if (rc) return rc;
   return aio_write_in_open_object(soid, c, layout, lockCookie, bl, len, off);
 }
@@ -439,11 +490,15 @@ int libradosstriper::RadosStriperImpl::aio_read(const std::string& soid,
 						uint64_t off)
 {
   // open the object. This will retrieve its layout and size
-  // and take a shared lock on it
+  // and take a shared lock on it (except in lockless mode)
   ceph_file_layout layout;
   uint64_t size;
   std::string lockCookie;
-  int rc = openStripedObjectForRead(soid, &layout, &size, &lockCookie);
+  int rc;
+  if (m_lockless)
+    rc = getObjectInfo(soid, &layout, &size, off+len, false);
+  else
+    rc = openStripedObjectForRead(soid, &layout, &size, &lockCookie);
   if (rc) return rc;
   // find out the actual number of bytes we can read
   uint64_t read_len;
@@ -578,6 +633,9 @@ int libradosstriper::RadosStriperImpl::remove(const std::string& soid)
     // delete rados objects in reverse order
     int rcr = 0;
     for (int i = nb_objects-1; i >= 0; i--) {
+      // let clients caching the striped object know, while it still exists
+      if (0 == i)
+	notifyObjectInfo(soid);
       rcr = m_ioCtx.remove(getObjectId(soid, i));
       if (rcr < 0 and -ENOENT != rcr) {
         lderr(cct()) << "RadosStriperImpl::remove : deletion incomplete for " << soid
@@ -596,24 +654,28 @@ int libradosstriper::RadosStriperImpl::remove(const std::string& soid)
 
 int libradosstriper::RadosStriperImpl::trunc(const std::string& soid, uint64_t size)
 {
-  // lock the object in exclusive mode. Will be released when leaving the scope
   std::string firstObjOid = getObjectId(soid, 0);
   try {
+    // lock the object in exclusive mode. Will be released when leaving the scope
     RadosExclusiveLock lock(&m_ioCtx, firstObjOid);
+    // load layout and size
+    ceph_file_layout layout;
+    uint64_t original_size;
+    int rc = internal_get_layout_and_size(firstObjOid, &layout, &original_size);
+    if (rc) return rc;
+    if (size < original_size) {
+      rc = truncate(soid, original_size, size, layout);
+    } else if (size > original_size) {
+      rc = grow(soid, original_size, size, layout);
+    }
+    // let clients caching the striped object know
+    if (size != original_size)
+      notifyObjectInfo(soid);
+    return rc;
   } catch (ErrorCode &e) {
+    // error caught when trying to take the exclusive lock
     return e.m_code;
   }
-  // load layout and size
-  ceph_file_layout layout;
-  uint64_t original_size;
-  int rc = internal_get_layout_and_size(firstObjOid, &layout, &original_size);
-  if (rc) return rc;
-  if (size < original_size) {
-    rc = truncate(soid, original_size, size, layout);
-  } else if (size > original_size) {
-    rc = grow(soid, original_size, size, layout);
-  }
-  return rc;
 }
 
 ///////////////////////// private helpers /////////////////////////////
@@ -637,6 +699,9 @@ int libradosstriper::RadosStriperImpl::closeForWrite(const std::string& soid,
 void libradosstriper::RadosStriperImpl::unlockObject(const std::string& soid,
 						     const std::string& lockCookie)
 {
+  // no lock was taken in lockless mode
+  if (lockCookie.empty())
+    return;
   // unlock the shared lock on the first rados object
   std::string firstObjOid = getObjectId(soid, 0);
   m_ioCtx.unlock(firstObjOid, RADOS_LOCK_NAME, lockCookie);
@@ -659,6 +724,9 @@ int libradosstriper::RadosStriperImpl::write_in_open_object(const std::string& s
   WriteCompletionData *cdata = new WriteCompletionData(this, soid, lockCookie);
   libradosstriper::MultiAioCompletionImpl *c = new libradosstriper::MultiAioCompletionImpl;
   c->set_complete_callback(cdata, striper_write_req_complete);
+  // in lockless mode, the size is updated together with the data
+  if (lockCookie.empty())
+    queueSizeUpdate(soid, c, off+len);
   // call the asynchronous API
   int rc = internal_aio_write(soid, c, bl, len, off, layout);
   if (!rc) {
@@ -714,6 +782,9 @@ int libradosstriper::RadosStriperImpl::aio_write_in_open_object(const std::strin
   libradosstriper::MultiAioCompletionImpl *nc = new libradosstriper::MultiAioCompletionImpl;
   nc->set_complete_callback(cdata, striper_write_aio_req_complete);
   nc->set_safe_callback(cdata, striper_write_aio_req_safe);
+  // in lockless mode, the size is updated together with the data
+  if (lockCookie.empty())
+    queueSizeUpdate(soid, nc, off+len);
   // internal asynchronous API
   return internal_aio_write(soid, nc, bl, len, off, layout);
 }
@@ -929,6 +1000,17 @@ int libradosstriper::RadosStriperImpl::createAndOpenStripedObject(const std::str
 								  uint64_t size,
 								  std::string *lockCookie,
 								  bool isFileSizeAbsolute)
+{
+  int rc = createStripedObject(soid, isFileSizeAbsolute?size:0);
+  // in case of error (but no EEXIST which would mean the object existed), return
+  if (rc && -EEXIST != rc) return rc;
+  // Otherwise open the object
+  uint64_t fileSize = size;
+  return openStripedObjectForWrite(soid, layout, &fileSize, lockCookie, isFileSizeAbsolute);
+}
+
+int libradosstriper::RadosStriperImpl::createStripedObject(const std::string& soid,
+							   uint64_t size)
 {
   // build atomic write operation
   librados::ObjectWriteOperation writeOp;
@@ -953,18 +1035,13 @@ int libradosstriper::RadosStriperImpl::createAndOpenStripedObject(const std::str
   writeOp.setxattr(XATTR_LAYOUT_STRIPE_COUNT, bl_stripe_count);
   // size
   std::ostringstream oss_size;
-  oss_size << (isFileSizeAbsolute?size:0);
+  oss_size << size;
   bufferlist bl_size;
   bl_size.append(oss_size.str());
   writeOp.setxattr(XATTR_SIZE, bl_size);
   // effectively change attributes
   std::string firstObjOid = getObjectId(soid, 0);
-  int rc = m_ioCtx.operate(firstObjOid, &writeOp);
-  // in case of error (but no EEXIST which would mean the object existed), return
-  if (rc && -EEXIST != rc) return rc;
-  // Otherwise open the object
-  uint64_t fileSize = size;
-  return openStripedObjectForWrite(soid, layout, &fileSize, lockCookie, isFileSizeAbsolute);
+  return m_ioCtx.operate(firstObjOid, &writeOp);
 }
 
 int libradosstriper::RadosStriperImpl::truncate(const std::string& soid,
@@ -1050,6 +1127,225 @@ int libradosstriper::RadosStriperImpl::grow(const std::string& soid,
   return rc;
 }  
 
+///////////////////////// lockless mode /////////////////////////////
+
+int libradosstriper::RadosStriperImpl::getObjectInfo(const std::string& soid,
+						     ceph_file_layout *layout,
+						     uint64_t *size,
+						     uint64_t minSize,
+						     bool create)
+{
+  bool watched = false;
+  {
+    Mutex::Locker l(m_objectInfoLock);
+    std::map<std::string, ObjectInfo*>::iterator it = m_objectInfos.find(soid);
+    if (it != m_objectInfos.end() && it->second->m_valid) {
+      if (it->second->m_size >= minSize) {
+	*layout = it->second->m_layout;
+	*size = it->second->m_size;
+	return 0;
+      }
+      // the object may have been grown by someone else, reload
+      watched = (0 != it->second->m_watchCtx);
+    }
+  }
+  // watch before loading, so that no invalidation can be missed. An
+  // invalidated object is watched again, as it may have been recreated
+  std::string firstObjOid = getObjectId(soid, 0);
+  ObjectInfoWatchCtx *watchCtx = 0;
+  uint64_t watchHandle = 0;
+  if (!watched) {
+    watchCtx = new ObjectInfoWatchCtx(this, soid);
+    int rc = m_ioCtx.watch(firstObjOid, 0, &watchHandle, watchCtx);
+    if (-ENOENT == rc && create) {
+      rc = createStripedObject(soid, 0);
+      if (0 == rc || -EEXIST == rc)
+	rc = m_ioCtx.watch(firstObjOid, 0, &watchHandle, watchCtx);
+    }
+    if (rc) {
+      delete watchCtx;
+      return rc;
+    }
+  }
+  ceph_file_layout newLayout;
+  uint64_t newSize;
+  int rc = internal_get_layout_and_size(firstObjOid, &newLayout, &newSize);
+  if (rc) {
+    if (watchCtx) {
+      m_ioCtx.unwatch(firstObjOid, watchHandle);
+      delete watchCtx;
+    }
+    lderr(cct()) << "RadosStriperImpl::getObjectInfo : "
+		 << "could not load layout and size for "
+		 << soid << " : rc = " << rc << dendl;
+    return rc;
+  }
+  // update the cache, collecting watches to drop
+  std::list<std::pair<std::string, ObjectInfo*> > evicted;
+  {
+    Mutex::Locker l(m_objectInfoLock);
+    ObjectInfo *&info = m_objectInfos[soid];
+    if (!info)
+      info = new ObjectInfo();
+    info->m_layout = newLayout;
+    info->m_size = newSize;
+    info->m_valid = true;
+    if (watchCtx) {
+      // keep the newest watch
+      if (info->m_watchCtx) {
+	ObjectInfo *old = new ObjectInfo();
+	old->m_watchCtx = info->m_watchCtx;
+	old->m_watchHandle = info->m_watchHandle;
+	evicted.push_back(std::make_pair(soid, old));
+      }
+      info->m_watchCtx = watchCtx;
+      info->m_watchHandle = watchHandle;
+    }
+    // bound the cache, skipping objects with size updates in flight
+    std::map<std::string, ObjectInfo*>::iterator it = m_objectInfos.begin();
+    while ((int64_t)m_objectInfos.size() > cct()->_conf->rados_striper_object_cache_size &&
+	   it != m_objectInfos.end()) {
+      if (it->first == soid || it->second->m_updatingSize) {
+	++it;
+	continue;
+      }
+      evicted.push_back(*it);
+      m_objectInfos.erase(it++);
+    }
+  }
+  for (std::list<std::pair<std::string, ObjectInfo*> >::iterator it = evicted.begin();
+       it != evicted.end();
+       ++it) {
+    if (it->second->m_watchCtx) {
+      m_ioCtx.unwatch(getObjectId(it->first, 0), it->second->m_watchHandle);
+      delete it->second->m_watchCtx;
+    }
+    delete it->second;
+  }
+  *layout = newLayout;
+  *size = newSize;
+  return 0;
+}
+
+void libradosstriper::RadosStriperImpl::invalidateObjectInfo(const std::string& soid)
+{
+  Mutex::Locker l(m_objectInfoLock);
+  std::map<std::string, ObjectInfo*>::iterator it = m_objectInfos.find(soid);
+  if (it != m_objectInfos.end())
+    it->second->m_valid = false;
+}
+
+void libradosstriper::RadosStriperImpl::notifyObjectInfo(const std::string& soid)
+{
+  invalidateObjectInfo(soid);
+  bufferlist bl;
+  int rc = m_ioCtx.notify(getObjectId(soid, 0), 0, bl);
+  if (rc < 0) {
+    ldout(cct(), 5) << "RadosStriperImpl::notifyObjectInfo : "
+		    << "could not notify clients caching " << soid
+		    << " : rc = " << rc << dendl;
+  }
+}
+
+void libradosstriper::RadosStriperImpl::queueSizeUpdate(const std::string& soid,
+							MultiAioCompletionImpl *c,
+							uint64_t size)
+{
+  {
+    Mutex::Locker l(m_objectInfoLock);
+    // the entry may have been evicted since the write looked it up. The
+    // update must go out anyway, and the entry now stays until it is done
+    ObjectInfo *&info = m_objectInfos[soid];
+    if (!info)
+      info = new ObjectInfo();
+    // a stale size says nothing of the size xattr, e.g. after a truncate
+    if (!info->m_valid && !info->m_updatingSize)
+      info->m_size = 0;
+    if (size <= info->m_size)
+      return;
+    // the write completes once the size xattr is at least size
+    c->add_request();
+    info->m_waiters.push_back(std::make_pair(size, c));
+    if (info->m_updatingSize) {
+      // batch with the next update
+      if (size > info->m_updatingSize && size > info->m_pendingSize)
+	info->m_pendingSize = size;
+      return;
+    }
+    info->m_updatingSize = size;
+  }
+  sendSizeUpdate(soid, size);
+}
+
+static void rados_req_size_update_complete(rados_completion_t c, void *arg)
+{
+  libradosstriper::RadosStriperImpl::CompletionData *cdata =
+    reinterpret_cast<libradosstriper::RadosStriperImpl::CompletionData*>(arg);
+  cdata->m_striper->finishSizeUpdate(cdata->m_soid, rados_aio_get_return_value(c));
+  delete cdata;
+}
+
+void libradosstriper::RadosStriperImpl::sendSizeUpdate(const std::string& soid,
+						       uint64_t size)
+{
+  // atomically update object size, only if smaller than current one
+  librados::ObjectWriteOperation writeOp;
+  writeOp.cmpxattr(XATTR_SIZE, LIBRADOS_CMPXATTR_OP_GT, size);
+  std::ostringstream oss;
+  oss << size;
+  bufferlist bl;
+  bl.append(oss.str());
+  writeOp.setxattr(XATTR_SIZE, bl);
+  CompletionData *cdata = new CompletionData(this, soid, "");
+  librados::AioCompletion *rados_completion =
+    m_radosCluster.aio_create_completion(cdata, rados_req_size_update_complete, NULL);
+  int rc = m_ioCtx.aio_operate(getObjectId(soid, 0), rados_completion, &writeOp);
+  rados_completion->release();
+  if (rc) {
+    delete cdata;
+    finishSizeUpdate(soid, rc);
+  }
+}
+
+void libradosstriper::RadosStriperImpl::finishSizeUpdate(const std::string& soid, int r)
+{
+  // -ECANCELED means the size was already bigger
+  if (-ECANCELED == r)
+    r = 0;
+  std::list<MultiAioCompletionImpl*> done;
+  uint64_t nextSize = 0;
+  {
+    Mutex::Locker l(m_objectInfoLock);
+    // objects with size updates in flight are never evicted
+    ObjectInfo *info = m_objectInfos[soid];
+    assert(info);
+    if (0 == r && info->m_updatingSize > info->m_size)
+      info->m_size = info->m_updatingSize;
+    std::list<std::pair<uint64_t, MultiAioCompletionImpl*> >::iterator it =
+      info->m_waiters.begin();
+    while (it != info->m_waiters.end()) {
+      if (r || it->first <= info->m_size) {
+	done.push_back(it->second);
+	info->m_waiters.erase(it++);
+      } else {
+	++it;
+      }
+    }
+    if (0 == r && info->m_pendingSize > info->m_size)
+      nextSize = info->m_pendingSize;
+    info->m_updatingSize = nextSize;
+    info->m_pendingSize = 0;
+  }
+  if (nextSize)
+    sendSizeUpdate(soid, nextSize);
+  for (std::list<MultiAioCompletionImpl*>::iterator it = done.begin();
+       it != done.end();
+       ++it) {
+    (*it)->complete_request(r);
+    (*it)->safe_request(r);
+  }
+}
+
 std::string libradosstriper::RadosStriperImpl::getUUID()
 {
   struct uuid_d uuid;
@@ -16,8 +16,11 @@
 #define CEPH_LIBRADOSSTRIPER_RADOSSTRIPERIMPL_H
 
 #include <string>
+#include <list>
+#include <map>
 
 #include "include/atomic.h"
+#include "common/Mutex.h"
 
 #include "include/rados/librados.h"
 #include "include/rados/librados.hpp"
@@ -113,6 +116,45 @@ struct libradosstriper::RadosStriperImpl {
     bufferlist *m_bl;
   };
 
+  /**
+   * watch on the first rados object of a striped object, invalidating
+   * the cached layout and size when truncate or remove notifies it
+   */
+  struct ObjectInfoWatchCtx : public librados::WatchCtx {
+    ObjectInfoWatchCtx(RadosStriperImpl *striper, const std::string& soid) :
+      m_striper(striper), m_soid(soid) {};
+    void notify(uint8_t opcode, uint64_t ver, bufferlist& bl);
+    /// striper owning the cache
+    RadosStriperImpl *m_striper;
+    /// striped object concerned
+    std::string m_soid;
+  };
+
+  /**
+   * layout and size of a striped object, cached client side in
+   * lockless mode (see rados_striper_lockless), together with the
+   * state of the batched updates of its size xattr
+   */
+  struct ObjectInfo {
+    ObjectInfo() : m_size(0), m_updatingSize(0), m_pendingSize(0),
+		   m_valid(false), m_watchHandle(0), m_watchCtx(0) {};
+    /// layout of the striped object
+    ceph_file_layout m_layout;
+    /// size known to be stored in the size xattr
+    uint64_t m_size;
+    /// size stored by the size xattr update in flight, 0 if none
+    uint64_t m_updatingSize;
+    /// largest size waiting for the next size xattr update
+    uint64_t m_pendingSize;
+    /// writes waiting for the size xattr to reach a given size
+    std::list<std::pair<uint64_t, MultiAioCompletionImpl*> > m_waiters;
+    /// false once invalidated, until reloaded
+    bool m_valid;
+    /// watch on the first rados object, if m_watchCtx is set
+    uint64_t m_watchHandle;
+    ObjectInfoWatchCtx *m_watchCtx;
+  };
+
   /**
    * exception wrapper around an error code
    */
@@ -146,7 +188,7 @@ struct libradosstriper::RadosStriperImpl {
    */
   RadosStriperImpl(librados::IoCtx& ioctx, librados::IoCtxImpl *ioctx_impl);
   /// Destructor
-  ~RadosStriperImpl() {};
+  ~RadosStriperImpl();
 
   // configuration
   int setObjectLayoutStripeUnit(unsigned int stripe_unit);
@@ -279,6 +321,42 @@ struct libradosstriper::RadosStriperImpl {
 				 std::string *lockCookie,
 				 bool isFileSizeAbsolute);
 
+  /**
+   * creates an empty striped object with the given size, using the default
+   * layout. Returns -EEXIST if it already exists
+   */
+  int createStripedObject(const std::string& soid, uint64_t size);
+
+  /**
+   * lockless mode version of the opening of a striped object : returns
+   * its layout and size from the client side cache, loading them (and
+   * setting up a watch for their invalidation) if needed
+   * @param minSize if the cached size is smaller, it is reloaded, as
+   * another client may have grown the object
+   * @param create whether to create the striped object if it does not exist
+   */
+  int getObjectInfo(const std::string& soid,
+		    ceph_file_layout *layout,
+		    uint64_t *size,
+		    uint64_t minSize,
+		    bool create);
+
+  /// marks the cached layout and size of a striped object as stale
+  void invalidateObjectInfo(const std::string& soid);
+
+  /// notifies all clients caching a striped object that it changed
+  void notifyObjectInfo(const std::string& soid);
+
+  /**
+   * lockless mode : makes c wait for the size xattr of soid to be
+   * at least size, sending an update or batching it with the next one
+   */
+  void queueSizeUpdate(const std::string& soid,
+		       MultiAioCompletionImpl *c,
+		       uint64_t size);
+  void sendSizeUpdate(const std::string& soid, uint64_t size);
+  void finishSizeUpdate(const std::string& soid, int r);
+
   /**
    * truncates an object. Should only be called with size < original_size
    */
@@ -314,6 +392,11 @@ struct libradosstriper::RadosStriperImpl {
 
   // Default layout
   ceph_file_layout m_layout;
+
+  // lockless mode : no shared lock for data IO, cached layouts and sizes
+  bool m_lockless;
+  Mutex m_objectInfoLock;
+  std::map<std::string, ObjectInfo*> m_objectInfos;
 };
 
 #endif
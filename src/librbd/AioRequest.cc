@@ -3,10 +3,12 @@
 
 #include "common/ceph_context.h"
 #include "common/dout.h"
+#include "common/errno.h"
 #include "common/Mutex.h"
 #include "common/RWLock.h"
 
 #include "librbd/AioCompletion.h"
+#include "librbd/CopyupRequest.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/internal.h"
 
@@ -77,17 +79,55 @@ namespace librbd {
       uint64_t object_overlap = m_ictx->prune_parent_extents(image_extents, image_overlap);
       if (object_overlap) {
 	m_tried_parent = true;
-	read_from_parent(image_extents);
+	if (should_copy_on_read()) {
+	  // read all of the object the parent has, so it can be copied up
+	  vector<pair<uint64_t,uint64_t> > object_image_extents;
+	  Striper::extent_to_file(m_ictx->cct, &m_ictx->layout,
+				  m_object_no, 0, m_ictx->get_object_size(),
+				  object_image_extents);
+	  m_ictx->prune_parent_extents(object_image_extents, image_overlap);
+	  m_copy_on_read = true;
+	  read_from_parent(object_image_extents);
+	} else {
+	  read_from_parent(image_extents);
+	}
 	return false;
       }
     }
 
+    if (m_copy_on_read) {
+      m_copy_on_read = false;
+      if (r >= 0) {
+	// hand the whole object to the copyup, keeping what was asked for
+	bufferlist object_data;
+	object_data.claim(m_read_data);
+	if (m_object_off < object_data.length()) {
+	  uint64_t len = MIN(m_object_len, object_data.length() - m_object_off);
+	  m_read_data.substr_of(object_data, m_object_off, len);
+	}
+	CopyupRequest::queue(m_ictx, m_oid, m_object_no, object_data);
+      }
+    }
+
     return true;
   }
 
+  bool AioRead::should_copy_on_read() const {
+    return (m_ictx->cct->_conf->rbd_clone_copy_on_read &&
+	    m_snap_id == CEPH_NOSNAP && !m_ictx->read_only &&
+	    CopyupRequest::can_queue(m_ictx, m_object_no));
+  }
+
   int AioRead::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
 
+    if (!m_ictx->object_map.object_may_exist(m_snap_id, m_object_no)) {
+      ldout(m_ictx->cct, 20) << "send " << this << " object does not exist"
+			     << dendl;
+      complete(-ENOENT);
+      return 0;
+    }
+
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(this, rados_req_cb, NULL);
     int r;
@@ -110,7 +150,8 @@ namespace librbd {
   AbstractWrite::AbstractWrite()
     : m_state(LIBRBD_AIO_WRITE_FLAT),
       m_parent_overlap(0),
-      m_snap_seq(0) {}
+      m_snap_seq(0),
+      m_write_state(LIBRBD_AIO_WRITE_FLAT) {}
   AbstractWrite::AbstractWrite(ImageCtx *ictx, const std::string &oid,
 			       uint64_t object_no, uint64_t object_off, uint64_t len,
 			       vector<pair<uint64_t,uint64_t> >& objectx,
@@ -120,7 +161,8 @@ namespace librbd {
 			       bool hide_enoent)
     : AioRequest(ictx, oid, object_no, object_off, len, snap_id, completion,
 		 hide_enoent),
-      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val)
+      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val),
+      m_write_state(LIBRBD_AIO_WRITE_FLAT)
   {
     m_object_image_extents = objectx;
     m_parent_overlap = object_overlap;
@@ -213,7 +255,28 @@ namespace librbd {
 
     case LIBRBD_AIO_WRITE_FLAT:
       ldout(m_ictx->cct, 20) << "WRITE_FLAT" << dendl;
-      // nothing to do
+      if ((r >= 0 || r == -ENOENT) && send_post())
+	finished = false;
+      break;
+
+    case LIBRBD_AIO_WRITE_PRE:
+      ldout(m_ictx->cct, 20) << "WRITE_PRE" << dendl;
+      if (r < 0) {
+	lderr(m_ictx->cct) << "failed to update object map: "
+			   << cpp_strerror(r) << dendl;
+	break;
+      }
+      m_state = m_write_state;
+      send_write();
+      finished = false;
+      break;
+
+    case LIBRBD_AIO_WRITE_POST:
+      ldout(m_ictx->cct, 20) << "WRITE_POST" << dendl;
+      if (r < 0) {
+	lderr(m_ictx->cct) << "failed to update object map: "
+			   << cpp_strerror(r) << dendl;
+      }
       break;
 
     default:
@@ -224,8 +287,53 @@ namespace librbd {
     return finished;
   }
 
+  uint8_t AbstractWrite::get_pre_write_object_map_state() const {
+    return RBD_OBJECT_EXISTS;
+  }
+
   int AbstractWrite::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
+    if (is_noop_if_nonexistent() &&
+	!m_ictx->object_map.object_may_exist(CEPH_NOSNAP, m_object_no)) {
+      ldout(m_ictx->cct, 20) << "send " << this << " object does not exist"
+			     << dendl;
+      m_completion->complete(0);
+      delete this;
+      return 0;
+    }
+    if (send_pre())
+      return 0;
+    return send_write();
+  }
+
+  bool AbstractWrite::send_pre() {
+    uint8_t new_state = get_pre_write_object_map_state();
+    if (!m_ictx->object_map.update_required(m_object_no, new_state))
+      return false;
+
+    ldout(m_ictx->cct, 20) << "send_pre " << this << " " << m_oid
+			   << " object map state " << (int)new_state << dendl;
+    m_write_state = m_state;
+    m_state = LIBRBD_AIO_WRITE_PRE;
+    m_ictx->object_map.aio_update(m_object_no, new_state, NULL,
+				  new C_AioRequest(this));
+    return true;
+  }
+
+  bool AbstractWrite::send_post() {
+    if (get_pre_write_object_map_state() != RBD_OBJECT_PENDING ||
+	!m_ictx->object_map.enabled())
+      return false;
+
+    ldout(m_ictx->cct, 20) << "send_post " << this << " " << m_oid << dendl;
+    m_state = LIBRBD_AIO_WRITE_POST;
+    uint8_t current_state = RBD_OBJECT_PENDING;
+    m_ictx->object_map.aio_update(m_object_no, RBD_OBJECT_NONEXISTENT,
+				  &current_state, new C_AioRequest(this));
+    return true;
+  }
+
+  int AbstractWrite::send_write() {
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(this, NULL, rados_req_cb);
     int r;
@@ -249,6 +357,10 @@ namespace librbd {
     rados_completion->release();
   }
 
+  uint8_t AioRemove::get_pre_write_object_map_state() const {
+    return has_parent() ? RBD_OBJECT_EXISTS : RBD_OBJECT_PENDING;
+  }
+
   void AioWrite::add_write_ops(librados::ObjectWriteOperation &wr) {
     wr.set_alloc_hint(m_ictx->get_object_size(), m_ictx->get_object_size());
     wr.write(m_object_off, m_write_data);
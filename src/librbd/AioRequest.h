@@ -59,6 +59,17 @@ namespace librbd {
     bool m_hide_enoent;
   };
 
+  class C_AioRequest : public Context {
+  public:
+    C_AioRequest(AioRequest *req) : m_req(req) {}
+    virtual ~C_AioRequest() {}
+    virtual void finish(int r) {
+      m_req->complete(r);
+    }
+  private:
+    AioRequest *m_req;
+  };
+
   class AioRead : public AioRequest {
   public:
     AioRead(ImageCtx *ictx, const std::string &oid,
@@ -69,7 +80,7 @@ namespace librbd {
       : AioRequest(ictx, oid, objectno, offset, len, snap_id, completion,
 		   false),
 	m_buffer_extents(be),
-	m_tried_parent(false), m_sparse(sparse) {
+	m_tried_parent(false), m_sparse(sparse), m_copy_on_read(false) {
     }
     virtual ~AioRead() {}
     virtual bool should_complete(int r);
@@ -83,9 +94,13 @@ namespace librbd {
     friend class C_AioRead;
 
   private:
+    bool should_copy_on_read() const;
+
     vector<pair<uint64_t,uint64_t> > m_buffer_extents;
     bool m_tried_parent;
     bool m_sparse;
+    /// reading the whole object from the parent to copy it up
+    bool m_copy_on_read;
   };
 
   class AbstractWrite : public AioRequest {
@@ -110,29 +125,43 @@ namespace librbd {
   private:
     /**
      * Writes go through the following state machine to deal with
-     * layering:
+     * layering and the object map:
      *
      *                           need copyup
      * LIBRBD_AIO_WRITE_GUARD ---------------> LIBRBD_AIO_WRITE_COPYUP
-     *           |        ^                              |
-     *           v        \------------------------------/
-     *         done
-     *           ^
-     *           |
-     * LIBRBD_AIO_WRITE_FLAT
+     *      ^    |        ^                              |
+     *      |    v        \------------------------------/
+     *      |  done <----------------------------\
+     *      |    ^                               |
+     *      |    |            removed object     |
+     *      | LIBRBD_AIO_WRITE_FLAT -------> LIBRBD_AIO_WRITE_POST
+     *      |    ^
+     *      |    |
+     * LIBRBD_AIO_WRITE_PRE
      *
      * Writes start in LIBRBD_AIO_WRITE_GUARD or _FLAT, depending on whether
-     * there is a parent or not.
+     * there is a parent or not, or in LIBRBD_AIO_WRITE_PRE first if the
+     * object map needs to record that the object exists (or is about to
+     * be removed). _POST marks a removed object nonexistent.
      */
     enum write_state_d {
       LIBRBD_AIO_WRITE_GUARD,
       LIBRBD_AIO_WRITE_COPYUP,
-      LIBRBD_AIO_WRITE_FLAT
+      LIBRBD_AIO_WRITE_FLAT,
+      LIBRBD_AIO_WRITE_PRE,
+      LIBRBD_AIO_WRITE_POST
     };
 
   protected:
     virtual void add_copyup_ops() = 0;
 
+    /// the object map state to record before writing
+    virtual uint8_t get_pre_write_object_map_state() const;
+    /// true if the op does nothing to an object that doesn't exist
+    virtual bool is_noop_if_nonexistent() const {
+      return false;
+    }
+
     write_state_d m_state;
     vector<pair<uint64_t,uint64_t> > m_object_image_extents;
     uint64_t m_parent_overlap;
@@ -143,6 +172,11 @@ namespace librbd {
 
   private:
     void send_copyup();
+    int send_write();
+    bool send_pre();
+    bool send_post();
+
+    write_state_d m_write_state;
   };
 
   class AioWrite : public AbstractWrite {
@@ -198,6 +232,11 @@ namespace librbd {
       // removing an object never needs to copyup
       assert(0);
     }
+
+    virtual uint8_t get_pre_write_object_map_state() const;
+    virtual bool is_noop_if_nonexistent() const {
+      return !has_parent();
+    }
   };
 
   class AioTruncate : public AbstractWrite {
@@ -221,6 +260,10 @@ namespace librbd {
     virtual void add_copyup_ops() {
       m_copyup.truncate(m_object_off);
     }
+
+    virtual bool is_noop_if_nonexistent() const {
+      return !has_parent();
+    }
   };
 
   class AioZero : public AbstractWrite {
@@ -244,6 +287,10 @@ namespace librbd {
     virtual void add_copyup_ops() {
       m_copyup.zero(m_object_off, m_object_len);
     }
+
+    virtual bool is_noop_if_nonexistent() const {
+      return !has_parent();
+    }
   };
 
 }
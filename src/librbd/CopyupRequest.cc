@@ -0,0 +1,138 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/Mutex.h"
+
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/CopyupRequest.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::CopyupRequest: "
+
+namespace librbd {
+
+  class CopyupRequest::C_SendCopyup : public Context {
+  public:
+    C_SendCopyup(CopyupRequest *req) : m_req(req) {}
+    virtual void finish(int r) {
+      if (r < 0)
+	m_req->complete(r);
+      else
+	m_req->send_copyup();
+    }
+  private:
+    CopyupRequest *m_req;
+  };
+
+  class CopyupRequest::C_Complete : public Context {
+  public:
+    C_Complete(CopyupRequest *req) : m_req(req) {}
+    virtual void finish(int r) {
+      m_req->complete(r);
+    }
+  private:
+    CopyupRequest *m_req;
+  };
+
+  CopyupRequest::CopyupRequest(ImageCtx *ictx, const std::string &oid,
+			       uint64_t object_no, ceph::bufferlist &data)
+    : m_ictx(ictx), m_oid(oid), m_object_no(object_no)
+  {
+    m_data.claim(data);
+  }
+
+  CopyupRequest::~CopyupRequest() {
+  }
+
+  bool CopyupRequest::can_queue(ImageCtx *ictx, uint64_t object_no)
+  {
+    Mutex::Locker l(ictx->copyup_list_lock);
+    return (ictx->copyup_list.count(object_no) == 0 &&
+	    ictx->copyup_list.size() <
+	      (uint64_t)ictx->cct->_conf->rbd_clone_copy_on_read_max_in_flight);
+  }
+
+  void CopyupRequest::queue(ImageCtx *ictx, const std::string &oid,
+			    uint64_t object_no, ceph::bufferlist &data)
+  {
+    CopyupRequest *req;
+    {
+      Mutex::Locker l(ictx->copyup_list_lock);
+      if (ictx->copyup_list.count(object_no) ||
+	  ictx->copyup_list.size() >=
+	    (uint64_t)ictx->cct->_conf->rbd_clone_copy_on_read_max_in_flight) {
+	ldout(ictx->cct, 20) << "not copying up " << oid << dendl;
+	return;
+      }
+      req = new CopyupRequest(ictx, oid, object_no, data);
+      ictx->copyup_list[object_no] = req;
+    }
+    req->send();
+  }
+
+  void CopyupRequest::send()
+  {
+    ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " "
+			   << m_data.length() << " bytes" << dendl;
+    m_ictx->perfcounter->inc(l_librbd_copyup_on_read);
+    m_ictx->perfcounter->inc(l_librbd_copyup_on_read_bytes, m_data.length());
+
+    // like a write, the object map must say it exists first
+    if (m_ictx->object_map.update_required(m_object_no, RBD_OBJECT_EXISTS)) {
+      m_ictx->object_map.aio_update(m_object_no, RBD_OBJECT_EXISTS, NULL,
+				    new C_SendCopyup(this));
+      return;
+    }
+    send_copyup();
+  }
+
+  void CopyupRequest::send_copyup()
+  {
+    std::vector<librados::snap_t> snaps;
+    librados::snap_t snap_seq;
+    {
+      RWLock::RLocker l(m_ictx->snap_lock);
+      snap_seq = m_ictx->snapc.seq.val;
+      for (std::vector<snapid_t>::const_iterator it =
+	     m_ictx->snapc.snaps.begin();
+	   it != m_ictx->snapc.snaps.end(); ++it) {
+	snaps.push_back(it->val);
+      }
+    }
+
+    librados::ObjectWriteOperation copyup_op;
+    copyup_op.exec("rbd", "copyup", m_data);
+
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(new C_Complete(this), NULL,
+					     rados_ctx_cb);
+    int r = m_ictx->data_ctx.aio_operate(m_oid, rados_completion, &copyup_op,
+					 snap_seq, snaps);
+    assert(r == 0);
+    rados_completion->release();
+  }
+
+  void CopyupRequest::complete(int r)
+  {
+    if (r < 0) {
+      lderr(m_ictx->cct) << "failed to copy up " << m_oid << ": "
+			 << cpp_strerror(r) << dendl;
+    } else {
+      ldout(m_ictx->cct, 20) << "copied up " << m_oid << dendl;
+    }
+
+    {
+      Mutex::Locker l(m_ictx->copyup_list_lock);
+      m_ictx->copyup_list.erase(m_object_no);
+      if (m_ictx->copyup_list.empty())
+	m_ictx->copyup_list_cond.Signal();
+    }
+    delete this;
+  }
+}
@@ -0,0 +1,59 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_COPYUPREQUEST_H
+#define CEPH_LIBRBD_COPYUPREQUEST_H
+
+#include "include/int_types.h"
+
+#include <string>
+
+#include "include/buffer.h"
+#include "include/rados/librados.hpp"
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * Copy parent data into a clone's object in the background, after a
+   * read had to go to the parent for it.
+   *
+   * Uses the same rbd.copyup class method as writes to a clone, which
+   * does nothing if the object was created meanwhile. Requests are
+   * tracked in ImageCtx::copyup_list so there is at most one per
+   * object, and at most rbd_clone_copy_on_read_max_in_flight at once.
+   */
+  class CopyupRequest {
+  public:
+    /**
+     * Start a copyup of @data, the parent's data for the whole
+     * object, unless one is already in flight for it or too many
+     * are. Call without holding any ImageCtx locks.
+     */
+    static void queue(ImageCtx *ictx, const std::string &oid,
+		      uint64_t object_no, ceph::bufferlist &data);
+
+    /// true if a copyup could be started for this object
+    static bool can_queue(ImageCtx *ictx, uint64_t object_no);
+
+  private:
+    CopyupRequest(ImageCtx *ictx, const std::string &oid, uint64_t object_no,
+		  ceph::bufferlist &data);
+    ~CopyupRequest();
+
+    void send();
+    void send_copyup();
+    void complete(int r);
+
+    class C_SendCopyup;
+    class C_Complete;
+
+    ImageCtx *m_ictx;
+    std::string m_oid;
+    uint64_t m_object_no;
+    ceph::bufferlist m_data;
+  };
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "common/dout.h"
 #include "common/errno.h"
 #include "common/perf_counters.h"
+#include "include/stringify.h"
 
 #include "librbd/internal.h"
 #include "librbd/WatchCtx.h"
@@ -41,17 +42,19 @@ namespace librbd {
       refresh_seq(0),
       last_refresh(0),
       md_lock("librbd::ImageCtx::md_lock"),
-      cache_lock("librbd::ImageCtx::cache_lock"),
       snap_lock("librbd::ImageCtx::snap_lock"),
       parent_lock("librbd::ImageCtx::parent_lock"),
+      object_map_lock("librbd::ImageCtx::object_map_lock"),
       refresh_lock("librbd::ImageCtx::refresh_lock"),
+      copyup_list_lock("librbd::ImageCtx::copyup_list_lock"),
       extra_read_flags(0),
       old_format(true),
       order(0), size(0), features(0),
       format_string(NULL),
       id(image_id), parent(NULL),
       stripe_unit(0), stripe_count(0),
-      object_cacher(NULL), writeback_handler(NULL), object_set(NULL)
+      object_map(*this),
+      total_bytes_read(0)
   {
     md_ctx.dup(p);
     data_ctx.dup(p);
@@ -69,14 +72,19 @@ namespace librbd {
     perf_start(pname);
 
     if (cct->_conf->rbd_cache) {
-      Mutex::Locker l(cache_lock);
       ldout(cct, 20) << "enabling caching..." << dendl;
-      writeback_handler = new LibrbdWriteback(this, cache_lock);
+      int num_shards = MAX(1, cct->_conf->rbd_cache_shards);
 
+      // the limits are split evenly between the shards
       uint64_t init_max_dirty = cct->_conf->rbd_cache_max_dirty;
       if (cct->_conf->rbd_cache_writethrough_until_flush)
 	init_max_dirty = 0;
+      uint64_t shard_size = cct->_conf->rbd_cache_size / num_shards;
+      uint64_t shard_max_dirty = init_max_dirty / num_shards;
+      uint64_t shard_target_dirty =
+	cct->_conf->rbd_cache_target_dirty / num_shards;
       ldout(cct, 20) << "Initial cache settings:"
+		     << " shards=" << num_shards
 		     << " size=" << cct->_conf->rbd_cache_size
 		     << " num_objects=" << 10
 		     << " max_dirty=" << init_max_dirty
@@ -84,34 +92,45 @@ namespace librbd {
 		     << " max_dirty_age="
 		     << cct->_conf->rbd_cache_max_dirty_age << dendl;
 
-      object_cacher = new ObjectCacher(cct, pname, *writeback_handler, cache_lock,
-				       NULL, NULL,
-				       cct->_conf->rbd_cache_size,
-				       10,  /* reset this in init */
-				       init_max_dirty,
-				       cct->_conf->rbd_cache_target_dirty,
-				       cct->_conf->rbd_cache_max_dirty_age,
-				       cct->_conf->rbd_cache_block_writes_upfront);
-      object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
-      object_set->return_enoent = true;
-      object_cacher->start();
+      for (int i = 0; i < num_shards; ++i) {
+	string shard_name = pname;
+	if (num_shards > 1)
+	  shard_name += "-" + stringify(i);
+	CacheShard *shard = new CacheShard;
+	Mutex::Locker l(shard->lock);
+	shard->writeback_handler = new LibrbdWriteback(this, shard->lock);
+	shard->object_cacher =
+	  new ObjectCacher(cct, shard_name, *shard->writeback_handler,
+			   shard->lock, NULL, NULL,
+			   shard_size,
+			   10,  /* reset this in init */
+			   shard_max_dirty,
+			   shard_target_dirty,
+			   cct->_conf->rbd_cache_max_dirty_age,
+			   cct->_conf->rbd_cache_block_writes_upfront);
+	shard->object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(),
+							0);
+	shard->object_set->return_enoent = true;
+	shard->object_cacher->start();
+	cache_shards.push_back(shard);
+      }
     }
+
+    readahead.set_trigger_requests(cct->_conf->rbd_readahead_trigger_requests);
+    readahead.set_max_readahead_size(cct->_conf->rbd_readahead_max_bytes);
   }
 
   ImageCtx::~ImageCtx() {
     perf_stop();
-    if (object_cacher) {
-      delete object_cacher;
-      object_cacher = NULL;
-    }
-    if (writeback_handler) {
-      delete writeback_handler;
-      writeback_handler = NULL;
-    }
-    if (object_set) {
-      delete object_set;
-      object_set = NULL;
+    for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	 it != cache_shards.end(); ++it) {
+      CacheShard *shard = *it;
+      delete shard->object_cacher;
+      delete shard->writeback_handler;
+      delete shard->object_set;
+      delete shard;
     }
+    cache_shards.clear();
     delete[] format_string;
   }
 
@@ -183,8 +202,15 @@ namespace librbd {
       snprintf(format_string, len, "%s.%%016llx", object_prefix.c_str());
     }
 
+    // prefetch whole objects or stripe periods where possible
+    vector<uint64_t> alignments;
+    alignments.push_back(stripe_count << order); // object set
+    alignments.push_back(stripe_unit * stripe_count); // stripe period
+    alignments.push_back(stripe_unit);
+    readahead.set_alignments(alignments);
+
     // size object cache appropriately
-    if (object_cacher) {
+    if (cache_enabled()) {
       uint64_t obj = cct->_conf->rbd_cache_max_dirty_object;
       if (!obj) {
         obj = cct->_conf->rbd_cache_size / (1ull << order);
@@ -192,7 +218,12 @@ namespace librbd {
       }
       ldout(cct, 10) << " cache bytes " << cct->_conf->rbd_cache_size << " order " << (int)order
 		     << " -> about " << obj << " objects" << dendl;
-      object_cacher->set_max_objects(obj);
+      uint64_t shard_obj = obj / cache_shards.size() + 1;
+      for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	   it != cache_shards.end(); ++it) {
+	Mutex::Locker l((*it)->lock);
+	(*it)->object_cacher->set_max_objects(shard_obj);
+      }
     }
 
     ldout(cct, 10) << "init_layout stripe_unit " << stripe_unit
@@ -232,6 +263,12 @@ namespace librbd {
     plb.add_u64_counter(l_librbd_snap_rollback, "snap_rollback");
     plb.add_u64_counter(l_librbd_notify, "notify");
     plb.add_u64_counter(l_librbd_resize, "resize");
+    plb.add_u64_counter(l_librbd_readahead, "readahead");
+    plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes");
+    plb.add_u64(l_librbd_readahead_hit_bytes, "readahead_hit_bytes");
+    plb.add_u64(l_librbd_readahead_waste_bytes, "readahead_waste_bytes");
+    plb.add_u64_counter(l_librbd_copyup_on_read, "copyup_on_read");
+    plb.add_u64_counter(l_librbd_copyup_on_read_bytes, "copyup_on_read_bytes");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -352,9 +389,14 @@ namespace librbd {
   }
 
   uint64_t ImageCtx::get_num_objects() const
+  {
+    return get_num_objects(size);
+  }
+
+  uint64_t ImageCtx::get_num_objects(uint64_t image_size) const
   {
     uint64_t period = get_stripe_period();
-    uint64_t num_periods = (size + period - 1) / period;
+    uint64_t num_periods = (image_size + period - 1) / period;
     return num_periods * stripe_count;
   }
 
@@ -464,27 +506,39 @@ namespace librbd {
     return -ENOENT;
   }
 
+  ImageCtx::CacheShard *ImageCtx::get_cache_shard(const object_t &o) const {
+    assert(!cache_shards.empty());
+    if (cache_shards.size() == 1)
+      return cache_shards[0];
+    uint64_t object_no = oid_to_object_no(o.name, object_prefix);
+    return cache_shards[object_no % cache_shards.size()];
+  }
+
   void ImageCtx::aio_read_from_cache(object_t o, bufferlist *bl, size_t len,
 				     uint64_t off, Context *onfinish) {
+    CacheShard *shard = get_cache_shard(o);
     snap_lock.get_read();
-    ObjectCacher::OSDRead *rd = object_cacher->prepare_read(snap_id, bl, 0);
+    ObjectCacher::OSDRead *rd = shard->object_cacher->prepare_read(snap_id,
+								   bl, 0);
     snap_lock.put_read();
     ObjectExtent extent(o, 0 /* a lie */, off, len, 0);
     extent.oloc.pool = data_ctx.get_id();
     extent.buffer_extents.push_back(make_pair(0, len));
     rd->extents.push_back(extent);
-    cache_lock.Lock();
-    int r = object_cacher->readx(rd, object_set, onfinish);
-    cache_lock.Unlock();
+    shard->lock.Lock();
+    int r = shard->object_cacher->readx(rd, shard->object_set, onfinish);
+    shard->lock.Unlock();
     if (r != 0)
       onfinish->complete(r);
   }
 
   void ImageCtx::write_to_cache(object_t o, bufferlist& bl, size_t len,
 				uint64_t off, Context *onfinish) {
+    CacheShard *shard = get_cache_shard(o);
     snap_lock.get_read();
-    ObjectCacher::OSDWrite *wr = object_cacher->prepare_write(snapc, bl,
-							      utime_t(), 0);
+    ObjectCacher::OSDWrite *wr = shard->object_cacher->prepare_write(snapc, bl,
+								     utime_t(),
+								     0);
     snap_lock.put_read();
     ObjectExtent extent(o, 0, off, len, 0);
     extent.oloc.pool = data_ctx.get_id();
@@ -493,8 +547,23 @@ namespace librbd {
     extent.buffer_extents.push_back(make_pair(0, len));
     wr->extents.push_back(extent);
     {
-      Mutex::Locker l(cache_lock);
-      object_cacher->writex(wr, object_set, cache_lock, onfinish);
+      Mutex::Locker l(shard->lock);
+      shard->object_cacher->writex(wr, shard->object_set, shard->lock,
+				   onfinish);
+    }
+  }
+
+  void ImageCtx::discard_from_cache(const vector<ObjectExtent> &extents) {
+    map<CacheShard*, vector<ObjectExtent> > shard_extents;
+    for (vector<ObjectExtent>::const_iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      shard_extents[get_cache_shard(p->oid)].push_back(*p);
+    }
+    for (map<CacheShard*, vector<ObjectExtent> >::iterator p =
+	   shard_extents.begin();
+	 p != shard_extents.end(); ++p) {
+      Mutex::Locker l(p->first->lock);
+      p->first->object_cacher->discard_set(p->first->object_set, p->second);
     }
   }
 
@@ -514,7 +583,7 @@ namespace librbd {
   }
 
   void ImageCtx::user_flushed() {
-    if (object_cacher && cct->_conf->rbd_cache_writethrough_until_flush) {
+    if (cache_enabled() && cct->_conf->rbd_cache_writethrough_until_flush) {
       md_lock.get_read();
       bool flushed_before = flush_encountered;
       md_lock.put_read();
@@ -526,16 +595,23 @@ namespace librbd {
 	md_lock.put_write();
 
 	ldout(cct, 10) << "saw first user flush, enabling writeback" << dendl;
-	Mutex::Locker l(cache_lock);
-	object_cacher->set_max_dirty(max_dirty);
+	for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	     it != cache_shards.end(); ++it) {
+	  Mutex::Locker l((*it)->lock);
+	  (*it)->object_cacher->set_max_dirty(max_dirty / cache_shards.size());
+	}
       }
     }
   }
 
   void ImageCtx::flush_cache_aio(Context *onfinish) {
-    cache_lock.Lock();
-    object_cacher->flush_set(object_set, onfinish);
-    cache_lock.Unlock();
+    C_GatherBuilder gather(cct, onfinish);
+    for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	 it != cache_shards.end(); ++it) {
+      Mutex::Locker l((*it)->lock);
+      (*it)->object_cacher->flush_set((*it)->object_set, gather.new_sub());
+    }
+    gather.activate();
   }
 
   int ImageCtx::flush_cache() {
@@ -556,29 +632,50 @@ namespace librbd {
   }
 
   void ImageCtx::shutdown_cache() {
+    readahead.wait_for_pending();
     md_lock.get_write();
     invalidate_cache();
     md_lock.put_write();
-    object_cacher->stop();
+    for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	 it != cache_shards.end(); ++it) {
+      (*it)->object_cacher->stop();
+    }
+  }
+
+  void ImageCtx::wait_for_pending_copyup() {
+    Mutex::Locker l(copyup_list_lock);
+    while (!copyup_list.empty()) {
+      ldout(cct, 20) << "waiting for " << copyup_list.size()
+		     << " copyups to complete" << dendl;
+      copyup_list_cond.Wait(copyup_list_lock);
+    }
   }
 
   int ImageCtx::invalidate_cache() {
-    if (!object_cacher)
+    if (!cache_enabled())
       return 0;
-    cache_lock.Lock();
-    object_cacher->release_set(object_set);
-    cache_lock.Unlock();
+    for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	 it != cache_shards.end(); ++it) {
+      Mutex::Locker l((*it)->lock);
+      (*it)->object_cacher->release_set((*it)->object_set);
+    }
     int r = flush_cache();
     if (r == -EBLACKLISTED) {
-      Mutex::Locker l(cache_lock);
       lderr(cct) << "Blacklisted during flush!  Purging cache..." << dendl;
-      object_cacher->purge_set(object_set);
+      for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	   it != cache_shards.end(); ++it) {
+	Mutex::Locker l((*it)->lock);
+	(*it)->object_cacher->purge_set((*it)->object_set);
+      }
     } else if (r) {
       lderr(cct) << "flush_cache returned " << r << dendl;
     }
-    cache_lock.Lock();
-    loff_t unclean = object_cacher->release_set(object_set);
-    cache_lock.Unlock();
+    loff_t unclean = 0;
+    for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	 it != cache_shards.end(); ++it) {
+      Mutex::Locker l((*it)->lock);
+      unclean += (*it)->object_cacher->release_set((*it)->object_set);
+    }
     if (unclean) {
       lderr(cct) << "could not release all objects from cache: "
                  << unclean << " bytes remain" << dendl;
@@ -588,11 +685,11 @@ namespace librbd {
   }
 
   void ImageCtx::clear_nonexistence_cache() {
-    if (!object_cacher)
-      return;
-    cache_lock.Lock();
-    object_cacher->clear_nonexistence(object_set);
-    cache_lock.Unlock();
+    for (vector<CacheShard*>::iterator it = cache_shards.begin();
+	 it != cache_shards.end(); ++it) {
+      Mutex::Locker l((*it)->lock);
+      (*it)->object_cacher->clear_nonexistence((*it)->object_set);
+    }
   }
 
   int ImageCtx::register_watch() {
@@ -10,9 +10,12 @@
 #include <string>
 #include <vector>
 
+#include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/RWLock.h"
+#include "common/Readahead.h"
 #include "common/snap_types.h"
+#include "include/atomic.h"
 #include "include/buffer.h"
 #include "include/rbd/librbd.hpp"
 #include "include/rbd_types.h"
@@ -21,6 +24,7 @@
 
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/SnapInfo.h"
 #include "librbd/parent_types.h"
 
@@ -29,6 +33,7 @@ class PerfCounters;
 
 namespace librbd {
 
+  class CopyupRequest;
   class WatchCtx;
 
   struct ImageCtx {
@@ -60,15 +65,17 @@ namespace librbd {
 
     /**
      * Lock ordering:
-     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock
+     * md_lock, CacheShard::lock, snap_lock, parent_lock,
+     * object_map_lock, refresh_lock, copyup_list_lock
      */
     RWLock md_lock; // protects access to the mutable image metadata that
                    // isn't guarded by other locks below
                    // (size, features, image locks, etc)
-    Mutex cache_lock; // used as client_lock for the ObjectCacher
     RWLock snap_lock; // protects snapshot-related member variables:
     RWLock parent_lock; // protects parent_md and parent
+    RWLock object_map_lock; // protects the in-memory object map
     Mutex refresh_lock; // protects refresh_seq and last_refresh
+    Mutex copyup_list_lock; // protects copyup_list
 
     unsigned extra_read_flags;
 
@@ -86,9 +93,32 @@ namespace librbd {
 
     ceph_file_layout layout;
 
-    ObjectCacher *object_cacher;
-    LibrbdWriteback *writeback_handler;
-    ObjectCacher::ObjectSet *object_set;
+    /**
+     * A slice of the cache. Objects are spread over rbd_cache_shards
+     * independent ObjectCachers by object number, each with its own
+     * lock, LRU, dirty limits and flusher, so that I/O to different
+     * objects doesn't serialize on a single lock.  Each ObjectCacher
+     * is still entirely under its shard's lock.
+     */
+    struct CacheShard {
+      Mutex lock; // used as client_lock for the ObjectCacher
+      LibrbdWriteback *writeback_handler;
+      ObjectCacher *object_cacher;
+      ObjectCacher::ObjectSet *object_set;
+
+      CacheShard()
+	: lock("librbd::ImageCtx::CacheShard::lock"), writeback_handler(NULL),
+	  object_cacher(NULL), object_set(NULL) {}
+    };
+    std::vector<CacheShard*> cache_shards; // empty if caching is disabled
+
+    ObjectMap object_map;
+
+    Readahead readahead;
+    atomic64_t total_bytes_read;
+
+    std::map<uint64_t, CopyupRequest*> copyup_list;
+    Cond copyup_list_cond;
 
     /**
      * Either image_name or image_id must be set.
@@ -121,6 +151,7 @@ namespace librbd {
     uint64_t get_object_size() const;
     string get_object_name(uint64_t num) const;
     uint64_t get_num_objects() const;
+    uint64_t get_num_objects(uint64_t image_size) const;
     uint64_t get_stripe_unit() const;
     uint64_t get_stripe_count() const;
     uint64_t get_stripe_period() const;
@@ -145,7 +176,13 @@ namespace librbd {
     void user_flushed();
     void flush_cache_aio(Context *onfinish);
     int flush_cache();
+    bool cache_enabled() const {
+      return !cache_shards.empty();
+    }
+    CacheShard *get_cache_shard(const object_t &o) const;
+    void discard_from_cache(const std::vector<ObjectExtent> &extents);
     void shutdown_cache();
+    void wait_for_pending_copyup();
     int invalidate_cache();
     void clear_nonexistence_cache();
     int register_watch();
@@ -0,0 +1,336 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/RWLock.h"
+
+#include "cls/rbd/cls_rbd_client.h"
+#include "include/rbd_types.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/ObjectMap.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::ObjectMap: "
+
+using std::string;
+
+namespace librbd {
+
+  class ObjectMap::C_UpdateState : public Context {
+  public:
+    C_UpdateState(ObjectMap *object_map, uint64_t object_no,
+		  uint8_t new_state, const uint8_t *current_state,
+		  Context *on_finish)
+      : m_object_map(object_map), m_object_no(object_no),
+	m_new_state(new_state), m_has_current_state(current_state != NULL),
+	m_current_state(current_state ? *current_state : 0),
+	m_on_finish(on_finish) {}
+    virtual ~C_UpdateState() {}
+    virtual void finish(int r) {
+      if (r == 0) {
+	m_object_map->update_in_memory(
+	  CEPH_NOSNAP, m_object_no, m_object_no + 1, m_new_state,
+	  m_has_current_state ? &m_current_state : NULL);
+      }
+      m_on_finish->complete(r);
+    }
+  private:
+    ObjectMap *m_object_map;
+    uint64_t m_object_no;
+    uint8_t m_new_state;
+    bool m_has_current_state;
+    uint8_t m_current_state;
+    Context *m_on_finish;
+  };
+
+  ObjectMap::ObjectMap(ImageCtx &image_ctx)
+    : m_image_ctx(image_ctx), m_snap_id(CEPH_NOSNAP), m_enabled(false)
+  {
+  }
+
+  string ObjectMap::object_map_name(const string &image_id,
+				    librados::snap_t snap_id)
+  {
+    string oid(RBD_OBJECT_MAP_PREFIX + image_id);
+    if (snap_id != CEPH_NOSNAP) {
+      char buf[20];
+      snprintf(buf, sizeof(buf), ".%016llx", (unsigned long long)snap_id);
+      oid += buf;
+    }
+    return oid;
+  }
+
+  int ObjectMap::remove(librados::IoCtx &io_ctx, const string &image_id,
+			librados::snap_t snap_id)
+  {
+    int r = io_ctx.remove(object_map_name(image_id, snap_id));
+    if (r == -ENOENT)
+      r = 0;
+    return r;
+  }
+
+  bool ObjectMap::enabled() const
+  {
+    RWLock::RLocker l(m_image_ctx.object_map_lock);
+    return m_enabled;
+  }
+
+  int ObjectMap::load(librados::snap_t snap_id,
+		      ceph::BitVector<2> *object_map) const
+  {
+    uint64_t num_objects =
+      m_image_ctx.get_num_objects(m_image_ctx.get_image_size(snap_id));
+    int r = cls_client::object_map_load(&m_image_ctx.md_ctx,
+					object_map_name(m_image_ctx.id, snap_id),
+					num_objects, object_map);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error loading object map for snap "
+			     << snap_id << ": " << cpp_strerror(r) << dendl;
+    }
+    return r;
+  }
+
+  int ObjectMap::refresh()
+  {
+    librados::snap_t snap_id = m_image_ctx.snap_id;
+    uint64_t features = 0;
+    if (!m_image_ctx.old_format)
+      m_image_ctx.get_features(snap_id, &features);
+
+    if ((features & RBD_FEATURE_OBJECT_MAP) == 0) {
+      RWLock::WLocker l(m_image_ctx.object_map_lock);
+      m_enabled = false;
+      m_object_map.clear();
+      return 0;
+    }
+
+    ldout(m_image_ctx.cct, 20) << "refreshing object map for snap "
+			       << snap_id << dendl;
+    ceph::BitVector<2> object_map;
+    int r = load(snap_id, &object_map);
+
+    RWLock::WLocker l(m_image_ctx.object_map_lock);
+    if (r < 0) {
+      m_enabled = false;
+      m_object_map.clear();
+      return r;
+    }
+
+    // an update that landed after we read the map must not be lost,
+    // or we'd skip an object that now exists
+    if (m_enabled && m_snap_id == snap_id) {
+      uint64_t n = std::min(object_map.size(), m_object_map.size());
+      for (uint64_t i = 0; i < n; ++i) {
+	if (object_map.get(i) == RBD_OBJECT_NONEXISTENT)
+	  object_map.set(i, m_object_map.get(i));
+      }
+    }
+    m_object_map = object_map;
+    m_snap_id = snap_id;
+    m_enabled = true;
+    return 0;
+  }
+
+  bool ObjectMap::object_may_exist(librados::snap_t snap_id,
+				   uint64_t object_no) const
+  {
+    RWLock::RLocker l(m_image_ctx.object_map_lock);
+    if (!m_enabled || snap_id != m_snap_id ||
+	object_no >= m_object_map.size())
+      return true;
+    return m_object_map.get(object_no) != RBD_OBJECT_NONEXISTENT;
+  }
+
+  bool ObjectMap::update_required(uint64_t object_no, uint8_t new_state) const
+  {
+    RWLock::RLocker l(m_image_ctx.object_map_lock);
+    if (!m_enabled || m_snap_id != CEPH_NOSNAP)
+      return false;
+    if (object_no >= m_object_map.size())
+      return true;
+    return m_object_map.get(object_no) != new_state;
+  }
+
+  void ObjectMap::aio_update(uint64_t object_no, uint8_t new_state,
+			     const uint8_t *current_state, Context *on_finish)
+  {
+    ldout(m_image_ctx.cct, 20) << "aio_update object " << object_no
+			       << " -> " << (int)new_state << dendl;
+    librados::ObjectWriteOperation op;
+    cls_client::object_map_update(&op, object_no, object_no + 1, new_state,
+				  current_state);
+
+    Context *ctx = new C_UpdateState(this, object_no, new_state,
+				     current_state, on_finish);
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(ctx, NULL, rados_ctx_cb);
+    int r = m_image_ctx.md_ctx.aio_operate(
+      object_map_name(m_image_ctx.id, CEPH_NOSNAP), rados_completion, &op);
+    assert(r == 0);
+    rados_completion->release();
+  }
+
+  int ObjectMap::update(librados::snap_t snap_id, uint64_t start_object_no,
+			uint64_t end_object_no, uint8_t new_state,
+			const uint8_t *current_state)
+  {
+    ldout(m_image_ctx.cct, 20) << "update snap " << snap_id << " objects "
+			       << start_object_no << "~"
+			       << (end_object_no - start_object_no) << " -> "
+			       << (int)new_state << dendl;
+    int r = cls_client::object_map_update(
+      &m_image_ctx.md_ctx, object_map_name(m_image_ctx.id, snap_id),
+      start_object_no, end_object_no, new_state, current_state);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error updating object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    update_in_memory(snap_id, start_object_no, end_object_no, new_state,
+		     current_state);
+    return 0;
+  }
+
+  void ObjectMap::update_in_memory(librados::snap_t snap_id,
+				   uint64_t start_object_no,
+				   uint64_t end_object_no, uint8_t new_state,
+				   const uint8_t *current_state)
+  {
+    RWLock::WLocker l(m_image_ctx.object_map_lock);
+    if (!m_enabled || m_snap_id != snap_id)
+      return;
+    end_object_no = std::min(end_object_no, m_object_map.size());
+    for (uint64_t i = start_object_no; i < end_object_no; ++i) {
+      if (current_state && m_object_map.get(i) != *current_state)
+	continue;
+      m_object_map.set(i, new_state);
+    }
+  }
+
+  int ObjectMap::resize(uint64_t num_objects)
+  {
+    ldout(m_image_ctx.cct, 20) << "resize to " << num_objects
+			       << " objects" << dendl;
+    int r = cls_client::object_map_resize(
+      &m_image_ctx.md_ctx, object_map_name(m_image_ctx.id, CEPH_NOSNAP),
+      num_objects);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error resizing object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    RWLock::WLocker l(m_image_ctx.object_map_lock);
+    if (m_enabled && m_snap_id == CEPH_NOSNAP)
+      m_object_map.resize(num_objects);
+    return 0;
+  }
+
+  int ObjectMap::snapshot_add(librados::snap_t snap_id)
+  {
+    ldout(m_image_ctx.cct, 20) << "snapshot_add " << snap_id << dendl;
+
+    ceph::BitVector<2> object_map;
+    int r = load(CEPH_NOSNAP, &object_map);
+    if (r < 0)
+      return r;
+    bufferlist bl;
+    object_map.encode_data(bl);
+    r = m_image_ctx.md_ctx.write_full(
+      object_map_name(m_image_ctx.id, snap_id), bl);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error writing snapshot object map: "
+			     << cpp_strerror(r) << dendl;
+    }
+    return r;
+  }
+
+  int ObjectMap::mark_clean()
+  {
+    ldout(m_image_ctx.cct, 20) << "mark_clean" << dendl;
+    uint8_t current_state = RBD_OBJECT_EXISTS;
+    return update(CEPH_NOSNAP, 0, m_image_ctx.get_num_objects(),
+		  RBD_OBJECT_EXISTS_CLEAN, &current_state);
+  }
+
+  int ObjectMap::snapshot_remove(librados::snap_t snap_id)
+  {
+    librados::snap_t next_snap_id = CEPH_NOSNAP;
+    uint64_t num_objects;
+    {
+      RWLock::RLocker l(m_image_ctx.snap_lock);
+      std::vector<librados::snap_t>::const_iterator it =
+	std::find(m_image_ctx.snaps.begin(), m_image_ctx.snaps.end(), snap_id);
+      if (it == m_image_ctx.snaps.end())
+	return -ENOENT;
+      if (it != m_image_ctx.snaps.begin())
+	next_snap_id = *(it - 1);
+      num_objects =
+	m_image_ctx.get_num_objects(m_image_ctx.get_image_size(next_snap_id));
+    }
+
+    // objects clean since this snapshot in the next newer map were not
+    // necessarily clean since the one before it
+    ldout(m_image_ctx.cct, 20) << "snapshot_remove " << snap_id
+			       << " dirtying snap " << next_snap_id << dendl;
+    uint8_t current_state = RBD_OBJECT_EXISTS_CLEAN;
+    return update(next_snap_id, 0, num_objects, RBD_OBJECT_EXISTS,
+		  &current_state);
+  }
+
+  int ObjectMap::rollback(librados::snap_t snap_id)
+  {
+    ldout(m_image_ctx.cct, 20) << "rollback to " << snap_id << dendl;
+
+    // mark everything the rollback may recreate as existing before it
+    // runs; objects it removes are merely left marked as existing
+    ceph::BitVector<2> snap_object_map;
+    int r;
+    {
+      RWLock::RLocker l(m_image_ctx.snap_lock);
+      r = load(snap_id, &snap_object_map);
+    }
+    if (r < 0)
+      return r;
+
+    ceph::BitVector<2> object_map;
+    uint64_t num_objects = m_image_ctx.get_num_objects();
+    r = cls_client::object_map_load(
+      &m_image_ctx.md_ctx, object_map_name(m_image_ctx.id, CEPH_NOSNAP),
+      ceph::BitVector<2>::get_byte_count(num_objects) *
+      ceph::BitVector<2>::ELEMENTS_PER_BYTE, &object_map);
+    if (r < 0)
+      return r;
+
+    uint64_t n = std::min(snap_object_map.size(), object_map.size());
+    for (uint64_t i = 0; i < n; ++i) {
+      if (snap_object_map.get(i) != RBD_OBJECT_NONEXISTENT)
+	object_map.set(i, RBD_OBJECT_EXISTS);
+    }
+    bufferlist bl;
+    object_map.encode_data(bl);
+    r = m_image_ctx.md_ctx.write(object_map_name(m_image_ctx.id, CEPH_NOSNAP),
+				 bl, bl.length(), 0);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error writing object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    RWLock::WLocker l(m_image_ctx.object_map_lock);
+    if (m_enabled && m_snap_id == CEPH_NOSNAP) {
+      object_map.resize(num_objects);
+      m_object_map = object_map;
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,81 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_OBJECTMAP_H
+#define CEPH_LIBRBD_OBJECTMAP_H
+
+#include "include/int_types.h"
+
+#include <string>
+
+#include "common/bit_vector.hpp"
+#include "include/Context.h"
+#include "include/rados/librados.hpp"
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * The object map of the image or snapshot an ImageCtx has open.
+   *
+   * With RBD_FEATURE_OBJECT_MAP, each image and snapshot has a map
+   * of which of its data objects may exist. Writes mark an object as
+   * existing before the data is written, and removals mark it
+   * nonexistent only once it is gone, so an object the map says is
+   * nonexistent never needs to be read, removed or listed. Like the
+   * cache, this assumes an image is written by one client at a time.
+   *
+   * The in-memory map is protected by ImageCtx::object_map_lock.
+   */
+  class ObjectMap {
+  public:
+    ObjectMap(ImageCtx &image_ctx);
+
+    static std::string object_map_name(const std::string &image_id,
+				       librados::snap_t snap_id);
+    static int remove(librados::IoCtx &io_ctx, const std::string &image_id,
+		      librados::snap_t snap_id);
+
+    bool enabled() const;
+
+    /// (re)load the map for ImageCtx::snap_id; needs snap_lock
+    int refresh();
+    int load(librados::snap_t snap_id, ceph::BitVector<2> *object_map) const;
+
+    bool object_may_exist(librados::snap_t snap_id, uint64_t object_no) const;
+    bool update_required(uint64_t object_no, uint8_t new_state) const;
+
+    /// update the head map for one object, then complete on_finish
+    void aio_update(uint64_t object_no, uint8_t new_state,
+		    const uint8_t *current_state, Context *on_finish);
+    int update(librados::snap_t snap_id, uint64_t start_object_no,
+	       uint64_t end_object_no, uint8_t new_state,
+	       const uint8_t *current_state);
+
+    int resize(uint64_t num_objects);
+
+    /// copy the head map for a snapshot about to be added
+    int snapshot_add(librados::snap_t snap_id);
+    /// once it has been, track changes to the head since then
+    int mark_clean();
+    /// before removing a snapshot, dirty what was clean since it
+    int snapshot_remove(librados::snap_t snap_id);
+    /// before rolling back, mark what the snapshot has as existing
+    int rollback(librados::snap_t snap_id);
+
+  private:
+    class C_UpdateState;
+
+    void update_in_memory(librados::snap_t snap_id, uint64_t start_object_no,
+			  uint64_t end_object_no, uint8_t new_state,
+			  const uint8_t *current_state);
+
+    ImageCtx &m_image_ctx;
+    ceph::BitVector<2> m_object_map;
+    librados::snap_t m_snap_id;
+    bool m_enabled;
+  };
+
+}
+
+#endif
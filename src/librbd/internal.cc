@@ -17,6 +17,7 @@
 #include "librbd/AioCompletion.h"
 #include "librbd/AioRequest.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/ObjectMap.h"
 
 #include "librbd/internal.h"
 #include "librbd/parent_types.h"
@@ -170,6 +171,8 @@ namespace librbd {
       ldout(cct, 2) << "trim_image objects " << delete_start << " to "
 		    << (num_objects - 1) << dendl;
       for (uint64_t i = delete_start; i < num_objects; ++i) {
+	if (!ictx->object_map.object_may_exist(CEPH_NOSNAP, i))
+	  continue;
 	string oid = ictx->get_object_name(i);
 	Context *req_comp = new C_SimpleThrottle(&throttle);
 	librados::AioCompletion *rados_completion =
@@ -190,6 +193,8 @@ namespace librbd {
       for (vector<ObjectExtent>::iterator p = extents.begin();
 	   p != extents.end(); ++p) {
 	ldout(ictx->cct, 20) << " ex " << *p << dendl;
+	if (!ictx->object_map.object_may_exist(CEPH_NOSNAP, p->objectno))
+	  continue;
 	Context *req_comp = new C_SimpleThrottle(&throttle);
 	librados::AioCompletion *rados_completion =
 	  librados::Rados::aio_create_completion(req_comp, NULL, rados_ctx_cb);
@@ -207,6 +212,9 @@ namespace librbd {
     if (r < 0) {
       lderr(cct) << "warning: failed to remove some object(s): "
 		 << cpp_strerror(r) << dendl;
+    } else if (delete_start < num_objects && ictx->object_map.enabled()) {
+      ictx->object_map.update(CEPH_NOSNAP, delete_start, num_objects,
+			      RBD_OBJECT_NONEXISTENT, NULL);
     }
   }
 
@@ -330,7 +338,16 @@ namespace librbd {
     CephContext *cct = ictx->cct;
     SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops, true);
 
+    if (ictx->object_map.enabled()) {
+      r = ictx->object_map.rollback(snap_id);
+      if (r < 0)
+	return r;
+    }
+
     for (uint64_t i = 0; i < numseg; i++) {
+      // neither the head nor the snapshot has it
+      if (!ictx->object_map.object_may_exist(CEPH_NOSNAP, i))
+	continue;
       string oid = ictx->get_object_name(i);
       Context *req_comp = new C_SimpleThrottle(&throttle);
       librados::AioCompletion *rados_completion =
@@ -458,6 +475,11 @@ namespace librbd {
       return r;
 
     RWLock::RLocker l(ictx->md_lock);
+    if (ictx->features & RBD_FEATURE_OBJECT_MAP) {
+      // the object map copied for the snapshot should include
+      // everything written so far
+      _flush(ictx);
+    }
     do {
       r = add_snap(ictx, snap_name);
     } while (r == -ESTALE);
@@ -528,6 +550,14 @@ namespace librbd {
       }
     }
 
+    bool object_map = !ictx->old_format &&
+      (ictx->features & RBD_FEATURE_OBJECT_MAP);
+    if (object_map) {
+      r = ictx->object_map.snapshot_remove(snap_id);
+      if (r < 0)
+	return r;
+    }
+
     r = rm_snap(ictx, snap_name);
     if (r < 0)
       return r;
@@ -537,6 +567,14 @@ namespace librbd {
     if (r < 0)
       return r;
 
+    if (object_map) {
+      r = ObjectMap::remove(ictx->md_ctx, ictx->id, snap_id);
+      if (r < 0) {
+	lderr(ictx->cct) << "error removing snapshot object map: "
+			 << cpp_strerror(r) << dendl;
+      }
+    }
+
     notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
 
     ictx->perfcounter->inc(l_librbd_snap_remove);
@@ -800,6 +838,15 @@ reprotect_and_return_err:
       }
     }
 
+    if (features & RBD_FEATURE_OBJECT_MAP) {
+      r = io_ctx.create(ObjectMap::object_map_name(id, CEPH_NOSNAP), true);
+      if (r < 0) {
+	lderr(cct) << "error creating object map: " << cpp_strerror(r)
+		   << dendl;
+	goto err_remove_header;
+      }
+    }
+
     ldout(cct, 2) << "done." << dendl;
     return 0;
 
@@ -1423,6 +1470,15 @@ reprotect_and_return_err:
 	lderr(cct) << "error removing header: " << cpp_strerror(-r) << dendl;
 	return r;
       }
+
+      if (!old_format) {
+	r = ObjectMap::remove(io_ctx, id, CEPH_NOSNAP);
+	if (r < 0) {
+	  lderr(cct) << "error removing object map: " << cpp_strerror(r)
+		     << dendl;
+	  return r;
+	}
+      }
     }
 
     if (old_format || unknown_format) {
@@ -1501,10 +1557,15 @@ reprotect_and_return_err:
     if (r < 0) {
       lderr(cct) << "error writing header: " << cpp_strerror(-r) << dendl;
       return r;
-    } else {
-      notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
     }
 
+    if (ictx->object_map.enabled()) {
+      // a shrink the trim couldn't complete leaves the extra entries
+      // in place, which is safe
+      ictx->object_map.resize(ictx->get_num_objects());
+    }
+    notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
+
     return 0;
   }
 
@@ -1524,7 +1585,7 @@ reprotect_and_return_err:
     }
 
     RWLock::WLocker l(ictx->md_lock);
-    if (size < ictx->size && ictx->object_cacher) {
+    if (size < ictx->size && ictx->cache_enabled()) {
       // need to invalidate since we're deleting objects, and
       // ObjectCacher doesn't track non-existent objects
       r = ictx->invalidate_cache();
@@ -1586,6 +1647,14 @@ reprotect_and_return_err:
       return r;
     }
 
+    bool object_map = !ictx->old_format &&
+      (ictx->features & RBD_FEATURE_OBJECT_MAP);
+    if (object_map) {
+      r = ictx->object_map.snapshot_add(snap_id);
+      if (r < 0)
+	return r;
+    }
+
     if (ictx->old_format) {
       r = cls_client::old_snapshot_add(&ictx->md_ctx, ictx->header_oid,
 				       snap_id, snap_name);
@@ -1597,9 +1666,14 @@ reprotect_and_return_err:
     if (r < 0) {
       lderr(ictx->cct) << "adding snapshot to header failed: "
 		       << cpp_strerror(r) << dendl;
+      if (object_map)
+	ObjectMap::remove(ictx->md_ctx, ictx->id, snap_id);
       return r;
     }
 
+    if (object_map)
+      ictx->object_map.mark_clean();
+
     return 0;
   }
 
@@ -1827,6 +1901,10 @@ reprotect_and_return_err:
       }
 
       ictx->data_ctx.selfmanaged_snap_set_write_ctx(ictx->snapc.seq, ictx->snaps);
+
+      int r = ictx->object_map.refresh();
+      if (r < 0)
+	return r;
     } // release snap_lock
 
     if (new_snap) {
@@ -2061,6 +2139,7 @@ reprotect_and_return_err:
   {
     RWLock::WLocker l1(ictx->snap_lock);
     RWLock::WLocker l2(ictx->parent_lock);
+    snap_t old_snap_id = ictx->snap_id;
     int r;
     if ((snap_name != NULL) && (strlen(snap_name) != 0)) {
       r = ictx->snap_set(snap_name);
@@ -2072,6 +2151,11 @@ reprotect_and_return_err:
       return r;
     }
     refresh_parent(ictx);
+    if (ictx->snap_id != old_snap_id) {
+      r = ictx->object_map.refresh();
+      if (r < 0)
+	return r;
+    }
     return 0;
   }
 
@@ -2082,7 +2166,7 @@ reprotect_and_return_err:
     // ignore return value, since we may be set to a non-existent
     // snapshot and the user is trying to fix that
     ictx_check(ictx);
-    if (ictx->object_cacher) {
+    if (ictx->cache_enabled()) {
       // complete pending writes before we're set to a snapshot and
       // get -EROFS for writes
       RWLock::WLocker l(ictx->md_lock);
@@ -2130,7 +2214,8 @@ reprotect_and_return_err:
   void close_image(ImageCtx *ictx)
   {
     ldout(ictx->cct, 20) << "close_image " << ictx << dendl;
-    if (ictx->object_cacher)
+    ictx->wait_for_pending_copyup();
+    if (ictx->cache_enabled())
       ictx->shutdown_cache(); // implicitly flushes
     else
       flush(ictx);
@@ -2208,6 +2293,14 @@ reprotect_and_return_err:
 	}
       }
 
+      // an object the child already has was copied up or written, so
+      // there is nothing to pull from the parent
+      if (ictx->object_map.enabled() &&
+	  ictx->object_map.object_may_exist(CEPH_NOSNAP, ono)) {
+	prog_ctx.update_progress(ono, overlap_objects);
+	continue;
+      }
+
       // map child object onto the parent
       vector<pair<uint64_t,uint64_t> > objectx;
       Striper::extent_to_file(cct, &ictx->layout,
@@ -2493,6 +2586,30 @@ reprotect_and_return_err:
     }
     snap_t end_snap_id = ictx->snap_id;
     uint64_t end_size = ictx->get_image_size(end_snap_id);
+
+    // objects missing from both object maps need not be listed, nor
+    // need objects clean since the snapshot just before end
+    bool use_object_map = false;
+    bool from_prev_snap = false;
+    ceph::BitVector<2> from_object_map;
+    ceph::BitVector<2> end_object_map;
+    uint64_t features = 0;
+    if (!ictx->old_format && from_snap_id != CEPH_NOSNAP &&
+	ictx->get_features(end_snap_id, &features) == 0 &&
+	(features & RBD_FEATURE_OBJECT_MAP) != 0) {
+      r = ictx->object_map.load(end_snap_id, &end_object_map);
+      if (r == 0 && from_snap_id != 0)
+	r = ictx->object_map.load(from_snap_id, &from_object_map);
+      use_object_map = (r == 0);
+
+      vector<snap_t>::const_iterator it = ictx->snaps.begin();
+      if (end_snap_id != CEPH_NOSNAP) {
+	it = std::find(ictx->snaps.begin(), ictx->snaps.end(), end_snap_id);
+	if (it != ictx->snaps.end())
+	  ++it;
+      }
+      from_prev_snap = it != ictx->snaps.end() && *it == from_snap_id;
+    }
     ictx->snap_lock.put_read();
     ictx->md_lock.put_read();
     if (from_snap_id == CEPH_NOSNAP) {
@@ -2550,7 +2667,21 @@ reprotect_and_return_err:
 	ldout(ictx->cct, 20) << "diff_iterate object " << p->first << dendl;
 
 	librados::snap_set_t snap_set;
-	int r = head_ctx.list_snaps(p->first.name, &snap_set);
+	int r;
+	uint64_t object_no = p->second.front().objectno;
+	if (use_object_map &&
+	    (object_no >= end_object_map.size() ||
+	     end_object_map.get(object_no) == RBD_OBJECT_NONEXISTENT) &&
+	    (from_snap_id == 0 || object_no >= from_object_map.size() ||
+	     from_object_map.get(object_no) == RBD_OBJECT_NONEXISTENT)) {
+	  r = -ENOENT;
+	} else if (use_object_map && from_prev_snap &&
+		   object_no < end_object_map.size() &&
+		   end_object_map.get(object_no) == RBD_OBJECT_EXISTS_CLEAN) {
+	  continue;
+	} else {
+	  r = head_ctx.list_snaps(p->first.name, &snap_set);
+	}
 	if (r == -ENOENT) {
 	  if (from_snap_id == 0 && !parent_diff.empty()) {
 	    // report parent diff instead
@@ -2863,7 +2994,7 @@ reprotect_and_return_err:
     c->add_request();
     c->init_time(ictx, AIO_TYPE_FLUSH);
     C_AioWrite *req_comp = new C_AioWrite(cct, c);
-    if (ictx->object_cacher) {
+    if (ictx->cache_enabled()) {
       ictx->flush_cache_aio(req_comp);
     } else {
       librados::AioCompletion *rados_completion =
@@ -2899,7 +3030,7 @@ reprotect_and_return_err:
     CephContext *cct = ictx->cct;
     int r;
     // flush any outstanding writes
-    if (ictx->object_cacher) {
+    if (ictx->cache_enabled()) {
       r = ictx->flush_cache();
     } else {
       r = ictx->data_ctx.aio_flush();
@@ -2980,7 +3111,7 @@ reprotect_and_return_err:
       }
 
       C_AioWrite *req_comp = new C_AioWrite(cct, c);
-      if (ictx->object_cacher) {
+      if (ictx->cache_enabled()) {
 	c->add_request();
 	ictx->write_to_cache(p->oid, bl, p->length, p->offset, req_comp);
       } else {
@@ -3085,10 +3216,8 @@ reprotect_and_return_err:
     }
     r = 0;
   done:
-    if (ictx->object_cacher) {
-      Mutex::Locker l(ictx->cache_lock);
-      ictx->object_cacher->discard_set(ictx->object_set, extents);
-    }
+    if (ictx->cache_enabled())
+      ictx->discard_from_cache(extents);
 
     c->finish_adding_requests(ictx->cct);
     c->put();
@@ -3107,6 +3236,84 @@ reprotect_and_return_err:
     req->complete(comp->get_return_value());
   }
 
+  struct C_RBD_Readahead : public Context {
+    ImageCtx *ictx;
+    object_t oid;
+    uint64_t offset;
+    uint64_t length;
+    bufferlist bl;
+    C_RBD_Readahead(ImageCtx *ictx, object_t oid, uint64_t offset,
+		    uint64_t length)
+      : ictx(ictx), oid(oid), offset(offset), length(length) {}
+    void finish(int r) {
+      ldout(ictx->cct, 20) << "C_RBD_Readahead on " << oid << ": " << offset
+			   << "+" << length << " finished with " << r << dendl;
+      ictx->readahead.dec_pending();
+    }
+  };
+
+  /**
+   * Prefetch into the cache ahead of a sequential reader. Stops for
+   * good once rbd_readahead_disable_after_bytes have been read, by
+   * which point the guest OS should have booted and be doing its own
+   * readahead.
+   */
+  static void readahead(ImageCtx *ictx,
+			const vector<pair<uint64_t,uint64_t> >& image_extents)
+  {
+    CephContext *cct = ictx->cct;
+    uint64_t total_bytes = 0;
+    for (vector<pair<uint64_t,uint64_t> >::const_iterator p =
+	   image_extents.begin();
+	 p != image_extents.end(); ++p) {
+      total_bytes += p->second;
+    }
+
+    uint64_t disable_after = cct->_conf->rbd_readahead_disable_after_bytes;
+    if (disable_after > 0 && ictx->total_bytes_read.read() > disable_after)
+      return;
+    ictx->total_bytes_read.add(total_bytes);
+
+    ictx->snap_lock.get_read();
+    uint64_t image_size = ictx->get_image_size(ictx->snap_id);
+    ictx->snap_lock.put_read();
+
+    pair<uint64_t, uint64_t> readahead_extent =
+      ictx->readahead.update(image_extents, image_size);
+    ictx->perfcounter->set(l_librbd_readahead_hit_bytes,
+			   ictx->readahead.get_hit_bytes());
+    ictx->perfcounter->set(l_librbd_readahead_waste_bytes,
+			   ictx->readahead.get_waste_bytes());
+    uint64_t readahead_offset = readahead_extent.first;
+    uint64_t readahead_length = readahead_extent.second;
+    if (readahead_length == 0)
+      return;
+
+    ldout(cct, 20) << "(readahead logical) " << readahead_offset << "~"
+		   << readahead_length << dendl;
+    map<object_t,vector<ObjectExtent> > readahead_object_extents;
+    Striper::file_to_extents(cct, ictx->format_string, &ictx->layout,
+			     readahead_offset, readahead_length, 0,
+			     readahead_object_extents);
+    for (map<object_t,vector<ObjectExtent> >::iterator p =
+	   readahead_object_extents.begin();
+	 p != readahead_object_extents.end(); ++p) {
+      for (vector<ObjectExtent>::iterator q = p->second.begin();
+	   q != p->second.end(); ++q) {
+	ldout(cct, 20) << "(readahead) oid " << q->oid << " " << q->offset
+		       << "~" << q->length << dendl;
+
+	C_RBD_Readahead *req_comp = new C_RBD_Readahead(ictx, q->oid,
+							q->offset, q->length);
+	ictx->readahead.inc_pending();
+	ictx->aio_read_from_cache(q->oid, &req_comp->bl, q->length, q->offset,
+				  req_comp);
+      }
+    }
+    ictx->perfcounter->inc(l_librbd_readahead);
+    ictx->perfcounter->inc(l_librbd_readahead_bytes, readahead_length);
+  }
+
   int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	       char *buf, bufferlist *bl,
 	       AioCompletion *c)
@@ -3130,6 +3337,9 @@ reprotect_and_return_err:
     snap_t snap_id = ictx->snap_id;
     ictx->snap_lock.put_read();
 
+    if (ictx->cache_enabled() && ictx->cct->_conf->rbd_readahead_max_bytes > 0)
+      readahead(ictx, image_extents);
+
     // map
     map<object_t,vector<ObjectExtent> > object_extents;
 
@@ -3171,7 +3381,7 @@ reprotect_and_return_err:
 	req_comp->set_req(req);
 	c->add_request();
 
-	if (ictx->object_cacher) {
+	if (ictx->cache_enabled()) {
 	  C_CacheRead *cache_comp = new C_CacheRead(req);
 	  ictx->aio_read_from_cache(q->oid, &req->data(),
 				    q->length, q->offset,
@@ -47,6 +47,14 @@ enum {
   l_librbd_notify,
   l_librbd_resize,
 
+  l_librbd_readahead,
+  l_librbd_readahead_bytes,
+  l_librbd_readahead_hit_bytes,   // read bytes served by prefetched data
+  l_librbd_readahead_waste_bytes, // prefetched bytes left unread
+
+  l_librbd_copyup_on_read,        // copyups triggered by reads from a parent
+  l_librbd_copyup_on_read_bytes,
+
   l_librbd_last,
 };
 
@@ -1665,7 +1665,7 @@ bool OSDMonitor::prepare_remove_snaps(MRemoveSnaps *m)
   for (map<int, vector<snapid_t> >::iterator p = m->snaps.begin(); 
        p != m->snaps.end();
        ++p) {
-    pg_pool_t& pi = osdmap.pools[p->first];
+    pg_pool_t& pi = (*osdmap.pools)[p->first];
     for (vector<snapid_t>::iterator q = p->second.begin();
 	 q != p->second.end();
 	 ++q) {
@@ -2156,8 +2156,8 @@ void OSDMonitor::get_health(list<pair<health_status_t,string> >& summary,
     // hit_set-less cache_mode?
     if (g_conf->mon_warn_on_cache_pools_without_hit_sets) {
       int problem_cache_pools = 0;
-      for (map<int64_t, pg_pool_t>::const_iterator p = osdmap.pools.begin();
-	   p != osdmap.pools.end();
+      for (map<int64_t, pg_pool_t>::const_iterator p = osdmap.pools->begin();
+	   p != osdmap.pools->end();
 	   ++p) {
 	const pg_pool_t& info = p->second;
 	if (info.cache_mode_requires_hit_set() &&
@@ -2523,8 +2523,8 @@ bool OSDMonitor::preprocess_command(MMonCommand *m)
     cmd_getval(g_ceph_context, cmdmap, "auid", auid, int64_t(0));
     if (f)
       f->open_array_section("pools");
-    for (map<int64_t, pg_pool_t>::iterator p = osdmap.pools.begin();
-	 p != osdmap.pools.end();
+    for (map<int64_t, pg_pool_t>::iterator p = osdmap.pools->begin();
+	 p != osdmap.pools->end();
 	 ++p) {
       if (!auid || p->second.auid == (uint64_t)auid) {
 	if (f) {
@@ -3767,6 +3767,25 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       ss << "expecting value 'true', 'false', '0', or '1'";
       return -EINVAL;
     }
+  } else if (var == "ec_overwrites") {
+    if (!p.is_erasure()) {
+      ss << "ec overwrites can only be enabled for an erasure coded pool";
+      return -EINVAL;
+    }
+    if (val == "true" || (interr.empty() && n == 1)) {
+      int err = check_cluster_features(CEPH_FEATURE_OSD_EC_OVERWRITES, ss);
+      if (err)
+	return err;
+      p.flags |= pg_pool_t::FLAG_EC_OVERWRITES;
+    } else if (val == "false" || (interr.empty() && n == 0)) {
+      if (p.has_flag(pg_pool_t::FLAG_EC_OVERWRITES)) {
+	ss << "ec overwrites cannot be disabled once enabled";
+	return -EINVAL;
+      }
+    } else {
+      ss << "expecting value 'true', 'false', '0', or '1'";
+      return -EINVAL;
+    }
   } else if (var == "hit_set_type") {
     if (val == "none")
       p.hit_set_params = HitSet::Params();
@@ -4448,7 +4467,7 @@ bool OSDMonitor::prepare_command_impl(MMonCommand *m,
     if (erasure_code_profile_in_use(pending_inc.new_pools, name, ss))
       goto wait;
 
-    if (erasure_code_profile_in_use(osdmap.pools, name, ss)) {
+    if (erasure_code_profile_in_use(*osdmap.pools, name, ss)) {
       err = -EBUSY;
       goto reply;
     }
@@ -1002,8 +1002,8 @@ bool PGMonitor::register_new_pgs()
   OSDMap *osdmap = &mon->osdmon()->osdmap;
 
   int created = 0;
-  for (map<int64_t,pg_pool_t>::iterator p = osdmap->pools.begin();
-       p != osdmap->pools.end();
+  for (map<int64_t,pg_pool_t>::iterator p = osdmap->pools->begin();
+       p != osdmap->pools->end();
        ++p) {
     int64_t poolid = p->first;
     pg_pool_t &pool = p->second;
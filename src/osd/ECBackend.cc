@@ -19,6 +19,7 @@
 
 #include "ECUtil.h"
 #include "ECBackend.h"
+#include "common/errno.h"
 #include "messages/MOSDPGPush.h"
 #include "messages/MOSDPGPushReply.h"
 
@@ -173,6 +174,7 @@ ECBackend::ECBackend(
   ErasureCodeInterfaceRef ec_impl,
   uint64_t stripe_width)
   : PGBackend(pg, store, coll, temp_coll),
+    extent_cache(cct->_conf->osd_ec_extent_cache_size),
     cct(cct),
     ec_impl(ec_impl),
     sinfo(ec_impl->get_data_chunk_count(), stripe_width) {
@@ -194,7 +196,10 @@ struct OnRecoveryReadComplete :
     : pg(pg), hoid(hoid) {}
   void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) {
     ECBackend::read_result_t &res = in.second;
-    assert(res.r == 0);
+    if (res.r != 0) {
+      pg->cancel_recovery_read(hoid, res);
+      return;
+    }
     assert(res.errors.empty());
     assert(res.returned.size() == 1);
     pg->handle_recovery_read_complete(
@@ -330,6 +335,19 @@ void ECBackend::handle_recovery_push_reply(
   continue_recovery_op(rop, m);
 }
 
+/// a shard failed the read, recovery of the object starts over later
+void ECBackend::cancel_recovery_read(
+  const hobject_t &hoid,
+  read_result_t &res)
+{
+  dout(0) << __func__ << ": canceling recovery of " << hoid
+	  << ", read errors " << res.errors << dendl;
+  if (!recovery_ops.count(hoid))
+    return;
+  get_parent()->cancel_pull(hoid);
+  recovery_ops.erase(hoid);
+}
+
 void ECBackend::handle_recovery_read_complete(
   const hobject_t &hoid,
   boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > &to_read,
@@ -454,7 +472,8 @@ void ECBackend::dispatch_recovery_messages(RecoveryMessages &m, int priority)
   start_read_op(
     priority,
     m.reads,
-    OpRequestRef());
+    OpRequestRef(),
+    false);
 }
 
 void ECBackend::continue_recovery_op(
@@ -873,7 +892,8 @@ void ECBackend::handle_sub_read(
 	bl,
 	false);
       if (r < 0) {
-	assert(0);
+	dout(0) << __func__ << ": error " << r << " reading " << i->first
+		<< " " << j->first << "~" << j->second << dendl;
 	reply->buffers_read.erase(i->first);
 	reply->errors[i->first] = r;
 	break;
@@ -949,8 +969,9 @@ void ECBackend::handle_sub_read_reply(
       // We canceled this read! @see filter_read_op
       continue;
     }
+    const read_request_t &req = rop.to_read.find(i->first)->second;
     list<pair<uint64_t, uint64_t> >::const_iterator req_iter =
-      rop.to_read.find(i->first)->second.to_read.begin();
+      req.to_read.begin();
     list<
       boost::tuple<
 	uint64_t, uint64_t, map<pg_shard_t, bufferlist> > >::iterator riter =
@@ -958,11 +979,10 @@ void ECBackend::handle_sub_read_reply(
     for (list<pair<uint64_t, bufferlist> >::iterator j = i->second.begin();
 	 j != i->second.end();
 	 ++j, ++req_iter, ++riter) {
-      assert(req_iter != rop.to_read.find(i->first)->second.to_read.end());
+      assert(req_iter != req.to_read.end());
       assert(riter != rop.complete[i->first].returned.end());
       pair<uint64_t, uint64_t> adjusted =
-	sinfo.aligned_offset_len_to_chunk(
-	  *req_iter);
+	req.get_chunk_extent(sinfo, from, *req_iter);
       assert(adjusted.first == j->first);
       riter->get<2>()[from].claim(j->second);
     }
@@ -997,6 +1017,18 @@ shard_to_read_map.find(from);
 
   assert(rop.in_progress.count(from));
   rop.in_progress.erase(from);
+  if (!rop.in_progress.empty() && rop.do_fast_read && fast_read_ready(rop)) {
+    dout(10) << __func__ << " fast read complete, not waiting on "
+	     << rop.in_progress << dendl;
+    for (set<pg_shard_t>::iterator i = rop.in_progress.begin();
+	 i != rop.in_progress.end();
+	 ++i) {
+      // late replies find no read op and are dropped
+      shard_to_read_map[*i].erase(rop.tid);
+    }
+    rop.in_progress.clear();
+    get_parent()->get_logger()->inc(l_osd_ec_read_fast);
+  }
   if (!rop.in_progress.empty()) {
     dout(10) << __func__ << " readop not complete: " << rop << dendl;
   } else {
@@ -1005,6 +1037,34 @@ shard_to_read_map.find(from);
   }
 }
 
+bool ECBackend::fast_read_ready(const ReadOp &rop)
+{
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  set<int> want_to_read;
+  for (int i = 0; i < (int)ec_impl->get_data_chunk_count(); ++i) {
+    int chunk = (int)chunk_mapping.size() > i ? chunk_mapping[i] : i;
+    want_to_read.insert(chunk);
+  }
+  for (map<hobject_t, read_result_t>::const_iterator i = rop.complete.begin();
+       i != rop.complete.end();
+       ++i) {
+    if (i->second.r != 0 || i->second.returned.empty())
+      return false;
+    // every shard replies for all extents at once, the first will do
+    set<int> have;
+    for (map<pg_shard_t, bufferlist>::const_iterator j =
+	   i->second.returned.front().get<2>().begin();
+	 j != i->second.returned.front().get<2>().end();
+	 ++j) {
+      have.insert(j->first.shard);
+    }
+    set<int> need;
+    if (ec_impl->minimum_to_decode(want_to_read, have, &need) < 0)
+      return false;
+  }
+  return true;
+}
+
 void ECBackend::complete_read_op(ReadOp &rop, RecoveryMessages *m)
 {
   map<hobject_t, read_request_t>::iterator reqiter =
@@ -1124,8 +1184,10 @@ void ECBackend::check_recovery_sources(const OSDMapRef osdmap)
 void ECBackend::on_change()
 {
   dout(10) << __func__ << dendl;
+  waiting_state.clear();
   writing.clear();
   tid_to_op_map.clear();
+  extent_cache.clear();
   for (map<ceph_tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
        i != tid_to_read_map.end();
        ++i) {
@@ -1188,12 +1250,25 @@ PGBackend::PGTransaction *ECBackend::get_transaction()
 
 struct MustPrependHashInfo : public ObjectModDesc::Visitor {
   enum { EMPTY, FOUND_APPEND, FOUND_CREATE_STASH } state;
-  MustPrependHashInfo() : state(EMPTY) {}
+  version_t stash_gen;
+  vector<pair<uint64_t, uint64_t> > stash_extents;
+  MustPrependHashInfo() : state(EMPTY), stash_gen(0) {}
   void append(uint64_t) {
     if (state == EMPTY) {
       state = FOUND_APPEND;
     }
   }
+  void rollback_extents(
+    version_t gen,
+    uint64_t old_size,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    // like an append, the object existed before this entry
+    if (state == EMPTY) {
+      state = FOUND_APPEND;
+    }
+    stash_gen = gen;
+    stash_extents = extents;
+  }
   void rmobject(version_t) {
     if (state == EMPTY) {
       state = FOUND_CREATE_STASH;
@@ -1251,11 +1326,23 @@ void ECBackend::submit_transaction(
 	get_hash_info(*i)));
   }
 
+  dout(10) << __func__ << ": op " << *op << " waiting" << dendl;
+  waiting_state.push_back(op);
+  check_waiting_state();
+}
+
+bool ECBackend::plan_write(Op *op)
+{
+  // The hash infos reflect every op started before this one, so this
+  // is the point at which the prior object state is known.
   for (vector<pg_log_entry_t>::iterator i = op->log_entries.begin();
        i != op->log_entries.end();
        ++i) {
     MustPrependHashInfo vis;
     i->mod_desc.visit(&vis);
+    if (!vis.stash_extents.empty()) {
+      op->to_stash[i->soid] = make_pair(vis.stash_gen, vis.stash_extents);
+    }
     if (vis.must_prepend_hash_info()) {
       dout(10) << __func__ << ": stashing HashInfo for "
 	       << i->soid << " for entry " << *i << dendl;
@@ -1272,23 +1359,174 @@ void ECBackend::submit_transaction(
     }
   }
 
-  dout(10) << __func__ << ": op " << *op << " starting" << dendl;
-  start_write(op);
-  writing.push_back(op);
-  dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
+  bool must_wait = false;
+  map<hobject_t, set<uint64_t> > want;
+  op->t->get_rmw_stripes(op->unstable_hash_infos, sinfo, &want);
+  if (op->t->has_overwrites())
+    get_parent()->get_logger()->inc(l_osd_ec_rmw);
+  for (map<hobject_t, set<uint64_t> >::iterator i = want.begin();
+       i != want.end();
+       ++i) {
+    unsigned wanted = i->second.size();
+    extent_cache.lookup(i->first, &(i->second), &(op->stripes[i->first]));
+    get_parent()->get_logger()->inc(
+      l_osd_ec_rmw_cache_hit, wanted - i->second.size());
+    if (i->second.empty())
+      continue;
+    op->to_read[i->first].swap(i->second);
+    if (extent_cache.is_pinned(i->first))
+      must_wait = true;
+  }
+  op->planned = true;
+  dout(10) << __func__ << ": " << *op << " to_read " << op->to_read
+	   << " stashing " << op->to_stash.size() << " objects"
+	   << (must_wait ? " waiting on in flight writes" : "") << dendl;
+  return !must_wait;
 }
 
-int ECBackend::get_min_avail_to_read_shards(
+struct OnRMWReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  OnRMWReadComplete(ECBackend *ec, ceph_tid_t tid) : ec(ec), tid(tid) {}
+  void finish(pair<RecoveryMessages*, ECBackend::read_result_t &> &in) {
+    ec->handle_rmw_read_complete(tid, in.second);
+  }
+};
+
+void ECBackend::handle_rmw_read_complete(
+  ceph_tid_t tid, read_result_t &res)
+{
+  map<ceph_tid_t, Op>::iterator iter = tid_to_op_map.find(tid);
+  assert(iter != tid_to_op_map.end());
+  Op *op = &(iter->second);
+  assert(op->pending_read);
+  assert(op->to_read.size() == 1);
+  const hobject_t &hoid = op->to_read.begin()->first;
+  if (res.r != 0) {
+    // read the stripes again without the shards that failed
+    for (map<pg_shard_t, int>::iterator i = res.errors.begin();
+	 i != res.errors.end();
+	 ++i) {
+      dout(0) << __func__ << ": " << *op << " failed to read " << hoid
+	      << " from " << i->first << ": " << cpp_strerror(i->second)
+	      << dendl;
+      op->read_errors.insert(i->first);
+    }
+    op->pending_read = false;
+    check_waiting_state();
+    return;
+  }
+  map<uint64_t, bufferlist> &out = op->stripes[hoid];
+  for (list<boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > >
+	 ::iterator i = res.returned.begin();
+       i != res.returned.end();
+       ++i) {
+    map<int, bufferlist> to_decode;
+    for (map<pg_shard_t, bufferlist>::iterator j = i->get<2>().begin();
+	 j != i->get<2>().end();
+	 ++j) {
+      to_decode[j->first.shard].claim(j->second);
+    }
+    bufferlist bl;
+    ECUtil::decode(sinfo, ec_impl, to_decode, &bl);
+    assert(bl.length() == i->get<1>());
+    out[i->get<0>()].claim(bl);
+  }
+  op->to_read.erase(op->to_read.begin());
+  op->read_errors.clear();
+  op->pending_read = false;
+  check_waiting_state();
+}
+
+void ECBackend::check_waiting_state()
+{
+  while (!waiting_state.empty()) {
+    Op *op = waiting_state.front();
+    if (op->pending_read || op->read_stalled)
+      return;
+    if (!op->planned) {
+      if (!plan_write(op))
+	return;
+    } else if (!op->to_read.empty() &&
+	       extent_cache.is_pinned(op->to_read.begin()->first)) {
+      return;
+    }
+
+    if (!op->to_read.empty()) {
+      // one object at a time, an op hardly ever overwrites more than one
+      const hobject_t &hoid = op->to_read.begin()->first;
+      set<uint64_t> &stripes = op->to_read.begin()->second;
+      const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+      set<int> want_to_read;
+      for (int i = 0; i < (int)ec_impl->get_data_chunk_count(); ++i) {
+	int chunk = (int)chunk_mapping.size() > i ? chunk_mapping[i] : i;
+	want_to_read.insert(chunk);
+      }
+      set<pg_shard_t> shards;
+      int r = get_min_avail_to_read_shards(
+	hoid,
+	want_to_read,
+	false,
+	&shards,
+	&op->read_errors);
+      if (r < 0) {
+	// The old stripe contents are gone.  The op can't be failed
+	// back to the client now that the pg has logged it, so it and
+	// the writes behind it wait; a new interval requeues them.
+	get_parent()->clog_error() << get_parent()->get_info().pgid
+				   << " cannot read " << hoid
+				   << " to overwrite it, shards "
+				   << op->read_errors << " failed";
+	op->read_stalled = true;
+	return;
+      }
+      list<pair<uint64_t, uint64_t> > extents;
+      for (set<uint64_t>::iterator i = stripes.begin();
+	   i != stripes.end();
+	   ++i) {
+	extents.push_back(make_pair(*i, sinfo.get_stripe_width()));
+      }
+      get_parent()->get_logger()->inc(
+	l_osd_ec_rmw_stripe_read, stripes.size());
+      map<hobject_t, read_request_t> for_read_op;
+      for_read_op.insert(
+	make_pair(
+	  hoid,
+	  read_request_t(
+	    hoid,
+	    extents,
+	    shards,
+	    false,
+	    new OnRMWReadComplete(this, op->tid))));
+      op->pending_read = true;
+      start_read_op(
+	cct->_conf->osd_client_op_priority,
+	for_read_op,
+	op->client_op,
+	false);
+      return;
+    }
+
+    waiting_state.pop_front();
+    dout(10) << __func__ << ": op " << *op << " starting" << dendl;
+    start_write(op);
+    writing.push_back(op);
+    dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
+  }
+}
+
+void ECBackend::get_all_avail_shards(
   const hobject_t &hoid,
-  const set<int> &want,
   bool for_recovery,
-  set<pg_shard_t> *to_read)
+  set<int> *_have,
+  map<shard_id_t, pg_shard_t> *_shards)
 {
   map<hobject_t, set<pg_shard_t> >::const_iterator miter =
     get_parent()->get_missing_loc_shards().find(hoid);
 
-  set<int> have;
-  map<shard_id_t, pg_shard_t> shards;
+  set<int> &have = *_have;
+  map<shard_id_t, pg_shard_t> &shards = *_shards;
 
   for (set<pg_shard_t>::const_iterator i =
 	 get_parent()->get_acting_shards().begin();
@@ -1338,6 +1576,29 @@ int ECBackend::get_min_avail_to_read_shards(
       }
     }
   }
+}
+
+int ECBackend::get_min_avail_to_read_shards(
+  const hobject_t &hoid,
+  const set<int> &want,
+  bool for_recovery,
+  set<pg_shard_t> *to_read,
+  const set<pg_shard_t> *skip)
+{
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  get_all_avail_shards(hoid, for_recovery, &have, &shards);
+  if (skip) {
+    for (set<pg_shard_t>::const_iterator i = skip->begin();
+	 i != skip->end();
+	 ++i) {
+      map<shard_id_t, pg_shard_t>::iterator j = shards.find(i->shard);
+      if (j != shards.end() && j->second == *i) {
+	have.erase(i->shard);
+	shards.erase(j);
+      }
+    }
+  }
 
   set<int> need;
   int r = ec_impl->minimum_to_decode(want, have, &need);
@@ -1359,13 +1620,15 @@ int ECBackend::get_min_avail_to_read_shards(
 void ECBackend::start_read_op(
   int priority,
   map<hobject_t, read_request_t> &to_read,
-  OpRequestRef _op)
+  OpRequestRef _op,
+  bool do_fast_read)
 {
   ceph_tid_t tid = get_parent()->get_tid();
   assert(!tid_to_read_map.count(tid));
   ReadOp &op(tid_to_read_map[tid]);
   op.priority = priority;
   op.tid = tid;
+  op.do_fast_read = do_fast_read;
   op.to_read.swap(to_read);
   op.op = _op;
   dout(10) << __func__ << ": starting " << op << dendl;
@@ -1397,13 +1660,11 @@ void ECBackend::start_read_op(
 	  j->first,
 	  j->second,
 	  map<pg_shard_t, bufferlist>()));
-      pair<uint64_t, uint64_t> chunk_off_len =
-	sinfo.aligned_offset_len_to_chunk(
-	  *j);
       for (set<pg_shard_t>::const_iterator k = i->second.need.begin();
 	   k != i->second.need.end();
 	   ++k) {
-	messages[*k].to_read[i->first].push_back(chunk_off_len);
+	messages[*k].to_read[i->first].push_back(
+	  i->second.get_chunk_extent(sinfo, *k, *j));
       }
       assert(!need_attrs);
     }
@@ -1482,8 +1743,14 @@ void ECBackend::check_op(Op *op)
     // done!
     assert(writing.front() == op);
     dout(10) << __func__ << " Completing " << *op << dendl;
+    for (set<hobject_t>::iterator i = op->pinned.begin();
+	 i != op->pinned.end();
+	 ++i) {
+      extent_cache.unpin(*i);
+    }
     writing.pop_front();
     tid_to_op_map.erase(op->tid);
+    check_waiting_state();
   }
   for (map<ceph_tid_t, Op>::iterator i = tid_to_op_map.begin();
        i != tid_to_op_map.end();
@@ -1500,15 +1767,42 @@ void ECBackend::start_write(Op *op) {
        ++i) {
     trans[i->shard];
   }
+  set<hobject_t> replaced;
   op->t->generate_transactions(
     op->unstable_hash_infos,
     ec_impl,
     get_parent()->get_info().pgid.pgid,
     sinfo,
+    op->to_stash,
+    &(op->stripes),
+    &replaced,
     &trans,
     &(op->temp_added),
     &(op->temp_cleared));
 
+  // the written stripes stay pinned until every shard has applied them
+  for (map<hobject_t, ECUtil::HashInfoRef>::iterator i =
+	 op->unstable_hash_infos.begin();
+       i != op->unstable_hash_infos.end();
+       ++i) {
+    extent_cache.pin(i->first);
+    op->pinned.insert(i->first);
+  }
+  for (set<hobject_t>::iterator i = replaced.begin();
+       i != replaced.end();
+       ++i) {
+    extent_cache.invalidate(*i);
+  }
+  if (op->t->has_overwrites()) {
+    for (map<hobject_t, map<uint64_t, bufferlist> >::iterator i =
+	   op->stripes.begin();
+	 i != op->stripes.end();
+	 ++i) {
+      extent_cache.insert(i->first, i->second);
+    }
+  }
+  op->stripes.clear();
+
   dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
 
   for (set<pg_shard_t>::const_iterator i =
@@ -1573,6 +1867,8 @@ struct CallClientContexts :
   ECBackend::ClientAsyncReadStatus *status;
   list<pair<pair<uint64_t, uint64_t>,
 	    pair<bufferlist*, Context*> > > to_read;
+  /// shard -> (data chunk index, chunk offset read) for a partial read
+  map<int, pair<unsigned, uint64_t> > partial;
   CallClientContexts(
     ECBackend *ec,
     ECBackend::ClientAsyncReadStatus *status,
@@ -1581,9 +1877,48 @@ struct CallClientContexts :
     : ec(ec), status(status), to_read(to_read) {}
   void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) {
     ECBackend::read_result_t &res = in.second;
+    if (res.r != 0) {
+      for (list<pair<pair<uint64_t, uint64_t>,
+		     pair<bufferlist*, Context*> > >::iterator i =
+	     to_read.begin();
+	   i != to_read.end();
+	   to_read.erase(i++)) {
+	if (i->second.second)
+	  i->second.second->complete(res.r);
+      }
+      status->r = res.r;
+      finish_status();
+      return;
+    }
     assert(res.returned.size() == to_read.size());
-    assert(res.r == 0);
     assert(res.errors.empty());
+    if (!partial.empty()) {
+      assert(to_read.size() == 1);
+      map<unsigned, pair<uint64_t, bufferlist> > chunks;
+      for (map<pg_shard_t, bufferlist>::iterator j =
+	     res.returned.front().get<2>().begin();
+	   j != res.returned.front().get<2>().end();
+	   ++j) {
+	map<int, pair<unsigned, uint64_t> >::iterator p =
+	  partial.find(j->first.shard);
+	assert(p != partial.end());
+	chunks[p->second.first].first = p->second.second;
+	chunks[p->second.first].second.claim(j->second);
+      }
+      bufferlist *out = to_read.front().second.first;
+      assert(out);
+      ECUtil::reassemble(
+	ec->sinfo,
+	chunks,
+	to_read.front().first.first,
+	to_read.front().first.second,
+	out);
+      if (to_read.front().second.second) {
+	to_read.front().second.second->complete(out->length());
+      }
+      to_read.pop_front();
+      res.returned.pop_front();
+    }
     for (list<pair<pair<uint64_t, uint64_t>,
 		   pair<bufferlist*, Context*> > >::iterator i = to_read.begin();
 	 i != to_read.end();
@@ -1616,12 +1951,15 @@ struct CallClientContexts :
       }
       res.returned.pop_front();
     }
+    finish_status();
+  }
+  void finish_status() {
     status->complete = true;
     list<ECBackend::ClientAsyncReadStatus> &ip =
       ec->in_progress_client_reads;
     while (ip.size() && ip.front().complete) {
       if (ip.front().on_complete) {
-	ip.front().on_complete->complete(0);
+	ip.front().on_complete->complete(ip.front().r);
 	ip.front().on_complete = NULL;
       }
       ip.pop_front();
@@ -1646,6 +1984,20 @@ void ECBackend::objects_read_async(
   in_progress_client_reads.push_back(ClientAsyncReadStatus(on_complete));
   CallClientContexts *c = new CallClientContexts(
     this, &(in_progress_client_reads.back()), to_read);
+  bool fast_read = cct->_conf->osd_ec_fast_read;
+  map<hobject_t, read_request_t> for_read_op;
+
+  if (!fast_read && to_read.size() == 1 &&
+      objects_read_partial(hoid, to_read.front().first, c, &for_read_op)) {
+    get_parent()->get_logger()->inc(l_osd_ec_read_partial);
+    start_read_op(
+      cct->_conf->osd_client_op_priority,
+      for_read_op,
+      OpRequestRef(),
+      false);
+    return;
+  }
+
   list<pair<uint64_t, uint64_t> > offsets;
   for (list<pair<pair<uint64_t, uint64_t>,
 		 pair<bufferlist*, Context*> > >::const_iterator i =
@@ -1663,14 +2015,27 @@ void ECBackend::objects_read_async(
     want_to_read.insert(chunk);
   }
   set<pg_shard_t> shards;
-  int r = get_min_avail_to_read_shards(
-    hoid,
-    want_to_read,
-    false,
-    &shards);
-  assert(r == 0);
+  if (fast_read) {
+    set<int> have;
+    map<shard_id_t, pg_shard_t> avail;
+    get_all_avail_shards(hoid, false, &have, &avail);
+    set<int> need;
+    int r = ec_impl->minimum_to_decode(want_to_read, have, &need);
+    assert(r == 0);
+    for (map<shard_id_t, pg_shard_t>::iterator i = avail.begin();
+	 i != avail.end();
+	 ++i) {
+      shards.insert(i->second);
+    }
+  } else {
+    int r = get_min_avail_to_read_shards(
+      hoid,
+      want_to_read,
+      false,
+      &shards);
+    assert(r == 0);
+  }
 
-  map<hobject_t, read_request_t> for_read_op;
   for_read_op.insert(
     make_pair(
       hoid,
@@ -1684,10 +2049,68 @@ void ECBackend::objects_read_async(
   start_read_op(
     cct->_conf->osd_client_op_priority,
     for_read_op,
-    OpRequestRef());
+    OpRequestRef(),
+    fast_read);
   return;
 }
 
+bool ECBackend::objects_read_partial(
+  const hobject_t &hoid,
+  const pair<uint64_t, uint64_t> &extent,
+  CallClientContexts *c,
+  map<hobject_t, read_request_t> *for_read_op)
+{
+  if (extent.second == 0)
+    return false;
+
+  // only the data chunks holding the extent, if all of them are readable
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  set<int> want_to_read;
+  map<int, pair<unsigned, uint64_t> > partial;
+  map<int, pair<uint64_t, uint64_t> > chunk_extents;
+  for (unsigned i = 0; i < ec_impl->get_data_chunk_count(); ++i) {
+    pair<uint64_t, uint64_t> chunk_extent;
+    if (!sinfo.logical_to_chunk_extent(
+	  i, extent.first, extent.second, &chunk_extent))
+      continue;
+    int chunk = chunk_mapping.size() > i ? chunk_mapping[i] : i;
+    want_to_read.insert(chunk);
+    partial[chunk] = make_pair(i, chunk_extent.first);
+    chunk_extents[chunk] = chunk_extent;
+  }
+
+  set<pg_shard_t> shards;
+  int r = get_min_avail_to_read_shards(
+    hoid,
+    want_to_read,
+    false,
+    &shards);
+  if (r < 0)
+    return false;
+  map<pg_shard_t, pair<uint64_t, uint64_t> > subchunks;
+  for (set<pg_shard_t>::iterator i = shards.begin(); i != shards.end(); ++i) {
+    if (!want_to_read.count(i->shard)) {
+      // degraded, the missing data chunk has to be decoded
+      return false;
+    }
+    subchunks[*i] = chunk_extents[i->shard];
+  }
+  dout(10) << __func__ << ": " << hoid << " " << extent
+	   << " from " << subchunks << dendl;
+
+  c->partial.swap(partial);
+  for_read_op->insert(
+    make_pair(
+      hoid,
+      read_request_t(
+	hoid,
+	sinfo.offset_len_to_stripe_bounds(extent),
+	shards,
+	subchunks,
+	c)));
+  return true;
+}
+
 
 int ECBackend::objects_get_attrs(
   const hobject_t &hoid,
@@ -1724,6 +2147,28 @@ void ECBackend::rollback_append(
       old_size));
 }
 
+void ECBackend::rollback_extents(
+  const hobject_t &hoid,
+  version_t gen,
+  uint64_t old_size,
+  const vector<pair<uint64_t, uint64_t> > &extents,
+  ObjectStore::Transaction *t)
+{
+  assert(old_size % sinfo.get_stripe_width() == 0);
+  vector<pair<uint64_t, uint64_t> > chunk_extents;
+  for (vector<pair<uint64_t, uint64_t> >::const_iterator i = extents.begin();
+       i != extents.end();
+       ++i) {
+    chunk_extents.push_back(sinfo.aligned_offset_len_to_chunk(*i));
+  }
+  PGBackend::rollback_extents(
+    hoid,
+    gen,
+    sinfo.aligned_logical_offset_to_chunk_offset(old_size),
+    chunk_extents,
+    t);
+}
+
 void ECBackend::be_deep_scrub(
   const hobject_t &poid,
   ScrubMap::object &o,
@@ -1763,7 +2208,9 @@ void ECBackend::be_deep_scrub(
     o.read_error = true;
   }
 
-  if (hinfo->get_chunk_hash(get_parent()->whoami_shard().shard) != h.digest()) {
+  if (hinfo->has_chunk_hash() &&
+      hinfo->get_chunk_hash(get_parent()->whoami_shard().shard) !=
+      h.digest()) {
     dout(0) << "_scan_list  " << poid << " got incorrect hash on read" << dendl;
     o.read_error = true;
   }
@@ -1779,8 +2226,13 @@ void ECBackend::be_deep_scrub(
    * we match our chunk hash and our recollection of the hash for
    * chunk 0 matches that of our peers, there is likely no corruption.
    */
-  o.digest = hinfo->get_chunk_hash(0);
-  o.digest_present = true;
+  if (hinfo->has_chunk_hash()) {
+    o.digest = hinfo->get_chunk_hash(0);
+    o.digest_present = true;
+  } else {
+    // overwritten objects carry no hashes to compare
+    o.digest_present = false;
+  }
 
   o.omap_digest = 0;
   o.omap_digest_present = true;
@@ -29,6 +29,7 @@
 #include "messages/MOSDECSubOpReadReply.h"
 
 struct RecoveryMessages;
+struct CallClientContexts;
 class ECBackend : public PGBackend {
 public:
   RecoveryHandle *open_recovery_op();
@@ -135,9 +136,10 @@ public:
   friend struct CallClientContexts;
   struct ClientAsyncReadStatus {
     bool complete;
+    int r;
     Context *on_complete;
     ClientAsyncReadStatus(Context *on_complete)
-    : complete(false), on_complete(on_complete) {}
+    : complete(false), r(0), on_complete(on_complete) {}
   };
   list<ClientAsyncReadStatus> in_progress_client_reads;
   void objects_read_async(
@@ -253,6 +255,13 @@ public:
    * Rather than handling reads on the primary directly, we simply send
    * ourselves a message.  This avoids a dedicated primary path for that
    * part.
+   *
+   * A request may restrict each shard to a sub range of the chunk
+   * extent (subchunks): a small client read whose data chunks are all
+   * available only reads the bytes it needs from the data shards and
+   * reassembles them without decoding.  A fast read (osd_ec_fast_read)
+   * instead asks every available shard and completes as soon as the
+   * replies received suffice to decode, ignoring the stragglers.
    */
   struct read_result_t {
     int r;
@@ -267,6 +276,9 @@ public:
     const list<pair<uint64_t, uint64_t> > to_read;
     const set<pg_shard_t> need;
     const bool want_attrs;
+    /// if not empty, to_read is a single extent and each shard only
+    /// reads this chunk range of it
+    const map<pg_shard_t, pair<uint64_t, uint64_t> > subchunks;
     GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb;
     read_request_t(
       const hobject_t &hoid,
@@ -276,6 +288,25 @@ public:
       GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb)
       : to_read(to_read), need(need), want_attrs(want_attrs),
 	cb(cb) {}
+    read_request_t(
+      const hobject_t &hoid,
+      const pair<uint64_t, uint64_t> &extent,
+      const set<pg_shard_t> &need,
+      const map<pg_shard_t, pair<uint64_t, uint64_t> > &subchunks,
+      GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb)
+      : to_read(1, extent), need(need), want_attrs(false),
+	subchunks(subchunks), cb(cb) {}
+    pair<uint64_t, uint64_t> get_chunk_extent(
+      const ECUtil::stripe_info_t &sinfo,
+      pg_shard_t shard,
+      const pair<uint64_t, uint64_t> &extent) const {
+      if (subchunks.empty())
+	return sinfo.aligned_offset_len_to_chunk(extent);
+      map<pg_shard_t, pair<uint64_t, uint64_t> >::const_iterator i =
+	subchunks.find(shard);
+      assert(i != subchunks.end());
+      return i->second;
+    }
   };
   friend ostream &operator<<(ostream &lhs, const read_request_t &rhs);
 
@@ -283,6 +314,7 @@ public:
     int priority;
     ceph_tid_t tid;
     OpRequestRef op; // may be null if not on behalf of a client
+    bool do_fast_read; // complete once the replies so far can be decoded
 
     map<hobject_t, read_request_t> to_read;
     map<hobject_t, read_result_t> complete;
@@ -293,8 +325,11 @@ public:
     void dump(Formatter *f) const;
 
     set<pg_shard_t> in_progress;
+
+    ReadOp() : priority(0), tid(0), do_fast_read(false) {}
   };
   friend struct FinishReadOp;
+  bool fast_read_ready(const ReadOp &rop);
   void filter_read_op(
     const OSDMapRef osdmap,
     ReadOp &op);
@@ -305,7 +340,8 @@ public:
   void start_read_op(
     int priority,
     map<hobject_t, read_request_t> &to_read,
-    OpRequestRef op);
+    OpRequestRef op,
+    bool do_fast_read);
 
 
   /**
@@ -320,6 +356,17 @@ public:
    * As with client reads, there is a possibility of out-of-order
    * completions. Thus, callbacks and completion are called in order
    * on the writing list.
+   *
+   * Overwrites (pools with FLAG_EC_OVERWRITES) need the old contents
+   * of any stripe they only partially cover.  Ops therefore first wait,
+   * in order, on the waiting_state list: once an op reaches the front
+   * its partial stripes are looked up in the extent cache and the rest
+   * are read from the shards.  An op which must read an object with
+   * writes still in flight waits for those to complete first, since the
+   * shards might not have applied them yet; every stripe written by an
+   * in flight op is pinned in the extent cache, so sequential small
+   * overwrites normally never wait.  Once its stripes are available the
+   * op is encoded and moves to the writing list.
    */
   struct Op {
     hobject_t hoid;
@@ -344,6 +391,24 @@ public:
     set<pg_shard_t> pending_apply;
 
     map<hobject_t, ECUtil::HashInfoRef> unstable_hash_infos;
+
+    /// read-modify-write state, valid while on waiting_state
+    bool planned;
+    bool pending_read;
+    map<hobject_t, set<uint64_t> > to_read;
+    ECTransaction::stash_extents_t to_stash;
+    /// logical stripe contents for rmw, keyed by object
+    map<hobject_t, map<uint64_t, bufferlist> > stripes;
+    /// objects pinned in the extent cache until completion
+    set<hobject_t> pinned;
+    /// shards that failed to read the object at the front of to_read
+    set<pg_shard_t> read_errors;
+    /// too few shards could be read, the op waits for a new interval
+    bool read_stalled;
+
+    Op() : on_local_applied_sync(0), on_all_applied(0), on_all_commit(0),
+	   tid(0), t(0), planned(false), pending_read(false),
+	   read_stalled(false) {}
     ~Op() {
       delete t;
       delete on_local_applied_sync;
@@ -364,6 +429,7 @@ public:
     boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > &to_read,
     boost::optional<map<string, bufferlist> > attrs,
     RecoveryMessages *m);
+  void cancel_recovery_read(const hobject_t &hoid, read_result_t &res);
   void handle_recovery_push(
     PushOp &op,
     RecoveryMessages *m);
@@ -373,8 +439,15 @@ public:
     RecoveryMessages *m);
 
   map<ceph_tid_t, Op> tid_to_op_map; /// lists below point into here
+  list<Op*> waiting_state;
   list<Op*> writing;
 
+  ECUtil::ExtentCache extent_cache;
+  friend struct OnRMWReadComplete;
+  void check_waiting_state();
+  bool plan_write(Op *op);
+  void handle_rmw_read_complete(ceph_tid_t tid, read_result_t &res);
+
   CephContext *cct;
   ErasureCodeInterfaceRef ec_impl;
 
@@ -447,12 +520,31 @@ public:
     ErasureCodeInterfaceRef ec_impl,
     uint64_t stripe_width);
 
+  /**
+   * Sets up a read of extent from only the data shards holding it,
+   * returns false if one of them is unavailable (the read must then
+   * decode).
+   */
+  bool objects_read_partial(
+    const hobject_t &hoid,
+    const pair<uint64_t, uint64_t> &extent,
+    CallClientContexts *c,
+    map<hobject_t, read_request_t> *for_read_op);
+
+  /// Returns the shards which have hoid and may be read from
+  void get_all_avail_shards(
+    const hobject_t &hoid,
+    bool for_recovery,
+    set<int> *have,
+    map<shard_id_t, pg_shard_t> *shards);
+
   /// Returns to_read replicas sufficient to reconstruct want
   int get_min_avail_to_read_shards(
     const hobject_t &hoid,     ///< [in] object
     const set<int> &want,      ///< [in] desired shards
     bool for_recovery,         ///< [in] true if we may use non-acting replicas
-    set<pg_shard_t> *to_read   ///< [out] shards to read
+    set<pg_shard_t> *to_read,  ///< [out] shards to read
+    const set<pg_shard_t> *skip = NULL ///< [in] shards not to read from
     ); ///< @return error code, 0 on success
 
   int objects_get_attrs(
@@ -464,6 +556,13 @@ public:
     uint64_t old_size,
     ObjectStore::Transaction *t);
 
+  void rollback_extents(
+    const hobject_t &hoid,
+    version_t gen,
+    uint64_t old_size,
+    const vector<pair<uint64_t, uint64_t> > &extents,
+    ObjectStore::Transaction *t);
+
   bool scrub_supported() { return true; }
 
   void be_deep_scrub(
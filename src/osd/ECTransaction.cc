@@ -29,6 +29,9 @@ struct AppendObjectsGenerator: public boost::static_visitor<void> {
   void operator()(const ECTransaction::AppendOp &op) {
     out->insert(op.oid);
   }
+  void operator()(const ECTransaction::WriteOp &op) {
+    out->insert(op.oid);
+  }
   void operator()(const ECTransaction::TouchOp &op) {}
   void operator()(const ECTransaction::CloneOp &op) {
     out->insert(op.source);
@@ -56,6 +59,102 @@ void ECTransaction::get_append_objects(
   reverse_visit(gen);
 }
 
+struct RMWPlanner : public boost::static_visitor<void> {
+  typedef void result_type;
+  map<hobject_t, ECUtil::HashInfoRef> &hash_infos;
+  const ECUtil::stripe_info_t &sinfo;
+  map<hobject_t, set<uint64_t> > *out;
+
+  /// object whose pre-transaction contents each object now holds, if any
+  map<hobject_t, boost::optional<hobject_t> > origin;
+  /// stripes already written by earlier ops in the transaction
+  map<hobject_t, set<uint64_t> > written;
+
+  RMWPlanner(
+    map<hobject_t, ECUtil::HashInfoRef> &hash_infos,
+    const ECUtil::stripe_info_t &sinfo,
+    map<hobject_t, set<uint64_t> > *out)
+    : hash_infos(hash_infos), sinfo(sinfo), out(out) {}
+
+  boost::optional<hobject_t> get_origin(const hobject_t &hoid) {
+    map<hobject_t, boost::optional<hobject_t> >::iterator i =
+      origin.find(hoid);
+    if (i == origin.end())
+      return hoid;
+    return i->second;
+  }
+  void mark_written(const hobject_t &hoid, uint64_t off, uint64_t len) {
+    set<uint64_t> &w = written[hoid];
+    for (uint64_t i = sinfo.logical_to_prev_stripe_offset(off);
+	 i < off + len;
+	 i += sinfo.get_stripe_width()) {
+      w.insert(i);
+    }
+  }
+  void replace(const hobject_t &hoid, const hobject_t &from) {
+    origin[hoid] = get_origin(from);
+    map<hobject_t, set<uint64_t> >::iterator i = written.find(from);
+    if (i != written.end())
+      written[hoid] = i->second;
+    else
+      written.erase(hoid);
+  }
+  void clear(const hobject_t &hoid) {
+    origin[hoid] = boost::optional<hobject_t>();
+    written.erase(hoid);
+  }
+
+  void operator()(const ECTransaction::AppendOp &op) {
+    mark_written(op.oid, op.off, op.bl.length());
+  }
+  void operator()(const ECTransaction::WriteOp &op) {
+    boost::optional<hobject_t> from = get_origin(op.oid);
+    if (from) {
+      assert(hash_infos.count(*from));
+      uint64_t old_size = sinfo.aligned_chunk_offset_to_logical_offset(
+	hash_infos[*from]->get_total_chunk_size());
+      set<uint64_t> partial;
+      sinfo.get_partial_stripes(op.off, op.bl.length(), old_size, &partial);
+      set<uint64_t> &w = written[op.oid];
+      for (set<uint64_t>::iterator i = partial.begin();
+	   i != partial.end();
+	   ++i) {
+	if (!w.count(*i))
+	  (*out)[*from].insert(*i);
+      }
+    }
+    mark_written(op.oid, op.off, op.bl.length());
+  }
+  void operator()(const ECTransaction::CloneOp &op) {
+    replace(op.target, op.source);
+  }
+  void operator()(const ECTransaction::RenameOp &op) {
+    replace(op.destination, op.source);
+    clear(op.source);
+  }
+  void operator()(const ECTransaction::StashOp &op) {
+    clear(op.oid);
+  }
+  void operator()(const ECTransaction::RemoveOp &op) {
+    clear(op.oid);
+  }
+  void operator()(const ECTransaction::TouchOp &op) {}
+  void operator()(const ECTransaction::SetAttrsOp &op) {}
+  void operator()(const ECTransaction::RmAttrOp &op) {}
+  void operator()(const ECTransaction::AllocHintOp &op) {}
+  void operator()(const ECTransaction::NoOp &op) {}
+};
+void ECTransaction::get_rmw_stripes(
+  map<hobject_t, ECUtil::HashInfoRef> &hash_infos,
+  const ECUtil::stripe_info_t &sinfo,
+  map<hobject_t, set<uint64_t> > *out) const
+{
+  if (!overwrites)
+    return;
+  RMWPlanner planner(hash_infos, sinfo, out);
+  visit(planner);
+}
+
 struct TransGenerator : public boost::static_visitor<void> {
   typedef void result_type;
   map<hobject_t, ECUtil::HashInfoRef> &hash_infos;
@@ -63,6 +162,8 @@ struct TransGenerator : public boost::static_visitor<void> {
   ErasureCodeInterfaceRef &ecimpl;
   const pg_t pgid;
   const ECUtil::stripe_info_t sinfo;
+  map<hobject_t, map<uint64_t, bufferlist> > *stripes;
+  set<hobject_t> *replaced;
   map<shard_id_t, ObjectStore::Transaction> *trans;
   set<int> want;
   set<hobject_t> *temp_added;
@@ -73,6 +174,8 @@ struct TransGenerator : public boost::static_visitor<void> {
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
+    map<hobject_t, map<uint64_t, bufferlist> > *stripes,
+    set<hobject_t> *replaced,
     map<shard_id_t, ObjectStore::Transaction> *trans,
     set<hobject_t> *temp_added,
     set<hobject_t> *temp_removed,
@@ -80,6 +183,7 @@ struct TransGenerator : public boost::static_visitor<void> {
     : hash_infos(hash_infos),
       ecimpl(ecimpl), pgid(pgid),
       sinfo(sinfo),
+      stripes(stripes), replaced(replaced),
       trans(trans),
       temp_added(temp_added), temp_removed(temp_removed),
       out(out) {
@@ -146,6 +250,7 @@ struct TransGenerator : public boost::static_visitor<void> {
       hbuf);
 
     assert(r == 0);
+    record_stripes(op.oid, offset, bl);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -165,10 +270,139 @@ struct TransGenerator : public boost::static_visitor<void> {
 	hbuf);
     }
   }
+  void operator()(const ECTransaction::WriteOp &op) {
+    assert(op.bl.length());
+    assert(hash_infos.count(op.oid));
+    ECUtil::HashInfoRef hinfo = hash_infos[op.oid];
+    const uint64_t stripe_width = sinfo.get_stripe_width();
+    const uint64_t end = op.off + op.bl.length();
+    pair<uint64_t, uint64_t> bounds = sinfo.offset_len_to_stripe_bounds(
+      make_pair(op.off, (uint64_t)op.bl.length()));
+
+    // assemble whole stripes from the new data, falling back on the old
+    // contents (read back or written earlier) or zeros past the end
+    map<uint64_t, bufferlist> &cur = (*stripes)[op.oid];
+    bufferlist bl;
+    for (uint64_t soff = bounds.first;
+	 soff < bounds.first + bounds.second;
+	 soff += stripe_width) {
+      bufferlist stripe;
+      if (sinfo.covers_stripe(soff, op.off, op.bl.length())) {
+	stripe.substr_of(op.bl, soff - op.off, stripe_width);
+      } else {
+	bufferlist old;
+	map<uint64_t, bufferlist>::iterator i = cur.find(soff);
+	if (i != cur.end()) {
+	  old = i->second;
+	} else {
+	  assert(sinfo.aligned_logical_offset_to_chunk_offset(soff) >=
+		 hinfo->get_total_chunk_size());
+	  old.append_zero(stripe_width);
+	}
+	assert(old.length() == stripe_width);
+	uint64_t start = MAX(soff, op.off);
+	uint64_t stop = MIN(soff + stripe_width, end);
+	if (start > soff) {
+	  bufferlist head;
+	  head.substr_of(old, 0, start - soff);
+	  stripe.claim_append(head);
+	}
+	bufferlist mid;
+	mid.substr_of(op.bl, start - op.off, stop - start);
+	stripe.claim_append(mid);
+	if (stop < soff + stripe_width) {
+	  bufferlist tail;
+	  tail.substr_of(old, stop - soff, soff + stripe_width - stop);
+	  stripe.claim_append(tail);
+	}
+      }
+      assert(stripe.length() == stripe_width);
+      cur[soff] = stripe;
+      bl.append(stripe);
+    }
+
+    map<int, bufferlist> buffers;
+    int r = ECUtil::encode(
+      sinfo, ecimpl, bl, want, &buffers);
+    assert(r == 0);
+
+    uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(
+      bounds.first);
+    uint64_t chunk_end = chunk_off +
+      sinfo.aligned_logical_offset_to_chunk_offset(bounds.second);
+    hinfo->set_total_chunk_size_clear_hash(
+      MAX(hinfo->get_total_chunk_size(), chunk_end));
+    bufferlist hbuf;
+    ::encode(
+      *hinfo,
+      hbuf);
+
+    for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
+	 i != trans->end();
+	 ++i) {
+      assert(buffers.count(i->first));
+      bufferlist &enc_bl = buffers[i->first];
+      assert(enc_bl.length() == chunk_end - chunk_off);
+      i->second.write(
+	get_coll_ct(i->first, op.oid),
+	ghobject_t(op.oid, ghobject_t::NO_GEN, i->first),
+	chunk_off,
+	enc_bl.length(),
+	enc_bl);
+      i->second.setattr(
+	get_coll_ct(i->first, op.oid),
+	ghobject_t(op.oid, ghobject_t::NO_GEN, i->first),
+	ECUtil::get_hinfo_key(),
+	hbuf);
+    }
+  }
+  void stash_extents(
+    const hobject_t &hoid,
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    assert(hash_infos.count(hoid));
+    uint64_t size = hash_infos[hoid]->get_total_chunk_size();
+    for (vector<pair<uint64_t, uint64_t> >::const_iterator j = extents.begin();
+	 j != extents.end();
+	 ++j) {
+      pair<uint64_t, uint64_t> chunk = sinfo.aligned_offset_len_to_chunk(*j);
+      if (chunk.first >= size)
+	continue;
+      chunk.second = MIN(chunk.second, size - chunk.first);
+      for (map<shard_id_t, ObjectStore::Transaction>::iterator i =
+	     trans->begin();
+	   i != trans->end();
+	   ++i) {
+	i->second.clone_range(
+	  get_coll(i->first, hoid),
+	  ghobject_t(hoid, ghobject_t::NO_GEN, i->first),
+	  ghobject_t(hoid, gen, i->first),
+	  chunk.first,
+	  chunk.second,
+	  chunk.first);
+      }
+    }
+  }
+  void record_stripes(const hobject_t &hoid, uint64_t off, bufferlist &bl) {
+    assert(off % sinfo.get_stripe_width() == 0);
+    assert(bl.length() % sinfo.get_stripe_width() == 0);
+    map<uint64_t, bufferlist> &cur = (*stripes)[hoid];
+    for (uint64_t i = 0; i < bl.length(); i += sinfo.get_stripe_width()) {
+      cur[off + i].substr_of(bl, i, sinfo.get_stripe_width());
+    }
+  }
+  void replace_stripes(const hobject_t &hoid, const hobject_t *from) {
+    replaced->insert(hoid);
+    if (from && stripes->count(*from))
+      (*stripes)[hoid] = (*stripes)[*from];
+    else
+      stripes->erase(hoid);
+  }
   void operator()(const ECTransaction::CloneOp &op) {
     assert(hash_infos.count(op.source));
     assert(hash_infos.count(op.target));
     *(hash_infos[op.target]) = *(hash_infos[op.source]);
+    replace_stripes(op.target, &op.source);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -183,6 +417,8 @@ struct TransGenerator : public boost::static_visitor<void> {
     assert(hash_infos.count(op.destination));
     *(hash_infos[op.destination]) = *(hash_infos[op.source]);
     hash_infos[op.source]->clear();
+    replace_stripes(op.destination, &op.source);
+    replace_stripes(op.source, 0);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -196,6 +432,7 @@ struct TransGenerator : public boost::static_visitor<void> {
   void operator()(const ECTransaction::StashOp &op) {
     assert(hash_infos.count(op.oid));
     hash_infos[op.oid]->clear();
+    replace_stripes(op.oid, 0);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -210,6 +447,7 @@ struct TransGenerator : public boost::static_visitor<void> {
   void operator()(const ECTransaction::RemoveOp &op) {
     assert(hash_infos.count(op.oid));
     hash_infos[op.oid]->clear();
+    replace_stripes(op.oid, 0);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -265,6 +503,9 @@ void ECTransaction::generate_transactions(
   ErasureCodeInterfaceRef &ecimpl,
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
+  const stash_extents_t &to_stash,
+  map<hobject_t, map<uint64_t, bufferlist> > *stripes,
+  set<hobject_t> *replaced,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
   set<hobject_t> *temp_added,
   set<hobject_t> *temp_removed,
@@ -275,9 +516,17 @@ void ECTransaction::generate_transactions(
     ecimpl,
     pgid,
     sinfo,
+    stripes,
+    replaced,
     transactions,
     temp_added,
     temp_removed,
     out);
+  // stash extents as they were before any op in this transaction
+  for (stash_extents_t::const_iterator i = to_stash.begin();
+       i != to_stash.end();
+       ++i) {
+    gen.stash_extents(i->first, i->second.first, i->second.second);
+  }
   visit(gen);
 }
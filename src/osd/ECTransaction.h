@@ -31,6 +31,13 @@ public:
     AppendOp(const hobject_t &oid, uint64_t off, bufferlist &bl)
       : oid(oid), off(off), bl(bl) {}
   };
+  struct WriteOp {
+    hobject_t oid;
+    uint64_t off;
+    bufferlist bl;
+    WriteOp(const hobject_t &oid, uint64_t off, bufferlist &bl)
+      : oid(oid), off(off), bl(bl) {}
+  };
   struct CloneOp {
     hobject_t source;
     hobject_t target;
@@ -87,6 +94,7 @@ public:
   struct NoOp {};
   typedef boost::variant<
     AppendOp,
+    WriteOp,
     CloneOp,
     RenameOp,
     StashOp,
@@ -98,8 +106,9 @@ public:
     NoOp> Op;
   list<Op> ops;
   uint64_t written;
+  bool overwrites;
 
-  ECTransaction() : written(0) {}
+  ECTransaction() : written(0), overwrites(false) {}
   /// Write
   void touch(
     const hobject_t &hoid) {
@@ -119,6 +128,29 @@ public:
     assert(len == bl.length());
     ops.push_back(AppendOp(hoid, off, bl));
   }
+  /// Overwrite, the backend reads and re-encodes partial stripes
+  void write(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len,
+    bufferlist &bl) {
+    if (len == 0) {
+      touch(hoid);
+      return;
+    }
+    written += len;
+    overwrites = true;
+    assert(len == bl.length());
+    ops.push_back(WriteOp(hoid, off, bl));
+  }
+  void zero(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len) {
+    bufferlist bl;
+    bl.append_zero(len);
+    write(hoid, off, len, bl);
+  }
   void stash(
     const hobject_t &hoid,
     version_t former_version) {
@@ -165,6 +197,8 @@ public:
     ECTransaction *to_append = static_cast<ECTransaction*>(_to_append);
     written += to_append->written;
     to_append->written = 0;
+    overwrites = overwrites || to_append->overwrites;
+    to_append->overwrites = false;
     ops.splice(ops.end(), to_append->ops,
 	       to_append->ops.begin(), to_append->ops.end());
   }
@@ -177,6 +211,9 @@ public:
   uint64_t get_bytes_written() const {
     return written;
   }
+  bool has_overwrites() const {
+    return overwrites;
+  }
   template <typename T>
   void visit(T &vis) const {
     for (list<Op>::const_iterator i = ops.begin(); i != ops.end(); ++i) {
@@ -193,11 +230,37 @@ public:
   }
   void get_append_objects(
     set<hobject_t> *out) const;
+
+  /**
+   * Stripes which overwrites in this transaction only partially cover,
+   * keyed by the object as it was before the transaction (which differs
+   * from the overwritten object after a clone or rename).  Stripes
+   * written by earlier ops in the transaction need not be read.
+   */
+  void get_rmw_stripes(
+    map<hobject_t, ECUtil::HashInfoRef> &hash_infos,
+    const ECUtil::stripe_info_t &sinfo,
+    map<hobject_t, set<uint64_t> > *out) const;
+
+  /// extents (logical) to stash, per object, before applying the ops
+  typedef map<hobject_t, pair<version_t, vector<pair<uint64_t, uint64_t> > > >
+    stash_extents_t;
+
+  /**
+   * stripes holds, per object, the logical contents of the stripes read
+   * back for read-modify-write (see get_rmw_stripes).  On return it
+   * holds the contents of every stripe read or written, keyed by object
+   * as of the end of the transaction, while replaced gets the objects
+   * whose contents were wholly replaced or removed.
+   */
   void generate_transactions(
     map<hobject_t, ECUtil::HashInfoRef> &hash_infos,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
+    const stash_extents_t &to_stash,
+    map<hobject_t, map<uint64_t, bufferlist> > *stripes,
+    set<hobject_t> *replaced,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
     set<hobject_t> *temp_added,
     set<hobject_t> *temp_removed,
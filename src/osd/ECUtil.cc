@@ -97,6 +97,40 @@ int ECUtil::decode(
   return 0;
 }
 
+void ECUtil::reassemble(
+  const stripe_info_t &sinfo,
+  map<unsigned, pair<uint64_t, bufferlist> > &chunks,
+  uint64_t off,
+  uint64_t len,
+  bufferlist *out)
+{
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  uint64_t pos = off;
+  while (pos < off + len) {
+    uint64_t in_stripe = pos % stripe_width;
+    uint64_t in_chunk = in_stripe % chunk_size;
+    uint64_t n = MIN(chunk_size - in_chunk, off + len - pos);
+    map<unsigned, pair<uint64_t, bufferlist> >::iterator c =
+      chunks.find(in_stripe / chunk_size);
+    assert(c != chunks.end());
+    uint64_t chunk_off = (pos / stripe_width) * chunk_size + in_chunk;
+    assert(chunk_off >= c->second.first);
+    uint64_t have = c->second.second.length();
+    if (chunk_off - c->second.first >= have)
+      break;  // past the end of the object
+    bool short_read = (chunk_off - c->second.first + n > have);
+    if (short_read)
+      n = have - (chunk_off - c->second.first);
+    bufferlist bl;
+    bl.substr_of(c->second.second, chunk_off - c->second.first, n);
+    out->claim_append(bl);
+    if (short_read)
+      break;
+    pos += n;
+  }
+}
+
 int ECUtil::encode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
@@ -194,3 +228,112 @@ const string &ECUtil::get_hinfo_key()
 {
   return HINFO_KEY;
 }
+
+void ECUtil::ExtentCache::touch(const hobject_t &hoid, object_entry_t &entry)
+{
+  if (entry.on_lru) {
+    lru.erase(entry.lru_pos);
+    entry.on_lru = false;
+  }
+  if (entry.pins == 0) {
+    entry.lru_pos = lru.insert(lru.begin(), hoid);
+    entry.on_lru = true;
+  }
+}
+
+void ECUtil::ExtentCache::remove_entry(
+  map<hobject_t, object_entry_t>::iterator i)
+{
+  if (i->second.on_lru)
+    lru.erase(i->second.lru_pos);
+  assert(bytes >= i->second.bytes);
+  bytes -= i->second.bytes;
+  objects.erase(i);
+}
+
+void ECUtil::ExtentCache::trim()
+{
+  while (bytes > max_bytes && !lru.empty()) {
+    map<hobject_t, object_entry_t>::iterator i = objects.find(lru.back());
+    assert(i != objects.end());
+    assert(i->second.pins == 0);
+    remove_entry(i);
+  }
+}
+
+void ECUtil::ExtentCache::lookup(
+  const hobject_t &hoid,
+  set<uint64_t> *want,
+  map<uint64_t, bufferlist> *out)
+{
+  map<hobject_t, object_entry_t>::iterator i = objects.find(hoid);
+  if (i == objects.end())
+    return;
+  for (set<uint64_t>::iterator j = want->begin(); j != want->end(); ) {
+    map<uint64_t, bufferlist>::iterator k = i->second.stripes.find(*j);
+    if (k != i->second.stripes.end()) {
+      (*out)[*j] = k->second;
+      want->erase(j++);
+    } else {
+      ++j;
+    }
+  }
+  touch(hoid, i->second);
+}
+
+void ECUtil::ExtentCache::insert(
+  const hobject_t &hoid,
+  const map<uint64_t, bufferlist> &stripes)
+{
+  object_entry_t &entry = objects[hoid];
+  for (map<uint64_t, bufferlist>::const_iterator i = stripes.begin();
+       i != stripes.end();
+       ++i) {
+    map<uint64_t, bufferlist>::iterator old = entry.stripes.find(i->first);
+    if (old != entry.stripes.end()) {
+      entry.bytes -= old->second.length();
+      bytes -= old->second.length();
+    }
+    bufferlist &bl = entry.stripes[i->first];
+    bl = i->second;
+    entry.bytes += bl.length();
+    bytes += bl.length();
+  }
+  touch(hoid, entry);
+  trim();
+}
+
+void ECUtil::ExtentCache::invalidate(const hobject_t &hoid)
+{
+  map<hobject_t, object_entry_t>::iterator i = objects.find(hoid);
+  if (i == objects.end())
+    return;
+  if (i->second.pins) {
+    bytes -= i->second.bytes;
+    i->second.bytes = 0;
+    i->second.stripes.clear();
+  } else {
+    remove_entry(i);
+  }
+}
+
+void ECUtil::ExtentCache::pin(const hobject_t &hoid)
+{
+  object_entry_t &entry = objects[hoid];
+  ++entry.pins;
+  touch(hoid, entry);
+}
+
+void ECUtil::ExtentCache::unpin(const hobject_t &hoid)
+{
+  map<hobject_t, object_entry_t>::iterator i = objects.find(hoid);
+  assert(i != objects.end());
+  assert(i->second.pins > 0);
+  if (--(i->second.pins) == 0) {
+    if (i->second.stripes.empty())
+      remove_entry(i);
+    else
+      touch(hoid, i->second);
+  }
+  trim();
+}
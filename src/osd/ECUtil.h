@@ -17,6 +17,7 @@
 
 #include <map>
 #include <set>
+#include <list>
 
 #include "include/memory.h"
 #include "erasure-code/ErasureCodeInterface.h"
@@ -24,6 +25,7 @@
 #include "include/assert.h"
 #include "include/encoding.h"
 #include "common/Formatter.h"
+#include "common/hobject.h"
 
 namespace ECUtil {
 
@@ -83,6 +85,65 @@ public:
       (in.first - off) + in.second);
     return make_pair(off, len);
   }
+  /// true if [off, off+len) covers the whole stripe starting at stripe_off
+  bool covers_stripe(uint64_t stripe_off, uint64_t off, uint64_t len) const {
+    assert(stripe_off % stripe_width == 0);
+    return off <= stripe_off && off + len >= stripe_off + stripe_width;
+  }
+  /**
+   * Range of data chunk raw_chunk (0 .. k-1, before any chunk mapping)
+   * holding the bytes of the logical extent [off, off+len), in chunk
+   * offsets.  Returns false if the extent does not touch that chunk.
+   */
+  bool logical_to_chunk_extent(
+    unsigned raw_chunk, uint64_t off, uint64_t len,
+    pair<uint64_t, uint64_t> *out) const {
+    assert(len);
+    const uint64_t end = off + len;
+    const uint64_t first = logical_to_prev_stripe_offset(off);
+    const uint64_t last = logical_to_prev_stripe_offset(end - 1);
+    const uint64_t cstart = raw_chunk * chunk_size;
+    uint64_t start = 0;
+    bool found = false;
+    for (uint64_t s = first; s <= last; s += stripe_width) {
+      uint64_t lo = MAX(off, s + cstart);
+      if (lo < MIN(end, s + cstart + chunk_size)) {
+	start = (s / stripe_width) * chunk_size + (lo - s - cstart);
+	found = true;
+	break;
+      }
+    }
+    if (!found)
+      return false;
+    for (uint64_t s = last; ; s -= stripe_width) {
+      uint64_t hi = MIN(end, s + cstart + chunk_size);
+      if (MAX(off, s + cstart) < hi) {
+	out->first = start;
+	out->second = (s / stripe_width) * chunk_size + (hi - s - cstart) -
+	  start;
+	return true;
+      }
+      assert(s > first);
+    }
+  }
+  /**
+   * Stripes which an overwrite of [off, off+len) only partially covers
+   * and which lie below the stripe aligned logical size old_size.  Those
+   * are the stripes which must be read back before the write can be
+   * re-encoded.
+   */
+  void get_partial_stripes(
+    uint64_t off, uint64_t len, uint64_t old_size,
+    set<uint64_t> *out) const {
+    if (len == 0)
+      return;
+    uint64_t first = logical_to_prev_stripe_offset(off);
+    uint64_t last = logical_to_prev_stripe_offset(off + len - 1);
+    if (first < old_size && !covers_stripe(first, off, len))
+      out->insert(first);
+    if (last != first && last < old_size && !covers_stripe(last, off, len))
+      out->insert(last);
+  }
 };
 
 int decode(
@@ -97,6 +158,20 @@ int decode(
   map<int, bufferlist> &to_decode,
   map<int, bufferlist*> &out);
 
+/**
+ * Rebuild the logical extent [off, off+len) from data chunks read with
+ * stripe_info_t::logical_to_chunk_extent, no decoding required.
+ * chunks maps the raw data chunk index to the chunk offset the buffer
+ * was read from and the buffer itself.  A read past the end of the
+ * object returns short buffers, out then stops where the data does.
+ */
+void reassemble(
+  const stripe_info_t &sinfo,
+  map<unsigned, pair<uint64_t, bufferlist> > &chunks,
+  uint64_t off,
+  uint64_t len,
+  bufferlist *out);
+
 int encode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
@@ -107,31 +182,46 @@ int encode(
 class HashInfo {
   uint64_t total_chunk_size;
   vector<uint32_t> cumulative_shard_hashes;
+  unsigned num_chunks; // not encoded, used to restore hashes on clear()
 public:
-  HashInfo() : total_chunk_size(0) {}
+  HashInfo() : total_chunk_size(0), num_chunks(0) {}
   HashInfo(unsigned num_chunks)
   : total_chunk_size(0),
-    cumulative_shard_hashes(num_chunks, -1) {}
+    cumulative_shard_hashes(num_chunks, -1),
+    num_chunks(num_chunks) {}
   void append(uint64_t old_size, map<int, bufferlist> &to_append) {
-    assert(to_append.size() == cumulative_shard_hashes.size());
     assert(old_size == total_chunk_size);
     uint64_t size_to_append = to_append.begin()->second.length();
-    for (map<int, bufferlist>::iterator i = to_append.begin();
-	 i != to_append.end();
-	 ++i) {
-      assert(size_to_append == i->second.length());
-      assert((unsigned)i->first < cumulative_shard_hashes.size());
-      uint32_t new_hash = i->second.crc32c(cumulative_shard_hashes[i->first]);
-      cumulative_shard_hashes[i->first] = new_hash;
+    if (has_chunk_hash()) {
+      assert(to_append.size() == cumulative_shard_hashes.size());
+      for (map<int, bufferlist>::iterator i = to_append.begin();
+	   i != to_append.end();
+	   ++i) {
+	assert(size_to_append == i->second.length());
+	assert((unsigned)i->first < cumulative_shard_hashes.size());
+	uint32_t new_hash = i->second.crc32c(cumulative_shard_hashes[i->first]);
+	cumulative_shard_hashes[i->first] = new_hash;
+      }
     }
     total_chunk_size += size_to_append;
   }
   void clear() {
     total_chunk_size = 0;
     cumulative_shard_hashes = vector<uint32_t>(
-      cumulative_shard_hashes.size(),
+      num_chunks ? num_chunks : cumulative_shard_hashes.size(),
       -1);
   }
+  /**
+   * Cumulative hashes cannot be maintained across an overwrite, the
+   * object only records its size until it is next cleared.
+   */
+  void set_total_chunk_size_clear_hash(uint64_t new_chunk_size) {
+    cumulative_shard_hashes.clear();
+    total_chunk_size = new_chunk_size;
+  }
+  bool has_chunk_hash() const {
+    return !cumulative_shard_hashes.empty();
+  }
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
@@ -146,6 +236,72 @@ public:
 };
 typedef ceph::shared_ptr<HashInfo> HashInfoRef;
 
+/**
+ * ExtentCache
+ *
+ * Keeps the logical contents of recently written stripes so that a
+ * read-modify-write of a stripe which was just written (sequential small
+ * overwrites, in particular) need not read it back from the shards.
+ * Stripes are keyed by their stripe aligned logical offset and are
+ * always a full stripe_width long.
+ *
+ * An object is pinned while a write to it is in flight: its stripes are
+ * then the only up to date copy of what the in flight writes produced
+ * and may not be evicted.  Unpinned objects are trimmed in lru order
+ * once the cache exceeds max_bytes.
+ */
+class ExtentCache {
+  struct object_entry_t {
+    map<uint64_t, bufferlist> stripes;
+    uint64_t bytes;
+    unsigned pins;
+    list<hobject_t>::iterator lru_pos;
+    bool on_lru;
+    object_entry_t() : bytes(0), pins(0), on_lru(false) {}
+  };
+  map<hobject_t, object_entry_t> objects;
+  list<hobject_t> lru; ///< unpinned objects, most recently used first
+  uint64_t max_bytes;
+  uint64_t bytes;
+
+  void touch(const hobject_t &hoid, object_entry_t &entry);
+  void remove_entry(map<hobject_t, object_entry_t>::iterator i);
+  void trim();
+public:
+  ExtentCache(uint64_t max_bytes) : max_bytes(max_bytes), bytes(0) {}
+
+  /// fill out with cached stripes in want, removing them from want
+  void lookup(
+    const hobject_t &hoid,
+    set<uint64_t> *want,
+    map<uint64_t, bufferlist> *out);
+  /// replace the cached contents of the given stripes
+  void insert(
+    const hobject_t &hoid,
+    const map<uint64_t, bufferlist> &stripes);
+  /// drop cached stripes for hoid (object removed, renamed, ...)
+  void invalidate(const hobject_t &hoid);
+
+  void pin(const hobject_t &hoid);
+  void unpin(const hobject_t &hoid);
+  bool is_pinned(const hobject_t &hoid) const {
+    map<hobject_t, object_entry_t>::const_iterator i = objects.find(hoid);
+    return i != objects.end() && i->second.pins > 0;
+  }
+
+  void set_max_bytes(uint64_t max) {
+    max_bytes = max;
+    trim();
+  }
+  uint64_t get_bytes() const { return bytes; }
+  bool empty() const { return objects.empty(); }
+  void clear() {
+    objects.clear();
+    lru.clear();
+    bytes = 0;
+  }
+};
+
 bool is_hinfo_key_string(const string &key);
 const string &get_hinfo_key();
 
@@ -217,6 +217,11 @@ OSDService::OSDService(OSD *osd) :
   next_notif_id(0),
   backfill_request_lock("OSD::backfill_request_lock"),
   backfill_request_timer(cct, backfill_request_lock, false),
+  snap_trim_budget_lock("OSDService::snap_trim_budget_lock"),
+  snap_trim_ops_avail(0),
+  snap_trim_bytes_avail(0),
+  snap_trim_timer_lock("OSDService::snap_trim_timer_lock"),
+  snap_trim_timer(cct, snap_trim_timer_lock, false),
   last_tid(0),
   tid_lock("OSDService::tid_lock"),
   reserver_finisher(cct),
@@ -227,6 +232,7 @@ OSDService::OSDService(OSD *osd) :
   pg_temp_lock("OSDService::pg_temp_lock"),
   map_cache_lock("OSDService::map_lock"),
   map_cache(cct, cct->_conf->osd_map_cache_size),
+  map_bl_cache_lock("OSDService::map_bl_cache_lock"),
   map_bl_cache(cct->_conf->osd_map_cache_size),
   map_bl_inc_cache(cct->_conf->osd_map_cache_size),
   in_progress_split_lock("OSDService::in_progress_split_lock"),
@@ -451,6 +457,10 @@ void OSDService::shutdown()
     Mutex::Locker l(backfill_request_lock);
     backfill_request_timer.shutdown();
   }
+  {
+    Mutex::Locker l(snap_trim_timer_lock);
+    snap_trim_timer.shutdown();
+  }
   osdmap = OSDMapRef();
   next_osdmap = OSDMapRef();
 }
@@ -736,6 +746,49 @@ void OSDService::send_pg_temp()
   monc->send_mon_message(m);
 }
 
+bool OSDService::snap_trim_budget_get(utime_t *wait)
+{
+  Mutex::Locker l(snap_trim_budget_lock);
+  double ops_rate = cct->_conf->osd_snap_trim_max_ops_per_sec;
+  double bytes_rate = cct->_conf->osd_snap_trim_max_bytes_per_sec;
+  if (ops_rate <= 0 && bytes_rate <= 0)
+    return true;
+
+  // refill, holding at most a second's worth
+  utime_t now = ceph_clock_now(cct);
+  double elapsed = (double)(now - snap_trim_budget_stamp);
+  snap_trim_budget_stamp = now;
+  double w = 0;
+  if (ops_rate > 0) {
+    snap_trim_ops_avail = MIN(MAX(ops_rate, 1.0),
+			      snap_trim_ops_avail + elapsed * ops_rate);
+    if (snap_trim_ops_avail < 1.0)
+      w = MAX(w, (1.0 - snap_trim_ops_avail) / ops_rate);
+  }
+  if (bytes_rate > 0) {
+    snap_trim_bytes_avail = MIN(bytes_rate,
+				snap_trim_bytes_avail + elapsed * bytes_rate);
+    if (snap_trim_bytes_avail <= 0)
+      w = MAX(w, -snap_trim_bytes_avail / bytes_rate + 0.001);
+  }
+  if (w > 0) {
+    wait->set_from_double(w);
+    return false;
+  }
+  return true;
+}
+
+void OSDService::snap_trim_budget_charge(unsigned ops, uint64_t bytes)
+{
+  logger->inc(l_osd_snap_trim, ops);
+  logger->inc(l_osd_snap_trim_bytes, bytes);
+  Mutex::Locker l(snap_trim_budget_lock);
+  if (cct->_conf->osd_snap_trim_max_ops_per_sec > 0)
+    snap_trim_ops_avail -= ops;
+  if (cct->_conf->osd_snap_trim_max_bytes_per_sec > 0)
+    snap_trim_bytes_avail -= bytes;
+}
+
 
 // --------------------------------------
 // dispatch
@@ -1080,28 +1133,33 @@ void OSDService::send_incremental_map(epoch_t since, Connection *con,
   send_map(m, con);
 }
 
-bool OSDService::_get_map_bl(epoch_t e, bufferlist& bl)
+bool OSDService::get_map_bl(epoch_t e, bufferlist& bl)
 {
-  bool found = map_bl_cache.lookup(e, &bl);
-  if (found)
-    return true;
-  found = store->read(
+  {
+    Mutex::Locker l(map_bl_cache_lock);
+    if (map_bl_cache.lookup(e, &bl))
+      return true;
+  }
+  // read without the lock held; a racing reader at worst adds the
+  // same bl twice.
+  bool found = store->read(
     coll_t::META_COLL, OSD::get_osdmap_pobject_name(e), 0, 0, bl) >= 0;
   if (found)
-    _add_map_bl(e, bl);
+    add_map_bl(e, bl);
   return found;
 }
 
 bool OSDService::get_inc_map_bl(epoch_t e, bufferlist& bl)
 {
-  Mutex::Locker l(map_cache_lock);
-  bool found = map_bl_inc_cache.lookup(e, &bl);
-  if (found)
-    return true;
-  found = store->read(
+  {
+    Mutex::Locker l(map_bl_cache_lock);
+    if (map_bl_inc_cache.lookup(e, &bl))
+      return true;
+  }
+  bool found = store->read(
     coll_t::META_COLL, OSD::get_inc_osdmap_pobject_name(e), 0, 0, bl) >= 0;
   if (found)
-    _add_map_inc_bl(e, bl);
+    add_map_inc_bl(e, bl);
   return found;
 }
 
@@ -1119,19 +1177,19 @@ void OSDService::_add_map_inc_bl(epoch_t e, bufferlist& bl)
 
 void OSDService::pin_map_inc_bl(epoch_t e, bufferlist &bl)
 {
-  Mutex::Locker l(map_cache_lock);
+  Mutex::Locker l(map_bl_cache_lock);
   map_bl_inc_cache.pin(e, bl);
 }
 
 void OSDService::pin_map_bl(epoch_t e, bufferlist &bl)
 {
-  Mutex::Locker l(map_cache_lock);
+  Mutex::Locker l(map_bl_cache_lock);
   map_bl_cache.pin(e, bl);
 }
 
 void OSDService::clear_map_bl_cache_pins(epoch_t e)
 {
-  Mutex::Locker l(map_cache_lock);
+  Mutex::Locker l(map_bl_cache_lock);
   map_bl_inc_cache.clear_pinned(e);
   map_bl_cache.clear_pinned(e);
 }
@@ -1157,18 +1215,20 @@ OSDMapRef OSDService::_add_map(OSDMap *o)
 
 OSDMapRef OSDService::try_get_map(epoch_t epoch)
 {
-  Mutex::Locker l(map_cache_lock);
   OSDMapRef retval = map_cache.lookup(epoch);
   if (retval) {
     dout(30) << "get_map " << epoch << " -cached" << dendl;
     return retval;
   }
 
+  // load and decode without holding map_cache_lock; if we race with
+  // another thread loading the same epoch, _add_map keeps the first
+  // one and drops ours.
   OSDMap *map = new OSDMap;
   if (epoch > 0) {
     dout(20) << "get_map " << epoch << " - loading and decoding " << map << dendl;
     bufferlist bl;
-    if (!_get_map_bl(epoch, bl)) {
+    if (!get_map_bl(epoch, bl)) {
       delete map;
       return OSDMapRef();
     }
@@ -1176,7 +1236,7 @@ OSDMapRef OSDService::try_get_map(epoch_t epoch)
   } else {
     dout(20) << "get_map " << epoch << " - return initial " << map << dendl;
   }
-  return _add_map(map);
+  return add_map(map);
 }
 
 bool OSDService::queue_for_recovery(PG *pg)
@@ -1875,6 +1935,7 @@ int OSD::init()
 
   tick_timer.init();
   service.backfill_request_timer.init();
+  service.snap_trim_timer.init();
 
   // mount.
   dout(2) << "mounting " << dev_path << " "
@@ -2157,7 +2218,8 @@ void OSD::final_init()
     "injectdataerr",
     "injectdataerr " \
     "name=pool,type=CephString " \
-    "name=objname,type=CephObjectname",
+    "name=objname,type=CephObjectname " \
+    "name=shardid,type=CephInt,req=false,range=0|255",
     test_ops_hook,
     "inject data error into omap");
   assert(r == 0);
@@ -2166,7 +2228,8 @@ void OSD::final_init()
     "injectmdataerr",
     "injectmdataerr " \
     "name=pool,type=CephString " \
-    "name=objname,type=CephObjectname",
+    "name=objname,type=CephObjectname " \
+    "name=shardid,type=CephInt,req=false,range=0|255",
     test_ops_hook,
     "inject metadata error");
   assert(r == 0);
@@ -2262,6 +2325,20 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_agent_flush, "agent_flush");
   osd_plb.add_u64_counter(l_osd_agent_evict, "agent_evict");
 
+  osd_plb.add_u64_counter(l_osd_ec_rmw, "ec_rmw");  // ec overwrites
+  osd_plb.add_u64_counter(l_osd_ec_rmw_stripe_read, "ec_rmw_stripe_read");
+  osd_plb.add_u64_counter(l_osd_ec_rmw_cache_hit, "ec_rmw_cache_hit");
+  osd_plb.add_u64_counter(l_osd_ec_read_partial, "ec_read_partial");  // ec reads served from data chunks, no decode
+  osd_plb.add_u64_counter(l_osd_ec_read_fast, "ec_read_fast");  // ec fast reads completed before all shards replied
+
+  osd_plb.add_u64_counter(l_osd_snap_trim, "snap_trim");  // clones trimmed
+  osd_plb.add_u64_counter(l_osd_snap_trim_bytes, "snap_trim_bytes");  // bytes of clones removed
+  osd_plb.add_u64_counter(l_osd_snap_trim_throttle, "snap_trim_throttle");  // passes deferred for lack of budget
+  osd_plb.add_u64(l_osd_snap_trimq, "snap_trimq");  // pgs waiting to trim
+
+  osd_plb.add_u64_counter(l_osd_degraded_write, "degraded_write");  // writes to degraded objects that did not wait
+  osd_plb.add_u64_counter(l_osd_degraded_wait, "degraded_wait");  // ops blocked on a degraded object
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -3968,6 +4045,9 @@ void OSD::tick()
   dout(5) << "tick" << dendl;
 
   logger->set(l_osd_buf, buffer::get_total_alloc());
+  snap_trim_wq.lock();
+  logger->set(l_osd_snap_trimq, snap_trim_queue.size());
+  snap_trim_wq.unlock();
 
   if (is_active() || is_waiting_for_healthy()) {
     map_lock.get_read();
@@ -4052,8 +4132,8 @@ void OSD::check_ops_in_flight()
 //   setomapheader <pool-id> [namespace/]<obj-name> <header>
 //   getomap <pool> [namespace/]<obj-name>
 //   truncobj <pool-id> [namespace/]<obj-name> <newlen>
-//   injectmdataerr [namespace/]<obj-name>
-//   injectdataerr [namespace/]<obj-name>
+//   injectmdataerr [namespace/]<obj-name> [shardid]
+//   injectdataerr [namespace/]<obj-name> [shardid]
 void TestOpsSocketHook::test_ops(OSDService *service, ObjectStore *store,
      std::string command, cmdmap_t& cmdmap, ostream &ss)
 {
@@ -4096,9 +4176,14 @@ void TestOpsSocketHook::test_ops(OSDService *service, ObjectStore *store,
       ss << "Invalid namespace/objname";
       return;
     }
+    // errors may be injected into one shard of an ec object
+    int64_t shardid = shard_id_t::NO_SHARD;
     if (curmap->pg_is_ec(rawpg)) {
-      ss << "Must not call on ec pool";
-      return;
+      if ((command != "injectdataerr" && command != "injectmdataerr") ||
+	  !cmd_getval(service->cct, cmdmap, "shardid", shardid)) {
+	ss << "Must not call on ec pool, except to inject errors into a shard";
+	return;
+      }
     }
     spg_t pgid = spg_t(curmap->raw_pg_to_pg(rawpg), shard_id_t::NO_SHARD);
 
@@ -4168,10 +4253,12 @@ void TestOpsSocketHook::test_ops(OSDService *service, ObjectStore *store,
       else
 	ss << "ok";
     } else if (command == "injectdataerr") {
-      store->inject_data_error(obj);
+      store->inject_data_error(
+	ghobject_t(obj, ghobject_t::NO_GEN, shard_id_t(shardid)));
       ss << "ok";
     } else if (command == "injectmdataerr") {
-      store->inject_mdata_error(obj);
+      store->inject_mdata_error(
+	ghobject_t(obj, ghobject_t::NO_GEN, shard_id_t(shardid)));
       ss << "ok";
     }
     return;
@@ -6179,10 +6266,10 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
+	// reference the previous epoch's pieces; apply_incremental
+	// copies only the ones this incremental touches.
 	OSDMapRef prev = get_map(e - 1);
-	prev->encode(obl);
-	o->decode(obl);
+	o->shallow_copy_from(*prev);
       }
 
       OSDMap::Incremental inc;
@@ -141,6 +141,20 @@ enum {
   l_osd_agent_flush,
   l_osd_agent_evict,
 
+  l_osd_ec_rmw,
+  l_osd_ec_rmw_stripe_read,
+  l_osd_ec_rmw_cache_hit,
+  l_osd_ec_read_partial,
+  l_osd_ec_read_fast,
+
+  l_osd_snap_trim,
+  l_osd_snap_trim_bytes,
+  l_osd_snap_trim_throttle,
+  l_osd_snap_trimq,
+
+  l_osd_degraded_write,
+  l_osd_degraded_wait,
+
   l_osd_last,
 };
 
@@ -666,6 +680,24 @@ public:
   Mutex backfill_request_lock;
   SafeTimer backfill_request_timer;
 
+  // -- snap trim budget --
+  //
+  // all pgs on the osd draw on one token bucket, refilled at
+  // osd_snap_trim_max_{ops,bytes}_per_sec.  a trimming pass may start
+  // while the bucket is positive and is charged for what it actually
+  // removed afterwards; a pg that finds the bucket empty is requeued
+  // from snap_trim_timer once it has refilled.
+  Mutex snap_trim_budget_lock;
+  utime_t snap_trim_budget_stamp;
+  double snap_trim_ops_avail, snap_trim_bytes_avail;
+  Mutex snap_trim_timer_lock;
+  SafeTimer snap_trim_timer;
+
+  /// true if a trimming pass may run now, else how long to wait in *wait
+  bool snap_trim_budget_get(utime_t *wait);
+  /// charge a completed pass against the budget
+  void snap_trim_budget_charge(unsigned ops, uint64_t bytes);
+
   // -- tids --
   // for ops i issue
   ceph_tid_t last_tid;
@@ -703,8 +735,14 @@ public:
   }
 
   // osd map cache (past osd maps)
+  //
+  // map_cache_lock only serializes dedup+insert of decoded maps;
+  // lookups go straight to the (internally locked) SharedLRU, and
+  // disk reads and decodes happen with no lock held.  the encoded
+  // map caches have their own lock.
   Mutex map_cache_lock;
   SharedLRU<epoch_t, const OSDMap> map_cache;
+  Mutex map_bl_cache_lock;
   SimpleLRU<epoch_t, bufferlist> map_bl_cache;
   SimpleLRU<epoch_t, bufferlist> map_bl_inc_cache;
 
@@ -721,19 +759,15 @@ public:
   OSDMapRef _add_map(OSDMap *o);
 
   void add_map_bl(epoch_t e, bufferlist& bl) {
-    Mutex::Locker l(map_cache_lock);
+    Mutex::Locker l(map_bl_cache_lock);
     return _add_map_bl(e, bl);
   }
   void pin_map_bl(epoch_t e, bufferlist &bl);
   void _add_map_bl(epoch_t e, bufferlist& bl);
-  bool get_map_bl(epoch_t e, bufferlist& bl) {
-    Mutex::Locker l(map_cache_lock);
-    return _get_map_bl(e, bl);
-  }
-  bool _get_map_bl(epoch_t e, bufferlist& bl);
+  bool get_map_bl(epoch_t e, bufferlist& bl);
 
   void add_map_inc_bl(epoch_t e, bufferlist& bl) {
-    Mutex::Locker l(map_cache_lock);
+    Mutex::Locker l(map_bl_cache_lock);
     return _add_map_inc_bl(e, bl);
   }
   void pin_map_inc_bl(epoch_t e, bufferlist &bl);
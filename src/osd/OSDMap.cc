@@ -806,8 +806,9 @@ void OSDMap::Incremental::generate_test_instances(list<Incremental*>& o)
 void OSDMap::set_epoch(epoch_t e)
 {
   epoch = e;
-  for (map<int64_t,pg_pool_t>::iterator p = pools.begin();
-       p != pools.end();
+  unshare(pools);
+  for (map<int64_t,pg_pool_t>::iterator p = pools->begin();
+       p != pools->end();
        ++p)
     p->second.last_change = e;
 }
@@ -846,6 +847,11 @@ void OSDMap::set_max_osd(int m)
 {
   int o = max_osd;
   max_osd = m;
+  if (m != o) {
+    unshare(osd_addrs);
+    unshare(osd_uuid);
+    unshare(osd_primary_affinity);
+  }
   osd_state.resize(m);
   osd_weight.resize(m);
   for (; o<max_osd; o++) {
@@ -971,7 +977,7 @@ uint64_t OSDMap::get_features(int entity_type, uint64_t *pmask) const
     features |= CEPH_FEATURE_CRUSH_TUNABLES3;
   mask |= CEPH_FEATURES_CRUSH;
 
-  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin(); p != pools.end(); ++p) {
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools->begin(); p != pools->end(); ++p) {
     if (p->second.flags & pg_pool_t::FLAG_HASHPSPOOL) {
       features |= CEPH_FEATURE_OSDHASHPSPOOL;
     }
@@ -1037,42 +1043,48 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
 
   int diff = 0;
 
-  // do addrs match?
-  if (o->max_osd != n->max_osd)
-    diff++;
-  for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
-    if ( n->osd_addrs->client_addr[i] &&  o->osd_addrs->client_addr[i] &&
-	*n->osd_addrs->client_addr[i] == *o->osd_addrs->client_addr[i])
-      n->osd_addrs->client_addr[i] = o->osd_addrs->client_addr[i];
-    else
-      diff++;
-    if ( n->osd_addrs->cluster_addr[i] &&  o->osd_addrs->cluster_addr[i] &&
-	*n->osd_addrs->cluster_addr[i] == *o->osd_addrs->cluster_addr[i])
-      n->osd_addrs->cluster_addr[i] = o->osd_addrs->cluster_addr[i];
-    else
-      diff++;
-    if ( n->osd_addrs->hb_back_addr[i] &&  o->osd_addrs->hb_back_addr[i] &&
-	*n->osd_addrs->hb_back_addr[i] == *o->osd_addrs->hb_back_addr[i])
-      n->osd_addrs->hb_back_addr[i] = o->osd_addrs->hb_back_addr[i];
-    else
+  // do addrs match?  skip this if n already shares its addrs with
+  // another map; they were deduped then, and must not be modified.
+  if (o->osd_addrs != n->osd_addrs && n->osd_addrs.unique()) {
+    if (o->max_osd != n->max_osd)
       diff++;
-    if ( n->osd_addrs->hb_front_addr[i] &&  o->osd_addrs->hb_front_addr[i] &&
-	*n->osd_addrs->hb_front_addr[i] == *o->osd_addrs->hb_front_addr[i])
-      n->osd_addrs->hb_front_addr[i] = o->osd_addrs->hb_front_addr[i];
-    else
-      diff++;
-  }
-  if (diff == 0) {
-    // zoinks, no differences at all!
-    n->osd_addrs = o->osd_addrs;
+    for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
+      if ( n->osd_addrs->client_addr[i] &&  o->osd_addrs->client_addr[i] &&
+	  *n->osd_addrs->client_addr[i] == *o->osd_addrs->client_addr[i])
+        n->osd_addrs->client_addr[i] = o->osd_addrs->client_addr[i];
+      else
+        diff++;
+      if ( n->osd_addrs->cluster_addr[i] &&  o->osd_addrs->cluster_addr[i] &&
+	  *n->osd_addrs->cluster_addr[i] == *o->osd_addrs->cluster_addr[i])
+        n->osd_addrs->cluster_addr[i] = o->osd_addrs->cluster_addr[i];
+      else
+        diff++;
+      if ( n->osd_addrs->hb_back_addr[i] &&  o->osd_addrs->hb_back_addr[i] &&
+	  *n->osd_addrs->hb_back_addr[i] == *o->osd_addrs->hb_back_addr[i])
+        n->osd_addrs->hb_back_addr[i] = o->osd_addrs->hb_back_addr[i];
+      else
+        diff++;
+      if ( n->osd_addrs->hb_front_addr[i] &&  o->osd_addrs->hb_front_addr[i] &&
+	  *n->osd_addrs->hb_front_addr[i] == *o->osd_addrs->hb_front_addr[i])
+        n->osd_addrs->hb_front_addr[i] = o->osd_addrs->hb_front_addr[i];
+      else
+        diff++;
+    }
+    if (diff == 0) {
+      // zoinks, no differences at all!
+      n->osd_addrs = o->osd_addrs;
+    }
   }
 
-  // does crush match?
-  bufferlist oc, nc;
-  ::encode(*o->crush, oc);
-  ::encode(*n->crush, nc);
-  if (oc.contents_equal(nc)) {
-    n->crush = o->crush;
+  // does crush match?  maps built with shallow_copy_from usually
+  // already share it, in which case skip the (expensive) encode.
+  if (o->crush != n->crush) {
+    bufferlist oc, nc;
+    ::encode(*o->crush, oc);
+    ::encode(*n->crush, nc);
+    if (oc.contents_equal(nc)) {
+      n->crush = o->crush;
+    }
   }
 
   // does pg_temp match?
@@ -1191,18 +1203,20 @@ int OSDMap::apply_incremental(const Incremental &inc)
   if (inc.new_pool_max != -1)
     pool_max = inc.new_pool_max;
 
+  if (!inc.old_pools.empty() || !inc.new_pools.empty())
+    unshare(pools);
   for (set<int64_t>::const_iterator p = inc.old_pools.begin();
        p != inc.old_pools.end();
        ++p) {
-    pools.erase(*p);
+    pools->erase(*p);
     name_pool.erase(pool_name[*p]);
     pool_name.erase(*p);
   }
   for (map<int64_t,pg_pool_t>::const_iterator p = inc.new_pools.begin();
        p != inc.new_pools.end();
        ++p) {
-    pools[p->first] = p->second;
-    pools[p->first].last_change = epoch;
+    (*pools)[p->first] = p->second;
+    (*pools)[p->first].last_change = epoch;
   }
   for (map<int64_t,string>::const_iterator p = inc.new_pool_names.begin();
        p != inc.new_pool_names.end();
@@ -1246,6 +1260,10 @@ int OSDMap::apply_incremental(const Incremental &inc)
     erasure_code_profiles.erase(*i);
   
   // up/down
+  if (!inc.new_state.empty() || !inc.new_uuid.empty())
+    unshare(osd_uuid);
+  if (!inc.new_up_client.empty() || !inc.new_up_cluster.empty())
+    unshare(osd_addrs);
   for (map<int32_t,uint8_t>::const_iterator i = inc.new_state.begin();
        i != inc.new_state.end();
        ++i) {
@@ -1306,6 +1324,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
     (*osd_uuid)[p->first] = p->second;
 
   // pg rebuild
+  if (!inc.new_pg_temp.empty())
+    unshare(pg_temp);
   for (map<pg_t, vector<int> >::const_iterator p = inc.new_pg_temp.begin(); p != inc.new_pg_temp.end(); ++p) {
     if (p->second.empty())
       pg_temp->erase(p->first);
@@ -1313,6 +1333,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
       (*pg_temp)[p->first] = p->second;
   }
 
+  if (!inc.new_primary_temp.empty())
+    unshare(primary_temp);
   for (map<pg_t,int32_t>::const_iterator p = inc.new_primary_temp.begin();
       p != inc.new_primary_temp.end();
       ++p) {
@@ -1674,10 +1696,10 @@ void OSDMap::encode_client_old(bufferlist& bl) const
   ::encode(modified, bl);
 
   // for ::encode(pools, bl);
-  __u32 n = pools.size();
+  __u32 n = pools->size();
   ::encode(n, bl);
-  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
-       p != pools.end();
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools->begin();
+       p != pools->end();
        ++p) {
     n = p->first;
     ::encode(n, bl);
@@ -1737,7 +1759,7 @@ void OSDMap::encode_classic(bufferlist& bl, uint64_t features) const
   ::encode(created, bl);
   ::encode(modified, bl);
 
-  ::encode(pools, bl, features);
+  ::encode(*pools, bl, features);
   ::encode(pool_name, bl);
   ::encode(pool_max, bl);
 
@@ -1794,7 +1816,7 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
     ::encode(created, bl);
     ::encode(modified, bl);
 
-    ::encode(pools, bl, features);
+    ::encode(*pools, bl, features);
     ::encode(pool_name, bl);
     ::encode(pool_max, bl);
 
@@ -1851,6 +1873,8 @@ void OSDMap::decode_classic(bufferlist::iterator& p)
   __u16 v;
   ::decode(v, p);
 
+  reset_shared();
+
   // base
   ::decode(fsid, p);
   ::decode(epoch, p);
@@ -1863,11 +1887,10 @@ void OSDMap::decode_classic(bufferlist::iterator& p)
       ::decode(max_pools, p);
       pool_max = max_pools;
     }
-    pools.clear();
     ::decode(n, p);
     while (n--) {
       ::decode(t, p);
-      ::decode(pools[t], p);
+      ::decode((*pools)[t], p);
     }
     if (v == 4) {
       ::decode(n, p);
@@ -1883,13 +1906,13 @@ void OSDMap::decode_classic(bufferlist::iterator& p)
       pool_max = n;
     }
   } else {
-    ::decode(pools, p);
+    ::decode(*pools, p);
     ::decode(pool_name, p);
     ::decode(pool_max, p);
   }
   // kludge around some old bug that zeroed out pool_max (#2307)
-  if (pools.size() && pool_max < pools.rbegin()->first) {
-    pool_max = pools.rbegin()->first;
+  if (pools->size() && pool_max < pools->rbegin()->first) {
+    pool_max = pools->rbegin()->first;
   }
 
   ::decode(flags, p);
@@ -1975,6 +1998,7 @@ void OSDMap::decode(bufferlist::iterator& bl)
   /**
    * Since we made it past that hurdle, we can use our normal paths.
    */
+  reset_shared();
   {
     DECODE_START(3, bl); // client-usable data
     // base
@@ -1983,7 +2007,7 @@ void OSDMap::decode(bufferlist::iterator& bl)
     ::decode(created, bl);
     ::decode(modified, bl);
 
-    ::decode(pools, bl);
+    ::decode(*pools, bl);
     ::decode(pool_name, bl);
     ::decode(pool_max, bl);
 
@@ -2037,6 +2061,22 @@ void OSDMap::decode(bufferlist::iterator& bl)
   post_decode();
 }
 
+/**
+ * Give this map private copies of the refcounted pieces before we
+ * decode into them; they may still be referenced by other epochs
+ * (see shallow_copy_from).
+ */
+void OSDMap::reset_shared()
+{
+  osd_addrs.reset(new addrs_s);
+  pg_temp.reset(new map<pg_t,vector<int32_t> >);
+  primary_temp.reset(new map<pg_t,int32_t>);
+  pools.reset(new map<int64_t,pg_pool_t>);
+  osd_uuid.reset(new vector<uuid_d>);
+  osd_primary_affinity.reset();
+  crush.reset(new CrushWrapper);
+}
+
 void OSDMap::post_decode()
 {
   // index pool names
@@ -2088,7 +2128,7 @@ void OSDMap::dump(Formatter *f) const
   f->dump_int("max_osd", get_max_osd());
 
   f->open_array_section("pools");
-  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin(); p != pools.end(); ++p) {
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools->begin(); p != pools->end(); ++p) {
     std::string name("<unknown>");
     map<int64_t,string>::const_iterator pni = pool_name.find(p->first);
     if (pni != pool_name.end())
@@ -2249,7 +2289,7 @@ void OSDMap::print(ostream& out) const
     out << "cluster_snapshot " << get_cluster_snapshot() << "\n";
   out << "\n";
 
-  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin(); p != pools.end(); ++p) {
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools->begin(); p != pools->end(); ++p) {
     std::string name("<unknown>");
     map<int64_t,string>::const_iterator pni = pool_name.find(p->first);
     if (pni != pool_name.end())
@@ -2481,7 +2521,7 @@ void OSDMap::print_oneline_summary(ostream& out) const
 
 bool OSDMap::crush_ruleset_in_use(int ruleset) const
 {
-  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin(); p != pools.end(); ++p) {
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools->begin(); p != pools->end(); ++p) {
     if (p->second.crush_ruleset == ruleset)
       return true;
   }
@@ -2550,17 +2590,17 @@ int OSDMap::build_simple(CephContext *cct, epoch_t e, uuid_d &fsid,
   for (vector<string>::iterator p = pool_names.begin();
        p != pool_names.end(); ++p) {
     int64_t pool = ++pool_max;
-    pools[pool].type = pg_pool_t::TYPE_REPLICATED;
-    pools[pool].flags = cct->_conf->osd_pool_default_flags;
+    (*pools)[pool].type = pg_pool_t::TYPE_REPLICATED;
+    (*pools)[pool].flags = cct->_conf->osd_pool_default_flags;
     if (cct->_conf->osd_pool_default_flag_hashpspool)
-      pools[pool].flags |= pg_pool_t::FLAG_HASHPSPOOL;
-    pools[pool].size = cct->_conf->osd_pool_default_size;
-    pools[pool].min_size = cct->_conf->get_osd_pool_default_min_size();
-    pools[pool].crush_ruleset = default_replicated_ruleset;
-    pools[pool].object_hash = CEPH_STR_HASH_RJENKINS;
-    pools[pool].set_pg_num(poolbase << pg_bits);
-    pools[pool].set_pgp_num(poolbase << pgp_bits);
-    pools[pool].last_change = epoch;
+      (*pools)[pool].flags |= pg_pool_t::FLAG_HASHPSPOOL;
+    (*pools)[pool].size = cct->_conf->osd_pool_default_size;
+    (*pools)[pool].min_size = cct->_conf->get_osd_pool_default_min_size();
+    (*pools)[pool].crush_ruleset = default_replicated_ruleset;
+    (*pools)[pool].object_hash = CEPH_STR_HASH_RJENKINS;
+    (*pools)[pool].set_pg_num(poolbase << pg_bits);
+    (*pools)[pool].set_pgp_num(poolbase << pgp_bits);
+    (*pools)[pool].last_change = epoch;
     pool_name[pool] = *p;
     name_pool[*p] = pool;
   }
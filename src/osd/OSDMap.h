@@ -226,7 +226,7 @@ private:
   ceph::shared_ptr< map<pg_t,int32_t > > primary_temp;  // temp primary mapping (e.g. while we rebuild)
   ceph::shared_ptr< vector<__u32> > osd_primary_affinity; ///< 16.16 fixed point, 0x10000 = baseline
 
-  map<int64_t,pg_pool_t> pools;
+  ceph::shared_ptr< map<int64_t,pg_pool_t> > pools;
   map<int64_t,string> pool_name;
   map<string,map<string,string> > erasure_code_profiles;
   map<string,int64_t> name_pool;
@@ -255,6 +255,7 @@ private:
 	     osd_addrs(new addrs_s),
 	     pg_temp(new map<pg_t,vector<int32_t> >),
 	     primary_temp(new map<pg_t,int32_t>),
+	     pools(new map<int64_t,pg_pool_t>),
 	     osd_uuid(new vector<uuid_d>),
 	     cluster_snapshot_epoch(0),
 	     new_blacklist_entries(false),
@@ -274,7 +275,10 @@ public:
     *this = o;
     primary_temp.reset(new map<pg_t,int32_t>(*o.primary_temp));
     pg_temp.reset(new map<pg_t,vector<int32_t> >(*o.pg_temp));
+    pools.reset(new map<int64_t,pg_pool_t>(*o.pools));
     osd_uuid.reset(new vector<uuid_d>(*o.osd_uuid));
+    if (o.osd_primary_affinity)
+      osd_primary_affinity.reset(new vector<__u32>(*o.osd_primary_affinity));
 
     // NOTE: this still references shared entity_addr_t's.
     osd_addrs.reset(new addrs_s(*o.osd_addrs));
@@ -283,6 +287,17 @@ public:
     // allocate a new CrushWrapper, though.
   }
 
+  /**
+   * Reference every refcounted piece (addrs, pg_temp, primary_temp,
+   * pools, uuids, primary affinity, crush) of o rather than copying
+   * it.  apply_incremental and decode copy or replace a shared piece
+   * before modifying it, so successive epochs built this way share
+   * whatever the incrementals in between left alone.
+   */
+  void shallow_copy_from(const OSDMap& o) {
+    *this = o;
+  }
+
   // map info
   const uuid_d& get_fsid() const { return fsid; }
   void set_fsid(uuid_d& f) { fsid = f; }
@@ -364,6 +379,8 @@ public:
     if (!osd_primary_affinity)
       osd_primary_affinity.reset(new vector<__u32>(max_osd,
 						   CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
+    else
+      unshare(osd_primary_affinity);
     (*osd_primary_affinity)[o] = w;
   }
   unsigned get_primary_affinity(int o) const {
@@ -547,6 +564,15 @@ public:
 
   int apply_incremental(const Incremental &inc);
 
+private:
+  /// copy a piece shared with other maps before modifying it
+  template<typename T>
+  static void unshare(ceph::shared_ptr<T> &p) {
+    if (p && !p.unique())
+      p.reset(new T(*p));
+  }
+public:
+
   /// try to re-use/reference addrs in oldmap from newmap
   static void dedup(const OSDMap *oldmap, OSDMap *newmap);
 
@@ -560,6 +586,7 @@ private:
   void encode_client_old(bufferlist& bl) const;
   void encode_classic(bufferlist& bl, uint64_t features) const;
   void decode_classic(bufferlist::iterator& p);
+  void reset_shared();
   void post_decode();
 public:
   void encode(bufferlist& bl, uint64_t features=CEPH_FEATURES_ALL) const;
@@ -663,8 +690,8 @@ public:
     pg_to_up_acting_osds(pg, &up, &up_primary, &acting, &acting_primary);
   }
   bool pg_is_ec(pg_t pg) const {
-    map<int64_t, pg_pool_t>::const_iterator i = pools.find(pg.pool());
-    assert(i != pools.end());
+    map<int64_t, pg_pool_t>::const_iterator i = pools->find(pg.pool());
+    assert(i != pools->end());
     return i->second.ec_pool();
   }
   bool get_primary_shard(const pg_t& pgid, spg_t *out) const {
@@ -700,7 +727,7 @@ public:
     return pool_max;
   }
   const map<int64_t,pg_pool_t>& get_pools() const {
-    return pools;
+    return *pools;
   }
   const string& get_pool_name(int64_t p) const {
     map<int64_t, string>::const_iterator i = pool_name.find(p);
@@ -708,28 +735,28 @@ public:
     return i->second;
   }
   bool have_pg_pool(int64_t p) const {
-    return pools.count(p);
+    return pools->count(p);
   }
   const pg_pool_t* get_pg_pool(int64_t p) const {
-    map<int64_t, pg_pool_t>::const_iterator i = pools.find(p);
-    if (i != pools.end())
+    map<int64_t, pg_pool_t>::const_iterator i = pools->find(p);
+    if (i != pools->end())
       return &i->second;
     return NULL;
   }
   unsigned get_pg_size(pg_t pg) const {
-    map<int64_t,pg_pool_t>::const_iterator p = pools.find(pg.pool());
-    assert(p != pools.end());
+    map<int64_t,pg_pool_t>::const_iterator p = pools->find(pg.pool());
+    assert(p != pools->end());
     return p->second.get_size();
   }
   int get_pg_type(pg_t pg) const {
-    assert(pools.count(pg.pool()));
-    return pools.find(pg.pool())->second.get_type();
+    assert(pools->count(pg.pool()));
+    return pools->find(pg.pool())->second.get_type();
   }
 
 
   pg_t raw_pg_to_pg(pg_t pg) const {
-    assert(pools.count(pg.pool()));
-    return pools.find(pg.pool())->second.raw_pg_to_pg(pg);
+    assert(pools->count(pg.pool()));
+    return pools->find(pg.pool())->second.raw_pg_to_pg(pg);
   }
 
   // pg -> acting primary osd
@@ -802,8 +829,8 @@ public:
   bool crush_ruleset_in_use(int ruleset) const;
 
   void clear_temp() {
-    pg_temp->clear();
-    primary_temp->clear();
+    pg_temp.reset(new map<pg_t,vector<int32_t> >);
+    primary_temp.reset(new map<pg_t,int32_t>);
   }
 
 private:
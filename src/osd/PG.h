@@ -837,6 +837,15 @@ public:
 	old_version,
 	t);
     }
+    void rollback_extents(
+      version_t gen,
+      uint64_t old_size,
+      const vector<pair<uint64_t, uint64_t> > &extents) {
+      pg->get_pgbackend()->trim_stashed_object(
+	soid,
+	gen,
+	t);
+    }
   };
 
   struct SnapRollBacker : public ObjectModDesc::Visitor {
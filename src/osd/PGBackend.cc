@@ -66,6 +66,15 @@ struct RollbackVisitor : public ObjectModDesc::Visitor {
   void update_snaps(set<snapid_t> &snaps) {
     // pass
   }
+  void rollback_extents(
+    version_t gen,
+    uint64_t old_size,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    ObjectStore::Transaction temp;
+    pg->rollback_extents(hoid, gen, old_size, extents, &temp);
+    temp.append(t);
+    temp.swap(t);
+  }
 };
 
 void PGBackend::rollback(
@@ -253,6 +262,33 @@ void PGBackend::rollback_stash(
     ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard));
 }
 
+void PGBackend::rollback_extents(
+  const hobject_t &hoid,
+  version_t gen,
+  uint64_t old_size,
+  const vector<pair<uint64_t, uint64_t> > &extents,
+  ObjectStore::Transaction *t) {
+  assert(!hoid.is_temp());
+  for (vector<pair<uint64_t, uint64_t> >::const_iterator i = extents.begin();
+       i != extents.end();
+       ++i) {
+    t->clone_range(
+      coll,
+      ghobject_t(hoid, gen, get_parent()->whoami_shard().shard),
+      ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+      i->first,
+      i->second,
+      i->first);
+  }
+  t->truncate(
+    coll,
+    ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+    old_size);
+  t->remove(
+    coll,
+    ghobject_t(hoid, gen, get_parent()->whoami_shard().shard));
+}
+
 void PGBackend::rollback_create(
   const hobject_t &hoid,
   ObjectStore::Transaction *t) {
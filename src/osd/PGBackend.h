@@ -180,6 +180,9 @@
        bool transaction_applied,
        ObjectStore::Transaction *t) = 0;
 
+     /// record e's object as missing (we got the log entry but no data)
+     virtual void add_local_next_event(const pg_log_entry_t &e) = 0;
+
      virtual void update_peer_last_complete_ondisk(
        pg_shard_t fromosd,
        eversion_t lcod) = 0;
@@ -532,6 +535,14 @@
      version_t old_version,
      ObjectStore::Transaction *t);
 
+   /// Restore stashed extents and size to rollback overwrite
+   virtual void rollback_extents(
+     const hobject_t &hoid,
+     version_t gen,
+     uint64_t old_size,
+     const vector<pair<uint64_t, uint64_t> > &extents,
+     ObjectStore::Transaction *t);
+
    /// Delete object to rollback create
    void rollback_create(
      const hobject_t &hoid,
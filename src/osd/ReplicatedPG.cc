@@ -435,9 +435,50 @@ bool ReplicatedPG::is_degraded_object(const hobject_t& soid)
   return false;
 }
 
+/**
+ * Whether a write to soid may go ahead while some replicas still
+ * miss it.  Those replicas then get the op's log entries but not its
+ * transaction (see should_send_op), which leaves the object, and
+ * anything else the op touches, in their missing sets for recovery
+ * to fill in later.  We need the object ourselves, at least min_size
+ * up to date copies, no recovery or backfill of soid in progress (a
+ * push started before the write would carry stale data), and peers
+ * that know to expect a log-only op.
+ */
+bool ReplicatedPG::can_write_degraded_object(const hobject_t& soid)
+{
+  if (!cct->_conf->osd_write_degraded_objects ||
+      !pool.info.is_replicated())
+    return false;
+  if (pg_log.get_missing().is_missing(soid) ||
+      recovering.count(soid) ||
+      backfills_in_flight.count(soid))
+    return false;
+
+  unsigned have = 1;  // us
+  for (set<pg_shard_t>::iterator i = actingbackfill.begin();
+       i != actingbackfill.end();
+       ++i) {
+    if (*i == get_primary() || is_backfill_targets(*i))
+      continue;
+    if (!(get_osdmap()->get_xinfo(i->osd).features &
+	  CEPH_FEATURE_OSD_DEGRADED_WRITES))
+      return false;
+    if (!peer_missing.count(*i) || !peer_missing[*i].is_missing(soid))
+      ++have;
+  }
+  if (have < pool.info.min_size) {
+    dout(20) << __func__ << " " << soid << " only " << have
+	     << " up to date copies" << dendl;
+    return false;
+  }
+  return true;
+}
+
 void ReplicatedPG::wait_for_degraded_object(const hobject_t& soid, OpRequestRef op)
 {
   assert(is_degraded_object(soid));
+  osd->logger->inc(l_osd_degraded_wait);
 
   // we don't have it (yet).
   if (recovering.count(soid)) {
@@ -651,6 +692,10 @@ int ReplicatedPG::do_command(cmdmap_t cmdmap, ostream& ss,
       agent_state->dump(f.get());
     f->close_section();
 
+    f->open_object_section("snap_trim_state");
+    snap_trimmer_machine.dump(f.get());
+    f->close_section();
+
     f->close_section();
     f->flush(odata);
     return 0;
@@ -1246,8 +1291,14 @@ void ReplicatedPG::do_op(OpRequestRef& op)
 
   // degraded object?
   if (write_ordered && is_degraded_object(head)) {
-    wait_for_degraded_object(head, op);
-    return;
+    if (op->may_write() && can_write_degraded_object(head)) {
+      dout(10) << __func__ << " " << head
+	       << " is degraded, writing without waiting for recovery" << dendl;
+      osd->logger->inc(l_osd_degraded_write);
+    } else {
+      wait_for_degraded_object(head, op);
+      return;
+    }
   }
 
   // missing snapdir?
@@ -2371,7 +2422,8 @@ void ReplicatedPG::do_backfill(OpRequestRef op)
   }
 }
 
-ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
+ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid,
+						  uint64_t *bytes_removed)
 {
   // load clone info
   bufferlist bl;
@@ -2420,6 +2472,7 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
   ctx->lock_to_release = OpContext::W_LOCK;
   ctx->release_snapset_obc = true;
   ctx->at_version = get_next_version();
+  *bytes_removed = 0;
 
   PGBackend::PGTransaction *t = ctx->op_t;
   set<snapid_t> new_snaps;
@@ -2473,6 +2526,7 @@ ReplicatedPG::RepGather *ReplicatedPG::trim_object(const hobject_t &coid)
     delta.num_object_clones--;
     info.stats.stats.add(delta, obc->obs.oi.category);
     obc->obs.exists = false;
+    *bytes_removed = coi.size;
 
     snapset.clones.erase(p);
     snapset.clone_overlap.erase(last);
@@ -3819,8 +3873,18 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  break;
 	}
 
+	// an ec append must start on a stripe boundary, anything else is
+	// an overwrite (read-modify-write) if the pool allows those
+	bool ec_overwrite = pool.info.allows_ecoverwrites() &&
+	  ((obs.exists && op.extent.offset != oi.size) ||
+	   op.extent.offset % pool.info.required_alignment() != 0);
 	if (!obs.exists) {
 	  ctx->mod_desc.create();
+	} else if (ec_overwrite) {
+	  result = prepare_ec_overwrite(ctx, op.extent.offset,
+					op.extent.length);
+	  if (result < 0)
+	    break;
 	} else if (op.extent.offset == oi.size) {
 	  ctx->mod_desc.append(oi.size);
 	} else {
@@ -3864,7 +3928,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	result = check_offset_and_length(op.extent.offset, op.extent.length, cct->_conf->osd_max_object_size);
 	if (result < 0)
 	  break;
-	if (pool.info.require_rollback()) {
+	if (pool.info.require_rollback() && !ec_overwrite) {
 	  t->append(soid, op.extent.offset, op.extent.length, osd_op.indata);
 	} else {
 	  t->write(soid, op.extent.offset, op.extent.length, osd_op.indata);
@@ -3892,6 +3956,11 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  break;
 
 	if (pool.info.require_rollback()) {
+	  if (ctx->mod_desc.has_rollback_extents()) {
+	    // the stash would collide with the overwrite's stashed extents
+	    result = -EOPNOTSUPP;
+	    break;
+	  }
 	  if (obs.exists) {
 	    if (ctx->mod_desc.rmobject(ctx->at_version.version)) {
 	      t->stash(soid, ctx->at_version.version);
@@ -3950,7 +4019,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 
     case CEPH_OSD_OP_ZERO:
       tracepoint(osd, do_osd_op_pre_zero, soid.oid.name.c_str(), soid.snap.val, op.extent.offset, op.extent.length);
-      if (pool.info.require_rollback()) {
+      if (pool.info.require_rollback() && !pool.info.allows_ecoverwrites()) {
 	result = -EOPNOTSUPP;
 	break;
       }
@@ -3960,7 +4029,23 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (result < 0)
 	  break;
 	assert(op.extent.length);
-	if (obs.exists && !oi.is_whiteout()) {
+	if (pool.info.require_rollback() && obs.exists &&
+	    !oi.is_whiteout()) {
+	  // never zero past the end, that would grow the shards
+	  if (op.extent.offset >= oi.size)
+	    break;
+	  if (op.extent.offset + op.extent.length > oi.size)
+	    op.extent.length = oi.size - op.extent.offset;
+	  result = prepare_ec_overwrite(ctx, op.extent.offset,
+					op.extent.length);
+	  if (result < 0)
+	    break;
+	  t->zero(soid, op.extent.offset, op.extent.length);
+	  interval_set<uint64_t> ch;
+	  ch.insert(op.extent.offset, op.extent.length);
+	  ctx->modified_ranges.union_of(ch);
+	  ctx->delta_stats.num_wr++;
+	} else if (obs.exists && !oi.is_whiteout()) {
 	  ctx->mod_desc.mark_unrollbackable();
 	  t->zero(soid, op.extent.offset, op.extent.length);
 	  interval_set<uint64_t> ch;
@@ -4810,6 +4895,8 @@ inline int ReplicatedPG::_delete_oid(OpContext *ctx, bool no_whiteout)
     return -ENOENT;
 
   if (pool.info.require_rollback()) {
+    if (ctx->mod_desc.has_rollback_extents())
+      return -EOPNOTSUPP;
     if (ctx->mod_desc.rmobject(ctx->at_version.version)) {
       t->stash(soid, ctx->at_version.version);
     } else {
@@ -4923,6 +5010,8 @@ int ReplicatedPG::_rollback_to(OpContext *ctx, ceph_osd_op& op)
 	       << " and rolling back to old snap" << dendl;
 
       if (pool.info.require_rollback()) {
+	if (ctx->mod_desc.has_rollback_extents())
+	  return -EOPNOTSUPP;
 	if (obs.exists) {
 	  if (ctx->mod_desc.rmobject(ctx->at_version.version)) {
 	    t->stash(soid, ctx->at_version.version);
@@ -5164,6 +5253,32 @@ void ReplicatedPG::write_update_size_and_usage(object_stat_sum_t& delta_stats, o
     delta_stats.num_wr_kb += SHIFT_ROUND_UP(length, 10);
 }
 
+int ReplicatedPG::prepare_ec_overwrite(OpContext *ctx, uint64_t offset,
+				       uint64_t length)
+{
+  assert(pool.info.allows_ecoverwrites());
+  if (ctx->mod_desc.has_rollback_extents()) {
+    dout(10) << __func__ << " " << ctx->obs->oi.soid
+	     << " already overwritten by this op" << dendl;
+    return -EOPNOTSUPP;
+  }
+  // the backend stashes the prior contents of the affected stripes, as
+  // they were on disk when the op started, in the object generation
+  // at_version; only extents below the original size need stashing
+  const uint64_t stripe_width = pool.info.get_stripe_width();
+  uint64_t old_size = ctx->obc->obs.exists ? ctx->obc->obs.oi.size : 0;
+  uint64_t aligned_old_size = ROUND_UP_TO(old_size, stripe_width);
+  uint64_t start = offset - (offset % stripe_width);
+  uint64_t end = MIN(ROUND_UP_TO(offset + length, stripe_width),
+		     aligned_old_size);
+  vector<pair<uint64_t, uint64_t> > extents;
+  if (start < end)
+    extents.push_back(make_pair(start, end - start));
+  ctx->mod_desc.rollback_extents(ctx->at_version.version, aligned_old_size,
+				 extents);
+  return 0;
+}
+
 void ReplicatedPG::add_interval_usage(interval_set<uint64_t>& s, object_stat_sum_t& delta_stats)
 {
   for (interval_set<uint64_t>::const_iterator p = s.begin(); p != s.end(); ++p) {
@@ -5296,6 +5411,17 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
   if (result < 0)
     return result;
 
+  // peers that miss a degraded object get only our log entries, which
+  // can't remove anything from their stores.  ops that delete the
+  // object, or recreate it (removing its snapdir), wait for recovery.
+  if ((!ctx->obs->exists || !ctx->new_obs.exists) &&
+      is_degraded_object(soid)) {
+    dout(10) << " " << soid << " is degraded and op removes objects,"
+	     << " waiting for recovery" << dendl;
+    wait_for_degraded_object(soid, ctx->op);
+    return -EAGAIN;
+  }
+
   // finish side-effects
   if (result == 0)
     do_osd_op_effects(ctx);
@@ -6921,6 +7047,17 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
       if (pinfo.last_complete == pinfo.last_update)
 	pinfo.last_complete = ctx->at_version;
       pinfo.last_update = ctx->at_version;
+
+      // a peer still missing soid only gets the log (see
+      // should_send_op), so whatever else the op touches goes missing
+      // there as well.
+      map<pg_shard_t, pg_missing_t>::iterator pm = peer_missing.find(*i);
+      if (pm != peer_missing.end() && pm->second.is_missing(soid)) {
+	for (vector<pg_log_entry_t>::iterator j = ctx->log.begin();
+	     j != ctx->log.end();
+	     ++j)
+	  pm->second.add_next_event(*j);
+      }
     }
   }
 
@@ -7011,7 +7148,14 @@ void ReplicatedBackend::issue_op(
       tid, at_version);
 
     // ship resulting transaction, log entries, and pg_stats
-    if (!parent->should_send_op(peer, soid)) {
+    boost::optional<const pg_missing_t &> pmissing =
+      parent->maybe_get_shard_missing(peer);
+    if (pmissing && pmissing->is_missing(soid)) {
+      dout(10) << "issue_repop shipping empty opt to osd." << peer
+	       << ", which is missing " << soid << dendl;
+      ObjectStore::Transaction t;
+      ::encode(t, wr->get_data());
+    } else if (!parent->should_send_op(peer, soid)) {
       dout(10) << "issue_repop shipping empty opt to osd." << peer
 	       <<", object " << soid
 	       << " beyond MAX(last_backfill_started "
@@ -7773,8 +7917,9 @@ void ReplicatedBackend::sub_op_modify(OpRequestRef op)
   // sanity checks
   assert(m->map_epoch >= get_info().history.same_interval_since);
   
-  // we better not be missing this.
-  assert(!parent->get_log().get_missing().is_missing(soid));
+  // if we are missing this, the primary wrote it without waiting for
+  // recovery and sent us only the log entries.
+  bool missing = parent->get_log().get_missing().is_missing(soid);
 
   int ackerosd = m->get_source().num();
   
@@ -7824,6 +7969,16 @@ void ReplicatedBackend::sub_op_modify(OpRequestRef op)
     }
     rm->opt.set_replica();
 
+    if (missing) {
+      assert(rm->opt.empty());
+      dout(10) << __func__ << " missing " << soid
+	       << ", recording the op's objects as missing" << dendl;
+      for (vector<pg_log_entry_t>::iterator i = log.begin();
+	   i != log.end();
+	   ++i)
+	parent->add_local_next_event(*i);
+    }
+
     bool update_snaps = false;
     if (!rm->opt.empty()) {
       // If the opt is non-empty, we infer we are before
@@ -12171,6 +12326,28 @@ void ReplicatedPG::SnapTrimmer::log_exit(const char *state_name, utime_t enter_t
   dout(20) << "exit " << state_name << dendl;
 }
 
+void ReplicatedPG::SnapTrimmer::dump(Formatter *f) const
+{
+  f->dump_string("state", state_cast<const NamedState&>().state_name);
+  f->dump_stream("snap_trimq") << pg->snap_trimq;
+  f->dump_unsigned("snaps_queued", pg->snap_trimq.size());
+  f->dump_stream("snap_to_trim") << snap_to_trim;
+  f->dump_unsigned("objects_trimmed", trimmed);
+  f->dump_unsigned("bytes_trimmed", trimmed_bytes);
+  f->dump_unsigned("in_flight", repops.size());
+}
+
+struct C_SnapTrimRetry : public Context {
+  ReplicatedPGRef pg;
+  C_SnapTrimRetry(ReplicatedPG *p) : pg(p) {}
+  void finish(int r) {
+    pg->lock();
+    if (!pg->deleting)
+      pg->queue_snap_trim();
+    pg->unlock();
+  }
+};
+
 /*---SnapTrimmer states---*/
 #undef dout_prefix
 #define dout_prefix (*_dout << context< SnapTrimmer >().pg->gen_prefix() \
@@ -12210,6 +12387,8 @@ boost::statechart::result ReplicatedPG::NotTrimming::react(const SnapTrim&)
     return discard_event();
   } else {
     context<SnapTrimmer>().snap_to_trim = pg->snap_trimq.range_start();
+    context<SnapTrimmer>().trimmed = 0;
+    context<SnapTrimmer>().trimmed_bytes = 0;
     dout(10) << "NotTrimming: trimming "
 	     << pg->snap_trimq.range_start()
 	     << dendl;
@@ -12224,6 +12403,9 @@ ReplicatedPG::TrimmingObjects::TrimmingObjects(my_context ctx)
     NamedState(context< SnapTrimmer >().pg->cct, "Trimming/TrimmingObjects")
 {
   context< SnapTrimmer >().log_enter(state_name);
+  // each pass kicks the next one itself, via repop completion or the
+  // budget timer; don't spin on the queue in between.
+  context< SnapTrimmer >().requeue = false;
 }
 
 void ReplicatedPG::TrimmingObjects::exit()
@@ -12247,32 +12429,74 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
 
   dout(10) << "TrimmingObjects: trimming snap " << snap_to_trim << dendl;
 
-  // Get next
-  hobject_t old_pos = pos;
-  int r = pg->snap_mapper.get_next_object_to_trim(snap_to_trim, &pos);
-  if (r != 0 && r != -ENOENT) {
-    derr << __func__ << ": get_next returned " << cpp_strerror(r) << dendl;
-    assert(0);
-  } else if (r == -ENOENT) {
-    // Done!
-    dout(10) << "TrimmingObjects: got ENOENT" << dendl;
-    post_event(SnapTrim());
-    return transit< WaitingOnReplicas >();
+  // let the previous batch apply before starting another; its
+  // completion requeues us.
+  for (set<RepGather *>::iterator i = repops.begin();
+       i != repops.end(); ) {
+    if (!(*i)->all_applied) {
+      dout(10) << "TrimmingObjects: " << repops.size()
+	       << " trims still in flight" << dendl;
+      return discard_event();
+    }
+    (*i)->put();
+    repops.erase(i++);
   }
 
-  dout(10) << "TrimmingObjects react trimming " << pos << dendl;
-  RepGather *repop = pg->trim_object(pos);
-  if (!repop) {
-    dout(10) << __func__ << " could not get write lock on obj "
-	     << pos << dendl;
-    pos = old_pos;
+  utime_t wait;
+  if (!pg->osd->snap_trim_budget_get(&wait)) {
+    dout(10) << "TrimmingObjects: over snap trim budget, retrying in "
+	     << wait << dendl;
+    pg->osd->logger->inc(l_osd_snap_trim_throttle);
+    Mutex::Locker l(pg->osd->snap_trim_timer_lock);
+    pg->osd->snap_trim_timer.add_event_after(wait, new C_SnapTrimRetry(pg));
     return discard_event();
   }
-  assert(repop);
-  repop->queue_snap_trimmer = true;
 
-  repops.insert(repop->get());
-  pg->simple_repop_submit(repop);
+  unsigned max = MAX(pg->cct->_conf->osd_snap_trim_batch_size, 1);
+  unsigned n = 0;
+  uint64_t bytes = 0;
+  int r = 0;
+  while (n < max) {
+    // Get next
+    hobject_t old_pos = pos;
+    r = pg->snap_mapper.get_next_object_to_trim(snap_to_trim, &pos);
+    if (r != 0 && r != -ENOENT) {
+      derr << __func__ << ": get_next returned " << cpp_strerror(r) << dendl;
+      assert(0);
+    } else if (r == -ENOENT) {
+      break;
+    }
+
+    dout(10) << "TrimmingObjects react trimming " << pos << dendl;
+    uint64_t removed = 0;
+    RepGather *repop = pg->trim_object(pos, &removed);
+    if (!repop) {
+      // releasing the lock will requeue us
+      dout(10) << __func__ << " could not get write lock on obj "
+	       << pos << dendl;
+      pos = old_pos;
+      break;
+    }
+    repop->queue_snap_trimmer = true;
+
+    repops.insert(repop->get());
+    pg->simple_repop_submit(repop);
+    ++n;
+    bytes += removed;
+  }
+
+  if (n) {
+    context<SnapTrimmer>().trimmed += n;
+    context<SnapTrimmer>().trimmed_bytes += bytes;
+    pg->osd->snap_trim_budget_charge(n, bytes);
+  }
+
+  if (r == -ENOENT) {
+    // Done!
+    dout(10) << "TrimmingObjects: got ENOENT" << dendl;
+    post_event(SnapTrim());
+    return transit< WaitingOnReplicas >();
+  }
   return discard_event();
 }
 /* WaitingOnReplicasObjects */
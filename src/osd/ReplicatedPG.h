@@ -357,6 +357,10 @@ public:
     append_log(logv, trim_to, trim_rollback_to, *t, transaction_applied);
   }
 
+  void add_local_next_event(const pg_log_entry_t &e) {
+    pg_log.missing_add_event(e);
+  }
+
   void op_applied(
     const eversion_t &applied_version);
 
@@ -366,6 +370,10 @@ public:
     if (peer == get_primary())
       return true;
     assert(peer_info.count(peer));
+    // peers still missing the object get only the log entries; see
+    // can_write_degraded_object().
+    if (peer_missing.count(peer) && peer_missing[peer].is_missing(hoid))
+      return false;
     bool should_send = hoid.pool != (int64_t)info.pgid.pool() ||
       hoid <= MAX(last_backfill_started, peer_info[peer].last_backfill);
     if (!should_send)
@@ -1047,6 +1055,8 @@ protected:
 				   SnapSet& ss, interval_set<uint64_t>& modified,
 				   uint64_t offset, uint64_t length, bool count_bytes);
   void add_interval_usage(interval_set<uint64_t>& s, object_stat_sum_t& st);
+  /// record rollback info for an in place overwrite of an ec object
+  int prepare_ec_overwrite(OpContext *ctx, uint64_t offset, uint64_t length);
 
   /**
    * This helper function is called from do_op if the ObjectContext lookup fails.
@@ -1287,7 +1297,7 @@ public:
     ThreadPool::TPHandle &handle);
   void do_backfill(OpRequestRef op);
 
-  RepGather *trim_object(const hobject_t &coid);
+  RepGather *trim_object(const hobject_t &coid, uint64_t *bytes_removed);
   void snap_trimmer();
   int do_osd_ops(OpContext *ctx, vector<OSDOp>& ops);
 
@@ -1334,12 +1344,17 @@ private:
     ReplicatedPG *pg;
     set<RepGather *> repops;
     snapid_t snap_to_trim;
+    uint64_t trimmed;        ///< clones trimmed so far for snap_to_trim
+    uint64_t trimmed_bytes;  ///< bytes removed so far for snap_to_trim
     bool need_share_pg_info;
     bool requeue;
-    SnapTrimmer(ReplicatedPG *pg) : pg(pg), need_share_pg_info(false), requeue(false) {}
+    SnapTrimmer(ReplicatedPG *pg)
+      : pg(pg), trimmed(0), trimmed_bytes(0),
+	need_share_pg_info(false), requeue(false) {}
     ~SnapTrimmer();
     void log_enter(const char *state_name);
     void log_exit(const char *state_name, utime_t duration);
+    void dump(Formatter *f) const;
   } snap_trimmer_machine;
 
   /* SnapTrimmerStates */
@@ -1388,6 +1403,7 @@ public:
   void wait_for_all_missing(OpRequestRef op);
 
   bool is_degraded_object(const hobject_t& oid);
+  bool can_write_degraded_object(const hobject_t& oid);
   void wait_for_degraded_object(const hobject_t& oid, OpRequestRef op);
 
   bool maybe_await_blocked_snapset(const hobject_t &soid, OpRequestRef op);
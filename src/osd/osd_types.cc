@@ -2542,6 +2542,16 @@ void ObjectModDesc::visit(Visitor *visitor) const
 	visitor->update_snaps(snaps);
 	break;
       }
+      case ROLLBACK_EXTENTS: {
+	version_t gen;
+	uint64_t old_size;
+	vector<pair<uint64_t, uint64_t> > extents;
+	::decode(gen, bp);
+	::decode(old_size, bp);
+	::decode(extents, bp);
+	visitor->rollback_extents(gen, old_size, extents);
+	break;
+      }
       default:
 	assert(0 == "Invalid rollback code");
       }
@@ -2552,6 +2562,26 @@ void ObjectModDesc::visit(Visitor *visitor) const
   }
 }
 
+struct HasRollbackExtentsVisitor : public ObjectModDesc::Visitor {
+  bool found;
+  HasRollbackExtentsVisitor() : found(false) {}
+  void rollback_extents(
+    version_t gen,
+    uint64_t old_size,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    found = true;
+  }
+};
+
+bool ObjectModDesc::has_rollback_extents() const
+{
+  if (!can_local_rollback)
+    return false;
+  HasRollbackExtentsVisitor vis;
+  visit(&vis);
+  return vis.found;
+}
+
 struct DumpVisitor : public ObjectModDesc::Visitor {
   Formatter *f;
   DumpVisitor(Formatter *f) : f(f) {}
@@ -2590,6 +2620,17 @@ struct DumpVisitor : public ObjectModDesc::Visitor {
     f->dump_stream("snaps") << snaps;
     f->close_section();
   }
+  void rollback_extents(
+    version_t gen,
+    uint64_t old_size,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    f->open_object_section("op");
+    f->dump_string("code", "ROLLBACK_EXTENTS");
+    f->dump_unsigned("gen", gen);
+    f->dump_unsigned("old_size", old_size);
+    f->dump_stream("extents") << extents;
+    f->close_section();
+  }
 };
 
 void ObjectModDesc::dump(Formatter *f) const
@@ -2625,6 +2666,14 @@ void ObjectModDesc::generate_test_instances(list<ObjectModDesc*>& o)
   o.back()->setattrs(attrs);
   o.back()->mark_unrollbackable();
   o.back()->append(1000);
+  o.push_back(new ObjectModDesc());
+  {
+    vector<pair<uint64_t, uint64_t> > extents;
+    extents.push_back(make_pair(0, 4096));
+    extents.push_back(make_pair(65536, 8192));
+    o.back()->setattrs(attrs);
+    o.back()->rollback_extents(1002, 73728, extents);
+  }
 }
 
 void ObjectModDesc::encode(bufferlist &_bl) const
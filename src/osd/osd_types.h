@@ -819,6 +819,7 @@ struct pg_pool_t {
     FLAG_FULL       = 1<<1, // pool is full
     FLAG_DEBUG_FAKE_EC_POOL = 1<<2, // require ReplicatedPG to act like an EC pg
     FLAG_INCOMPLETE_CLONES = 1<<3, // may have incomplete clones (bc we are/were an overlay)
+    FLAG_EC_OVERWRITES = 1<<4, // ec pool accepts partial (read-modify-write) overwrites
   };
 
   static const char *get_flag_name(int f) {
@@ -827,6 +828,7 @@ struct pg_pool_t {
     case FLAG_FULL: return "full";
     case FLAG_DEBUG_FAKE_EC_POOL: return "require_local_rollback";
     case FLAG_INCOMPLETE_CLONES: return "incomplete_clones";
+    case FLAG_EC_OVERWRITES: return "ec_overwrites";
     default: return "???";
     }
   }
@@ -1021,6 +1023,11 @@ public:
     return ec_pool() || flags & FLAG_DEBUG_FAKE_EC_POOL;
   }
 
+  /// true if an ec pool may be overwritten in place (read-modify-write)
+  bool allows_ecoverwrites() const {
+    return ec_pool() && has_flag(FLAG_EC_OVERWRITES);
+  }
+
   /// true if incomplete clones may be present
   bool allow_incomplete_clones() const {
     return cache_mode != CACHEMODE_NONE || has_flag(FLAG_INCOMPLETE_CLONES);
@@ -1050,7 +1057,9 @@ public:
   bool is_replicated()   const { return get_type() == TYPE_REPLICATED; }
   bool is_erasure() const { return get_type() == TYPE_ERASURE; }
 
-  bool requires_aligned_append() const { return is_erasure(); }
+  bool requires_aligned_append() const {
+    return is_erasure() && !has_flag(FLAG_EC_OVERWRITES);
+  }
   uint64_t required_alignment() const { return stripe_width; }
 
   bool can_shift_osds() const {
@@ -1898,6 +1907,10 @@ public:
     virtual void rmobject(version_t old_version) {}
     virtual void create() {}
     virtual void update_snaps(set<snapid_t> &old_snaps) {}
+    virtual void rollback_extents(
+      version_t gen,
+      uint64_t old_size,
+      const vector<pair<uint64_t, uint64_t> > &extents) {}
     virtual ~Visitor() {}
   };
   void visit(Visitor *visitor) const;
@@ -1907,7 +1920,8 @@ public:
     SETATTRS = 2,
     DELETE = 3,
     CREATE = 4,
-    UPDATE_SNAPS = 5
+    UPDATE_SNAPS = 5,
+    ROLLBACK_EXTENTS = 6
   };
   ObjectModDesc() : can_local_rollback(true), rollback_info_completed(false) {}
   void claim(ObjectModDesc &other) {
@@ -1983,6 +1997,28 @@ public:
     ::encode(old_snaps, bl);
     ENCODE_FINISH(bl);
   }
+  /**
+   * Overwrite of existing object data.  The prior contents of extents
+   * (logical, stripe aligned) have been cloned into the object
+   * generation gen, and the object was old_size bytes long before the
+   * overwrite.
+   */
+  bool rollback_extents(
+    version_t gen,
+    uint64_t old_size,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    if (!can_local_rollback || rollback_info_completed)
+      return false;
+    ENCODE_START(1, 1, bl);
+    append_id(ROLLBACK_EXTENTS);
+    ::encode(gen, bl);
+    ::encode(old_size, bl);
+    ::encode(extents, bl);
+    ENCODE_FINISH(bl);
+    return true;
+  }
+  /// true if an overwrite has already stashed extents for this object
+  bool has_rollback_extents() const;
 
   // cannot be rolled back
   void mark_unrollbackable() {
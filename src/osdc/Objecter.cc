@@ -68,6 +68,7 @@ enum {
   l_osdc_op_w,
   l_osdc_op_rmw,
   l_osdc_op_pg,
+  l_osdc_op_coalesced,
 
   l_osdc_osdop_stat,
   l_osdc_osdop_create,
@@ -191,6 +192,7 @@ void Objecter::init()
     pcb.add_u64_counter(l_osdc_op_w, "op_w");
     pcb.add_u64_counter(l_osdc_op_rmw, "op_rmw");
     pcb.add_u64_counter(l_osdc_op_pg, "op_pg");
+    pcb.add_u64_counter(l_osdc_op_coalesced, "op_coalesced");
 
     pcb.add_u64_counter(l_osdc_osdop_stat, "osdop_stat");
     pcb.add_u64_counter(l_osdc_osdop_create, "osdop_create");
@@ -268,6 +270,8 @@ void Objecter::init()
   }
 
   timer.init();
+  if (coalesce_writes)
+    coalesce_finisher.start();
 
   initialized.set(1);
 }
@@ -290,6 +294,26 @@ void Objecter::shutdown()
 {
   assert(initialized.read());
 
+  // the finisher submits ops, so it must be gone before we lock
+  if (coalesce_writes) {
+    coalesce_finisher.stop();
+    Mutex::Locker l(coalesce_lock);
+    for (map<coalesce_key_t, list<Op*> >::iterator p = coalesce_queues.begin();
+	 p != coalesce_queues.end();
+	 ++p) {
+      for (list<Op*>::iterator q = p->second.begin();
+	   q != p->second.end();
+	   ++q) {
+	if ((*q)->budgeted)
+	  put_op_budget(*q);
+	delete (*q)->onack;
+	delete (*q)->oncommit;
+	(*q)->put();
+      }
+    }
+    coalesce_queues.clear();
+  }
+
   RWLock::WLocker wl(rwlock);
 
   initialized.set(0);
@@ -1238,6 +1262,7 @@ int Objecter::_get_session(int osd, OSDSession **session, RWLock::Context& lc)
   OSDSession *s = new OSDSession(cct, osd);
   osd_sessions[osd] = s;
   s->con = messenger->get_connection(osdmap->get_inst(osd));
+  s->con->set_priv(s->get());
   logger->inc(l_osdc_osd_session_open);
   logger->inc(l_osdc_osd_sessions, osd_sessions.size());
   s->get();
@@ -1271,10 +1296,12 @@ void Objecter::_reopen_session(OSDSession *s)
   entity_inst_t inst = osdmap->get_inst(s->osd);
   ldout(cct, 10) << "reopen_session osd." << s->osd << " session, addr now " << inst << dendl;
   if (s->con) {
+    s->con->set_priv(NULL);
     s->con->mark_down();
     logger->inc(l_osdc_osd_session_close);
   }
   s->con = messenger->get_connection(inst);
+  s->con->set_priv(s->get());
   s->incarnation++;
   logger->inc(l_osdc_osd_session_open);
 }
@@ -1285,6 +1312,7 @@ void Objecter::close_session(OSDSession *s)
 
   ldout(cct, 10) << "close_session for osd." << s->osd << dendl;
   if (s->con) {
+    s->con->set_priv(NULL);
     s->con->mark_down();
     logger->inc(l_osdc_osd_session_close);
   }
@@ -1317,7 +1345,9 @@ void Objecter::close_session(OSDSession *s)
 
   osd_sessions.erase(s->osd);
   s->lock.unlock();
-  assert(s->get_nref() == 1);  // We reassigned any/all ops, so should be last ref
+  // We reassigned any/all ops, so the only other refs are from replies
+  // that found the session through its connection; they will find no
+  // ops here.
   put_session(s);
 
   // Assign any leftover ops to the homeless session
@@ -1674,9 +1704,321 @@ ceph_tid_t Objecter::op_submit(Op *op)
 {
   RWLock::RLocker rl(rwlock);
   RWLock::Context lc(rwlock, RWLock::Context::TakenForRead);
+  if (coalesce_writes && osd_timeout <= 0) {
+    assert(initialized.read());
+    _take_op_budget(op);
+    if (_coalesce_submit(op))
+      return 0;
+    return _op_submit(op, lc);
+  }
   return _op_submit_with_budget(op, lc);
 }
 
+class Objecter::C_CoalescedReply : public Context {
+  Objecter *objecter;
+  CoalescedOp *c;
+  bool commit;
+public:
+  C_CoalescedReply(Objecter *o, CoalescedOp *c, bool commit)
+    : objecter(o), c(c), commit(commit) {}
+  void finish(int r) {
+    objecter->coalesced_finish(c, commit, r);
+  }
+};
+
+class Objecter::C_CoalesceRelease : public Context {
+  Objecter *objecter;
+  coalesce_key_t key;
+  Context *onfinish;
+public:
+  C_CoalesceRelease(Objecter *o, const coalesce_key_t& k, Context *c)
+    : objecter(o), key(k), onfinish(c) {}
+  void finish(int r) {
+    onfinish->complete(r);
+    objecter->coalesce_done(key, NULL);
+  }
+};
+
+class Objecter::C_CoalesceKick : public Context {
+  Objecter *objecter;
+  coalesce_key_t key;
+public:
+  vector<Op*> retry;
+  C_CoalesceKick(Objecter *o, const coalesce_key_t& k)
+    : objecter(o), key(k) {}
+  void finish(int r) {
+    objecter->coalesce_kick(key, retry);
+  }
+};
+
+bool Objecter::_op_coalescable(Op *op)
+{
+  if ((op->target.flags & (CEPH_OSD_FLAG_READ | CEPH_OSD_FLAG_WRITE |
+			   CEPH_OSD_FLAG_PGOP)) != CEPH_OSD_FLAG_WRITE)
+    return false;
+  if (op->outbl || op->snapid != CEPH_NOSNAP || op->ontimeout ||
+      (!op->onack && !op->oncommit))
+    return false;
+
+  uint64_t bytes = 0;
+  for (vector<OSDOp>::iterator p = op->ops.begin(); p != op->ops.end(); ++p) {
+    switch (p->op.op) {
+    case CEPH_OSD_OP_CREATE:
+    case CEPH_OSD_OP_WRITE:
+    case CEPH_OSD_OP_WRITEFULL:
+    case CEPH_OSD_OP_APPEND:
+    case CEPH_OSD_OP_ZERO:
+    case CEPH_OSD_OP_TRUNCATE:
+    case CEPH_OSD_OP_DELETE:
+    case CEPH_OSD_OP_SETXATTR:
+    case CEPH_OSD_OP_RMXATTR:
+    case CEPH_OSD_OP_OMAPSETVALS:
+    case CEPH_OSD_OP_OMAPSETHEADER:
+    case CEPH_OSD_OP_OMAPCLEAR:
+    case CEPH_OSD_OP_OMAPRMKEYS:
+      break;
+    case CEPH_OSD_OP_CMPXATTR:
+    case CEPH_OSD_OP_ASSERT_VER:
+    case CEPH_OSD_OP_OMAP_CMP:
+    case CEPH_OSD_OP_CALL:
+      // may only lead a merge; see _op_reads_state()
+      break;
+    default:
+      return false;
+    }
+    bytes += p->indata.length();
+  }
+  return bytes <= cct->_conf->objecter_coalesce_max_bytes;
+}
+
+/**
+ * does the op check or act on the object's state?
+ *
+ * Guards and class methods are only merged at the front of a compound
+ * op, where they see the object just as they would if sent alone.  If
+ * one fails, the whole compound op fails and its parts are resent one
+ * at a time, so the guard still fails by itself.
+ */
+bool Objecter::_op_reads_state(Op *op)
+{
+  for (vector<OSDOp>::iterator p = op->ops.begin(); p != op->ops.end(); ++p) {
+    switch (p->op.op) {
+    case CEPH_OSD_OP_CMPXATTR:
+    case CEPH_OSD_OP_ASSERT_VER:
+    case CEPH_OSD_OP_OMAP_CMP:
+    case CEPH_OSD_OP_CALL:
+      return true;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+bool Objecter::_ops_compatible(Op *first, Op *op)
+{
+  return !_op_reads_state(op) &&
+    op->target.flags == first->target.flags &&
+    op->priority == first->priority &&
+    op->snapc.seq == first->snapc.seq &&
+    op->snapc.snaps == first->snapc.snaps &&
+    !op->onack == !first->onack &&
+    !op->oncommit == !first->oncommit &&
+    _op_coalescable(op);
+}
+
+/**
+ * queue an op behind the write in flight to its object, if any
+ *
+ * @return true if the op was queued, false if it should be sent now
+ */
+bool Objecter::_coalesce_submit(Op *op)
+{
+  assert(rwlock.is_locked());
+
+  coalesce_key_t key(op->target);
+  Mutex::Locker l(coalesce_lock);
+  map<coalesce_key_t, list<Op*> >::iterator p = coalesce_queues.find(key);
+  if (p != coalesce_queues.end()) {
+    ldout(cct, 20) << __func__ << " queued " << op << " behind write to "
+		   << op->target.base_oid << dendl;
+    p->second.push_back(op);
+    return true;
+  }
+  if (_op_coalescable(op)) {
+    coalesce_queues[key];
+    _coalesce_track(op, key);
+  }
+  return false;
+}
+
+/// have the op release what queues behind it once it completes
+void Objecter::_coalesce_track(Op *op, const coalesce_key_t& key)
+{
+  if (op->oncommit)
+    op->oncommit = new C_CoalesceRelease(this, key, op->oncommit);
+  else
+    op->onack = new C_CoalesceRelease(this, key, op->onack);
+}
+
+Objecter::Op *Objecter::_coalesce_merge(const coalesce_key_t& key,
+					vector<Op*>& parts)
+{
+  Op *first = parts.front();
+  vector<OSDOp> ops;
+  for (vector<Op*>::iterator p = parts.begin(); p != parts.end(); ++p)
+    ops.insert(ops.end(), (*p)->ops.begin(), (*p)->ops.end());
+
+  CoalescedOp *c = new CoalescedOp(key, parts);
+  Context *onack = NULL;
+  Context *oncommit = NULL;
+  if (first->onack) {
+    onack = new C_CoalescedReply(this, c, false);
+    ++c->pending;
+  }
+  if (first->oncommit) {
+    oncommit = new C_CoalescedReply(this, c, true);
+    ++c->pending;
+  }
+
+  Op *op = new Op(first->target.base_oid, first->target.base_oloc, ops,
+		  first->target.flags, onack, oncommit, &c->objver);
+  op->snapc = first->snapc;
+  op->mtime = c->parts.back()->mtime;
+  op->priority = first->priority;
+  op->reply_epoch = &c->reply_epoch;
+
+  // parts keep their own budget until the compound op is done
+  c->outbl.resize(op->ops.size());
+  c->rval.resize(op->ops.size());
+  for (unsigned i = 0; i < op->ops.size(); i++) {
+    op->out_bl[i] = &c->outbl[i];
+    op->out_rval[i] = &c->rval[i];
+  }
+
+  logger->inc(l_osdc_op_coalesced, c->parts.size());
+  ldout(cct, 15) << __func__ << " " << c->parts.size() << " ops to "
+		 << op->target.base_oid << " as " << op << dendl;
+  return op;
+}
+
+void Objecter::coalesced_finish(CoalescedOp *c, bool commit, int r)
+{
+  c->lock.Lock();
+  if (r >= 0 && !c->demuxed) {
+    unsigned i = 0;
+    for (vector<Op*>::iterator p = c->parts.begin(); p != c->parts.end(); ++p) {
+      Op *op = *p;
+      for (unsigned j = 0; j < op->ops.size(); ++i, ++j) {
+	if (op->out_bl[j])
+	  *op->out_bl[j] = c->outbl[i];
+	if (op->out_rval[j])
+	  *op->out_rval[j] = c->rval[i];
+	if (op->out_handler[j]) {
+	  op->out_handler[j]->complete(c->rval[i]);
+	  op->out_handler[j] = NULL;
+	}
+      }
+      if (op->objver)
+	*op->objver = c->objver;
+      if (op->reply_epoch)
+	*op->reply_epoch = c->reply_epoch;
+    }
+    c->demuxed = true;
+  }
+
+  // a failed compound op changed nothing, so the parts are resent
+  // alone.  once they have had their results they get any error as is.
+  if (c->demuxed) {
+    for (vector<Op*>::iterator p = c->parts.begin(); p != c->parts.end(); ++p) {
+      Context **ctx = commit ? &(*p)->oncommit : &(*p)->onack;
+      if (*ctx) {
+	(*ctx)->complete(r);
+	*ctx = NULL;
+      }
+    }
+  }
+
+  bool done = --c->pending == 0;
+  c->lock.Unlock();
+  if (!done)
+    return;
+
+  if (c->demuxed) {
+    for (vector<Op*>::iterator p = c->parts.begin(); p != c->parts.end(); ++p) {
+      put_op_budget(*p);
+      (*p)->put();
+    }
+    coalesce_done(c->key, NULL);
+  } else {
+    ldout(cct, 10) << __func__ << " compound op to " << c->key.oid
+		   << " failed, resending its " << c->parts.size()
+		   << " parts" << dendl;
+    coalesce_done(c->key, &c->parts);
+  }
+  delete c;
+}
+
+/**
+ * the write in flight to an object completed; send what it held back
+ *
+ * We may be called with any objecter lock held, so the sending is
+ * left to the finisher.
+ *
+ * @param retry ops to resend first, one at a time
+ */
+void Objecter::coalesce_done(const coalesce_key_t& key, vector<Op*> *retry)
+{
+  C_CoalesceKick *kick = new C_CoalesceKick(this, key);
+  if (retry)
+    kick->retry.swap(*retry);
+  coalesce_finisher.queue(kick);
+}
+
+void Objecter::coalesce_kick(const coalesce_key_t& key, vector<Op*>& retry)
+{
+  RWLock::RLocker rl(rwlock);
+  RWLock::Context lc(rwlock, RWLock::Context::TakenForRead);
+
+  list<Op*> send(retry.begin(), retry.end());
+  coalesce_lock.Lock();
+  map<coalesce_key_t, list<Op*> >::iterator p = coalesce_queues.find(key);
+  assert(p != coalesce_queues.end());
+  list<Op*>& q = p->second;
+  while (!q.empty() && !_op_coalescable(q.front())) {
+    send.push_back(q.front());
+    q.pop_front();
+  }
+  if (q.empty()) {
+    coalesce_queues.erase(p);
+  } else {
+    vector<Op*> parts;
+    parts.push_back(q.front());
+    q.pop_front();
+    uint64_t bytes = calc_op_budget(parts.front());
+    while (!q.empty() &&
+	   (int)parts.size() < cct->_conf->objecter_coalesce_max_ops &&
+	   _ops_compatible(parts.front(), q.front())) {
+      uint64_t op_bytes = calc_op_budget(q.front());
+      if (bytes + op_bytes > cct->_conf->objecter_coalesce_max_bytes)
+	break;
+      bytes += op_bytes;
+      parts.push_back(q.front());
+      q.pop_front();
+    }
+    if (parts.size() == 1) {
+      _coalesce_track(parts.front(), key);
+      send.push_back(parts.front());
+    } else {
+      send.push_back(_coalesce_merge(key, parts));
+    }
+  }
+  coalesce_lock.Unlock();
+
+  for (list<Op*>::iterator i = send.begin(); i != send.end(); ++i)
+    _op_submit(*i, lc);
+}
+
 ceph_tid_t Objecter::_op_submit_with_budget(Op *op, RWLock::Context& lc)
 {
   assert(initialized.read());
@@ -1858,6 +2200,11 @@ int Objecter::op_cancel(OSDSession *s, ceph_tid_t tid, int r)
 
   ldout(cct, 10) << __func__ << " tid " << tid << dendl;
   Op *op = p->second;
+  // the caller may free the rx buffer once we complete, so the
+  // messenger must not be left receiving into it
+  if (op->con) {
+    op->con->revoke_rx_buffer(op->tid);
+  }
   if (op->onack) {
     op->onack->complete(r);
     op->onack = NULL;
@@ -2452,21 +2799,41 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 
   int osd_num = (int)m->get_source().num();
 
-  RWLock::RLocker l(rwlock);
-  RWLock::Context lc(rwlock, RWLock::Context::TakenForRead);
+  // The session is normally found through the connection, without
+  // rwlock.  Only redirects and resends need it; they start over with
+  // it held.
+  bool locked = false;
+  RWLock::Context lc(rwlock, RWLock::Context::Untaken);
+  OSDSession *s;
 
-  map<int, OSDSession *>::iterator siter = osd_sessions.find(osd_num);
-  if (siter == osd_sessions.end()) {
-    ldout(cct, 7) << "handle_osd_op_reply " << tid
-		  << (m->is_ondisk() ? " ondisk":(m->is_onnvram() ?
-						  " onnvram":" ack"))
-		  << " ... unknown osd" << dendl;
-    m->put();
-    return;
+ retry:
+  s = NULL;
+  if (!locked) {
+    s = static_cast<OSDSession*>(m->get_connection()->get_priv());
+    if (s && s->osd != osd_num) {
+      s->put();
+      s = NULL;
+    }
+  }
+  if (!s) {
+    if (!locked) {
+      rwlock.get_read();
+      lc.set_state(RWLock::Context::TakenForRead);
+      locked = true;
+    }
+    map<int, OSDSession *>::iterator siter = osd_sessions.find(osd_num);
+    if (siter == osd_sessions.end()) {
+      ldout(cct, 7) << "handle_osd_op_reply " << tid
+		    << (m->is_ondisk() ? " ondisk":(m->is_onnvram() ?
+						    " onnvram":" ack"))
+		    << " ... unknown osd" << dendl;
+      rwlock.unlock();
+      m->put();
+      return;
+    }
+    s = siter->second;
+    get_session(s);
   }
-
-  OSDSession *s = siter->second;
-  get_session(s);
 
   s->lock.get_write();
 
@@ -2477,6 +2844,8 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 	    << " ... stray" << dendl;
     s->lock.unlock();
     put_session(s);
+    if (locked)
+      rwlock.unlock();
     m->put();
     return;
   }
@@ -2498,6 +2867,8 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
       m->put();
       s->lock.unlock();
       put_session(s);
+      if (locked)
+	rwlock.unlock();
       return;
     }
   } else {
@@ -2511,6 +2882,15 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 
   int rc = m->get_result();
 
+  if (!locked && (m->is_redirect_reply() || rc == -EAGAIN)) {
+    s->lock.unlock();
+    put_session(s);
+    rwlock.get_read();
+    lc.set_state(RWLock::Context::TakenForRead);
+    locked = true;
+    goto retry;
+  }
+
   if (m->is_redirect_reply()) {
     ldout(cct, 5) << " got redirect reply; redirecting" << dendl;
     if (op->onack)
@@ -2528,6 +2908,7 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 					   op->target.target_oid.name);
     op->target.flags |= CEPH_OSD_FLAG_REDIRECTED;
     _op_submit(op, lc);
+    rwlock.unlock();
     m->put();
     return;
   }
@@ -2542,12 +2923,15 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     _send_op(op);
     s->lock.unlock();
     put_session(s);
+    rwlock.unlock();
     m->put();
     return;
   }
 
-  l.unlock();
-  lc.set_state(RWLock::Context::Untaken);
+  if (locked) {
+    rwlock.unlock();
+    lc.set_state(RWLock::Context::Untaken);
+  }
 
   if (op->objver)
     *op->objver = m->get_user_version();
@@ -24,6 +24,8 @@
 #include "common/admin_socket.h"
 #include "common/Timer.h"
 #include "common/RWLock.h"
+#include "common/Mutex.h"
+#include "common/Finisher.h"
 #include "include/rados/rados_types.h"
 #include "include/rados/rados_types.hpp"
 
@@ -1034,6 +1036,13 @@ private:
   version_t last_seen_osdmap_version;
   version_t last_seen_pgmap_version;
 
+  /**
+   * Protects osdmap, osd_sessions and the linger and command state.
+   * Every op submission takes it for read, since the target is computed
+   * against osdmap, which handle_osd_map updates in place under the
+   * write lock.  Replies find their session through the connection and
+   * take it only for redirects and resends.
+   */
   RWLock rwlock;
   RWTimer timer;
 
@@ -1586,6 +1595,81 @@ public:
   }
   Throttle op_throttle_bytes, op_throttle_ops;
 
+  /**
+   * write coalescing (objecter_coalesce_writes)
+   *
+   * While a small write to an object is in flight, later ops to the
+   * same object queue up behind it rather than going out.  When it
+   * completes, the leading run of compatible small writes is sent as
+   * one compound op, and ops that can't be merged go out on their own,
+   * all in submission order.  The window is thus the round trip of the
+   * write ahead, so objects that aren't written in bursts see no added
+   * latency.  An OSD applies all of a compound op or none of it, so a
+   * failed one is resent a part at a time, and each part gets the
+   * result it would have had alone.  Queued ops have no tid yet and
+   * can't be cancelled.
+   */
+  struct coalesce_key_t {
+    int64_t pool;
+    string nspace;
+    string key;
+    object_t oid;
+
+    coalesce_key_t(const op_target_t& t)
+      : pool(t.base_oloc.pool), nspace(t.base_oloc.nspace),
+	key(t.base_oloc.key), oid(t.base_oid) {}
+
+    bool operator<(const coalesce_key_t& o) const {
+      if (pool != o.pool)
+	return pool < o.pool;
+      if (nspace != o.nspace)
+	return nspace < o.nspace;
+      if (key != o.key)
+	return key < o.key;
+      return oid < o.oid;
+    }
+  };
+
+  /// the parts of a compound op and the results to split back to them
+  struct CoalescedOp {
+    coalesce_key_t key;
+    vector<Op*> parts;
+    vector<bufferlist> outbl;
+    vector<int> rval;
+    version_t objver;
+    epoch_t reply_epoch;
+    Mutex lock;
+    int pending;   ///< compound op contexts yet to complete
+    bool demuxed;  ///< results went to the parts
+
+    CoalescedOp(const coalesce_key_t& k, vector<Op*>& p)
+      : key(k), objver(0), reply_epoch(0),
+	lock("Objecter::CoalescedOp::lock"), pending(0), demuxed(false) {
+      parts.swap(p);
+    }
+  };
+
+  class C_CoalescedReply;
+  class C_CoalesceRelease;
+  class C_CoalesceKick;
+
+  bool coalesce_writes;
+  Mutex coalesce_lock;
+  /// objects with a coalescable write in flight, and the ops behind it
+  map<coalesce_key_t, list<Op*> > coalesce_queues;
+  /// sends what was queued behind a completed write, outside its callback
+  Finisher coalesce_finisher;
+
+  bool _op_coalescable(Op *op);
+  bool _op_reads_state(Op *op);
+  bool _ops_compatible(Op *first, Op *op);
+  bool _coalesce_submit(Op *op);
+  void _coalesce_track(Op *op, const coalesce_key_t& key);
+  Op *_coalesce_merge(const coalesce_key_t& key, vector<Op*>& parts);
+  void coalesce_done(const coalesce_key_t& key, vector<Op*> *retry);
+  void coalesce_kick(const coalesce_key_t& key, vector<Op*>& retry);
+  void coalesced_finish(CoalescedOp *c, bool commit, int r);
+
  public:
   Objecter(CephContext *cct_, Messenger *m, MonClient *mc,
 	   double mon_timeout,
@@ -1610,7 +1694,10 @@ public:
     mon_timeout(mon_timeout),
     osd_timeout(osd_timeout),
     op_throttle_bytes(cct, "objecter_bytes", cct->_conf->objecter_inflight_op_bytes),
-    op_throttle_ops(cct, "objecter_ops", cct->_conf->objecter_inflight_ops)
+    op_throttle_ops(cct, "objecter_ops", cct->_conf->objecter_inflight_ops),
+    coalesce_writes(cct->_conf->objecter_coalesce_writes),
+    coalesce_lock("Objecter::coalesce_lock"),
+    coalesce_finisher(cct)
   { }
   ~Objecter();
 
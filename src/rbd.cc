@@ -28,6 +28,8 @@
 
 #include "include/compat.h"
 #include "common/blkdev.h"
+#include "common/Throttle.h"
+#include "include/interval_set.h"
 
 #include <boost/scoped_ptr.hpp>
 #include <errno.h>
@@ -141,6 +143,9 @@ void usage()
 "  --image-format <format-number>     format to use when creating an image\n"
 "                                     format 1 is the original format (default)\n"
 "                                     format 2 supports cloning\n"
+"  --image-features <features>        optional format 2 features to enable,\n"
+"                                     as a bitmask: +1 layering, +2 striping,\n"
+"                                     +4 object map (default: 1)\n"
 "  --id <username>                    rados user (without 'client.'prefix) to\n"
 "                                     authenticate as\n"
 "  --keyfile <path>                   file containing secret key for use with cephx\n"
@@ -160,6 +165,8 @@ static string feature_str(uint64_t feature)
     return "layering";
   case RBD_FEATURE_STRIPINGV2:
     return "striping";
+  case RBD_FEATURE_OBJECT_MAP:
+    return "object map";
   default:
     return "";
   }
@@ -169,7 +176,7 @@ static string features_str(uint64_t features)
 {
   string s = "";
 
-  for (uint64_t feature = 1; feature <= RBD_FEATURE_STRIPINGV2;
+  for (uint64_t feature = 1; feature <= RBD_FEATURE_OBJECT_MAP;
        feature <<= 1) {
     if (feature & features) {
       if (s.size())
@@ -183,7 +190,7 @@ static string features_str(uint64_t features)
 static void format_features(Formatter *f, uint64_t features)
 {
   f->open_array_section("features");
-  for (uint64_t feature = 1; feature <= RBD_FEATURE_STRIPINGV2;
+  for (uint64_t feature = 1; feature <= RBD_FEATURE_OBJECT_MAP;
        feature <<= 1) {
     f->dump_string("feature", feature_str(feature));
   }
@@ -193,8 +200,10 @@ static void format_features(Formatter *f, uint64_t features)
 struct MyProgressContext : public librbd::ProgressContext {
   const char *operation;
   int last_pc;
+  utime_t start;
 
-  MyProgressContext(const char *o) : operation(o), last_pc(0) {
+  MyProgressContext(const char *o) : operation(o), last_pc(0),
+				     start(ceph_clock_now(NULL)) {
   }
 
   int update_progress(uint64_t offset, uint64_t total) {
@@ -215,6 +224,18 @@ struct MyProgressContext : public librbd::ProgressContext {
       cerr << "\r" << operation << ": 100% complete...done." << std::endl;
     }
   }
+  /// finish, and report how fast @bytes of data were moved
+  void finish(uint64_t bytes) {
+    finish();
+    if (progress) {
+      double elapsed = ceph_clock_now(NULL) - start;
+      cerr << operation << ": " << prettybyte_t(bytes) << " in "
+	   << (int)elapsed << " sec";
+      if (elapsed > 0)
+	cerr << " (" << prettybyte_t((uint64_t)(bytes / elapsed)) << "/s)";
+      cerr << std::endl;
+    }
+  }
   void fail() {
     if (progress) {
       cerr << "\r" << operation << ": " << last_pc << "% complete...failed."
@@ -968,70 +989,179 @@ static int do_bench_write(librbd::Image& image, uint64_t io_size,
   return 0;
 }
 
+/**
+ * An extent of an export, retired in the order it was queued: a
+ * header to write first, if any, then the image data, which is read
+ * by an aio read when the extent exists.
+ */
+struct ExportOp {
+  uint64_t off;
+  uint64_t len;
+  bufferlist header;
+  bufferlist bl;
+  librbd::RBD::AioCompletion *c;
+
+  ExportOp(uint64_t o, uint64_t l) : off(o), len(l), c(NULL) {}
+};
+
+/**
+ * Keeps up to rbd_concurrent_management_ops reads in flight while
+ * writing their data out in order. A sparse export writes each extent
+ * at its offset in the output file and leaves zeros as holes; anything
+ * else (stdout, or an export-diff stream) is written sequentially.
+ */
 struct ExportContext {
   librbd::Image *image;
   int fd;
   uint64_t totalsize;
   MyProgressContext pc;
-
-  ExportContext(librbd::Image *i, int f, uint64_t t) :
+  bool sparse;
+  uint64_t object_size;
+  size_t max_ops;
+  std::deque<ExportOp*> ops;
+  bufferptr zero;
+  uint64_t bytes;
+
+  ExportContext(librbd::Image *i, int f, uint64_t t, const char *o,
+		bool s, uint64_t os) :
     image(i),
     fd(f),
     totalsize(t),
-    pc("Exporting image")
+    pc(o),
+    sparse(s),
+    object_size(os),
+    max_ops(MAX(1, g_conf->rbd_concurrent_management_ops)),
+    bytes(0)
   {}
+
+  ~ExportContext() {
+    // after an error, reads may still be in flight into our buffers
+    while (!ops.empty()) {
+      ExportOp *op = ops.front();
+      ops.pop_front();
+      if (op->c) {
+	op->c->wait_for_complete();
+	op->c->release();
+      }
+      delete op;
+    }
+  }
 };
 
-static int export_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg)
+static int export_retire(ExportContext *ec)
 {
-  ssize_t ret;
-  ExportContext *ec = static_cast<ExportContext *>(arg);
-  int fd = ec->fd;
-  static char *localbuf = NULL;
-  static size_t maplen = 0;
-
-  if (fd == 1) {
-    if (!buf) {
-      // can't seek stdout; need actual data to write
-      if (maplen < len) {
-	// never mapped, or need to map larger
-	int r;
-	if (localbuf != NULL){
-	  if ((r = munmap(localbuf, len)) < 0) {
-	    cerr << "rbd: error " << r << "munmap'ing buffer" << std::endl;
-	    return errno;
-	  }
-	}
+  ExportOp *op = ec->ops.front();
+  ec->ops.pop_front();
+  int r = 0;
+
+  if (op->c) {
+    op->c->wait_for_complete();
+    r = op->c->get_return_value();
+    op->c->release();
+    if (r < 0)
+      goto out;
+    r = 0;
+    if (op->bl.length() < op->len)
+      op->bl.append_zero(op->len - op->bl.length());
+    ec->bytes += op->len;
+  }
 
-	maplen = len;
-	localbuf = (char *)mmap(NULL, maplen, PROT_READ,
-			        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-	if (localbuf == MAP_FAILED) {
-	  cerr << "rbd: MAP_FAILED mmap'ing buffer for zero writes"
-	       << std::endl;
-	  return -ENOMEM;
-	}
-      }
-      ret = write(fd, localbuf, len);
-    } else {
-      ret = write(fd, buf, len);
-    }
-  } else {		// not stdout
-    if (!buf || buf_is_zero(buf, len)) {
+  if (op->header.length()) {
+    r = op->header.write_fd(ec->fd);
+    if (r < 0)
+      goto out;
+  }
+
+  if (op->bl.length() == 0)
+    goto out;
+  if (ec->sparse) {
+    if (op->bl.is_zero()) {
       /* a hole */
-      return 0;
+      goto out;
+    }
+    if (lseek64(ec->fd, op->off, SEEK_SET) < 0) {
+      r = -errno;
+      goto out;
     }
+  }
+  r = op->bl.write_fd(ec->fd);
+  if (r < 0)
+    goto out;
+
+  ec->pc.update_progress(op->off, ec->totalsize);
+
+ out:
+  delete op;
+  return r;
+}
 
-    ret = lseek64(fd, ofs, SEEK_SET);
-    if (ret < 0)
-      return -errno;
-    ret = write(fd, buf, len);
-    ec->pc.update_progress(ofs, ec->totalsize);
+static int export_queue(ExportContext *ec, ExportOp *op, bool exists)
+{
+  if (exists) {
+    op->c = new librbd::RBD::AioCompletion(NULL, NULL);
+    int r = ec->image->aio_read(op->off, op->len, op->bl, op->c);
+    if (r < 0) {
+      op->c->release();
+      delete op;
+      return r;
+    }
   }
+  ec->ops.push_back(op);
 
-  if (ret < 0)
-    return -errno;
+  while (ec->ops.size() > ec->max_ops) {
+    int r = export_retire(ec);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+static int export_drain(ExportContext *ec)
+{
+  while (!ec->ops.empty()) {
+    int r = export_retire(ec);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+/**
+ * Queue an extent of the image, split at object boundaries so each
+ * read hits one object. Nonexistent extents are skipped, unless the
+ * output can't have holes, in which case they are written as zeros.
+ */
+static int export_queue_extent(ExportContext *ec, uint64_t off, uint64_t len,
+			       bool exists)
+{
+  if (!exists && ec->sparse)
+    return 0;
+
+  while (len > 0) {
+    uint64_t object_end = (off / ec->object_size + 1) * ec->object_size;
+    uint64_t chunk = MIN(len, object_end - off);
+    ExportOp *op = new ExportOp(off, chunk);
+    if (!exists) {
+      if (ec->zero.length() < chunk) {
+	ec->zero = buffer::create(ec->object_size);
+	ec->zero.zero();
+      }
+      op->bl.append(ec->zero, 0, chunk);
+    }
+    int r = export_queue(ec, op, exists);
+    if (r < 0)
+      return r;
+    off += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
 
+static int export_extents_cb(uint64_t ofs, size_t len, int exists, void *arg)
+{
+  interval_set<uint64_t> *extents = static_cast<interval_set<uint64_t> *>(arg);
+  if (exists)
+    extents->insert(ofs, len);
   return 0;
 }
 
@@ -1052,10 +1182,33 @@ static int do_export(librbd::Image& image, const char *path)
   if (fd < 0)
     return -errno;
 
-  ExportContext ec(&image, fd, info.size);
-  r = image.read_iterate2(0, info.size, export_read_cb, (void *)&ec);
-  if (r < 0)
-    goto out;
+  ExportContext ec(&image, fd, info.size, "Exporting image", fd != 1,
+		   info.obj_size);
+  {
+    // only read what exists; the rest is zeros
+    interval_set<uint64_t> extents;
+    r = image.diff_iterate(NULL, 0, info.size, export_extents_cb, &extents);
+    if (r < 0)
+      goto out;
+
+    uint64_t off = 0;
+    for (interval_set<uint64_t>::iterator p = extents.begin();
+	 p != extents.end(); ++p) {
+      r = export_queue_extent(&ec, off, p.get_start() - off, false);
+      if (r < 0)
+	goto out;
+      r = export_queue_extent(&ec, p.get_start(), p.get_len(), true);
+      if (r < 0)
+	goto out;
+      off = p.get_start() + p.get_len();
+    }
+    r = export_queue_extent(&ec, off, info.size - off, false);
+    if (r < 0)
+      goto out;
+    r = export_drain(&ec);
+    if (r < 0)
+      goto out;
+  }
 
   if (fd != 1)
     r = ftruncate(fd, info.size);
@@ -1067,40 +1220,23 @@ static int do_export(librbd::Image& image, const char *path)
   if (r < 0)
     ec.pc.fail();
   else
-    ec.pc.finish();
+    ec.pc.finish(ec.bytes);
   return r;
 }
 
 static int export_diff_cb(uint64_t ofs, size_t _len, int exists, void *arg)
 {
   ExportContext *ec = static_cast<ExportContext *>(arg);
-  int r;
 
   // extent
-  bufferlist bl;
+  ExportOp *op = new ExportOp(ofs, _len);
   __u8 tag = exists ? 'w' : 'z';
-  ::encode(tag, bl);
-  ::encode(ofs, bl);
+  ::encode(tag, op->header);
+  ::encode(ofs, op->header);
   uint64_t len = _len;
-  ::encode(len, bl);
-  r = bl.write_fd(ec->fd);
-  if (r < 0)
-    return r;
-
-  if (exists) {
-    // read block
-    bl.clear();
-    r = ec->image->read(ofs, len, bl);
-    if (r < 0)
-      return r;
-    r = bl.write_fd(ec->fd);
-    if (r < 0)
-      return r;
-  }
-
-  ec->pc.update_progress(ofs, ec->totalsize);
+  ::encode(len, op->header);
 
-  return 0;
+  return export_queue(ec, op, exists);
 }
 
 static int do_export_diff(librbd::Image& image, const char *fromsnapname,
@@ -1154,8 +1290,12 @@ static int do_export_diff(librbd::Image& image, const char *fromsnapname,
     }
   }
 
-  ExportContext ec(&image, fd, info.size);
+  ExportContext ec(&image, fd, info.size, "Exporting image", false,
+		   info.obj_size);
   r = image.diff_iterate(fromsnapname, 0, info.size, export_diff_cb, (void *)&ec);
+  if (r < 0)
+    goto out;
+  r = export_drain(&ec);
   if (r < 0)
     goto out;
 
@@ -1171,7 +1311,7 @@ static int do_export_diff(librbd::Image& image, const char *fromsnapname,
   if (r < 0)
     ec.pc.fail();
   else
-    ec.pc.finish();
+    ec.pc.finish(ec.bytes);
   return r;
 }
 
@@ -1288,6 +1428,37 @@ done_img:
   update_snap_name(*new_img, snap);
 }
 
+static void import_aio_cb(librbd::completion_t cb, void *arg)
+{
+  librbd::RBD::AioCompletion *c = (librbd::RBD::AioCompletion *)cb;
+  SimpleThrottle *throttle = static_cast<SimpleThrottle *>(arg);
+  throttle->end_op(c->get_return_value());
+  c->release();
+}
+
+/**
+ * Start an aio write (or, with no data, a discard) once fewer than
+ * rbd_concurrent_management_ops are in flight. Errors are collected by
+ * the throttle, for SimpleThrottle::wait_for_ret().
+ */
+static int import_aio_write(librbd::Image &image, SimpleThrottle &throttle,
+			    uint64_t off, uint64_t len, bufferlist *bl)
+{
+  throttle.start_op();
+  librbd::RBD::AioCompletion *c =
+    new librbd::RBD::AioCompletion((void *)&throttle, import_aio_cb);
+  int r;
+  if (bl)
+    r = image.aio_write(off, len, *bl, c);
+  else
+    r = image.aio_discard(off, len, c);
+  if (r < 0) {
+    c->release();
+    throttle.end_op(r);
+  }
+  return r;
+}
+
 static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
 		     const char *imgname, int *order, const char *path,
 		     int format, uint64_t features, uint64_t size)
@@ -1305,11 +1476,14 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   // try to fill whole imgblklen blocks for sparsification
   uint64_t image_pos = 0;
   size_t imgblklen = 1 << *order;
-  char *p = new char[imgblklen];
+  bufferptr p;
   size_t reqlen = imgblklen;	// amount requested from read
   ssize_t readlen;		// amount received from one read
   size_t blklen = 0;		// amount accumulated from reads to fill blk
+  uint64_t written = 0;
   librbd::Image image;
+  SimpleThrottle throttle(MAX(1, g_conf->rbd_concurrent_management_ops),
+			  false);
 
   bool from_stdin = !strcmp(path, "-");
   if (from_stdin) {
@@ -1357,8 +1531,11 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     goto done;
   }
 
+  // each block gets its own buffer, since writes of earlier blocks
+  // may still be in flight while later ones are read
+  p = buffer::create(imgblklen);
   // loop body handles 0 return, as we may have a block to flush
-  while ((readlen = ::read(fd, p + blklen, reqlen)) >= 0) {
+  while ((readlen = ::read(fd, p.c_str() + blklen, reqlen)) >= 0) {
     blklen += readlen;
     // if read was short, try again to fill the block before writing
     if (readlen && ((size_t)readlen < reqlen)) {
@@ -1368,8 +1545,8 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     if (!from_stdin)
       pc.update_progress(image_pos, size);
 
-    bufferlist bl(blklen);
-    bl.append(p, blklen);
+    bufferlist bl;
+    bl.append(p, 0, blklen);
     // resize output image by binary expansion as we go for stdin
     if (from_stdin && (image_pos + (size_t)blklen) > size) {
       size *= 2;
@@ -1383,12 +1560,14 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     // write as much as we got; perhaps less than imgblklen
     // but skip writing zeros to create sparse images
     if (!bl.is_zero()) {
-      r = image.write(image_pos, blklen, bl);
+      r = import_aio_write(image, throttle, image_pos, blklen, &bl);
       if (r < 0) {
 	cerr << "rbd: error writing to image position " << image_pos
 	     << std::endl;
 	goto done;
       }
+      written += blklen;
+      p = buffer::create(imgblklen);
     }
     // done with whole block, whether written or not
     image_pos += blklen;
@@ -1398,6 +1577,11 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     blklen = 0;
     reqlen = imgblklen;
   }
+  r = throttle.wait_for_ret();
+  if (r < 0) {
+    cerr << "rbd: error writing to image: " << cpp_strerror(r) << std::endl;
+    goto done;
+  }
   if (from_stdin) {
     r = image.resize(image_pos);
     if (r < 0) {
@@ -1409,15 +1593,16 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   r = 0;
 
  done:
+  // nothing may be left in flight once the image goes away
+  throttle.wait_for_ret();
   if (!from_stdin) {
     if (r < 0)
       pc.fail();
     else
-      pc.finish();
+      pc.finish(written);
     close(fd);
   }
  done2:
-  delete[] p;
   return r;
 }
 
@@ -1452,7 +1637,10 @@ static int do_import_diff(librbd::Image &image, const char *path)
   MyProgressContext pc("Importing image diff");
   uint64_t size = 0;
   uint64_t off = 0;
+  uint64_t written = 0;
   string from, to;
+  SimpleThrottle throttle(MAX(1, g_conf->rbd_concurrent_management_ops),
+			  false);
 
   bool from_stdin = !strcmp(path, "-");
   if (from_stdin) {
@@ -1525,6 +1713,10 @@ static int do_import_diff(librbd::Image &image, const char *path)
       bl.append(buf, 8);
       bufferlist::iterator p = bl.begin();
       ::decode(end_size, p);
+      // don't resize under writes that are still in flight
+      r = throttle.wait_for_ret();
+      if (r < 0)
+	goto done;
       uint64_t cur_size;
       image.size(&cur_size);
       if (cur_size != end_size) {
@@ -1555,11 +1747,14 @@ static int do_import_diff(librbd::Image &image, const char *path)
 	bufferlist data;
 	data.append(bp);
 	dout(2) << " write " << off << "~" << len << dendl;
-	image.write(off, len, data);
+	r = import_aio_write(image, throttle, off, len, &data);
+	written += len;
       } else {
 	dout(2) << " zero " << off << "~" << len << dendl;
-	image.discard(off, len);
+	r = import_aio_write(image, throttle, off, len, NULL);
       }
+      if (r < 0)
+	goto done;
     } else {
       cerr << "unrecognized tag byte " << (int)tag << " in stream; aborting" << std::endl;
       r = -EINVAL;
@@ -1576,6 +1771,10 @@ static int do_import_diff(librbd::Image &image, const char *path)
     }
   }
 
+  r = throttle.wait_for_ret();
+  if (r < 0)
+    goto done;
+
   // take final snap
   if (to.length()) {
     dout(2) << " create end snap " << to << dendl;
@@ -1583,10 +1782,12 @@ static int do_import_diff(librbd::Image &image, const char *path)
   }
 
  done:
+  // nothing may be left in flight once the image goes away
+  throttle.wait_for_ret();
   if (r < 0)
     pc.fail();
   else
-    pc.finish();
+    pc.finish(written);
   if (!from_stdin)
     close(fd);
   return r;
@@ -2010,6 +2211,18 @@ int main(int argc, const char **argv)
       }
       format_specified = true;
       g_conf->set_val_or_die("rbd_default_format", val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--image-features",
+				     (char*)NULL)) {
+      features = strict_strtol(val.c_str(), 10, &parse_err);
+      if (!parse_err.empty()) {
+	cerr << "rbd: error parsing --image-features: " << parse_err
+	     << std::endl;
+	return EXIT_FAILURE;
+      }
+      if ((features & ~RBD_FEATURES_ALL) != 0) {
+	cerr << "rbd: unsupported image features" << std::endl;
+	return EXIT_FAILURE;
+      }
     } else if (ceph_argparse_witharg(args, i, &val, "-p", "--pool", (char*)NULL)) {
       poolname = strdup(val.c_str());
     } else if (ceph_argparse_witharg(args, i, &val, "--dest-pool", (char*)NULL)) {
@@ -0,0 +1,140 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "IOStats.hpp"
+#include <limits>
+#include "common/Formatter.h"
+
+
+using namespace std;
+using namespace rbd_replay;
+
+
+IOStats::stats_d::stats_d()
+  : count(0),
+    bytes(0),
+    total_usec(0),
+    min_usec(0),
+    max_usec(0) {
+}
+
+void IOStats::stats_d::add(uint64_t b, uint64_t usec) {
+  if (count == 0 || usec < min_usec) {
+    min_usec = usec;
+  }
+  if (usec > max_usec) {
+    max_usec = usec;
+  }
+  count++;
+  bytes += b;
+  total_usec += usec;
+  hist.add(std::min(usec, (uint64_t)numeric_limits<int32_t>::max()));
+}
+
+void IOStats::stats_d::dump(ceph::Formatter *f) const {
+  f->dump_unsigned("avg", count ? total_usec / count : 0);
+  f->dump_unsigned("min", min_usec);
+  f->dump_unsigned("max", max_usec);
+  hist.dump(f);
+}
+
+
+IOStats::IOStats()
+  : m_start(boost::get_system_time()),
+    m_end(boost::posix_time::not_a_date_time) {
+}
+
+void IOStats::start() {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_start = boost::get_system_time();
+  m_end = boost::posix_time::not_a_date_time;
+}
+
+void IOStats::finish() {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_end = boost::get_system_time();
+}
+
+void IOStats::add_io(io_type type, uint64_t bytes, uint64_t latency_usec) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_ios[type].add(bytes, latency_usec);
+}
+
+void IOStats::add_lag(uint64_t lag_usec) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  m_lag.add(0, lag_usec);
+}
+
+double IOStats::elapsed() const {
+  boost::system_time end(m_end.is_not_a_date_time() ? boost::get_system_time() : m_end);
+  return (end - m_start).total_microseconds() / 1000000.0;
+}
+
+const char *IOStats::type_name(io_type type) {
+  switch (type) {
+  case IO_START_THREAD: return "start_thread";
+  case IO_STOP_THREAD: return "stop_thread";
+  case IO_READ: return "read";
+  case IO_WRITE: return "write";
+  case IO_ASYNC_READ: return "aio_read";
+  case IO_ASYNC_WRITE: return "aio_write";
+  case IO_OPEN_IMAGE: return "open_image";
+  case IO_CLOSE_IMAGE: return "close_image";
+  }
+  return "unknown";
+}
+
+void IOStats::dump(ceph::Formatter *f) const {
+  boost::mutex::scoped_lock lock(m_mutex);
+  double secs = elapsed();
+  f->open_object_section("replay");
+  f->dump_float("elapsed_sec", secs);
+  f->open_array_section("ios");
+  for (map<io_type, stats_d>::const_iterator p = m_ios.begin(); p != m_ios.end(); ++p) {
+    const stats_d &s(p->second);
+    f->open_object_section("io");
+    f->dump_string("type", type_name(p->first));
+    f->dump_unsigned("count", s.count);
+    f->dump_unsigned("bytes", s.bytes);
+    f->dump_float("iops", secs > 0 ? s.count / secs : 0);
+    f->dump_float("bytes_per_sec", secs > 0 ? s.bytes / secs : 0);
+    f->open_object_section("latency_usec");
+    s.dump(f);
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+  f->open_object_section("dispatch_lag_usec");
+  f->dump_unsigned("count", m_lag.count);
+  m_lag.dump(f);
+  f->close_section();
+  f->close_section();
+}
+
+void IOStats::print_summary(ostream &out) const {
+  boost::mutex::scoped_lock lock(m_mutex);
+  double secs = elapsed();
+  out << "Replayed in " << secs << " seconds" << std::endl;
+  for (map<io_type, stats_d>::const_iterator p = m_ios.begin(); p != m_ios.end(); ++p) {
+    const stats_d &s(p->second);
+    out << "  " << type_name(p->first) << ": " << s.count << " ios";
+    if (secs > 0) {
+      out << ", " << s.count / secs << " iops, " << s.bytes / secs / (1 << 20) << " MB/s";
+    }
+    out << ", latency avg " << (s.count ? s.total_usec / s.count : 0)
+	<< " min " << s.min_usec << " max " << s.max_usec << " usec" << std::endl;
+  }
+  if (m_lag.count) {
+    out << "  dispatch lag avg " << m_lag.total_usec / m_lag.count
+	<< " max " << m_lag.max_usec << " usec" << std::endl;
+  }
+}
@@ -0,0 +1,82 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef _INCLUDED_RBD_REPLAY_IOSTATS_HPP
+#define _INCLUDED_RBD_REPLAY_IOSTATS_HPP
+
+#include <map>
+#include <ostream>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include "common/histogram.h"
+#include "actions.hpp"
+
+namespace ceph {
+  class Formatter;
+}
+
+namespace rbd_replay {
+
+/**
+   Latency and throughput of a replay, by IO type.
+
+   Latencies are kept in microseconds, along with a power of two
+   histogram of them.  Dispatch lag is how much later than the trace
+   timing called for an action was started; it shows how faithfully
+   the replay kept to the trace.
+ */
+class IOStats {
+public:
+  IOStats();
+
+  void start();
+
+  void finish();
+
+  void add_io(io_type type, uint64_t bytes, uint64_t latency_usec);
+
+  void add_lag(uint64_t lag_usec);
+
+  void dump(ceph::Formatter *f) const;
+
+  void print_summary(std::ostream &out) const;
+
+  static const char *type_name(io_type type);
+
+private:
+  struct stats_d {
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t total_usec;
+    uint64_t min_usec;
+    uint64_t max_usec;
+    pow2_hist_t hist;
+
+    stats_d();
+
+    void add(uint64_t bytes, uint64_t usec);
+
+    void dump(ceph::Formatter *f) const;
+  };
+
+  double elapsed() const;
+
+  mutable boost::mutex m_mutex;
+  std::map<io_type, stats_d> m_ios;
+  stats_d m_lag;
+  boost::system_time m_start;
+  boost::system_time m_end;
+};
+
+}
+
+#endif
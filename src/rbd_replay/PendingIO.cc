@@ -26,10 +26,15 @@ void pending_io_callback(librbd::completion_t cb, void *arg) {
 }
 
 PendingIO::PendingIO(action_id_t id,
-		     ActionCtx &worker)
+		     ActionCtx &worker,
+		     io_type type,
+		     uint64_t length)
   : m_id(id),
     m_completion(new librbd::RBD::AioCompletion(this, pending_io_callback)),
-    m_worker(worker) {
+    m_worker(worker),
+    m_type(type),
+    m_length(length),
+    m_start_time(boost::get_system_time()) {
     }
 
 PendingIO::~PendingIO() {
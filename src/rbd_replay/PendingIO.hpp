@@ -16,6 +16,7 @@
 #define _INCLUDED_RBD_REPLAY_PENDINGIO_HPP
 
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/thread_time.hpp>
 #include "actions.hpp"
 
 namespace rbd_replay {
@@ -25,7 +26,9 @@ public:
   typedef boost::shared_ptr<PendingIO> ptr;
 
   PendingIO(action_id_t id,
-            ActionCtx &worker);
+            ActionCtx &worker,
+            io_type type,
+            uint64_t length);
 
   ~PendingIO();
 
@@ -43,11 +46,27 @@ public:
     return *m_completion;
   }
 
+  io_type type() const {
+    return m_type;
+  }
+
+  uint64_t length() const {
+    return m_length;
+  }
+
+  // When the IO was issued
+  boost::system_time start_time() const {
+    return m_start_time;
+  }
+
 private:
   const action_id_t m_id;
   ceph::bufferlist m_bl;
   librbd::RBD::AioCompletion *m_completion;
   ActionCtx &m_worker;
+  const io_type m_type;
+  const uint64_t m_length;
+  const boost::system_time m_start_time;
 };
 
 }
@@ -16,6 +16,7 @@
 #include <boost/foreach.hpp>
 #include <boost/thread/thread.hpp>
 #include <fstream>
+#include "common/Formatter.h"
 #include "global/global_context.h"
 #include "rbd_replay_debug.hpp"
 
@@ -24,9 +25,10 @@ using namespace std;
 using namespace rbd_replay;
 
 
-Worker::Worker(Replayer &replayer)
+Worker::Worker(Replayer &replayer, bool shared)
   : m_replayer(replayer),
     m_buffer(100),
+    m_shared(shared),
     m_done(false) {
 }
 
@@ -36,7 +38,9 @@ void Worker::start() {
 
 // Should only be called by StopThreadAction
 void Worker::stop() {
-  m_done = true;
+  if (!m_shared) {
+    m_done = true;
+  }
 }
 
 void Worker::join() {
@@ -60,6 +64,9 @@ void Worker::run() {
   while (!m_done) {
     Action::ptr action;
     m_buffer.pop_back(&action);
+    if (!action) {
+      break;
+    }
     m_replayer.wait_for_actions(action->predecessors());
     action->perform(*this);
     m_replayer.set_action_complete(action->id());
@@ -86,6 +93,8 @@ void Worker::run() {
 void Worker::remove_pending(PendingIO::ptr io) {
   assert(io);
   m_replayer.set_action_complete(io->id());
+  uint64_t latency = (boost::get_system_time() - io->start_time()).total_microseconds();
+  m_replayer.stats().add_io(io->type(), io->length(), latency);
   boost::mutex::scoped_lock lock(m_pending_ios_mutex);
   size_t num_erased = m_pending_ios.erase(io->id());
   assertf(num_erased == 1, "id = %d", io->id());
@@ -135,6 +144,9 @@ rbd_loc Worker::map_image_name(string image_name, string snap_name) const {
 
 Replayer::Replayer(int num_action_trackers)
   : m_pool_name("rbd"),
+    m_latency_multiplier(1),
+    m_readonly(false),
+    m_num_workers(0),
     m_num_action_trackers(num_action_trackers),
     m_action_trackers(new action_tracker_d[m_num_action_trackers]) {
   assertf(num_action_trackers > 0, "num_action_trackers = %d", num_action_trackers);
@@ -171,6 +183,14 @@ void Replayer::run(const std::string replay_file) {
       }
       m_rbd = new librbd::RBD();
       map<thread_id_t, Worker*> workers;
+      // With a bounded pool, traced threads are dealt out to the
+      // workers round robin, each keeping its actions in order.
+      vector<Worker*> pool;
+      for (int i = 0; i < m_num_workers; i++) {
+	Worker *worker = new Worker(*this, true);
+	pool.push_back(worker);
+	worker->start();
+      }
 
       ifstream input(replay_file.c_str(), ios::in | ios::binary);
       if (!input.is_open()) {
@@ -178,6 +198,7 @@ void Replayer::run(const std::string replay_file) {
 	exit(1);
       }
 
+      m_stats.start();
       Deser deser(input);
       while (true) {
 	Action::ptr action = Action::read_from(deser);
@@ -185,19 +206,46 @@ void Replayer::run(const std::string replay_file) {
 	  break;
 	}
 	if (action->is_start_thread()) {
-	  Worker *worker = new Worker(*this);
-	  workers[action->thread_id()] = worker;
-	  worker->start();
+	  if (pool.empty()) {
+	    Worker *worker = new Worker(*this, false);
+	    workers[action->thread_id()] = worker;
+	    worker->start();
+	  } else {
+	    workers[action->thread_id()] = pool[workers.size() % pool.size()];
+	  }
 	} else {
 	  workers[action->thread_id()]->send(action);
 	}
       }
 
       dout(THREAD_LEVEL) << "Waiting for workers to die" << dendl;
-      pair<thread_id_t, Worker*> w;
-      BOOST_FOREACH(w, workers) {
-	w.second->join();
-	delete w.second;
+      if (pool.empty()) {
+	pair<thread_id_t, Worker*> w;
+	BOOST_FOREACH(w, workers) {
+	  w.second->join();
+	  delete w.second;
+	}
+      } else {
+	BOOST_FOREACH(Worker *worker, pool) {
+	  worker->send(Action::ptr());
+	}
+	BOOST_FOREACH(Worker *worker, pool) {
+	  worker->join();
+	  delete worker;
+	}
+      }
+      m_stats.finish();
+      m_stats.print_summary(cout);
+      if (!m_stats_file.empty()) {
+	ofstream out(m_stats_file.c_str());
+	if (!out.is_open()) {
+	  cerr << "Unable to open " << m_stats_file << std::endl;
+	} else {
+	  JSONFormatter f(true);
+	  m_stats.dump(&f);
+	  f.flush(out);
+	  out << std::endl;
+	}
       }
       clear_images();
       delete m_rbd;
@@ -268,7 +316,8 @@ void Replayer::wait_for_actions(const vector<dependency_d> &deps) {
     dout(DEPGRAPH_LEVEL) << "Finished waiting for " << dep.id << " after " << micros << " microseconds" << dendl;
     // Apparently the nanoseconds constructor is optional:
     // http://www.boost.org/doc/libs/1_46_0/doc/html/date_time/details.html#compile_options
-    boost::system_time sub_release_time(action_completed_time + boost::posix_time::microseconds(dep.time_delta * m_latency_multiplier / 1000));
+    // Scale in double precision; a float loses microseconds on deltas of a few seconds.
+    boost::system_time sub_release_time(action_completed_time + boost::posix_time::microseconds((int64_t)(dep.time_delta * (double)m_latency_multiplier / 1000)));
     if (sub_release_time > release_time) {
       release_time = sub_release_time;
     }
@@ -277,6 +326,10 @@ void Replayer::wait_for_actions(const vector<dependency_d> &deps) {
     dout(SLEEP_LEVEL) << "Sleeping for " << (release_time - boost::get_system_time()).total_microseconds() << " microseconds" << dendl;
     boost::this_thread::sleep(release_time);
   }
+  if (!deps.empty()) {
+    boost::posix_time::time_duration lag(boost::get_system_time() - release_time);
+    m_stats.add_lag(lag.is_negative() ? 0 : lag.total_microseconds());
+  }
 }
 
 void Replayer::clear_images() {
@@ -293,6 +346,15 @@ void Replayer::set_latency_multiplier(float f) {
   m_latency_multiplier = f;
 }
 
+void Replayer::set_num_workers(int num_workers) {
+  assertf(num_workers >= 0, "num_workers = %d", num_workers);
+  m_num_workers = num_workers;
+}
+
+void Replayer::set_stats_file(string stats_file) {
+  m_stats_file = stats_file;
+}
+
 bool Replayer::readonly() const {
   return m_readonly;
 }
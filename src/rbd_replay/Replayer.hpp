@@ -19,6 +19,7 @@
 #include <boost/thread/shared_mutex.hpp>
 #include "BoundedBuffer.hpp"
 #include "ImageNameMap.hpp"
+#include "IOStats.hpp"
 #include "PendingIO.hpp"
 
 namespace rbd_replay {
@@ -27,7 +28,9 @@ class Replayer;
 
 class Worker : public ActionCtx {
 public:
-  explicit Worker(Replayer &replayer);
+  // A shared worker replays several traced threads, and only stops
+  // when sent a null action.
+  Worker(Replayer &replayer, bool shared);
 
   void start();
 
@@ -67,6 +70,7 @@ private:
   std::map<action_id_t, PendingIO::ptr> m_pending_ios;
   boost::mutex m_pending_ios_mutex;
   boost::condition m_pending_ios_empty;
+  bool m_shared;
   bool m_done;
 };
 
@@ -105,6 +109,16 @@ public:
 
   void set_latency_multiplier(float f);
 
+  // 0 means one worker per traced thread
+  void set_num_workers(int num_workers);
+
+  // Where to write the replay statistics as JSON, if anywhere
+  void set_stats_file(std::string stats_file);
+
+  IOStats &stats() {
+    return m_stats;
+  }
+
   bool readonly() const;
 
   void set_readonly(bool readonly);
@@ -139,6 +153,9 @@ private:
   float m_latency_multiplier;
   bool m_readonly;
   ImageNameMap m_image_name_map;
+  int m_num_workers;
+  std::string m_stats_file;
+  IOStats m_stats;
 
   std::map<imagectx_id_t, librbd::Image*> m_images;
   boost::shared_mutex m_images_mutex;
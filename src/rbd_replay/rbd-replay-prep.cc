@@ -85,8 +85,53 @@ private:
   uint64_t m_max_ts;
 };
 
+class FieldLookup {
+public:
+  FieldLookup(struct bt_ctf_event *evt,
+	      const struct bt_definition *scope)
+    : m_evt(evt),
+      m_scope(scope) {
+  }
+
+  const char* string(const char* name) {
+    const struct bt_definition *field = bt_ctf_get_field(m_evt, m_scope, name);
+    assertf(field, "field name = '%s'", name);
+    const char* c = bt_ctf_get_string(field);
+    int err = bt_ctf_field_get_error();
+    assertf(c && err == 0, "field name = '%s', err = %d", name, err);
+    return c;
+  }
+
+  int64_t int64(const char* name) {
+    const struct bt_definition *field = bt_ctf_get_field(m_evt, m_scope, name);
+    assertf(field, "field name = '%s'", name);
+    int64_t val = bt_ctf_get_int64(field);
+    int err = bt_ctf_field_get_error();
+    assertf(err == 0, "field name = '%s', err = %d", name, err);
+    return val;
+  }
+
+  uint64_t uint64(const char* name) {
+    const struct bt_definition *field = bt_ctf_get_field(m_evt, m_scope, name);
+    assertf(field, "field name = '%s'", name);
+    uint64_t val = bt_ctf_get_uint64(field);
+    int err = bt_ctf_field_get_error();
+    assertf(err == 0, "field name = '%s', err = %d", name, err);
+    return val;
+  }
+
+private:
+  struct bt_ctf_event *m_evt;
+  const struct bt_definition *m_scope;
+};
+
 static void usage(string prog) {
-  cout << "Usage: " << prog << " [ --window <seconds> ] <trace-input> <replay-output>" << endl;
+  cout << "Usage: " << prog << " [ --window <seconds> ] [ --image <name> ... ]" << endl;
+  cout << "    [ --start-time <seconds> ] [ --end-time <seconds> ] <trace-input> <replay-output>" << endl;
+  cout << endl;
+  cout << "--image keeps only IOs to the named images, and may be repeated." << endl;
+  cout << "--start-time and --end-time keep only IOs started in that window, in seconds" << endl;
+  cout << "from the start of the trace." << endl;
 }
 
 __attribute__((noreturn)) static void usage_exit(string prog, string msg) {
@@ -99,6 +144,8 @@ class Processor {
 public:
   Processor()
     : m_window(1000000000ULL), // 1 billion nanoseconds, i.e., one second
+      m_start_time(0),
+      m_end_time(0),
       m_threads(),
       m_io_count(0),
       m_recent_completions(io_set_t()),
@@ -123,6 +170,21 @@ public:
 	// TODO: test
 	printf("Arg: '%s'\n", arg.c_str() + sizeof("--window="));
 	m_window = (uint64_t)(1e9 * atof(arg.c_str() + sizeof("--window=")));
+      } else if (arg == "--image") {
+	if (i == nargs - 1) {
+	  usage_exit(args[0], "--image requires an argument");
+	}
+	m_image_filter.insert(args[++i]);
+      } else if (arg == "--start-time") {
+	if (i == nargs - 1) {
+	  usage_exit(args[0], "--start-time requires an argument");
+	}
+	m_start_time = (uint64_t)(1e9 * atof(args[++i].c_str()));
+      } else if (arg == "--end-time") {
+	if (i == nargs - 1) {
+	  usage_exit(args[0], "--end-time requires an argument");
+	}
+	m_end_time = (uint64_t)(1e9 * atof(args[++i].c_str()));
       } else if (arg == "-h" || arg == "--help") {
 	usage(args[0]);
 	exit(0);
@@ -141,6 +203,9 @@ public:
     if (!got_output) {
       usage_exit(args[0], "Not enough arguments");
     }
+    if (m_end_time && m_end_time <= m_start_time) {
+      usage_exit(args[0], "--end-time must be after --start-time");
+    }
 
     struct bt_context *ctx = bt_context_create();
     int trace_handle = bt_context_add_trace(ctx,
@@ -177,9 +242,13 @@ public:
 	first = false;
       }
       ts -= trace_start;
-      ts += 4; // This is so we have room to insert two events (thread start and open image) at unique timestamps before whatever the first event is.
 
-      process_event(ts, evt);
+      if (!skip_event(ts, evt)) {
+	ts -= m_start_time;
+	ts += 4; // This is so we have room to insert two events (thread start and open image) at unique timestamps before whatever the first event is.
+
+	process_event(ts, evt);
+      }
 
       int r = bt_iter_next(bt_itr);
       assert(!r);
@@ -256,6 +325,57 @@ private:
     }
   }
 
+  // Whether an event is filtered out by image or time window.  Calls
+  // started outside the filter are dropped along with their
+  // completions; those started inside are kept to completion, even
+  // past the end of the window.
+  bool skip_event(uint64_t ts, struct bt_ctf_event *evt) {
+    const char *event_name = bt_ctf_event_name(evt);
+    bool sync_call = (strcmp(event_name, "librbd:read_enter") == 0 ||
+		      strcmp(event_name, "librbd:write_enter") == 0 ||
+		      strcmp(event_name, "librbd:open_image_enter") == 0 ||
+		      strcmp(event_name, "librbd:close_image_enter") == 0);
+    bool aio_call = (strcmp(event_name, "librbd:aio_read_enter") == 0 ||
+		     strcmp(event_name, "librbd:aio_write_enter") == 0);
+    bool sync_return = (strcmp(event_name, "librbd:read_exit") == 0 ||
+			strcmp(event_name, "librbd:write_exit") == 0 ||
+			strcmp(event_name, "librbd:open_image_exit") == 0 ||
+			strcmp(event_name, "librbd:close_image_exit") == 0);
+    if (!sync_call && !aio_call && !sync_return) {
+      // completions of skipped aio are not found, so are ignored anyway
+      return false;
+    }
+
+    const struct bt_definition *scope_context = bt_ctf_get_top_level_scope(evt,
+									   BT_STREAM_EVENT_CONTEXT);
+    assert(scope_context);
+    const struct bt_definition *pthread_id_field = bt_ctf_get_field(evt, scope_context, "pthread_id");
+    assert(pthread_id_field);
+    thread_id_t threadID = bt_ctf_get_uint64(pthread_id_field);
+    if (sync_return) {
+      return m_skipped_threads.erase(threadID) > 0;
+    }
+
+    const struct bt_definition *scope_fields = bt_ctf_get_top_level_scope(evt,
+									  BT_EVENT_FIELDS);
+    assert(scope_fields);
+    FieldLookup fields(evt, scope_fields);
+    imagectx_id_t imagectx = fields.uint64("imagectx");
+    if (strcmp(event_name, "librbd:close_image_enter") != 0) {
+      m_image_names[imagectx] = fields.string("name");
+    }
+
+    bool skip = ts < m_start_time || (m_end_time && ts >= m_end_time);
+    if (!skip && !m_image_filter.empty()) {
+      map<imagectx_id_t, string>::const_iterator itr = m_image_names.find(imagectx);
+      skip = itr == m_image_names.end() || m_image_filter.count(itr->second) == 0;
+    }
+    if (sync_call && skip) {
+      m_skipped_threads.insert(threadID);
+    }
+    return skip;
+  }
+
   void process_event(uint64_t ts, struct bt_ctf_event *evt) {
     const char *event_name = bt_ctf_event_name(evt);
     const struct bt_definition *scope_context = bt_ctf_get_top_level_scope(evt,
@@ -276,45 +396,7 @@ private:
     }
     thread->insert_ts(ts);
 
-    class FieldLookup {
-    public:
-      FieldLookup(struct bt_ctf_event *evt,
-		  const struct bt_definition *scope)
-	: m_evt(evt),
-	  m_scope(scope) {
-      }
-
-      const char* string(const char* name) {
-	const struct bt_definition *field = bt_ctf_get_field(m_evt, m_scope, name);
-	assertf(field, "field name = '%s'", name);
-	const char* c = bt_ctf_get_string(field);
-	int err = bt_ctf_field_get_error();
-	assertf(c && err == 0, "field name = '%s', err = %d", name, err);
-	return c;
-      }
-
-      int64_t int64(const char* name) {
-	const struct bt_definition *field = bt_ctf_get_field(m_evt, m_scope, name);
-	assertf(field, "field name = '%s'", name);
-	int64_t val = bt_ctf_get_int64(field);
-	int err = bt_ctf_field_get_error();
-	assertf(err == 0, "field name = '%s', err = %d", name, err);
-	return val;
-      }
-
-      uint64_t uint64(const char* name) {
-	const struct bt_definition *field = bt_ctf_get_field(m_evt, m_scope, name);
-	assertf(field, "field name = '%s'", name);
-	uint64_t val = bt_ctf_get_uint64(field);
-	int err = bt_ctf_field_get_error();
-	assertf(err == 0, "field name = '%s', err = %d", name, err);
-	return val;
-      }
-
-    private:
-      struct bt_ctf_event *m_evt;
-      const struct bt_definition *m_scope;
-    } fields(evt, scope_fields);
+    FieldLookup fields(evt, scope_fields);
 
     if (strcmp(event_name, "librbd:read_enter") == 0) {
       string name(fields.string("name"));
@@ -465,6 +547,13 @@ private:
   }
 
   uint64_t m_window;
+  // Filters, with times in nanoseconds from the start of the trace
+  set<string> m_image_filter;
+  uint64_t m_start_time;
+  uint64_t m_end_time;
+  map<imagectx_id_t, string> m_image_names;
+  // Threads in a sync call that was filtered out
+  set<thread_id_t> m_skipped_threads;
   map<thread_id_t, Thread::ptr> m_threads;
   uint32_t m_io_count;
   io_set_t m_recent_completions;
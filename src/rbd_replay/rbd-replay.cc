@@ -39,6 +39,11 @@ static void usage(const char* program) {
   cout << "Options:" << std::endl;
   cout << "  -p, --pool-name <pool>          Name of the pool to use.  Default: rbd" << std::endl;
   cout << "  --latency-multiplier <float>    Multiplies inter-request latencies.  Default: 1" << std::endl;
+  cout << "                                  0 replays as fast as dependencies allow." << std::endl;
+  cout << "  --threads <n>                   Replay with a pool of n worker threads, rather" << std::endl;
+  cout << "                                  than one per traced thread.  Default: 0" << std::endl;
+  cout << "  --stats <file>                  Write latency and throughput statistics to" << std::endl;
+  cout << "                                  file as JSON." << std::endl;
   cout << "  --read-only                     Only perform non-destructive operations." << std::endl;
   cout << "  --map-image <rule>              Add a rule to map image names in the trace to" << std::endl;
   cout << "                                  image names in the replay cluster." << std::endl;
@@ -59,6 +64,8 @@ int main(int argc, const char **argv) {
   string pool_name = "rbd";
   float latency_multiplier = 1;
   bool readonly = false;
+  int num_workers = 0;
+  string stats_file;
   ImageNameMap image_name_map;
   std::string val;
   std::ostringstream err;
@@ -73,6 +80,18 @@ int main(int argc, const char **argv) {
 	cerr << err.str() << std::endl;
 	return 1;
       }
+    } else if (ceph_argparse_withint(args, i, &num_workers, &err, "--threads",
+				     (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	return 1;
+      }
+      if (num_workers < 0) {
+	cerr << "--threads must not be negative" << std::endl;
+	return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--stats", (char*)NULL)) {
+      stats_file = val;
     } else if (ceph_argparse_flag(args, i, "--read-only", (char*)NULL)) {
       readonly = true;
     } else if (ceph_argparse_witharg(args, i, &val, "--map-image", (char*)NULL)) {
@@ -109,6 +128,8 @@ int main(int argc, const char **argv) {
   unsigned int nthreads = boost::thread::hardware_concurrency();
   Replayer replayer(2 * nthreads + 1);
   replayer.set_latency_multiplier(latency_multiplier);
+  replayer.set_num_workers(num_workers);
+  replayer.set_stats_file(stats_file);
   replayer.set_pool_name(pool_name);
   replayer.set_readonly(readonly);
   replayer.set_image_name_map(image_name_map);
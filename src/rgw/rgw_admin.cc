@@ -1676,83 +1676,109 @@ int main(int argc, char **argv)
       return usage();
     }
 
-    string oid;
+    // an ops log sharded by rgw_ops_log_num_shards is read from every shard
+    vector<string> oids;
     if (!object.empty()) {
-      oid = object;
+      oids.push_back(object);
     } else {
-      oid = date;
+      string oid = date;
       oid += "-";
       oid += bucket_id;
       oid += "-";
       oid += bucket_name;
+      int num_shards = g_ceph_context->_conf->rgw_ops_log_num_shards;
+      if (num_shards > 1) {
+        for (int i = 0; i < num_shards; i++) {
+          char buf[16];
+          snprintf(buf, sizeof(buf), ".%d", i);
+          oids.push_back(oid + buf);
+        }
+      } else {
+        oids.push_back(oid);
+      }
     }
 
     if (opt_cmd == OPT_LOG_SHOW) {
-      RGWAccessHandle h;
-
-      int r = store->log_show_init(oid, &h);
-      if (r < 0) {
-	cerr << "error opening log " << oid << ": " << cpp_strerror(-r) << std::endl;
-	return -r;
-      }
-
       formatter->reset();
       formatter->open_object_section("log");
 
-      struct rgw_log_entry entry;
-      
-      // peek at first entry to get bucket metadata
-      r = store->log_show_next(h, &entry);
-      if (r < 0) {
-	cerr << "error reading log " << oid << ": " << cpp_strerror(-r) << std::endl;
-	return -r;
-      }
-      formatter->dump_string("bucket_id", entry.bucket_id);
-      formatter->dump_string("bucket_owner", entry.bucket_owner);
-      formatter->dump_string("bucket", entry.bucket);
-
       uint64_t agg_time = 0;
       uint64_t agg_bytes_sent = 0;
       uint64_t agg_bytes_received = 0;
       uint64_t total_entries = 0;
+      bool found = false;
 
-      if (show_log_entries)
-        formatter->open_array_section("log_entries");
+      for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+        const string& oid = *iter;
+        RGWAccessHandle h;
 
-      do {
-	uint64_t total_time =  entry.total_time.sec() * 1000000LL * entry.total_time.usec();
+        int r = store->log_show_init(oid, &h);
+        if (r < 0) {
+          cerr << "error opening log " << oid << ": " << cpp_strerror(-r) << std::endl;
+          return -r;
+        }
 
-        agg_time += total_time;
-        agg_bytes_sent += entry.bytes_sent;
-        agg_bytes_received += entry.bytes_received;
-        total_entries++;
+        struct rgw_log_entry entry;
 
-        if (skip_zero_entries && entry.bytes_sent == 0 &&
-            entry.bytes_received == 0)
-          goto next;
+        // peek at first entry to get bucket metadata
+        r = store->log_show_next(h, &entry);
+        if (r == -ENOENT && oids.size() > 1) {
+          // nothing was logged to this shard
+          continue;
+        }
+        if (r < 0) {
+          cerr << "error reading log " << oid << ": " << cpp_strerror(-r) << std::endl;
+          return -r;
+        }
+        if (!found) {
+          formatter->dump_string("bucket_id", entry.bucket_id);
+          formatter->dump_string("bucket_owner", entry.bucket_owner);
+          formatter->dump_string("bucket", entry.bucket);
+
+          if (show_log_entries)
+            formatter->open_array_section("log_entries");
+          found = true;
+        }
 
-        if (show_log_entries) {
+        do {
+          uint64_t total_time =  entry.total_time.sec() * 1000000LL * entry.total_time.usec();
 
-	  rgw_format_ops_log_entry(entry, formatter);
-	  formatter->flush(cout);
-        }
+          agg_time += total_time;
+          agg_bytes_sent += entry.bytes_sent;
+          agg_bytes_received += entry.bytes_received;
+          total_entries++;
+
+          if (skip_zero_entries && entry.bytes_sent == 0 &&
+              entry.bytes_received == 0)
+            goto next;
+
+          if (show_log_entries) {
+
+            rgw_format_ops_log_entry(entry, formatter);
+            formatter->flush(cout);
+          }
 next:
-	r = store->log_show_next(h, &entry);
-      } while (r > 0);
+          r = store->log_show_next(h, &entry);
+        } while (r > 0);
 
-      if (r < 0) {
-      	cerr << "error reading log " << oid << ": " << cpp_strerror(-r) << std::endl;
-	return -r;
+        if (r < 0) {
+          cerr << "error reading log " << oid << ": " << cpp_strerror(-r) << std::endl;
+          return -r;
+        }
+      }
+      if (!found) {
+        cerr << "error reading log " << oids.front() << ".*: " << cpp_strerror(ENOENT) << std::endl;
+        return ENOENT;
       }
       if (show_log_entries)
         formatter->close_section();
 
       if (show_log_sum) {
         formatter->open_object_section("log_sum");
-	formatter->dump_int("bytes_sent", agg_bytes_sent);
-	formatter->dump_int("bytes_received", agg_bytes_received);
-	formatter->dump_int("total_time", agg_time);
-	formatter->dump_int("total_entries", total_entries);
+        formatter->dump_int("bytes_sent", agg_bytes_sent);
+        formatter->dump_int("bytes_received", agg_bytes_received);
+        formatter->dump_int("total_time", agg_time);
+        formatter->dump_int("total_entries", total_entries);
         formatter->close_section();
       }
       formatter->close_section();
@@ -1760,10 +1786,20 @@ next:
       cout << std::endl;
     }
     if (opt_cmd == OPT_LOG_RM) {
-      int r = store->log_remove(oid);
-      if (r < 0) {
-	cerr << "error removing log " << oid << ": " << cpp_strerror(-r) << std::endl;
-	return -r;
+      bool found = false;
+      for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+        int r = store->log_remove(*iter);
+        if (r == -ENOENT && oids.size() > 1)
+          continue;
+        if (r < 0) {
+          cerr << "error removing log " << *iter << ": " << cpp_strerror(-r) << std::endl;
+          return -r;
+        }
+        found = true;
+      }
+      if (!found) {
+        cerr << "error removing log " << oids.front() << ".*: " << cpp_strerror(ENOENT) << std::endl;
+        return ENOENT;
       }
     }
   }
@@ -243,3 +243,126 @@ void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter
 }
 
 
+
+uint64_t ObjectDataCache::get_seq()
+{
+  Mutex::Locker l(lock);
+  return invalidate_seq;
+}
+
+int ObjectDataCache::get(const string& name, uint64_t *psize, time_t *pmtime, uint64_t *epoch,
+                         map<string, bufferlist> *attrs, bufferlist *data)
+{
+  Mutex::Locker l(lock);
+
+  map<string, ObjectDataCacheEntry>::iterator iter = cache_map.find(name);
+  if (iter == cache_map.end()) {
+    ldout(cct, 10) << "data cache get: name=" << name << " : miss" << dendl;
+    if (perfcounter) perfcounter->inc(l_rgw_data_cache_miss);
+    return -ENOENT;
+  }
+  ldout(cct, 10) << "data cache get: name=" << name << " : hit" << dendl;
+
+  ObjectDataCacheEntry& entry = iter->second;
+  if (entry.expires < ceph_clock_now(cct)) {
+    ldout(cct, 10) << "data cache get: name=" << name << " : expired" << dendl;
+    remove_entry(iter);
+    update_perf_counters();
+    if (perfcounter) perfcounter->inc(l_rgw_data_cache_miss);
+    return -ENOENT;
+  }
+  lru.splice(lru.end(), lru, entry.lru_iter);
+
+  if (psize)
+    *psize = entry.size;
+  if (pmtime)
+    *pmtime = entry.mtime;
+  if (epoch)
+    *epoch = entry.epoch;
+  if (attrs)
+    *attrs = entry.attrs;
+  if (data)
+    *data = entry.data;
+  if (perfcounter) perfcounter->inc(l_rgw_data_cache_hit);
+
+  return 0;
+}
+
+void ObjectDataCache::put(const string& name, uint64_t seq, uint64_t size, time_t mtime, uint64_t epoch,
+                          map<string, bufferlist>& attrs, bufferlist& data)
+{
+  uint64_t max_size = cct->_conf->rgw_obj_data_cache_size;
+
+  uint64_t charge = name.size() + data.length();
+  for (map<string, bufferlist>::iterator aiter = attrs.begin(); aiter != attrs.end(); ++aiter) {
+    charge += aiter->first.size() + aiter->second.length();
+  }
+  if (charge > max_size)
+    return;
+
+  Mutex::Locker l(lock);
+
+  if (seq != invalidate_seq) {
+    ldout(cct, 10) << "data cache put: name=" << name << " : raced with invalidation, not caching" << dendl;
+    return;
+  }
+
+  map<string, ObjectDataCacheEntry>::iterator iter = cache_map.find(name);
+  if (iter != cache_map.end())
+    remove_entry(iter);
+
+  ldout(cct, 10) << "data cache put: name=" << name << " size=" << size << dendl;
+
+  ObjectDataCacheEntry& entry = cache_map[name];
+  entry.size = size;
+  entry.mtime = mtime;
+  entry.epoch = epoch;
+  entry.attrs = attrs;
+  /* the read buffer is usually much larger than the object, copy it */
+  bufferptr bp(data.length());
+  data.copy(0, data.length(), bp.c_str());
+  entry.data.append(bp);
+  entry.charge = charge;
+  entry.expires = ceph_clock_now(cct);
+  entry.expires += cct->_conf->rgw_obj_data_cache_ttl;
+  entry.lru_iter = lru.insert(lru.end(), name);
+  cur_size += charge;
+
+  while (cur_size > max_size) {
+    map<string, ObjectDataCacheEntry>::iterator evict = cache_map.find(lru.front());
+    ldout(cct, 20) << "data cache: evicting " << evict->first << dendl;
+    remove_entry(evict);
+  }
+
+  update_perf_counters();
+}
+
+void ObjectDataCache::remove(const string& name)
+{
+  Mutex::Locker l(lock);
+
+  invalidate_seq++;
+
+  map<string, ObjectDataCacheEntry>::iterator iter = cache_map.find(name);
+  if (iter == cache_map.end())
+    return;
+
+  ldout(cct, 10) << "data cache: removing " << name << dendl;
+  remove_entry(iter);
+  update_perf_counters();
+}
+
+void ObjectDataCache::remove_entry(map<string, ObjectDataCacheEntry>::iterator& iter)
+{
+  cur_size -= iter->second.charge;
+  lru.erase(iter->second.lru_iter);
+  cache_map.erase(iter);
+}
+
+void ObjectDataCache::update_perf_counters()
+{
+  if (perfcounter) {
+    perfcounter->set(l_rgw_data_cache_bytes, cur_size);
+    perfcounter->set(l_rgw_data_cache_entries, cache_map.size());
+  }
+}
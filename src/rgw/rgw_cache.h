@@ -11,10 +11,12 @@
 #include "include/utime.h"
 #include "include/assert.h"
 #include "common/RWLock.h"
+#include "common/Mutex.h"
 
 enum {
   UPDATE_OBJ,
   REMOVE_OBJ,
+  REMOVE_OBJ_DATA,
 };
 
 #define CACHE_FLAG_DATA           0x01
@@ -160,10 +162,69 @@ public:
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry);
 };
 
+struct ObjectDataCacheEntry {
+  uint64_t size;
+  time_t mtime;
+  uint64_t epoch;
+  map<string, bufferlist> attrs;
+  bufferlist data;
+  uint64_t charge;
+  utime_t expires;
+  std::list<string>::iterator lru_iter;
+
+  ObjectDataCacheEntry() : size(0), mtime(0), epoch(0), charge(0) {}
+};
+
+/*
+ * Whole small user objects, as the head object stat and first chunk read
+ * returned them, so that a GET of a hot object doesn't go to RADOS.
+ * Bounded by rgw_obj_data_cache_size bytes; entries are dropped when the
+ * object is written or removed through any gateway, and in any case after
+ * rgw_obj_data_cache_ttl seconds.
+ */
+class ObjectDataCache {
+  std::map<string, ObjectDataCacheEntry> cache_map;
+  std::list<string> lru;
+  uint64_t cur_size;
+  uint64_t invalidate_seq;
+  Mutex lock;
+  CephContext *cct;
+
+  void remove_entry(std::map<string, ObjectDataCacheEntry>::iterator& iter);
+  void update_perf_counters();
+public:
+  ObjectDataCache() : cur_size(0), invalidate_seq(0), lock("ObjectDataCache"), cct(NULL) {}
+  void set_ctx(CephContext *_cct) { cct = _cct; }
+  bool enabled() {
+    return cct && cct->_conf->rgw_obj_data_cache_size > 0;
+  }
+  /// whether writes must tell other gateways to drop their copies
+  bool invalidates() {
+    if (!cct)
+      return false;
+    int invalidate = cct->_conf->rgw_obj_data_cache_invalidate;
+    return invalidate < 0 ? enabled() : invalidate > 0;
+  }
+
+  /*
+   * taken before reading an object from RADOS; put() refuses the result
+   * if the cache was invalidated in the meantime, since the read may have
+   * raced with the write that caused the invalidation
+   */
+  uint64_t get_seq();
+
+  int get(const string& name, uint64_t *psize, time_t *pmtime, uint64_t *epoch,
+          map<string, bufferlist> *attrs, bufferlist *data);
+  void put(const string& name, uint64_t seq, uint64_t size, time_t mtime, uint64_t epoch,
+           map<string, bufferlist>& attrs, bufferlist& data);
+  void remove(const string& name);
+};
+
 template <class T>
 class RGWCache  : public T
 {
   ObjectCache cache;
+  ObjectDataCache data_cache;
 
   int list_objects_raw_init(rgw_bucket& bucket, RGWAccessHandle *handle) {
     return T::list_objects_raw_init(bucket, handle);
@@ -186,9 +247,18 @@ class RGWCache  : public T
     return normal_name(obj.bucket, obj.object);
   }
 
+  string data_cache_name(rgw_obj& obj) {
+    rgw_bucket bucket;
+    string oid, key;
+    get_obj_bucket_and_oid_key(obj, bucket, oid, key);
+    return bucket.bucket_id + "/" + oid;
+  }
+  void invalidate_data_cache(rgw_obj& obj);
+
   int init_rados() {
     int ret;
     cache.set_ctx(T::cct);
+    data_cache.set_ctx(T::cct);
     ret = T::init_rados();
     if (ret < 0)
       return ret;
@@ -201,6 +271,8 @@ class RGWCache  : public T
   }
 
   int distribute_cache(const string& normal_name, rgw_obj& obj, ObjectCacheInfo& obj_info, int op);
+  int obj_stat_data_cache(void *ctx, rgw_obj& obj, uint64_t *psize, time_t *pmtime, uint64_t *epoch,
+                          map<string, bufferlist> *attrs, bufferlist *first_chunk);
   int watch_cb(int opcode, uint64_t ver, bufferlist& bl);
 public:
   RGWCache() {}
@@ -250,8 +322,11 @@ int RGWCache<T>::delete_obj_impl(void *ctx, const string& bucket_owner, rgw_obj&
   rgw_bucket bucket;
   string oid;
   normalize_bucket_and_obj(obj.bucket, obj.object, bucket, oid);
-  if (bucket.name[0] != '.')
-    return T::delete_obj_impl(ctx, bucket_owner, obj, objv_tracker);
+  if (bucket.name[0] != '.') {
+    int ret = T::delete_obj_impl(ctx, bucket_owner, obj, objv_tracker);
+    invalidate_data_cache(obj);
+    return ret;
+  }
 
   string name = normal_name(obj);
   cache.remove(name);
@@ -342,6 +417,8 @@ int RGWCache<T>::set_attr(void *ctx, rgw_obj& obj, const char *attr_name, buffer
     }
   }
   int ret = T::set_attr(ctx, obj, attr_name, bl, objv_tracker);
+  if (!cacheable)
+    invalidate_data_cache(obj);
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
@@ -381,6 +458,8 @@ int RGWCache<T>::set_attrs(void *ctx, rgw_obj& obj,
     }
   }
   int ret = T::set_attrs(ctx, obj, attrs, rmattrs, objv_tracker);
+  if (!cacheable)
+    invalidate_data_cache(obj);
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
@@ -425,6 +504,8 @@ int RGWCache<T>::put_obj_meta_impl(void *ctx, rgw_obj& obj, uint64_t size, time_
   }
   int ret = T::put_obj_meta_impl(ctx, obj, size, mtime, attrs, category, flags, rmattrs, data, manifest, ptag, remove_objs,
                                  modify_version, objv_tracker, set_mtime, owner);
+  if (!cacheable)
+    invalidate_data_cache(obj);
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
@@ -483,8 +564,12 @@ int RGWCache<T>::obj_stat(void *ctx, rgw_obj& obj, uint64_t *psize, time_t *pmti
   rgw_bucket bucket;
   string oid;
   normalize_bucket_and_obj(obj.bucket, obj.object, bucket, oid);
-  if (bucket.name[0] != '.')
-    return T::obj_stat(ctx, obj, psize, pmtime, pepoch, attrs, first_chunk, objv_tracker);
+  if (bucket.name[0] != '.') {
+    /* only reads that fetch the data go through the data cache */
+    if (!first_chunk || objv_tracker || !data_cache.enabled())
+      return T::obj_stat(ctx, obj, psize, pmtime, pepoch, attrs, first_chunk, objv_tracker);
+    return obj_stat_data_cache(ctx, obj, psize, pmtime, pepoch, attrs, first_chunk);
+  }
 
   string name = normal_name(bucket, oid);
 
@@ -538,6 +623,72 @@ done:
   return 0;
 }
 
+template <class T>
+int RGWCache<T>::obj_stat_data_cache(void *ctx, rgw_obj& obj, uint64_t *psize, time_t *pmtime,
+                                     uint64_t *pepoch, map<string, bufferlist> *attrs,
+                                     bufferlist *first_chunk)
+{
+  string name = data_cache_name(obj);
+  if (data_cache.get(name, psize, pmtime, pepoch, attrs, first_chunk) == 0)
+    return 0;
+
+  uint64_t seq = data_cache.get_seq();
+  uint64_t size;
+  time_t mtime;
+  uint64_t epoch;
+  map<string, bufferlist> attrset;
+  int r = T::obj_stat(ctx, obj, &size, &mtime, &epoch, &attrset, first_chunk, NULL);
+  if (r < 0)
+    return r;
+
+  /* cache only objects whose data lives entirely in the head */
+  bool cacheable = (size <= T::cct->_conf->rgw_obj_data_cache_max_obj_size &&
+                    first_chunk->length() == size);
+  map<string, bufferlist>::iterator iter = attrset.find(RGW_ATTR_MANIFEST);
+  if (cacheable && iter != attrset.end()) {
+    RGWObjManifest manifest;
+    try {
+      bufferlist::iterator miter = iter->second.begin();
+      ::decode(manifest, miter);
+      cacheable = (manifest.get_obj_size() == size);
+    } catch (buffer::error& err) {
+      cacheable = false;
+    }
+  }
+  if (cacheable)
+    data_cache.put(name, seq, size, mtime, epoch, attrset, *first_chunk);
+
+  if (psize)
+    *psize = size;
+  if (pmtime)
+    *pmtime = mtime;
+  if (pepoch)
+    *pepoch = epoch;
+  if (attrs)
+    *attrs = attrset;
+  return 0;
+}
+
+template <class T>
+void RGWCache<T>::invalidate_data_cache(rgw_obj& obj)
+{
+  /*
+   * other gateways may cache the object even if we don't, so whether
+   * the invalidation goes out is set apart from our own cache size; it
+   * costs a synchronous notify per write
+   */
+  string name = data_cache_name(obj);
+  if (data_cache.enabled())
+    data_cache.remove(name);
+  if (!data_cache.invalidates())
+    return;
+
+  ObjectCacheInfo info;
+  int r = distribute_cache(name, obj, info, REMOVE_OBJ_DATA);
+  if (r < 0)
+    mydout(0) << "ERROR: failed to distribute cache for " << obj << dendl;
+}
+
 template <class T>
 int RGWCache<T>::distribute_cache(const string& normal_name, rgw_obj& obj, ObjectCacheInfo& obj_info, int op)
 {
@@ -569,6 +720,11 @@ int RGWCache<T>::watch_cb(int opcode, uint64_t ver, bufferlist& bl)
     return -EIO;
   }
 
+  if (info.op == REMOVE_OBJ_DATA) {
+    data_cache.remove(data_cache_name(info.obj));
+    return 0;
+  }
+
   rgw_bucket bucket;
   string oid;
   normalize_bucket_and_obj(info.obj.bucket, info.obj.object, bucket, oid);
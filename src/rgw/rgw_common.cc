@@ -46,9 +46,23 @@ int rgw_perf_start(CephContext *cct)
   plb.add_u64_counter(l_rgw_cache_hit, "cache_hit");
   plb.add_u64_counter(l_rgw_cache_miss, "cache_miss");
 
+  plb.add_u64_counter(l_rgw_data_cache_hit, "data_cache_hit");
+  plb.add_u64_counter(l_rgw_data_cache_miss, "data_cache_miss");
+  plb.add_u64(l_rgw_data_cache_bytes, "data_cache_bytes");
+  plb.add_u64(l_rgw_data_cache_entries, "data_cache_entries");
+
+  plb.add_u64(l_rgw_gc_backlog, "gc_backlog");
+  plb.add_u64_counter(l_rgw_gc_removed_objs, "gc_removed_objs");
+  plb.add_u64_counter(l_rgw_gc_removed_chains, "gc_removed_chains");
+  plb.add_u64_counter(l_rgw_gc_failed_objs, "gc_failed_objs");
+
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss");
 
+  plb.add_u64_counter(l_rgw_ops_log_entries, "ops_log_entries");
+  plb.add_u64(l_rgw_ops_log_backlog, "ops_log_backlog");
+  plb.add_time_avg(l_rgw_ops_log_wait_lat, "ops_log_wait_lat");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
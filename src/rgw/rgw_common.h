@@ -167,9 +167,23 @@ enum {
   l_rgw_cache_hit,
   l_rgw_cache_miss,
 
+  l_rgw_data_cache_hit,
+  l_rgw_data_cache_miss,
+  l_rgw_data_cache_bytes,
+  l_rgw_data_cache_entries,
+
+  l_rgw_gc_backlog,
+  l_rgw_gc_removed_objs,
+  l_rgw_gc_removed_chains,
+  l_rgw_gc_failed_objs,
+
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
 
+  l_rgw_ops_log_entries,
+  l_rgw_ops_log_backlog,
+  l_rgw_ops_log_wait_lat,
+
   l_rgw_last,
 };
 
@@ -729,9 +743,10 @@ struct RGWBucketInfo
   RGWObjVersionTracker objv_tracker; /* we don't need to serialize this, for runtime tracking */
   obj_version ep_objv; /* entry point object version, for runtime tracking only */
   RGWQuotaInfo quota;
+  uint32_t num_shards; /* number of bucket index shard objects, 0 if not sharded */
 
   void encode(bufferlist& bl) const {
-     ENCODE_START(9, 4, bl);
+     ENCODE_START(10, 4, bl);
      ::encode(bucket, bl);
      ::encode(owner, bl);
      ::encode(flags, bl);
@@ -741,6 +756,7 @@ struct RGWBucketInfo
      ::encode(placement_rule, bl);
      ::encode(has_instance_obj, bl);
      ::encode(quota, bl);
+     ::encode(num_shards, bl);
      ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator& bl) {
@@ -763,6 +779,8 @@ struct RGWBucketInfo
        ::decode(has_instance_obj, bl);
      if (struct_v >= 9)
        ::decode(quota, bl);
+     if (struct_v >= 10)
+       ::decode(num_shards, bl);
      DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -770,7 +788,7 @@ struct RGWBucketInfo
 
   void decode_json(JSONObj *obj);
 
-  RGWBucketInfo() : flags(0), creation_time(0), has_instance_obj(false) {}
+  RGWBucketInfo() : flags(0), creation_time(0), has_instance_obj(false), num_shards(0) {}
 };
 WRITE_CLASS_ENCODER(RGWBucketInfo)
 
@@ -912,6 +930,7 @@ struct req_state {
    string swift_groups;
 
    utime_t time;
+   map<string, utime_t> op_timings; /* stages of long running ops, for the ops log */
 
    void *obj_ctx;
 
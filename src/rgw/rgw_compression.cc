@@ -0,0 +1,121 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+
+#include <snappy.h>
+
+#include "rgw_compression.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+bool rgw_compression_supported(const string& type)
+{
+  return (type == "snappy");
+}
+
+int rgw_compress(const string& type, bufferlist& in, bufferlist& out)
+{
+  if (type != "snappy")
+    return -EOPNOTSUPP;
+
+  bufferptr ptr(snappy::MaxCompressedLength(in.length()));
+  size_t len;
+  snappy::RawCompress(in.c_str(), in.length(), ptr.c_str(), &len);
+  /* copy out, rather than pinning the worst case sized buffer */
+  out.append(ptr.c_str(), len);
+  return 0;
+}
+
+int rgw_decompress(const string& type, bufferlist& in, bufferlist& out)
+{
+  if (type != "snappy")
+    return -EOPNOTSUPP;
+
+  size_t len;
+  if (!snappy::GetUncompressedLength(in.c_str(), in.length(), &len))
+    return -EIO;
+
+  bufferptr ptr(len);
+  if (!snappy::RawUncompress(in.c_str(), in.length(), ptr.c_str()))
+    return -EIO;
+  out.append(ptr);
+  return 0;
+}
+
+RGWGetObj_Decompress::RGWGetObj_Decompress(CephContext *_cct, const RGWCompressionInfo& _info,
+                                           off_t ofs, off_t end, RGWGetDataCB *_next)
+  : cct(_cct), info(_info), next(_next), cur_block(0), last_block(0), skip(0), left(0)
+{
+  if (info.blocks.empty() || !info.block_size || end < ofs)
+    return;
+
+  cur_block = ofs / info.block_size;
+  last_block = end / info.block_size;
+  if (last_block >= info.blocks.size())
+    last_block = info.blocks.size() - 1;
+  skip = ofs - cur_block * info.block_size;
+  left = end - ofs + 1;
+}
+
+uint64_t RGWGetObj_Decompress::stored_block_len(uint64_t block)
+{
+  uint64_t next_ofs = (block + 1 < info.blocks.size() ? info.blocks[block + 1] : info.compressed_size);
+  return next_ofs - info.blocks[block];
+}
+
+void RGWGetObj_Decompress::get_stored_range(off_t *ofs, off_t *end)
+{
+  if (!left) {
+    *ofs = 0;
+    *end = -1;
+    return;
+  }
+  *ofs = info.blocks[cur_block];
+  *end = info.blocks[last_block] + stored_block_len(last_block) - 1;
+}
+
+int RGWGetObj_Decompress::handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len)
+{
+  bufferlist in;
+  in.substr_of(bl, bl_ofs, bl_len);
+  waiting.claim_append(in);
+
+  while (left > 0 && cur_block <= last_block) {
+    uint64_t len = stored_block_len(cur_block);
+    if (waiting.length() < len)
+      break;
+
+    bufferlist block, out;
+    waiting.splice(0, len, &block);
+    int r = rgw_decompress(info.compression_type, block, out);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to decompress block " << cur_block << " (" << info.compression_type
+                    << "): r=" << r << dendl;
+      return r;
+    }
+    if (out.length() <= skip) {
+      ldout(cct, 0) << "ERROR: decompressed block " << cur_block << " is too short: " << out.length() << dendl;
+      return -EIO;
+    }
+    ++cur_block;
+
+    uint64_t out_len = MIN(out.length() - skip, left);
+    r = next->handle_data(out, skip, out_len);
+    if (r < 0)
+      return r;
+
+    skip = 0;
+    left -= out_len;
+  }
+  return 0;
+}
+
+int RGWGetObj_Decompress::flush()
+{
+  if (left > 0) {
+    ldout(cct, 0) << "ERROR: compressed data ended short, " << left << " bytes missing" << dendl;
+    return -EIO;
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_COMPRESSION_H
+#define CEPH_RGW_COMPRESSION_H
+
+#include <string>
+
+#include "include/buffer.h"
+#include "rgw_rados.h"
+
+/* whether data can be compressed with the named codec */
+bool rgw_compression_supported(const std::string& type);
+
+/* compress or decompress a single block; in is consumed as a whole */
+int rgw_compress(const std::string& type, bufferlist& in, bufferlist& out);
+int rgw_decompress(const std::string& type, bufferlist& in, bufferlist& out);
+
+/*
+ * Reading a range of compressed object data.  The range asked for is
+ * widened to the blocks it overlaps; get_stored_range() is what has to be
+ * read of the stored data, which is then fed through handle_data().  Each
+ * block is decompressed as soon as it is complete, and the part of it
+ * that was asked for is passed on to the next callback.
+ */
+class RGWGetObj_Decompress : public RGWGetDataCB
+{
+  CephContext *cct;
+  RGWCompressionInfo info;
+  RGWGetDataCB *next;
+
+  uint64_t cur_block;   /* block collected in waiting */
+  uint64_t last_block;
+  uint64_t skip;        /* bytes to drop from the start of the next decompressed block */
+  uint64_t left;        /* bytes still to pass on */
+  bufferlist waiting;
+
+  uint64_t stored_block_len(uint64_t block);
+
+public:
+  RGWGetObj_Decompress(CephContext *_cct, const RGWCompressionInfo& _info,
+                       off_t ofs, off_t end, RGWGetDataCB *_next);
+  virtual ~RGWGetObj_Decompress() {}
+
+  void get_stored_range(off_t *ofs, off_t *end);
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len);
+  /* called once all of the stored range was handed in */
+  int flush();
+};
+
+#endif
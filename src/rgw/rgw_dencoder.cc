@@ -128,6 +128,21 @@ void RGWObjManifest::obj_iterator::update_explicit_pos()
   }
 }
 
+void RGWCompressionInfo::generate_test_instances(std::list<RGWCompressionInfo*>& o)
+{
+  RGWCompressionInfo *i = new RGWCompressionInfo;
+  i->compression_type = "snappy";
+  i->orig_size = 1024 * 1024 + 100;
+  i->compressed_size = 300 * 1024;
+  i->block_size = 512 * 1024;
+  i->blocks.push_back(0);
+  i->blocks.push_back(150 * 1024);
+  i->blocks.push_back(299 * 1024);
+  o.push_back(i);
+
+  o.push_back(new RGWCompressionInfo);
+}
+
 void RGWObjManifest::generate_test_instances(std::list<RGWObjManifest*>& o)
 {
   RGWObjManifest *m = new RGWObjManifest;
@@ -210,6 +225,7 @@ void rgw_log_entry::generate_test_instances(list<rgw_log_entry*>& o)
   e->user_agent = "user_agent";
   e->referrer = "referrer";
   e->bucket_id = "10";
+  e->op_timings["read_parts"] = utime_t(1, 500000);
   o.push_back(e);
   o.push_back(new rgw_log_entry);
 }
@@ -425,6 +441,7 @@ void RGWBucketInfo::generate_test_instances(list<RGWBucketInfo*>& o)
   i->bucket = rgw_bucket("bucket", "pool", ".index_pool", "marker", "10", "region");
   i->owner = "owner";
   i->flags = BUCKET_SUSPENDED;
+  i->num_shards = 8;
   o.push_back(i);
   o.push_back(new RGWBucketInfo);
 }
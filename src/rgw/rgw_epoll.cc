@@ -0,0 +1,886 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "common/errno.h"
+#include "common/strtol.h"
+#include "rgw_epoll.h"
+
+
+#define dout_subsys ceph_subsys_rgw
+
+#define EPOLL_MAX_EVENTS 256
+#define EPOLL_READ_CHUNK (16 * 1024)
+#define EPOLL_MAX_HEADER (64 * 1024)
+#define EPOLL_MAX_ACCEPTS 64
+
+static const char CONTINUE_RESPONSE[] = "HTTP/1.1 100 CONTINUE\r\n\r\n";
+
+static string trim(const string& s)
+{
+  size_t start = s.find_first_not_of(" \t");
+  if (start == string::npos)
+    return string();
+  size_t end = s.find_last_not_of(" \t\r");
+  return s.substr(start, end - start + 1);
+}
+
+void RGWEpollConn::reset_request()
+{
+  method.clear();
+  uri.clear();
+  query.clear();
+  headers.clear();
+  content_length = 0;
+  body_read = 0;
+  chunked = false;
+  chunk_state = CHUNK_SIZE;
+  chunk_left = 0;
+  keepalive = false;
+  explicit_keepalive = false;
+  expect_continue = false;
+  sent_continue = false;
+}
+
+/*
+ * parse the request line and headers, which take up the first
+ * header_len bytes of the input buffer, and consume them
+ */
+int RGWEpollConn::parse_header(size_t header_len)
+{
+  reset_request();
+
+  size_t pos = 0;
+  bool first = true;
+  while (pos < header_len) {
+    size_t eol = in.find('\n', pos);
+    if (eol == string::npos || eol >= header_len)
+      break;
+    string line = in.substr(pos, eol - pos);
+    pos = eol + 1;
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.resize(line.size() - 1);
+    if (line.empty())
+      break;
+
+    if (first) {
+      first = false;
+      size_t sp1 = line.find(' ');
+      size_t sp2 = line.rfind(' ');
+      if (sp1 == string::npos || sp2 == sp1)
+        return -EINVAL;
+      method = line.substr(0, sp1);
+      string target = trim(line.substr(sp1 + 1, sp2 - sp1 - 1));
+      string version = line.substr(sp2 + 1);
+      if (target.empty() || version.compare(0, 5, "HTTP/") != 0)
+        return -EINVAL;
+      keepalive = (version != "HTTP/1.0");
+      size_t q = target.find('?');
+      if (q != string::npos) {
+        uri = target.substr(0, q);
+        query = target.substr(q + 1);
+      } else {
+        uri = target;
+      }
+      continue;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == string::npos || colon == 0)
+      return -EINVAL;
+    string name = trim(line.substr(0, colon));
+    string val = trim(line.substr(colon + 1));
+
+    if (strcasecmp(name.c_str(), "content-length") == 0) {
+      string err;
+      long long len = strict_strtoll(val.c_str(), 10, &err);
+      if (!err.empty() || len < 0)
+        return -EINVAL;
+      content_length = len;
+    } else if (strcasecmp(name.c_str(), "connection") == 0) {
+      if (strcasecmp(val.c_str(), "close") == 0) {
+        keepalive = false;
+      } else if (strcasecmp(val.c_str(), "keep-alive") == 0) {
+        keepalive = true;
+        explicit_keepalive = true;
+      }
+    } else if (strcasecmp(name.c_str(), "expect") == 0) {
+      expect_continue = (strcasecmp(val.c_str(), "100-continue") == 0);
+    } else if (strcasecmp(name.c_str(), "transfer-encoding") == 0) {
+      /* chunked is the only transfer coding we can take apart */
+      if (strcasecmp(val.c_str(), "chunked") != 0)
+        return -EOPNOTSUPP;
+      chunked = true;
+    }
+    headers.push_back(pair<string, string>(name, val));
+  }
+
+  if (first)
+    return -EINVAL;
+
+  /* a chunked body is delimited by its chunks, whatever Content-Length says */
+  if (chunked)
+    content_length = 0;
+
+  in.erase(0, header_len);
+  return 0;
+}
+
+int RGWEpollConn::wait_io(short events, int timeout_ms)
+{
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = events;
+  pfd.revents = 0;
+  for (;;) {
+    int r = ::poll(&pfd, 1, timeout_ms);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return -errno;
+    }
+    if (r == 0)
+      return -ETIMEDOUT;
+    if (pfd.revents & (POLLERR | POLLNVAL))
+      return -EIO;
+    return 0;
+  }
+}
+
+/*
+ * read whatever the client sent next into the input buffer, waiting for
+ * it if need be; returns the number of bytes read, 0 at end of file
+ */
+int RGWEpollConn::fill_in(int timeout_ms)
+{
+  char buf[EPOLL_READ_CHUNK];
+  for (;;) {
+    ssize_t r = ::read(fd, buf, sizeof(buf));
+    if (r > 0) {
+      in.append(buf, r);
+      return r;
+    }
+    if (r == 0)
+      return 0;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      int ret = wait_io(POLLIN, timeout_ms);
+      if (ret < 0)
+        return ret;
+      continue;
+    }
+    return -errno;
+  }
+}
+
+/* take the next CRLF terminated line off the input, without the CRLF */
+int RGWEpollConn::read_line(string *line, int timeout_ms)
+{
+  size_t eol;
+  while ((eol = in.find('\n')) == string::npos) {
+    if (in.size() > EPOLL_MAX_HEADER)
+      return -EINVAL;
+    int r = fill_in(timeout_ms);
+    if (r <= 0)
+      return (r < 0 ? r : -EIO);
+  }
+  line->assign(in, 0, eol);
+  in.erase(0, eol + 1);
+  if (!line->empty() && (*line)[line->size() - 1] == '\r')
+    line->resize(line->size() - 1);
+  return 0;
+}
+
+/*
+ * read the data of a chunked request body; chunk sizes, extensions and
+ * trailers are consumed on the way.  Returns 0 once the last chunk was
+ * read.
+ */
+int RGWEpollConn::read_chunked(char *buf, int len, int timeout_ms)
+{
+  while (chunk_state != CHUNK_DONE) {
+    if (chunk_state == CHUNK_DATA) {
+      if (in.empty()) {
+        int r = fill_in(timeout_ms);
+        if (r <= 0)
+          return (r < 0 ? r : -EIO);
+      }
+      size_t n = min((uint64_t)len, min(chunk_left, (uint64_t)in.size()));
+      memcpy(buf, in.data(), n);
+      in.erase(0, n);
+      chunk_left -= n;
+      body_read += n;
+      if (!chunk_left)
+        chunk_state = CHUNK_DATA_END;
+      return n;
+    }
+
+    string line;
+    int r = read_line(&line, timeout_ms);
+    if (r < 0)
+      return r;
+
+    switch (chunk_state) {
+    case CHUNK_SIZE:
+      {
+        string size_str = trim(line.substr(0, line.find(';')));
+        if (size_str.empty() || size_str.size() > 16 ||
+            size_str.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+          return -EINVAL;
+        chunk_left = strtoull(size_str.c_str(), NULL, 16);
+        chunk_state = (chunk_left ? CHUNK_DATA : CHUNK_TRAILER);
+      }
+      break;
+    case CHUNK_DATA_END:
+      if (!line.empty())
+        return -EINVAL;
+      chunk_state = CHUNK_SIZE;
+      break;
+    case CHUNK_TRAILER:
+      if (line.empty())
+        chunk_state = CHUNK_DONE;
+      break;
+    default:
+      assert(0);
+    }
+  }
+  return 0;
+}
+
+/*
+ * send as much of the output buffer as we can; if block is set, wait
+ * for the socket to drain rather than returning -EAGAIN
+ */
+int RGWEpollConn::flush_out(bool block, int timeout_ms)
+{
+  while (out.length()) {
+    const bufferptr& bp = out.buffers().front();
+    ssize_t r = ::send(fd, bp.c_str(), bp.length(), MSG_NOSIGNAL);
+    if (r > 0) {
+      out.splice(0, r);
+      continue;
+    }
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!block)
+        return -EAGAIN;
+      int ret = wait_io(POLLOUT, timeout_ms);
+      if (ret < 0)
+        return ret;
+      continue;
+    }
+    return (r < 0 ? -errno : -EIO);
+  }
+  return 0;
+}
+
+
+RGWEpollLoop::RGWEpollLoop(CephContext *_cct, RGWEpollDispatcher *_dispatcher, int _listen_fd,
+                           int _idle_timeout, uint64_t _max_buffered_body)
+  : cct(_cct), dispatcher(_dispatcher), listen_fd(_listen_fd), epfd(-1),
+    idle_timeout(_idle_timeout), max_buffered_body(_max_buffered_body),
+    lock("RGWEpollLoop::lock"), going_down(false), stopped(false)
+{
+  wake_fds[0] = wake_fds[1] = -1;
+}
+
+RGWEpollLoop::~RGWEpollLoop()
+{
+  if (epfd >= 0)
+    ::close(epfd);
+  if (wake_fds[0] >= 0)
+    ::close(wake_fds[0]);
+  if (wake_fds[1] >= 0)
+    ::close(wake_fds[1]);
+}
+
+int RGWEpollLoop::init()
+{
+  epfd = epoll_create(1024);
+  if (epfd < 0) {
+    int err = errno;
+    lderr(cct) << "ERROR: epoll_create() failed: " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+  if (pipe(wake_fds) < 0) {
+    int err = errno;
+    lderr(cct) << "ERROR: pipe() failed: " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+  fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+
+  int fds[2] = { wake_fds[0], listen_fd };
+  for (int i = 0; i < 2; i++) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fds[i];
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+      int err = errno;
+      lderr(cct) << "ERROR: epoll_ctl() failed: " << cpp_strerror(err) << dendl;
+      return -err;
+    }
+  }
+  return 0;
+}
+
+void RGWEpollLoop::wake()
+{
+  char c = 'w';
+  int r = ::write(wake_fds[1], &c, 1);
+  (void)r; /* a full pipe means a wakeup is already pending */
+}
+
+void RGWEpollLoop::stop()
+{
+  Mutex::Locker l(lock);
+  going_down = true;
+  wake();
+}
+
+void RGWEpollLoop::kick()
+{
+  Mutex::Locker l(lock);
+  if (!parked.empty())
+    wake();
+}
+
+void RGWEpollLoop::requeue(RGWEpollConn *conn)
+{
+  Mutex::Locker l(lock);
+  if (stopped) {
+    ::close(conn->fd);
+    delete conn;
+    return;
+  }
+  returned.push_back(conn);
+  wake();
+}
+
+int RGWEpollLoop::update_events(RGWEpollConn *conn)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = (conn->state == RGWEpollConn::WRITE_RESPONSE ? EPOLLOUT : EPOLLIN);
+  ev.data.fd = conn->fd;
+  int op = (conn->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+  if (epoll_ctl(epfd, op, conn->fd, &ev) < 0) {
+    int err = errno;
+    ldout(cct, 0) << "ERROR: epoll_ctl() on fd " << conn->fd << " failed: " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+  conn->registered = true;
+  return 0;
+}
+
+void RGWEpollLoop::unregister(RGWEpollConn *conn)
+{
+  if (!conn->registered)
+    return;
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  conn->registered = false;
+}
+
+void RGWEpollLoop::close_conn(RGWEpollConn *conn)
+{
+  ldout(cct, 20) << "epoll: closing fd " << conn->fd << dendl;
+  unregister(conn);
+  ::close(conn->fd);
+  conns.erase(conn->fd);
+  delete conn;
+}
+
+void RGWEpollLoop::do_accept()
+{
+  for (int i = 0; i < EPOLL_MAX_ACCEPTS; i++) {
+    int fd = ::accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      int err = errno;
+      if (err == EINTR)
+        continue;
+      if (err != EAGAIN && err != EWOULDBLOCK)
+        ldout(cct, 0) << "ERROR: accept() failed: " << cpp_strerror(err) << dendl;
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    RGWEpollConn *conn = new RGWEpollConn(this, fd);
+    conn->last_active = ceph_clock_now(cct);
+    conns[fd] = conn;
+    ldout(cct, 20) << "epoll: accepted fd " << fd << dendl;
+    if (update_events(conn) < 0)
+      close_conn(conn);
+  }
+}
+
+void RGWEpollLoop::handle_read(RGWEpollConn *conn)
+{
+  char buf[EPOLL_READ_CHUNK];
+  /* don't let a client that keeps sending grow the buffer without bound */
+  while (conn->in.size() < max_buffered_body + EPOLL_MAX_HEADER) {
+    ssize_t r = ::read(conn->fd, buf, sizeof(buf));
+    if (r > 0) {
+      conn->in.append(buf, r);
+      if (r < (ssize_t)sizeof(buf))
+        break;
+      continue;
+    }
+    if (r == 0) {
+      close_conn(conn);
+      return;
+    }
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+    close_conn(conn);
+    return;
+  }
+  conn->last_active = ceph_clock_now(cct);
+  process_input(conn);
+}
+
+void RGWEpollLoop::reply_error(RGWEpollConn *conn, const char *status)
+{
+  ldout(cct, 10) << "epoll: fd " << conn->fd << ": bad request, replying " << status << dendl;
+  conn->in.clear();
+  conn->keepalive = false;
+  conn->out.append("HTTP/1.1 ");
+  conn->out.append(status);
+  conn->out.append("\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+  conn->state = RGWEpollConn::WRITE_RESPONSE;
+  handle_write(conn);
+}
+
+void RGWEpollLoop::process_input(RGWEpollConn *conn)
+{
+  if (conn->state == RGWEpollConn::READ_HEADER) {
+    size_t pos = conn->in.find("\r\n\r\n");
+    if (pos == string::npos) {
+      if (conn->in.size() > EPOLL_MAX_HEADER)
+        reply_error(conn, "400 Bad Request");
+      return;
+    }
+    int r = conn->parse_header(pos + 4);
+    if (r == -EOPNOTSUPP) {
+      reply_error(conn, "501 Not Implemented");
+      return;
+    }
+    if (r < 0) {
+      reply_error(conn, "400 Bad Request");
+      return;
+    }
+    conn->state = RGWEpollConn::READ_BODY;
+
+    /*
+     * a client waiting for 100-continue won't send a body we intend to
+     * buffer before dispatching, so answer on behalf of rgw
+     */
+    if (conn->expect_continue && conn->content_length <= max_buffered_body &&
+        conn->in.size() < conn->content_length) {
+      conn->out.append(CONTINUE_RESPONSE, sizeof(CONTINUE_RESPONSE) - 1);
+      if (conn->flush_out(false, 0) < 0) {
+        close_conn(conn);
+        return;
+      }
+      conn->sent_continue = true;
+    }
+  }
+
+  if (conn->state == RGWEpollConn::READ_BODY) {
+    if (conn->content_length > max_buffered_body ||
+        conn->in.size() >= conn->content_length) {
+      dispatch(conn);
+    }
+  }
+}
+
+/*
+ * queue the request behind the ones already waiting for a worker; it
+ * isn't read from any further until it gets one
+ */
+void RGWEpollLoop::dispatch(RGWEpollConn *conn)
+{
+  unregister(conn);
+  conn->state = RGWEpollConn::WAIT_WORKER;
+  {
+    Mutex::Locker l(lock);
+    parked.push_back(conn);
+  }
+  dispatch_parked();
+}
+
+void RGWEpollLoop::dispatch_parked()
+{
+  for (;;) {
+    RGWEpollConn *conn;
+    {
+      Mutex::Locker l(lock);
+      if (parked.empty())
+        return;
+      conn = parked.front();
+    }
+    ldout(cct, 20) << "epoll: fd " << conn->fd << ": dispatching " << conn->method
+                   << " " << conn->uri << dendl;
+    conn->state = RGWEpollConn::PROCESSING;
+    if (!dispatcher->dispatch(conn)) {
+      /* kick() brings us back here once a worker is free */
+      conn->state = RGWEpollConn::WAIT_WORKER;
+      return;
+    }
+    Mutex::Locker l(lock);
+    parked.pop_front();
+  }
+}
+
+void RGWEpollLoop::handle_write(RGWEpollConn *conn)
+{
+  int r = conn->flush_out(false, 0);
+  if (r == -EAGAIN) {
+    conn->last_active = ceph_clock_now(cct);
+    if (update_events(conn) < 0)
+      close_conn(conn);
+    return;
+  }
+  if (r < 0 || !conn->keepalive) {
+    close_conn(conn);
+    return;
+  }
+
+  conn->last_active = ceph_clock_now(cct);
+  conn->reset_request();
+  conn->state = RGWEpollConn::READ_HEADER;
+  if (update_events(conn) < 0) {
+    close_conn(conn);
+    return;
+  }
+  /* a pipelining client may already have sent the next request */
+  if (!conn->in.empty())
+    process_input(conn);
+}
+
+void RGWEpollLoop::handle_returned(RGWEpollConn *conn)
+{
+  conn->state = RGWEpollConn::WRITE_RESPONSE;
+  handle_write(conn);
+}
+
+void RGWEpollLoop::check_idle()
+{
+  utime_t cutoff = ceph_clock_now(cct);
+  cutoff -= idle_timeout;
+
+  list<RGWEpollConn *> idle;
+  for (map<int, RGWEpollConn *>::iterator iter = conns.begin(); iter != conns.end(); ++iter) {
+    RGWEpollConn *conn = iter->second;
+    if (conn->state != RGWEpollConn::PROCESSING &&
+        conn->state != RGWEpollConn::WAIT_WORKER &&
+        conn->last_active < cutoff)
+      idle.push_back(conn);
+  }
+  for (list<RGWEpollConn *>::iterator iter = idle.begin(); iter != idle.end(); ++iter) {
+    ldout(cct, 10) << "epoll: fd " << (*iter)->fd << " idle for too long" << dendl;
+    close_conn(*iter);
+  }
+}
+
+void *RGWEpollLoop::entry()
+{
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  utime_t last_check = ceph_clock_now(cct);
+
+  for (;;) {
+    {
+      Mutex::Locker l(lock);
+      if (going_down)
+        break;
+    }
+
+    int n = epoll_wait(epfd, events, EPOLL_MAX_EVENTS, 1000);
+    if (n < 0) {
+      int err = errno;
+      if (err == EINTR)
+        continue;
+      lderr(cct) << "ERROR: epoll_wait() failed: " << cpp_strerror(err) << dendl;
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == wake_fds[0]) {
+        char buf[64];
+        while (::read(wake_fds[0], buf, sizeof(buf)) > 0);
+        continue;
+      }
+      if (fd == listen_fd) {
+        do_accept();
+        continue;
+      }
+      map<int, RGWEpollConn *>::iterator iter = conns.find(fd);
+      if (iter == conns.end())
+        continue;
+      RGWEpollConn *conn = iter->second;
+      if (conn->state == RGWEpollConn::PROCESSING ||
+          conn->state == RGWEpollConn::WAIT_WORKER)
+        continue;
+      if (conn->state == RGWEpollConn::WRITE_RESPONSE) {
+        handle_write(conn);
+      } else {
+        handle_read(conn);
+      }
+    }
+
+    list<RGWEpollConn *> done;
+    {
+      Mutex::Locker l(lock);
+      done.swap(returned);
+    }
+    for (list<RGWEpollConn *>::iterator iter = done.begin(); iter != done.end(); ++iter) {
+      handle_returned(*iter);
+    }
+    dispatch_parked();
+
+    utime_t now = ceph_clock_now(cct);
+    if (now - last_check >= utime_t(1, 0)) {
+      check_idle();
+      last_check = now;
+    }
+  }
+
+  /*
+   * connections still being processed are freed by requeue() once their
+   * worker is done with them
+   */
+  list<RGWEpollConn *> to_close;
+  {
+    Mutex::Locker l(lock);
+    stopped = true;
+    to_close.swap(returned);
+    parked.clear();
+  }
+  for (map<int, RGWEpollConn *>::iterator iter = conns.begin(); iter != conns.end(); ++iter) {
+    if (iter->second->state != RGWEpollConn::PROCESSING)
+      to_close.push_back(iter->second);
+  }
+  for (list<RGWEpollConn *>::iterator iter = to_close.begin(); iter != to_close.end(); ++iter) {
+    close_conn(*iter);
+  }
+  conns.clear();
+
+  return NULL;
+}
+
+
+RGWEpoll::RGWEpoll(RGWEpollConn *_conn, int _port, uint64_t _max_buffered)
+  : conn(_conn), port(_port), max_buffered(_max_buffered), header_done(false),
+    sent_header(false), has_content_length(false)
+{
+}
+
+int RGWEpoll::send_data(const char *buf, int len)
+{
+  conn->out.append(buf, len);
+  if (conn->out.length() >= max_buffered) {
+    int r = conn->flush_out(true, conn->loop->get_idle_timeout() * 1000);
+    if (r < 0) {
+      dout(10) << "epoll: fd " << conn->fd << ": write failed: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+  return len;
+}
+
+int RGWEpoll::write_data(const char *buf, int len)
+{
+  if (!header_done) {
+    header_data.append(buf, len);
+    return len;
+  }
+  if (!sent_header) {
+    data.append(buf, len);
+    return len;
+  }
+  return send_data(buf, len);
+}
+
+int RGWEpoll::read_data(char *buf, int len)
+{
+  if (conn->chunked)
+    return conn->read_chunked(buf, len, conn->loop->get_idle_timeout() * 1000);
+
+  uint64_t left = conn->body_left();
+  if (left == 0)
+    return 0;
+  if ((uint64_t)len > left)
+    len = left;
+
+  if (!conn->in.empty()) {
+    size_t n = min((size_t)len, conn->in.size());
+    memcpy(buf, conn->in.data(), n);
+    conn->in.erase(0, n);
+    conn->body_read += n;
+    return n;
+  }
+
+  for (;;) {
+    ssize_t r = ::read(conn->fd, buf, len);
+    if (r > 0) {
+      conn->body_read += r;
+      return r;
+    }
+    if (r == 0)
+      return 0;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      int ret = conn->wait_io(POLLIN, conn->loop->get_idle_timeout() * 1000);
+      if (ret < 0)
+        return ret;
+      continue;
+    }
+    return -errno;
+  }
+}
+
+void RGWEpoll::flush()
+{
+}
+
+int RGWEpoll::complete_request()
+{
+  if (!sent_header) {
+    if (!has_content_length) {
+      header_done = false; /* let's go back to writing the header */
+
+      int r = send_content_length(data.length());
+      if (r < 0)
+        return r;
+    }
+
+    complete_header();
+  }
+
+  if (data.length()) {
+    int r = write_data(data.c_str(), data.length());
+    if (r < 0)
+      return r;
+    data.clear();
+  }
+
+  /* an unread request body is still on the socket, the connection can't be reused */
+  if (!conn->body_done())
+    conn->keepalive = false;
+
+  return 0;
+}
+
+void RGWEpoll::init_env(CephContext *cct)
+{
+  env.init(cct);
+
+  list<pair<string, string> >::iterator iter;
+  for (iter = conn->headers.begin(); iter != conn->headers.end(); ++iter) {
+    const string& name = iter->first;
+    const string& val = iter->second;
+
+    if (strcasecmp(name.c_str(), "content-length") == 0) {
+      if (!conn->chunked)
+        env.set("CONTENT_LENGTH", val.c_str());
+      continue;
+    }
+
+    if (strcasecmp(name.c_str(), "content-type") == 0) {
+      env.set("CONTENT_TYPE", val.c_str());
+      continue;
+    }
+
+    string buf = "HTTP_";
+    for (string::const_iterator c = name.begin(); c != name.end(); ++c) {
+      buf.push_back(*c == '-' ? '_' : toupper(*c));
+    }
+
+    env.set(buf.c_str(), val.c_str());
+  }
+
+  env.set("REQUEST_METHOD", conn->method.c_str());
+  env.set("REQUEST_URI", conn->uri.c_str());
+  env.set("QUERY_STRING", conn->query.c_str());
+  env.set("SCRIPT_URI", conn->uri.c_str()); /* FIXME */
+
+  char port_buf[16];
+  snprintf(port_buf, sizeof(port_buf), "%d", port);
+  env.set("SERVER_PORT", port_buf);
+}
+
+int RGWEpoll::send_status(const char *status, const char *status_name)
+{
+  char buf[128];
+
+  if (!status_name)
+    status_name = "";
+
+  snprintf(buf, sizeof(buf), "HTTP/1.1 %s %s\n", status, status_name);
+
+  bufferlist bl;
+  bl.append(buf);
+  bl.append(header_data);
+  header_data = bl;
+
+  return 0;
+}
+
+int RGWEpoll::send_100_continue()
+{
+  if (conn->sent_continue)
+    return 0;
+
+  conn->sent_continue = true;
+  conn->out.append(CONTINUE_RESPONSE, sizeof(CONTINUE_RESPONSE) - 1);
+  return conn->flush_out(true, conn->loop->get_idle_timeout() * 1000);
+}
+
+int RGWEpoll::complete_header()
+{
+  header_done = true;
+
+  if (!has_content_length) {
+    return 0;
+  }
+
+  if (!conn->body_done())
+    conn->keepalive = false;
+
+  if (!conn->keepalive)
+    header_data.append("Connection: close\r\n");
+  else if (conn->explicit_keepalive)
+    header_data.append("Connection: Keep-Alive\r\n");
+
+  header_data.append("\r\n");
+
+  sent_header = true;
+
+  int r = send_data(header_data.c_str(), header_data.length());
+  return (r < 0 ? r : 0);
+}
+
+int RGWEpoll::send_content_length(uint64_t len)
+{
+  has_content_length = true;
+  char buf[21];
+  snprintf(buf, sizeof(buf), "%" PRIu64, len);
+  return print("Content-Length: %s\n", buf);
+}
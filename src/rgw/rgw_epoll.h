@@ -0,0 +1,196 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_EPOLL_H
+#define CEPH_RGW_EPOLL_H
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "include/utime.h"
+#include "rgw_client_io.h"
+
+class RGWEpollLoop;
+
+/*
+ * A client connection of the epoll frontend.
+ *
+ * The loop that accepted it owns it while a request is read off the
+ * socket and while a response is flushed back.  In between, while the
+ * request is processed, it is removed from the loop's epoll set and
+ * belongs to the worker thread alone, which hands it back with
+ * RGWEpollLoop::requeue() once the request is complete.  A request
+ * that no worker is free for waits outside of the epoll set too, so
+ * that nothing more is read off it until it is dispatched.  Idle
+ * keep-alive connections and slow clients therefore only cost a file
+ * descriptor and a few buffers, not a worker thread.
+ */
+struct RGWEpollConn {
+  enum State {
+    READ_HEADER,
+    READ_BODY,
+    WAIT_WORKER,
+    PROCESSING,
+    WRITE_RESPONSE,
+  };
+
+  /* decoding a chunked request body */
+  enum ChunkState {
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_DATA_END, /* the CRLF following the data */
+    CHUNK_TRAILER,
+    CHUNK_DONE,
+  };
+
+  RGWEpollLoop *loop;
+  int fd;
+  State state;
+  bool registered; /* in the loop's epoll set */
+  utime_t last_active;
+
+  std::string in;  /* bytes read from the socket and not consumed yet */
+  bufferlist out;  /* response bytes not sent yet */
+
+  /* the current request */
+  std::string method;
+  std::string uri;
+  std::string query;
+  std::list<std::pair<std::string, std::string> > headers;
+  uint64_t content_length;
+  uint64_t body_read;
+  bool chunked;
+  ChunkState chunk_state;
+  uint64_t chunk_left;
+  bool keepalive;
+  bool explicit_keepalive;
+  bool expect_continue;
+  bool sent_continue;
+
+  RGWEpollConn(RGWEpollLoop *_loop, int _fd) : loop(_loop), fd(_fd), state(READ_HEADER),
+                                               registered(false), content_length(0), body_read(0),
+                                               chunked(false), chunk_state(CHUNK_SIZE), chunk_left(0),
+                                               keepalive(false), explicit_keepalive(false),
+                                               expect_continue(false), sent_continue(false) {}
+
+  void reset_request();
+  int parse_header(size_t header_len);
+
+  uint64_t body_left() { return content_length - body_read; }
+  /* whether the whole request body was consumed */
+  bool body_done() { return (chunked ? chunk_state == CHUNK_DONE : body_left() == 0); }
+
+  int wait_io(short events, int timeout_ms);
+  int fill_in(int timeout_ms);
+  int read_line(std::string *line, int timeout_ms);
+  int read_chunked(char *buf, int len, int timeout_ms);
+  int flush_out(bool block, int timeout_ms);
+};
+
+class RGWEpollDispatcher {
+public:
+  virtual ~RGWEpollDispatcher() {}
+  /*
+   * called from the loop thread once a request is ready to be processed;
+   * returns false, without taking the connection, if no worker is free
+   */
+  virtual bool dispatch(RGWEpollConn *conn) = 0;
+};
+
+/*
+ * An event loop thread.  All loops share the listening socket and accept
+ * from it; each one then drives the connections it accepted.
+ */
+class RGWEpollLoop : public Thread {
+  CephContext *cct;
+  RGWEpollDispatcher *dispatcher;
+  int listen_fd;
+  int epfd;
+  int wake_fds[2];
+
+  int idle_timeout;
+  uint64_t max_buffered_body;
+
+  std::map<int, RGWEpollConn *> conns;
+
+  Mutex lock;
+  std::list<RGWEpollConn *> returned;
+  std::list<RGWEpollConn *> parked; /* waiting for a worker, in order */
+  bool going_down;
+  bool stopped;
+
+  int update_events(RGWEpollConn *conn);
+  void unregister(RGWEpollConn *conn);
+  void close_conn(RGWEpollConn *conn);
+  void do_accept();
+  void handle_read(RGWEpollConn *conn);
+  void handle_write(RGWEpollConn *conn);
+  void process_input(RGWEpollConn *conn);
+  void handle_returned(RGWEpollConn *conn);
+  void dispatch(RGWEpollConn *conn);
+  void dispatch_parked();
+  void reply_error(RGWEpollConn *conn, const char *status);
+  void check_idle();
+  void wake();
+
+public:
+  RGWEpollLoop(CephContext *_cct, RGWEpollDispatcher *_dispatcher, int _listen_fd,
+               int _idle_timeout, uint64_t _max_buffered_body);
+  ~RGWEpollLoop();
+
+  int init();
+  void *entry();
+  void stop();
+
+  /* called from a worker thread when it is done with the connection */
+  void requeue(RGWEpollConn *conn);
+  /* called once a worker is free, to retry the parked requests */
+  void kick();
+
+  int get_idle_timeout() { return idle_timeout; }
+};
+
+/*
+ * The RGWClientIO of a request read by an event loop.  Small responses
+ * are left in the connection's output buffer for the loop to flush;
+ * once more than max_buffered bytes pile up the worker writes them out
+ * itself, so large GETs stream rather than being held in memory.
+ * Likewise the body of a request larger than the loop was willing to
+ * buffer is read off the socket by the worker.
+ */
+class RGWEpoll : public RGWClientIO
+{
+  RGWEpollConn *conn;
+
+  bufferlist header_data;
+  bufferlist data;
+
+  int port;
+  uint64_t max_buffered;
+
+  bool header_done;
+  bool sent_header;
+  bool has_content_length;
+
+  int send_data(const char *buf, int len);
+
+public:
+  void init_env(CephContext *cct);
+
+  int write_data(const char *buf, int len);
+  int read_data(char *buf, int len);
+
+  int send_status(const char *status, const char *status_name);
+  int send_100_continue();
+  int complete_header();
+  int complete_request();
+  int send_content_length(uint64_t len);
+
+  RGWEpoll(RGWEpollConn *_conn, int _port, uint64_t _max_buffered);
+  void flush();
+};
+
+#endif
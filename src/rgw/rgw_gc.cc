@@ -8,7 +8,10 @@
 #include "cls/lock/cls_lock_client.h"
 #include "auth/Crypto.h"
 
+#include <deque>
 #include <list>
+#include <map>
+#include <set>
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -84,6 +87,21 @@ int RGWGC::defer_chain(const string& tag, bool sync)
   return store->gc_aio_operate(obj_names[i], &op);
 }
 
+int RGWGC::defer_chain(int index, const string& tag, AioCompletion **pc)
+{
+  ObjectWriteOperation op;
+  cls_rgw_gc_defer_entry(op, cct->_conf->rgw_gc_obj_min_wait, tag);
+
+  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  int ret = store->gc_pool_ctx.aio_operate(obj_names[index], c, &op);
+  if (ret < 0) {
+    c->release();
+    return ret;
+  }
+  *pc = c;
+  return 0;
+}
+
 int RGWGC::remove(int index, const std::list<string>& tags)
 {
   ObjectWriteOperation op;
@@ -91,6 +109,21 @@ int RGWGC::remove(int index, const std::list<string>& tags)
   return store->gc_operate(obj_names[index], &op);
 }
 
+int RGWGC::remove(int index, const std::list<string>& tags, AioCompletion **pc)
+{
+  ObjectWriteOperation op;
+  cls_rgw_gc_remove(op, tags);
+
+  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  int ret = store->gc_pool_ctx.aio_operate(obj_names[index], c, &op);
+  if (ret < 0) {
+    c->release();
+    return ret;
+  }
+  *pc = c;
+  return 0;
+}
+
 int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std::list<cls_rgw_gc_obj_info>& result, bool *truncated)
 {
   result.clear();
@@ -128,11 +161,186 @@ int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std
   return 0;
 }
 
+/*
+ * Keeps up to rgw_gc_max_concurrent_io tail object removals of one gc
+ * shard in flight.  A chain's tag is trimmed from the shard, in batches,
+ * once every removal of the chain has succeeded.  A chain that failed is
+ * deferred instead, so that it no longer lists as expired and doesn't
+ * hold up the chains behind it.
+ */
+class RGWGCIOManager {
+  CephContext *cct;
+  RGWGC *gc;
+  int index;
+  size_t max_aio;
+  size_t max_trim;
+
+  struct IO {
+    enum Type {
+      TailIO,
+      IndexIO,
+      DeferIO,
+    } type;
+    AioCompletion *c;
+    string oid;
+    string tag;
+  };
+
+  deque<IO> ios;
+  map<string, int> tag_refs; /* in flight removals of a chain, plus one while it's being scheduled */
+  set<string> failed_tags;
+  std::list<string> remove_tags;
+
+  void handle_next_completion();
+  void put_tag(const string& tag);
+  void defer_tag(const string& tag);
+
+public:
+  RGWGCIOManager(CephContext *_cct, RGWGC *_gc, int _index) : cct(_cct), gc(_gc), index(_index) {
+    max_aio = max(cct->_conf->rgw_gc_max_concurrent_io, 1);
+    max_trim = max(cct->_conf->rgw_gc_max_trim_chunk, 1);
+  }
+  ~RGWGCIOManager() {
+    drain();
+  }
+
+  void begin_chain(const string& tag) {
+    tag_refs[tag] = 1;
+  }
+  void end_chain(const string& tag) {
+    put_tag(tag);
+  }
+  void fail_chain(const string& tag) {
+    failed_tags.insert(tag);
+  }
+
+  int schedule_io(IoCtx *ioctx, const string& oid, ObjectWriteOperation *op, const string& tag);
+  void flush_remove_tags();
+  void drain();
+};
+
+int RGWGCIOManager::schedule_io(IoCtx *ioctx, const string& oid, ObjectWriteOperation *op, const string& tag)
+{
+  while (ios.size() >= max_aio) {
+    handle_next_completion();
+  }
+
+  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  int ret = ioctx->aio_operate(oid, c, op);
+  if (ret < 0) {
+    c->release();
+    return ret;
+  }
+
+  IO io;
+  io.type = IO::TailIO;
+  io.c = c;
+  io.oid = oid;
+  io.tag = tag;
+  ios.push_back(io);
+  tag_refs[tag]++;
+  return 0;
+}
+
+void RGWGCIOManager::handle_next_completion()
+{
+  IO io = ios.front();
+  ios.pop_front();
+
+  io.c->wait_for_safe();
+  int ret = io.c->get_return_value();
+  io.c->release();
+
+  if (ret == -ENOENT)
+    ret = 0;
+
+  if (io.type == IO::DeferIO) {
+    if (ret < 0)
+      dout(0) << "WARNING: gc could not defer chain " << io.tag << " ret=" << ret << dendl;
+    return;
+  }
+  if (io.type == IO::IndexIO) {
+    if (ret < 0)
+      dout(0) << "WARNING: gc could not remove entries from " << io.oid << " ret=" << ret << dendl;
+    return;
+  }
+
+  if (ret < 0) {
+    dout(0) << "failed to remove " << io.oid << " ret=" << ret << dendl;
+    failed_tags.insert(io.tag);
+    if (perfcounter) perfcounter->inc(l_rgw_gc_failed_objs);
+  } else {
+    if (perfcounter) perfcounter->inc(l_rgw_gc_removed_objs);
+  }
+  put_tag(io.tag);
+}
+
+void RGWGCIOManager::put_tag(const string& tag)
+{
+  map<string, int>::iterator iter = tag_refs.find(tag);
+  assert(iter != tag_refs.end());
+  if (--iter->second > 0)
+    return;
+  tag_refs.erase(iter);
+
+  if (failed_tags.erase(tag)) {
+    defer_tag(tag);
+    return;
+  }
+
+  if (perfcounter) perfcounter->inc(l_rgw_gc_removed_chains);
+  remove_tags.push_back(tag);
+  if (remove_tags.size() >= max_trim)
+    flush_remove_tags();
+}
+
+/* like trimming, deferring is not held to the window */
+void RGWGCIOManager::defer_tag(const string& tag)
+{
+  IO io;
+  io.type = IO::DeferIO;
+  io.tag = tag;
+  int ret = gc->defer_chain(index, tag, &io.c);
+  if (ret < 0) {
+    dout(0) << "WARNING: gc could not defer chain " << tag << " on shard " << index << " ret=" << ret << dendl;
+    return;
+  }
+  ios.push_back(io);
+}
+
+/* trimming is not held to the window, it never waits on a completion */
+void RGWGCIOManager::flush_remove_tags()
+{
+  if (remove_tags.empty())
+    return;
+
+  IO io;
+  io.type = IO::IndexIO;
+  int ret = gc->remove(index, remove_tags, &io.c);
+  if (ret < 0) {
+    dout(0) << "WARNING: gc could not remove " << remove_tags.size() << " entries from shard " << index << " ret=" << ret << dendl;
+    remove_tags.clear();
+    return;
+  }
+  remove_tags.clear();
+  ios.push_back(io);
+}
+
+void RGWGCIOManager::drain()
+{
+  while (!ios.empty()) {
+    handle_next_completion();
+  }
+  flush_remove_tags();
+  while (!ios.empty()) {
+    handle_next_completion();
+  }
+}
+
 int RGWGC::process(int index, int max_secs)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
   utime_t end = ceph_clock_now(g_ceph_context);
-  std::list<string> remove_tags;
 
   /* max_secs should be greater than zero. We don't want a zero max_secs
    * to be translated as no timeout, since we'd then need to break the
@@ -147,7 +355,7 @@ int RGWGC::process(int index, int max_secs)
 
   int ret = l.lock_exclusive(&store->gc_pool_ctx, obj_names[index]);
   if (ret == -EBUSY) { /* already locked by another gc processor */
-    dout(0) << "RGWGC::process() failed to acquire lock on " << obj_names[index] << dendl;
+    dout(10) << "RGWGC::process() failed to acquire lock on " << obj_names[index] << dendl;
     return 0;
   }
   if (ret < 0)
@@ -155,7 +363,9 @@ int RGWGC::process(int index, int max_secs)
 
   string marker;
   bool truncated;
-  IoCtx *ctx = new IoCtx;
+  map<string, IoCtx> ctxs;
+  set<string> seen_tags;
+  RGWGCIOManager io_manager(cct, this, index);
   do {
     int max = 100;
     std::list<cls_rgw_gc_obj_info> entries;
@@ -167,64 +377,75 @@ int RGWGC::process(int index, int max_secs)
     if (ret < 0)
       goto done;
 
-    string last_pool;
+    int processed = 0;
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
       cls_rgw_gc_obj_info& info = *iter;
       std::list<cls_rgw_obj>::iterator liter;
       cls_rgw_obj_chain& chain = info.chain;
 
+      if (!seen_tags.insert(info.tag).second)
+        continue;
+      ++processed;
+      ++backlog;
+
       utime_t now = ceph_clock_now(g_ceph_context);
       if (now >= end)
         goto done;
 
-      remove_tag = true;
+      io_manager.begin_chain(info.tag);
       for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
         cls_rgw_obj& obj = *liter;
 
-        if (obj.pool != last_pool) {
-          delete ctx;
-          ctx = new IoCtx;
-	  ret = store->rados->ioctx_create(obj.pool.c_str(), *ctx);
-	  if (ret < 0) {
-	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
-	    continue;
-	  }
-          last_pool = obj.pool;
+        map<string, IoCtx>::iterator citer = ctxs.find(obj.pool);
+        if (citer == ctxs.end()) {
+          IoCtx& ctx = ctxs[obj.pool];
+          ret = store->rados->ioctx_create(obj.pool.c_str(), ctx);
+          if (ret < 0) {
+            ctxs.erase(obj.pool);
+            if (ret == -ENOENT) {
+              /* the pool is gone, and the object with it */
+              dout(5) << "gc::process: pool " << obj.pool << " no longer exists, skipping " << obj.oid << dendl;
+              continue;
+            }
+            dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
+            io_manager.fail_chain(info.tag);
+            continue;
+          }
+          citer = ctxs.find(obj.pool);
         }
+        IoCtx *ctx = &citer->second;
 
         ctx->locator_set_key(obj.key);
-	dout(0) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
-	ObjectWriteOperation op;
-	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(obj.oid, &op);
-	if (ret == -ENOENT)
-	  ret = 0;
+        dout(5) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
+        ObjectWriteOperation op;
+        cls_refcount_put(op, info.tag, true);
+        ret = io_manager.schedule_io(ctx, obj.oid, &op, info.tag);
         if (ret < 0) {
-          remove_tag = false;
+          io_manager.fail_chain(info.tag);
           dout(0) << "failed to remove " << obj.pool << ":" << obj.oid << "@" << obj.key << dendl;
         }
 
         if (going_down()) // leave early, even if tag isn't removed, it's ok
           goto done;
       }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
-#define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          remove(index, remove_tags);
-          remove_tags.clear();
-        }
-      }
+      io_manager.end_chain(info.tag);
     }
+
+    /*
+     * the listing starts over from the beginning of the shard, so let the
+     * trims and defers land before listing again; whatever is still there
+     * couldn't be updated
+     */
+    io_manager.drain();
+    if (!processed)
+      break;
   } while (truncated);
 
 done:
-  if (!remove_tags.empty())
-    remove(index, remove_tags);
+  /* wait for all removals while we still hold the shard */
+  io_manager.drain();
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
   return 0;
 }
 
@@ -238,6 +459,8 @@ int RGWGC::process()
   if (ret < 0)
     return ret;
 
+  backlog = 0;
+
   for (int i = 0; i < max_objs; i++) {
     int index = (i + start) % max_objs;
     ret = process(index, max_secs);
@@ -245,6 +468,8 @@ int RGWGC::process()
       return ret;
   }
 
+  if (perfcounter) perfcounter->set(l_rgw_gc_backlog, backlog);
+
   return 0;
 }
 
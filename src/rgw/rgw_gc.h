@@ -21,6 +21,7 @@ class RGWGC {
   int max_objs;
   string *obj_names;
   atomic_t down_flag;
+  uint64_t backlog; /* expired entries seen by the current process() pass */
 
   int tag_index(const string& tag);
 
@@ -38,7 +39,7 @@ class RGWGC {
 
   GCWorker *worker;
 public:
-  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), backlog(0), worker(NULL) {}
   ~RGWGC() {
     stop_processor();
     finalize();
@@ -47,7 +48,9 @@ public:
   void add_chain(librados::ObjectWriteOperation& op, cls_rgw_obj_chain& chain, const string& tag);
   int send_chain(cls_rgw_obj_chain& chain, const string& tag, bool sync);
   int defer_chain(const string& tag, bool sync);
+  int defer_chain(int index, const string& tag, librados::AioCompletion **pc);
   int remove(int index, const std::list<string>& tags);
+  int remove(int index, const std::list<string>& tags, librados::AioCompletion **pc);
 
   void initialize(CephContext *_cct, RGWRados *_store);
   void finalize();
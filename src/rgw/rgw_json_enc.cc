@@ -70,6 +70,20 @@ void RGWObjManifest::dump(Formatter *f) const
   ::encode_json("prefix", prefix, f);
   ::encode_json("tail_bucket", tail_bucket, f);
   ::encode_json("rules", rules, f);
+  ::encode_json("compression", compression, f);
+}
+
+void RGWCompressionInfo::dump(Formatter *f) const
+{
+  encode_json("compression_type", compression_type, f);
+  encode_json("orig_size", orig_size, f);
+  encode_json("compressed_size", compressed_size, f);
+  encode_json("block_size", block_size, f);
+  f->open_array_section("blocks");
+  for (vector<uint64_t>::const_iterator iter = blocks.begin(); iter != blocks.end(); ++iter) {
+    f->dump_unsigned("ofs", *iter);
+  }
+  f->close_section();
 }
 
 void rgw_log_entry::dump(Formatter *f) const
@@ -92,6 +106,11 @@ void rgw_log_entry::dump(Formatter *f) const
   f->dump_string("user_agent", user_agent);
   f->dump_string("referrer", referrer);
   f->dump_string("bucket_id", bucket_id);
+  f->open_object_section("op_timings");
+  for (map<string, utime_t>::const_iterator iter = op_timings.begin(); iter != op_timings.end(); ++iter) {
+    f->dump_stream(iter->first.c_str()) << iter->second;
+  }
+  f->close_section();
 }
 
 void rgw_intent_log_entry::dump(Formatter *f) const
@@ -538,6 +557,7 @@ void RGWBucketInfo::dump(Formatter *f) const
   encode_json("placement_rule", placement_rule, f);
   encode_json("has_instance_obj", has_instance_obj, f);
   encode_json("quota", quota, f);
+  encode_json("num_shards", num_shards, f);
 }
 
 void RGWBucketInfo::decode_json(JSONObj *obj) {
@@ -549,6 +569,7 @@ void RGWBucketInfo::decode_json(JSONObj *obj) {
   JSONDecoder::decode_json("placement_rule", placement_rule, obj);
   JSONDecoder::decode_json("has_instance_obj", has_instance_obj, obj);
   JSONDecoder::decode_json("quota", quota, obj);
+  JSONDecoder::decode_json("num_shards", num_shards, obj);
 }
 
 void RGWObjEnt::dump(Formatter *f) const
@@ -620,6 +641,7 @@ void RGWZonePlacementInfo::dump(Formatter *f) const
   encode_json("index_pool", index_pool, f);
   encode_json("data_pool", data_pool, f);
   encode_json("data_extra_pool", data_extra_pool, f);
+  encode_json("compression", compression, f);
 }
 
 void RGWZonePlacementInfo::decode_json(JSONObj *obj)
@@ -627,6 +649,7 @@ void RGWZonePlacementInfo::decode_json(JSONObj *obj)
   JSONDecoder::decode_json("index_pool", index_pool, obj);
   JSONDecoder::decode_json("data_pool", data_pool, obj);
   JSONDecoder::decode_json("data_extra_pool", data_extra_pool, obj);
+  JSONDecoder::decode_json("compression", compression, obj);
 }
 
 void RGWZoneParams::decode_json(JSONObj *obj)
@@ -2,10 +2,13 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
 #include "common/Timer.h"
 #include "common/utf8.h"
 #include "common/OutputDataSocket.h"
 #include "common/Formatter.h"
+#include "include/ceph_hash.h"
 
 #include "rgw_log.h"
 #include "rgw_acl.h"
@@ -90,6 +93,7 @@ class UsageLogger {
   Mutex timer_lock;
   SafeTimer timer;
   utime_t round_timestamp;
+  bool flush_scheduled; /* protected by timer_lock */
 
   class C_UsageLogTimeout : public Context {
     UsageLogger *logger;
@@ -101,12 +105,22 @@ class UsageLogger {
     }
   };
 
+  class C_UsageLogFlush : public Context {
+    UsageLogger *logger;
+  public:
+    C_UsageLogFlush(UsageLogger *_l) : logger(_l) {}
+    void finish(int r) {
+      logger->flush_scheduled = false;
+      logger->flush();
+    }
+  };
+
   void set_timer() {
     timer.add_event_after(cct->_conf->rgw_usage_log_tick_interval, new C_UsageLogTimeout(this));
   }
 public:
 
-  UsageLogger(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), lock("UsageLogger"), num_entries(0), timer_lock("UsageLogger::timer_lock"), timer(cct, timer_lock) {
+  UsageLogger(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), lock("UsageLogger"), num_entries(0), timer_lock("UsageLogger::timer_lock"), timer(cct, timer_lock), flush_scheduled(false) {
     timer.init();
     Mutex::Locker l(timer_lock);
     set_timer();
@@ -136,10 +150,18 @@ public:
     if (account)
       num_entries++;
     bool need_flush = (num_entries > cct->_conf->rgw_usage_log_flush_threshold);
+    /* the timer thread isn't keeping up, push back on the request */
+    bool flush_now = (num_entries > 2 * cct->_conf->rgw_usage_log_flush_threshold);
     lock.Unlock();
-    if (need_flush) {
+    if (flush_now) {
       Mutex::Locker l(timer_lock);
       flush();
+    } else if (need_flush) {
+      Mutex::Locker l(timer_lock);
+      if (!flush_scheduled) {
+        flush_scheduled = true;
+        timer.add_event_after(0, new C_UsageLogFlush(this));
+      }
     }
   }
 
@@ -167,6 +189,175 @@ void rgw_log_usage_finalize()
   usage_logger = NULL;
 }
 
+/*
+ * Ops log entries bound for rados.  Requests only add their encoded entry
+ * to the pending data of its log object; a flush thread appends each log
+ * object's data with a single aio write, every rgw_ops_log_flush_interval
+ * seconds or as soon as rgw_ops_log_flush_threshold bytes are pending.
+ * Once rgw_ops_log_data_backlog bytes are pending or in flight, requests
+ * wait for the writes to drain rather than dropping entries.
+ */
+class OpsLogRados : public Thread {
+  CephContext *cct;
+  RGWRados *store;
+  Mutex lock;
+  Cond flush_cond;
+  Cond space_cond;
+  map<string, bufferlist> pending;
+  uint64_t pending_bytes;
+  uint64_t in_flight_bytes;
+  bool going_down;
+
+  void write(map<string, bufferlist>& entries);
+
+  void update_backlog() {
+    if (perfcounter)
+      perfcounter->set(l_rgw_ops_log_backlog, pending_bytes + in_flight_bytes);
+  }
+
+public:
+  OpsLogRados(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), lock("OpsLogRados"),
+                                                     pending_bytes(0), in_flight_bytes(0), going_down(false) {}
+
+  void *entry();
+  void stop();
+
+  void log(const string& oid, bufferlist& bl);
+};
+
+void *OpsLogRados::entry()
+{
+  lock.Lock();
+  while (true) {
+    if (!going_down && pending.empty()) {
+      /* log() wakes us up with the first entry */
+      flush_cond.Wait(lock);
+      continue;
+    }
+    if (!going_down && pending_bytes < (uint64_t)cct->_conf->rgw_ops_log_flush_threshold) {
+      utime_t interval;
+      interval.set_from_double(cct->_conf->rgw_ops_log_flush_interval);
+      flush_cond.WaitInterval(cct, lock, interval);
+    }
+    if (pending.empty()) {
+      if (going_down)
+        break;
+      continue;
+    }
+
+    map<string, bufferlist> entries;
+    entries.swap(pending);
+    uint64_t bytes = pending_bytes;
+    in_flight_bytes += bytes;
+    pending_bytes = 0;
+    lock.Unlock();
+
+    write(entries);
+
+    lock.Lock();
+    in_flight_bytes -= bytes;
+    update_backlog();
+    space_cond.SignalAll();
+  }
+  lock.Unlock();
+  return NULL;
+}
+
+void OpsLogRados::write(map<string, bufferlist>& entries)
+{
+  list<pair<string, librados::AioCompletion *> > completions;
+
+  map<string, bufferlist>::iterator iter;
+  for (iter = entries.begin(); iter != entries.end(); ++iter) {
+    rgw_obj obj(store->zone.log_pool, iter->first);
+    bufferlist& bl = iter->second;
+
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int r = store->append_async(obj, bl.length(), bl, c);
+    if (r == -ENOENT) {
+      r = store->create_pool(store->zone.log_pool);
+      if (r >= 0 || r == -EEXIST) {
+        // retry
+        r = store->append_async(obj, bl.length(), bl, c);
+      }
+    }
+    if (r < 0) {
+      c->release();
+      ldout(cct, 0) << "ERROR: failed to write ops log object " << iter->first << ": r=" << r << dendl;
+      continue;
+    }
+    completions.push_back(make_pair(iter->first, c));
+  }
+
+  list<pair<string, librados::AioCompletion *> >::iterator citer;
+  for (citer = completions.begin(); citer != completions.end(); ++citer) {
+    librados::AioCompletion *c = citer->second;
+    c->wait_for_complete();
+    int r = c->get_return_value();
+    c->release();
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to write ops log object " << citer->first << ": r=" << r << dendl;
+    }
+  }
+}
+
+void OpsLogRados::stop()
+{
+  lock.Lock();
+  going_down = true;
+  flush_cond.Signal();
+  space_cond.SignalAll();
+  lock.Unlock();
+
+  join();
+}
+
+void OpsLogRados::log(const string& oid, bufferlist& bl)
+{
+  Mutex::Locker l(lock);
+
+  uint64_t backlog = cct->_conf->rgw_ops_log_data_backlog;
+  if (backlog && pending_bytes + in_flight_bytes >= backlog && !going_down) {
+    utime_t start = ceph_clock_now(cct);
+    while (pending_bytes + in_flight_bytes >= backlog && !going_down) {
+      flush_cond.Signal();
+      space_cond.Wait(lock);
+    }
+    if (perfcounter)
+      perfcounter->tinc(l_rgw_ops_log_wait_lat, ceph_clock_now(cct) - start);
+  }
+
+  bool was_empty = pending.empty();
+  pending_bytes += bl.length();
+  pending[oid].claim_append(bl);
+  if (perfcounter)
+    perfcounter->inc(l_rgw_ops_log_entries);
+  update_backlog();
+
+  if (was_empty || pending_bytes >= (uint64_t)cct->_conf->rgw_ops_log_flush_threshold)
+    flush_cond.Signal();
+}
+
+static OpsLogRados *ops_log_rados = NULL;
+
+void rgw_log_ops_init(CephContext *cct, RGWRados *store)
+{
+  if (!cct->_conf->rgw_enable_ops_log || !cct->_conf->rgw_ops_log_rados)
+    return;
+
+  ops_log_rados = new OpsLogRados(cct, store);
+  ops_log_rados->create();
+}
+
+void rgw_log_ops_finalize()
+{
+  if (!ops_log_rados)
+    return;
+  ops_log_rados->stop();
+  delete ops_log_rados;
+  ops_log_rados = NULL;
+}
+
 static void log_usage(struct req_state *s, const string& op_name)
 {
   if (s->system_request) /* don't log system user operations */
@@ -222,6 +413,14 @@ void rgw_format_ops_log_entry(struct rgw_log_entry& entry, Formatter *formatter)
   formatter->dump_int("total_time", total_time);
   formatter->dump_string("user_agent",  entry.user_agent);
   formatter->dump_string("referrer",  entry.referrer);
+  if (!entry.op_timings.empty()) {
+    formatter->open_object_section("op_timings");
+    map<string, utime_t>::iterator iter;
+    for (iter = entry.op_timings.begin(); iter != entry.op_timings.end(); ++iter) {
+      formatter->dump_stream(iter->first.c_str()) << iter->second;
+    }
+    formatter->close_section();
+  }
   formatter->close_section();
 }
 
@@ -331,6 +530,7 @@ int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsL
 
   entry.error_code = s->err.s3_code;
   entry.bucket_id = bucket_id;
+  entry.op_timings = s->op_timings;
 
   bufferlist bl;
   ::encode(entry, bl);
@@ -348,15 +548,26 @@ int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsL
     string oid = render_log_object_name(s->cct->_conf->rgw_log_object_name, &bdt,
 				        s->bucket.bucket_id, entry.bucket);
 
-    rgw_obj obj(store->zone.log_pool, oid);
+    int num_shards = s->cct->_conf->rgw_ops_log_num_shards;
+    if (num_shards > 1) {
+      char buf[16];
+      snprintf(buf, sizeof(buf), ".%u", ceph_str_hash_linux(s->req_id.c_str(), s->req_id.size()) % num_shards);
+      oid.append(buf);
+    }
+
+    if (ops_log_rados) {
+      ops_log_rados->log(oid, bl);
+    } else {
+      rgw_obj obj(store->zone.log_pool, oid);
 
-    ret = store->append_async(obj, bl.length(), bl);
-    if (ret == -ENOENT) {
-      ret = store->create_pool(store->zone.log_pool);
-      if (ret < 0)
-        goto done;
-      // retry
       ret = store->append_async(obj, bl.length(), bl);
+      if (ret == -ENOENT) {
+        ret = store->create_pool(store->zone.log_pool);
+        if (ret < 0)
+          goto done;
+        // retry
+        ret = store->append_async(obj, bl.length(), bl);
+      }
     }
   }
 
@@ -30,9 +30,10 @@ struct rgw_log_entry {
   string user_agent;
   string referrer;
   string bucket_id;
+  map<string, utime_t> op_timings;
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(6, 5, bl);
+    ENCODE_START(7, 5, bl);
     ::encode(object_owner, bl);
     ::encode(bucket_owner, bl);
     ::encode(bucket, bl);
@@ -51,10 +52,11 @@ struct rgw_log_entry {
     ::encode(referrer, bl);
     ::encode(bytes_received, bl);
     ::encode(bucket_id, bl);
+    ::encode(op_timings, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &p) {
-    DECODE_START_LEGACY_COMPAT_LEN(6, 5, 5, p);
+    DECODE_START_LEGACY_COMPAT_LEN(7, 5, 5, p);
     ::decode(object_owner, p);
     if (struct_v > 3)
       ::decode(bucket_owner, p);
@@ -89,6 +91,8 @@ struct rgw_log_entry {
       }
     } else
       bucket_id = "";
+    if (struct_v >= 7)
+      ::decode(op_timings, p);
     DECODE_FINISH(p);
   }
   void dump(Formatter *f) const;
@@ -141,6 +145,8 @@ int rgw_log_intent(RGWRados *store, rgw_obj& obj, RGWIntentEvent intent, const u
 int rgw_log_intent(RGWRados *store, struct req_state *s, rgw_obj& obj, RGWIntentEvent intent);
 void rgw_log_usage_init(CephContext *cct, RGWRados *store);
 void rgw_log_usage_finalize();
+void rgw_log_ops_init(CephContext *cct, RGWRados *store);
+void rgw_log_ops_finalize();
 void rgw_format_ops_log_entry(struct rgw_log_entry& entry, Formatter *formatter);
 
 #endif
@@ -10,6 +10,8 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include <curl/curl.h>
 
@@ -57,6 +59,7 @@
 #include "rgw_resolve.h"
 #include "rgw_loadgen.h"
 #include "rgw_civetweb.h"
+#include "rgw_epoll.h"
 
 #include "civetweb/civetweb.h"
 
@@ -202,6 +205,7 @@ protected:
       perfcounter->inc(l_rgw_qactive);
       process->handle_request(req);
       process->req_throttle.put(1);
+      process->worker_freed();
       perfcounter->inc(l_rgw_qactive, -1);
     }
     void _dump_queue() {
@@ -238,6 +242,8 @@ public:
   virtual ~RGWProcess() {}
   virtual void run() = 0;
   virtual void handle_request(RGWRequest *req) = 0;
+  /* called once a request is done and its req_throttle slot returned */
+  virtual void worker_freed() {}
 
   void close_fd() {
     if (sock_fd >= 0) {
@@ -676,6 +682,155 @@ void RGWLoadGenProcess::handle_request(RGWRequest *r)
   delete req;
 }
 
+struct RGWEpollRequest : public RGWRequest {
+  RGWEpollConn *conn;
+
+  RGWEpollRequest(RGWEpollConn *_conn) : conn(_conn) {}
+};
+
+/*
+ * Requests are read and responses written by a few event loop threads;
+ * only a request that has been fully read (or, for a large body, whose
+ * header has) takes up a worker thread, and only until rgw is done with
+ * it.  Only connection handling is event driven: ops still block their
+ * worker while they wait on RADOS, so the worker count still bounds the
+ * requests in progress, just not the connections open.
+ */
+class RGWEpollProcess : public RGWProcess, public RGWEpollDispatcher {
+  int port;
+  int num_loops;
+  int idle_timeout;
+  int max_buffered;
+  Mutex id_lock;
+  vector<RGWEpollLoop *> loops;
+
+public:
+  RGWEpollProcess(CephContext *cct, RGWProcessEnv *pe, int num_threads, RGWFrontendConfig *_conf) :
+    RGWProcess(cct, pe, num_threads, _conf), port(pe->port), num_loops(2), idle_timeout(60),
+    max_buffered(1024 * 1024), id_lock("RGWEpollProcess::id_lock") {}
+  ~RGWEpollProcess();
+
+  int init();
+  void run();
+  void stop();
+  void handle_request(RGWRequest *req);
+  void worker_freed();
+  bool dispatch(RGWEpollConn *conn);
+};
+
+RGWEpollProcess::~RGWEpollProcess()
+{
+  for (vector<RGWEpollLoop *>::iterator iter = loops.begin(); iter != loops.end(); ++iter) {
+    delete *iter;
+  }
+}
+
+int RGWEpollProcess::init()
+{
+  conf->get_val("num_loops", 2, &num_loops);
+  conf->get_val("idle_timeout", 60, &idle_timeout);
+  conf->get_val("max_buffered", 1024 * 1024, &max_buffered);
+  if (num_loops < 1 || idle_timeout < 1 || max_buffered < 0) {
+    derr << "ERROR: invalid epoll frontend configuration" << dendl;
+    return -EINVAL;
+  }
+
+  sock_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock_fd < 0) {
+    int err = errno;
+    derr << "ERROR: socket() failed: " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+  int one = 1;
+  setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (::bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      ::listen(sock_fd, SOCKET_BACKLOG) < 0) {
+    int err = errno;
+    derr << "ERROR: failed to listen on port " << port << ": " << cpp_strerror(err) << dendl;
+    close_fd();
+    return -err;
+  }
+
+  for (int i = 0; i < num_loops; i++) {
+    RGWEpollLoop *loop = new RGWEpollLoop(g_ceph_context, this, sock_fd, idle_timeout, max_buffered);
+    loops.push_back(loop);
+    int r = loop->init();
+    if (r < 0)
+      return r;
+  }
+
+  return 0;
+}
+
+void RGWEpollProcess::run()
+{
+  m_tp.start();
+
+  for (vector<RGWEpollLoop *>::iterator iter = loops.begin(); iter != loops.end(); ++iter) {
+    (*iter)->create();
+  }
+  for (vector<RGWEpollLoop *>::iterator iter = loops.begin(); iter != loops.end(); ++iter) {
+    (*iter)->join();
+  }
+
+  /* the loops are gone, in-flight requests close their connections when done */
+  m_tp.drain(&req_wq);
+  m_tp.stop();
+}
+
+void RGWEpollProcess::stop()
+{
+  for (vector<RGWEpollLoop *>::iterator iter = loops.begin(); iter != loops.end(); ++iter) {
+    (*iter)->stop();
+  }
+}
+
+void RGWEpollProcess::worker_freed()
+{
+  for (vector<RGWEpollLoop *>::iterator iter = loops.begin(); iter != loops.end(); ++iter) {
+    (*iter)->kick();
+  }
+}
+
+/* never block here, that would stall every other connection of the loop */
+bool RGWEpollProcess::dispatch(RGWEpollConn *conn)
+{
+  if (!req_throttle.get_or_fail(1))
+    return false;
+
+  RGWEpollRequest *req = new RGWEpollRequest(conn);
+  {
+    Mutex::Locker l(id_lock);
+    req->id = ++max_req_id;
+  }
+  dout(10) << "allocated request req=" << hex << req << dec << dendl;
+  req_wq.queue(req);
+  return true;
+}
+
+void RGWEpollProcess::handle_request(RGWRequest *r)
+{
+  RGWEpollRequest *req = static_cast<RGWEpollRequest *>(r);
+  RGWEpollConn *conn = req->conn;
+  RGWEpoll client_io(conn, port, max_buffered);
+
+  int ret = process_request(store, rest, req, &client_io, olog);
+  if (ret < 0) {
+    /* we don't really care about return code */
+    dout(20) << "process_request() returned " << ret << dendl;
+  }
+
+  conn->loop->requeue(conn);
+
+  delete req;
+}
+
 
 static int civetweb_callback(struct mg_connection *conn) {
   struct mg_request_info *req_info = mg_get_request_info(conn);
@@ -921,6 +1076,30 @@ public:
   }
 };
 
+class RGWEpollFrontend : public RGWProcessFrontend {
+  RGWEpollProcess *epoll_process;
+public:
+  RGWEpollFrontend(RGWProcessEnv& pe, RGWFrontendConfig *_conf) : RGWProcessFrontend(pe, _conf), epoll_process(NULL) {}
+
+  int init() {
+    int num_threads;
+    conf->get_val("num_threads", g_conf->rgw_thread_pool_size, &num_threads);
+    epoll_process = new RGWEpollProcess(g_ceph_context, &env, num_threads, conf);
+    pprocess = epoll_process;
+
+    return epoll_process->init();
+  }
+
+  void stop() {
+    epoll_process->stop();
+  }
+
+  void join() {
+    RGWProcessFrontend::join();
+    epoll_process->close_fd();
+  }
+};
+
 class RGWMongooseFrontend : public RGWFrontend {
   RGWFrontendConfig *conf;
   struct mg_context *ctx;
@@ -1042,6 +1221,7 @@ int main(int argc, const char **argv)
   rgw_user_init(store->meta_mgr);
   rgw_bucket_init(store->meta_mgr);
   rgw_log_usage_init(g_ceph_context, store);
+  rgw_log_ops_init(g_ceph_context, store);
 
   RGWREST rest;
 
@@ -1143,6 +1323,13 @@ int main(int argc, const char **argv)
       RGWProcessEnv env = { store, &rest, olog, port };
 
       fe = new RGWMongooseFrontend(env, config);
+    } else if (framework == "epoll") {
+      int port;
+      config->get_val("port", 80, &port);
+
+      RGWProcessEnv env = { store, &rest, olog, port };
+
+      fe = new RGWEpollFrontend(env, config);
     } else if (framework == "loadgen") {
       int port;
       config->get_val("port", 80, &port);
@@ -1196,6 +1383,7 @@ int main(int argc, const char **argv)
   }
 
   rgw_log_usage_finalize();
+  rgw_log_ops_finalize();
 
   delete olog;
 
@@ -614,6 +614,18 @@ bool RGWOp::generate_cors_headers(string& origin, string& method, string& header
   return true;
 }
 
+class RGWGetObj_CB : public RGWGetDataCB
+{
+  RGWGetObj *op;
+public:
+  RGWGetObj_CB(RGWGetObj *_op) : op(_op) {}
+  virtual ~RGWGetObj_CB() {}
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) {
+    return op->get_data_cb(bl, bl_ofs, bl_len);
+  }
+};
+
 int RGWGetObj::read_user_manifest_part(rgw_bucket& bucket, RGWObjEnt& ent, RGWAccessControlPolicy *bucket_policy, off_t start_ofs, off_t end_ofs)
 {
   ldout(s->cct, 0) << "user manifest obj=" << ent.name << dendl;
@@ -657,21 +669,16 @@ int RGWGetObj::read_user_manifest_part(rgw_bucket& bucket, RGWObjEnt& ent, RGWAc
   }
 
   perfcounter->inc(l_rgw_get_b, cur_end - cur_ofs);
-  while (cur_ofs <= cur_end) {
-    bufferlist bl;
-    ret = store->get_obj(obj_ctx, NULL, &handle, part, bl, cur_ofs, cur_end, NULL);
+  if (cur_ofs <= cur_end) {
+    /* iterate rather than get_obj(), so that compressed parts are decompressed */
+    RGWGetObj_CB cb(this);
+    ret = store->get_obj_iterate(obj_ctx, &handle, part, cur_ofs, cur_end, &cb);
     if (ret < 0)
       goto done_err;
 
-    off_t len = bl.length();
-    cur_ofs += len;
-    ofs += len;
-    ret = 0;
+    ofs += cur_end - cur_ofs + 1;
     perfcounter->tinc(l_rgw_get_lat,
                       (ceph_clock_now(s->cct) - start_time));
-    send_response_data(bl, 0, len);
-
-    start_time = ceph_clock_now(s->cct);
   }
 
   store->destroy_context(obj_ctx);
@@ -814,18 +821,6 @@ int RGWGetObj::handle_user_manifest(const char *prefix)
   return 0;
 }
 
-class RGWGetObj_CB : public RGWGetDataCB
-{
-  RGWGetObj *op;
-public:
-  RGWGetObj_CB(RGWGetObj *_op) : op(_op) {}
-  virtual ~RGWGetObj_CB() {}
-
-  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) {
-    return op->get_data_cb(bl, bl_ofs, bl_len);
-  }
-};
-
 int RGWGetObj::get_data_cb(bufferlist& bl, off_t bl_ofs, off_t bl_len)
 {
   /* garbage collection related handling */
@@ -1503,7 +1498,12 @@ RGWPutObjProcessor *RGWPutObj::select_processor(bool *is_multipart)
   const string& bucket_owner = s->bucket_owner.get_id();
 
   if (!multipart) {
-    processor = new RGWPutObjProcessor_Atomic(bucket_owner, s->bucket, s->object_str, part_size, s->req_id);
+    RGWPutObjProcessor_Atomic *atomic = new RGWPutObjProcessor_Atomic(bucket_owner, s->bucket, s->object_str, part_size, s->req_id);
+    const string& compression_type = store->get_compression_type(s->bucket_info.placement_rule);
+    if (!compression_type.empty()) {
+      atomic->set_compression(compression_type, s->cct->_conf->rgw_compression_block_size);
+    }
+    processor = atomic;
   } else {
     processor = new RGWPutObjProcessor_Multipart(bucket_owner, part_size, s);
   }
@@ -1567,9 +1567,12 @@ int RGWPutObj::user_manifest_iterate_cb(rgw_bucket& bucket, RGWObjEnt& ent, RGWA
 static int put_data_and_throttle(RGWPutObjProcessor *processor, bufferlist& data, off_t ofs,
                                  MD5 *hash, bool need_to_wait)
 {
-  const unsigned char *data_ptr = (hash ? (const unsigned char *)data.c_str() : NULL);
   bool again;
-  uint64_t len = data.length();
+
+  if (hash) {
+    /* before handing the data over, the processor may compress it away */
+    hash->Update((const unsigned char *)data.c_str(), data.length());
+  }
 
   do {
     void *handle;
@@ -1578,11 +1581,6 @@ static int put_data_and_throttle(RGWPutObjProcessor *processor, bufferlist& data
     if (ret < 0)
       return ret;
 
-    if (hash) {
-      hash->Update(data_ptr, len);
-      hash = NULL; /* only calculate hash once */
-    }
-
     ret = processor->throttle_data(handle, need_to_wait);
     if (ret < 0)
       return ret;
@@ -1806,7 +1804,12 @@ RGWPutObjProcessor *RGWPostObj::select_processor()
 
   uint64_t part_size = s->cct->_conf->rgw_obj_stripe_size;
 
-  processor = new RGWPutObjProcessor_Atomic(s->bucket_owner.get_id(), s->bucket, s->object_str, part_size, s->req_id);
+  RGWPutObjProcessor_Atomic *atomic = new RGWPutObjProcessor_Atomic(s->bucket_owner.get_id(), s->bucket, s->object_str, part_size, s->req_id);
+  const string& compression_type = store->get_compression_type(s->bucket_info.placement_rule);
+  if (!compression_type.empty()) {
+    atomic->set_compression(compression_type, s->cct->_conf->rgw_compression_block_size);
+  }
+  processor = atomic;
 
   return processor;
 }
@@ -2197,6 +2200,7 @@ void RGWCopyObj::execute()
 
   store->set_atomic(s->obj_ctx, dst_obj);
 
+  utime_t start_time = ceph_clock_now(s->cct);
   ret = store->copy_obj(s->obj_ctx,
                         s->user.user_id,
                         client_id,
@@ -2218,6 +2222,7 @@ void RGWCopyObj::execute()
                         &s->err,
                         copy_obj_progress_cb, (void *)this
                         );
+  s->op_timings["copy_obj"] = ceph_clock_now(s->cct) - start_time;
 }
 
 int RGWGetACLs::verify_permission()
@@ -2681,6 +2686,67 @@ static int list_multipart_parts(RGWRados *store, struct req_state *s,
   return 0;
 }
 
+/*
+ * Read the info of parts 1..num_parts of a v2 upload, along with the part
+ * after those if there is one.  As the omap keys of such an upload sort by
+ * part number, where each batch of max_parts starts is known up front and
+ * all of them are read concurrently.  *complete is left false if the parts
+ * aren't numbered contiguously after all; the caller then has to go through
+ * list_multipart_parts() instead.
+ */
+static int read_multipart_parts_concurrent(RGWRados *store, struct req_state *s,
+                                           string& meta_oid, int num_parts, int max_parts,
+                                           map<uint32_t, RGWUploadPartInfo>& parts, bool *complete)
+{
+  rgw_obj obj;
+  obj.init_ns(s->bucket, meta_oid, mp_ns);
+  obj.set_in_extra_data(true);
+
+  *complete = false;
+  parts.clear();
+
+  vector<string> markers;
+  for (int marker = 0; marker < num_parts || markers.empty(); marker += max_parts) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "part.%08d", marker);
+    markers.push_back(buf);
+  }
+
+  vector<map<string, bufferlist> > results;
+  int ret = store->omap_get_vals_concurrent(obj, markers, max_parts + 1, results,
+                                            s->cct->_conf->rgw_multipart_complete_max_aio);
+  if (ret < 0)
+    return ret;
+
+  uint32_t expected_next = 1;
+  for (size_t i = 0; i < results.size(); i++) {
+    bool last = (i == results.size() - 1);
+    map<string, bufferlist>::iterator iter;
+    int n;
+    for (n = 0, iter = results[i].begin(); iter != results[i].end() && (last || n < max_parts); ++iter, ++n) {
+      bufferlist::iterator bli = iter->second.begin();
+      RGWUploadPartInfo info;
+      try {
+        ::decode(info, bli);
+      } catch (buffer::error& err) {
+        ldout(s->cct, 0) << "ERROR: could not part info, caught buffer::error" << dendl;
+        return -EIO;
+      }
+      if (info.num != expected_next) {
+        ldout(s->cct, 10) << "part " << info.num << " found where " << expected_next
+                          << " was expected, listing parts instead" << dendl;
+        parts.clear();
+        return 0;
+      }
+      expected_next++;
+      parts[info.num] = info;
+    }
+  }
+
+  *complete = true;
+  return 0;
+}
+
 int RGWCompleteMultipart::verify_permission()
 {
   if (!verify_bucket_permission(s, RGW_PERM_WRITE))
@@ -2762,13 +2828,29 @@ void RGWCompleteMultipart::execute()
     return;
   }
 
-  do {
-    ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts, marker, obj_parts, &marker, &truncated);
+  utime_t start_time = ceph_clock_now(s->cct);
+
+  bool prefetched = false;
+  if (is_v2_upload_id(upload_id)) {
+    ret = read_multipart_parts_concurrent(store, s, meta_oid, parts->parts.size(), max_parts, obj_parts, &prefetched);
     if (ret == -ENOENT) {
       ret = -ERR_NO_SUCH_UPLOAD;
     }
     if (ret < 0)
       return;
+  }
+
+  do {
+    if (prefetched) {
+      truncated = false;
+    } else {
+      ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts, marker, obj_parts, &marker, &truncated);
+      if (ret == -ENOENT) {
+        ret = -ERR_NO_SUCH_UPLOAD;
+      }
+      if (ret < 0)
+        return;
+    }
 
     total_parts += obj_parts.size();
     if (!truncated && total_parts != (int)parts->parts.size()) {
@@ -2822,6 +2904,8 @@ void RGWCompleteMultipart::execute()
   } while (truncated);
   hash.Final((byte *)final_etag);
 
+  utime_t parts_time = ceph_clock_now(s->cct) - start_time;
+
   buf_to_hex((unsigned char *)final_etag, sizeof(final_etag), final_etag_str);
   snprintf(&final_etag_str[CEPH_CRYPTO_MD5_DIGESTSIZE * 2],  sizeof(final_etag_str) - CEPH_CRYPTO_MD5_DIGESTSIZE * 2,
            "-%lld", (long long)parts->parts.size());
@@ -2850,6 +2934,13 @@ void RGWCompleteMultipart::execute()
   if (ret < 0)
     return;
 
+  utime_t total_time = ceph_clock_now(s->cct) - start_time;
+  s->op_timings["read_parts"] = parts_time;
+  s->op_timings["complete_multipart"] = total_time;
+  ldout(s->cct, 2) << "completed multipart upload of " << total_parts << " parts, " << ofs << " bytes: "
+                   << "read parts and built manifest in " << parts_time << " s, total "
+                   << total_time << " s" << dendl;
+
   // remove the upload obj
   store->delete_obj(s->obj_ctx, s->bucket_owner.get_id(), meta_obj);
 }
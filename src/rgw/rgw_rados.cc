@@ -11,6 +11,7 @@
 #include "common/errno.h"
 #include "common/Formatter.h"
 #include "common/Throttle.h"
+#include "common/Cond.h"
 
 #include "rgw_rados.h"
 #include "rgw_cache.h"
@@ -31,6 +32,7 @@
 #include "rgw_tools.h"
 
 #include "common/Clock.h"
+#include "include/ceph_hash.h"
 
 #include "include/rados/librados.hpp"
 using namespace librados;
@@ -45,6 +47,7 @@ using namespace librados;
 #include "rgw_log.h"
 
 #include "rgw_gc.h"
+#include "rgw_compression.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -720,6 +723,11 @@ RGWObjManifest::obj_iterator RGWObjManifest::obj_find(uint64_t ofs)
 
 int RGWObjManifest::append(RGWObjManifest& m)
 {
+  if (compression.is_compressed() || m.compression.is_compressed()) {
+    /* block offsets are relative to the start of the compressed data */
+    return -EINVAL;
+  }
+
   if (explicit_objs || m.explicit_objs) {
     return append_explicit(m);
   }
@@ -1033,6 +1041,48 @@ int RGWPutObjProcessor_Atomic::write_data(bufferlist& bl, off_t ofs, void **phan
   return RGWPutObjProcessor_Aio::handle_obj_data(cur_obj, bl, ofs - cur_part_ofs, ofs, phandle, exclusive);
 }
 
+void RGWPutObjProcessor_Atomic::set_compression(const string& type, uint64_t block_size)
+{
+  compression = RGWCompressionInfo();
+  compression.compression_type = type;
+  compression.block_size = block_size;
+  compress_data = true;
+}
+
+void RGWPutObjProcessor_Atomic::set_compressed_data(const RGWCompressionInfo& info)
+{
+  compression = info;
+  compress_data = false;
+}
+
+/*
+ * Replace bl by the compressed form of whatever whole blocks there are
+ * now; with flush, the remainder is compressed as the (short) last block.
+ */
+int RGWPutObjProcessor_Atomic::compress(bufferlist& bl, bool flush)
+{
+  compression.orig_size += bl.length();
+  compress_pending.claim_append(bl);
+
+  while (compress_pending.length() >= compression.block_size ||
+         (flush && compress_pending.length() > 0)) {
+    bufferlist in;
+    uint64_t len = MIN((uint64_t)compress_pending.length(), compression.block_size);
+    compress_pending.splice(0, len, &in);
+
+    compression.blocks.push_back(compression.compressed_size);
+    uint64_t start = bl.length();
+    int r = rgw_compress(compression.compression_type, in, bl);
+    if (r < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to compress data with " << compression.compression_type
+                             << ": r=" << r << dendl;
+      return r;
+    }
+    compression.compressed_size += bl.length() - start;
+  }
+  return 0;
+}
+
 int RGWPutObjProcessor_Atomic::handle_data(bufferlist& bl, off_t ofs, void **phandle, bool *again)
 {
   *again = false;
@@ -1053,6 +1103,22 @@ int RGWPutObjProcessor_Atomic::handle_data(bufferlist& bl, off_t ofs, void **pha
     }
   }
 
+  if (compress_data && bl.length()) {
+    int r = compress(bl, false);
+    if (r < 0)
+      return r;
+  }
+
+  return queue_data(bl, phandle, again);
+}
+
+/* bl is the data as it is stored; writes out a chunk once there is enough of it */
+int RGWPutObjProcessor_Atomic::queue_data(bufferlist& bl, void **phandle, bool *again)
+{
+  *again = false;
+
+  *phandle = NULL;
+
   uint64_t max_write_size = MIN(max_chunk_size, (uint64_t)next_part_ofs - data_ofs);
 
   pending_data_bl.claim_append(bl);
@@ -1138,6 +1204,24 @@ int RGWPutObjProcessor_Atomic::complete_parts()
 
 int RGWPutObjProcessor_Atomic::complete_writing_data()
 {
+  if (compress_data && compress_pending.length()) {
+    bufferlist bl;
+    int r = compress(bl, true);
+    if (r < 0)
+      return r;
+
+    bool again;
+    do {
+      void *handle;
+      r = queue_data(bl, &handle, &again);
+      if (r < 0)
+        return r;
+      r = throttle_data(handle, false);
+      if (r < 0)
+        return r;
+    } while (again);
+  }
+
   if (!data_ofs && !immutable_head()) {
     first_chunk.claim(pending_data_bl);
     obj_len = (uint64_t)first_chunk.length();
@@ -1183,7 +1267,13 @@ int RGWPutObjProcessor_Atomic::do_complete(string& etag, time_t *mtime, time_t s
   extra_params.set_mtime = set_mtime;
   extra_params.owner = bucket_owner;
 
-  r = store->put_obj_meta(obj_ctx, head_obj, obj_len, attrs,
+  uint64_t size = obj_len;
+  if (compression.is_compressed() && compression.orig_size > 0) {
+    manifest.set_compression(compression);
+    size = compression.orig_size;
+  }
+
+  r = store->put_obj_meta(obj_ctx, head_obj, size, attrs,
                           RGW_OBJ_CATEGORY_MAIN, PUT_OBJ_CREATE,
                           extra_params);
   return r;
@@ -1264,6 +1354,236 @@ int RGWRados::get_max_chunk_size(rgw_bucket& bucket, uint64_t *max_chunk_size)
   return 0;
 }
 
+const string& RGWRados::get_compression_type(const string& placement_rule)
+{
+  static string none;
+
+  /* buckets without a placement rule predate placement targets */
+  if (placement_rule.empty())
+    return none;
+
+  map<string, RGWZonePlacementInfo>::iterator iter = zone.placement_pools.find(placement_rule);
+  if (iter == zone.placement_pools.end())
+    return none;
+
+  const string& type = iter->second.compression;
+  if (!type.empty() && !rgw_compression_supported(type)) {
+    ldout(cct, 0) << "WARNING: unknown compression type " << type << " for placement rule "
+                  << placement_rule << ", not compressing" << dendl;
+    return none;
+  }
+  return type;
+}
+
+/*
+ * Group commit of bucket index completions.
+ *
+ * Completions are sent without waiting for them anyway (a lost one is
+ * fixed up through dir_suggest_changes the next time the entry is listed),
+ * but each one is a separate op on the index object, and on a busy bucket
+ * those ops, all hitting the same object, are what limits the PUT rate.
+ * While an op on an index object is in flight, further completions for it
+ * are queued and then sent together in a single bucket_complete_ops call
+ * once it returns.  An idle index object is never waited on, so this adds
+ * no latency.
+ */
+class RGWIndexCompletionBatcher {
+  CephContext *cct;
+
+  struct Batch {
+    librados::IoCtx ioctx;
+    string oid;
+    bool in_flight;
+    list<rgw_cls_obj_complete_op> pending;
+    set<string> names; /* entries touched by pending ops */
+
+    Batch() : in_flight(false) {}
+  };
+
+  struct Request {
+    RGWIndexCompletionBatcher *batcher;
+    librados::IoCtx ioctx;
+    string key;
+    string oid;
+    list<rgw_cls_obj_complete_op> ops;
+    librados::AioCompletion *c;
+  };
+
+  Mutex lock;
+  Cond cond;
+  map<string, Batch> batches; /* keyed by pool id and oid */
+  int num_in_flight;
+  bool batch_supported;
+
+  static void complete_cb(librados::completion_t cb, void *arg);
+  void handle_completion(Request *req, int r);
+
+  bool conflicts(Batch& b, rgw_cls_obj_complete_op& op);
+  int send(Request *req);
+  int send_single(librados::IoCtx& ioctx, const string& oid, rgw_cls_obj_complete_op& op);
+
+public:
+  RGWIndexCompletionBatcher(CephContext *_cct) : cct(_cct), lock("RGWIndexCompletionBatcher"),
+                                                 num_in_flight(0), batch_supported(true) {}
+
+  int complete(librados::IoCtx& ioctx, const string& oid, rgw_cls_obj_complete_op& op);
+  void drain();
+};
+
+bool RGWIndexCompletionBatcher::conflicts(Batch& b, rgw_cls_obj_complete_op& op)
+{
+  if (b.names.count(op.name))
+    return true;
+  for (list<string>::iterator iter = op.remove_objs.begin(); iter != op.remove_objs.end(); ++iter) {
+    if (b.names.count(*iter))
+      return true;
+  }
+  return false;
+}
+
+int RGWIndexCompletionBatcher::send_single(librados::IoCtx& ioctx, const string& oid,
+                                           rgw_cls_obj_complete_op& op)
+{
+  ObjectWriteOperation o;
+  cls_rgw_bucket_complete_op(o, op);
+
+  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  int r = ioctx.aio_operate(oid, c, &o);
+  c->release();
+  return r;
+}
+
+/* call without the lock held */
+int RGWIndexCompletionBatcher::send(Request *req)
+{
+  ObjectWriteOperation o;
+  if (req->ops.size() == 1)
+    cls_rgw_bucket_complete_op(o, req->ops.front());
+  else
+    cls_rgw_bucket_complete_ops(o, req->ops);
+
+  ldout(cct, 20) << "sending " << req->ops.size() << " completions to " << req->oid << dendl;
+
+  req->c = librados::Rados::aio_create_completion((void *)req, complete_cb, NULL);
+  int r = req->ioctx.aio_operate(req->oid, req->c, &o);
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: failed to send bucket index completions to " << req->oid
+                  << ": r=" << r << dendl;
+    /* nothing is coming back for it, so finish it here */
+    handle_completion(req, r);
+  }
+  return r;
+}
+
+void RGWIndexCompletionBatcher::complete_cb(librados::completion_t cb, void *arg)
+{
+  Request *req = (Request *)arg;
+  req->batcher->handle_completion(req, rados_aio_get_return_value(cb));
+}
+
+void RGWIndexCompletionBatcher::handle_completion(Request *req, int r)
+{
+  if (req->c) {
+    req->c->release();
+    req->c = NULL;
+  }
+
+  if (r < 0 && req->ops.size() > 1) {
+    /*
+     * nothing of a failed batch was applied, resend its ops one at a
+     * time so that only the failing one is lost
+     */
+    if (r == -EOPNOTSUPP) {
+      /* the osd doesn't have bucket_complete_ops yet */
+      ldout(cct, 0) << "WARNING: bucket_complete_ops not supported by osd, not batching index completions" << dendl;
+      Mutex::Locker l(lock);
+      batch_supported = false;
+    } else {
+      ldout(cct, 0) << "WARNING: " << req->ops.size() << " bucket index completions to " << req->oid
+                    << " returned r=" << r << ", resending them one at a time" << dendl;
+    }
+    for (list<rgw_cls_obj_complete_op>::iterator iter = req->ops.begin(); iter != req->ops.end(); ++iter) {
+      send_single(req->ioctx, req->oid, *iter);
+    }
+  } else if (r < 0) {
+    ldout(cct, 0) << "WARNING: " << req->ops.size() << " bucket index completions to " << req->oid
+                  << " returned r=" << r << dendl;
+  }
+
+  lock.Lock();
+  map<string, Batch>::iterator iter = batches.find(req->key);
+  assert(iter != batches.end());
+  Batch& b = iter->second;
+  if (b.pending.empty()) {
+    batches.erase(iter);
+    --num_in_flight;
+    cond.Signal();
+    lock.Unlock();
+    delete req;
+    return;
+  }
+
+  /* send what was queued up meanwhile, the batch stays in flight */
+  req->ops.swap(b.pending);
+  b.pending.clear();
+  b.names.clear();
+  lock.Unlock();
+
+  send(req);
+}
+
+int RGWIndexCompletionBatcher::complete(librados::IoCtx& ioctx, const string& oid,
+                                        rgw_cls_obj_complete_op& op)
+{
+  uint32_t max_batch = cct->_conf->rgw_bucket_index_max_complete_batch;
+
+  lock.Lock();
+  if (max_batch <= 1 || !batch_supported) {
+    lock.Unlock();
+    return send_single(ioctx, oid, op);
+  }
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%lld:", (long long)ioctx.get_id());
+  string key = buf + oid;
+
+  Batch& b = batches[key];
+  if (b.in_flight) {
+    if (b.pending.size() >= max_batch || conflicts(b, op)) {
+      /* the cls call can't see its own writes, send this one by itself */
+      lock.Unlock();
+      return send_single(ioctx, oid, op);
+    }
+    b.pending.push_back(op);
+    b.names.insert(op.name);
+    b.names.insert(op.remove_objs.begin(), op.remove_objs.end());
+    lock.Unlock();
+    return 0;
+  }
+
+  b.in_flight = true;
+  ++num_in_flight;
+  lock.Unlock();
+
+  Request *req = new Request;
+  req->batcher = this;
+  req->ioctx = ioctx;
+  req->key = key;
+  req->oid = oid;
+  req->ops.push_back(op);
+  req->c = NULL;
+  return send(req);
+}
+
+void RGWIndexCompletionBatcher::drain()
+{
+  Mutex::Locker l(lock);
+  while (num_in_flight > 0) {
+    ldout(cct, 10) << "waiting for " << num_in_flight << " bucket index completion batches" << dendl;
+    cond.Wait(lock);
+  }
+}
+
 void RGWRados::finalize()
 {
   if (need_watch_notify()) {
@@ -1271,6 +1591,11 @@ void RGWRados::finalize()
   }
   delete meta_mgr;
   delete data_log;
+  if (index_completion_batcher) {
+    index_completion_batcher->drain();
+    delete index_completion_batcher;
+    index_completion_batcher = NULL;
+  }
   if (use_gc_thread) {
     gc->stop_processor();
     delete gc;
@@ -1313,6 +1638,7 @@ int RGWRados::init_rados()
 
   meta_mgr = new RGWMetadataManager(cct, this);
   data_log = new RGWDataChangesLog(cct, this);
+  index_completion_batcher = new RGWIndexCompletionBatcher(cct);
 
   return ret;
 }
@@ -2201,6 +2527,16 @@ int RGWRados::list_objects(rgw_bucket& bucket, int max, string& prefix, string&
     bigger_than_delim = buf;
   }
 
+  /*
+   * let the index objclass collapse common prefixes, so that we don't
+   * read every entry under them.  Not when a filter has to see each
+   * entry, or when the delimiter could match the '_' that raw names of
+   * namespaced and escaped objects start with.
+   */
+  string cls_delim;
+  if (!delim.empty() && !filter && delim.find('_') == string::npos)
+    cls_delim = delim;
+
   string skip_after_delim;
 
   /* if marker points at a common prefix, fast forward it into its upperbound string */
@@ -2219,7 +2555,7 @@ int RGWRados::list_objects(rgw_bucket& bucket, int max, string& prefix, string&
     }
     std::map<string, RGWObjEnt> ent_map;
     int r = cls_bucket_list(bucket, cur_marker, cur_prefix, max + 1 - count, ent_map,
-                            &truncated, &cur_marker);
+                            &truncated, &cur_marker, NULL, cls_delim);
     if (r < 0)
       return r;
 
@@ -2326,7 +2662,7 @@ int RGWRados::create_pool(rgw_bucket& bucket)
   return 0;
 }
 
-int RGWRados::init_bucket_index(rgw_bucket& bucket)
+int RGWRados::init_bucket_index(rgw_bucket& bucket, uint32_t num_shards)
 {
   librados::IoCtx index_ctx; // context for new bucket
 
@@ -2337,13 +2673,10 @@ int RGWRados::init_bucket_index(rgw_bucket& bucket)
   string dir_oid =  dir_oid_prefix;
   dir_oid.append(bucket.marker);
 
-  librados::ObjectWriteOperation op;
-  op.create(true);
-  r = cls_rgw_init_index(index_ctx, op, dir_oid);
-  if (r < 0 && r != -EEXIST)
-    return r;
+  map<int, string> bucket_objs;
+  get_bucket_index_objects(dir_oid, num_shards, bucket_objs);
 
-  return 0;
+  return cls_rgw_bucket_index_init_op(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio);
 }
 
 /**
@@ -2394,7 +2727,8 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
     string dir_oid =  dir_oid_prefix;
     dir_oid.append(bucket.marker);
 
-    r = init_bucket_index(bucket);
+    uint32_t num_shards = cct->_conf->rgw_override_bucket_index_max_shards;
+    r = init_bucket_index(bucket, num_shards);
     if (r < 0)
       return r;
 
@@ -2410,6 +2744,7 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
     info.owner = owner.user_id;
     info.region = region_name;
     info.placement_rule = selected_placement_rule;
+    info.num_shards = num_shards;
     if (!creation_time)
       time(&info.creation_time);
     else
@@ -2442,7 +2777,12 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
         if (r < 0)
           return r;
 
-        index_ctx.remove(dir_oid);
+        map<int, string> bucket_objs;
+        get_bucket_index_objects(dir_oid, num_shards, bucket_objs);
+        map<int, string>::iterator iter;
+        for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+          index_ctx.remove(iter->second);
+        }
       }
       /* ret == -ENOENT here */
     }
@@ -2927,7 +3267,7 @@ int RGWRados::put_obj_meta_impl(void *ctx, rgw_obj& obj,  uint64_t size,
 
   if (state) {
     /* update quota cache */
-    quota_handler->update_stats(bucket_owner, bucket, (state->exists ? 0 : 1), size, state->size);
+    quota_handler->update_stats(bucket_owner, bucket, (state->exists ? 0 : 1), size, state->accounted_size());
   }
 
   return 0;
@@ -3223,6 +3563,11 @@ int RGWRados::copy_obj(void *ctx,
     if (ret < 0)
       return ret;
 
+    const string& compression_type = get_compression_type(dest_bucket_info.placement_rule);
+    if (!compression_type.empty()) {
+      processor.set_compression(compression_type, cct->_conf->rgw_compression_block_size);
+    }
+
     RGWRESTConn *conn;
     if (source_zone.empty()) {
       if (dest_bucket_info.region.empty()) {
@@ -3320,11 +3665,11 @@ set_err_state:
 
     RGWRESTStreamWriteRequest *out_stream_req;
 
-    int ret = rest_master_conn->put_obj_init(user_id, dest_obj, astate->size, src_attrs, &out_stream_req);
+    int ret = rest_master_conn->put_obj_init(user_id, dest_obj, astate->accounted_size(), src_attrs, &out_stream_req);
     if (ret < 0)
       return ret;
 
-    ret = get_obj_iterate(ctx, &handle, src_obj, 0, astate->size - 1, out_stream_req->get_out_cb());
+    ret = get_obj_iterate(ctx, &handle, src_obj, 0, astate->accounted_size() - 1, out_stream_req->get_out_cb());
     if (ret < 0)
       return ret;
 
@@ -3466,6 +3811,37 @@ done_ret:
 }
 
 
+/* hands the data read by get_obj_iterate() on to a put processor */
+class RGWCopyObjData_CB : public RGWGetDataCB
+{
+  RGWPutObjProcessor *processor;
+  off_t ofs;
+public:
+  RGWCopyObjData_CB(RGWPutObjProcessor *_processor) : processor(_processor), ofs(0) {}
+  virtual ~RGWCopyObjData_CB() {}
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) {
+    bufferlist data;
+    data.substr_of(bl, bl_ofs, bl_len);
+
+    bool again;
+    do {
+      void *handle;
+
+      int ret = processor->handle_data(data, ofs, &handle, &again);
+      if (ret < 0)
+        return ret;
+
+      ret = processor->throttle_data(handle, false);
+      if (ret < 0)
+        return ret;
+    } while (again);
+
+    ofs += bl_len;
+    return 0;
+  }
+};
+
 int RGWRados::copy_obj_data(void *ctx,
                const string& owner,
 	       void **handle, off_t end,
@@ -3492,31 +3868,26 @@ int RGWRados::copy_obj_data(void *ctx,
   if (ret < 0)
     return ret;
 
-  off_t ofs = 0;
-
-  do {
-    bufferlist bl;
-    ret = get_obj(ctx, NULL, handle, src_obj, bl, ofs, end, NULL);
-    if (ret < 0)
-      return ret;
-
-    uint64_t read_len = ret;
-    bool again;
+  RGWObjState *astate = NULL;
+  ret = get_obj_state(static_cast<RGWRadosCtx *>(ctx), src_obj, &astate, NULL);
+  if (ret < 0)
+    return ret;
 
-    do {
-      void *handle;
+  if (astate->has_manifest && astate->manifest.is_compressed()) {
+    /* copy the data as it is stored, along with its layout */
+    processor.set_compressed_data(astate->manifest.get_compression());
+    end = astate->size - 1;
+  }
 
-      ret = processor.handle_data(bl, ofs, &handle, &again);
-      if (ret < 0) {
-        return ret;
-      }
-      ret = processor.throttle_data(handle, false);
-      if (ret < 0)
-        return ret;
-    } while (again);
+  utime_t start_time = ceph_clock_now(cct);
 
-    ofs += read_len;
-  } while (ofs <= end);
+  if (end >= 0) {
+    /* reads are windowed aio, and the processor keeps its writes in flight too */
+    RGWCopyObjData_CB cb(&processor);
+    ret = get_obj_iterate_stored(ctx, handle, src_obj, 0, end, &cb);
+    if (ret < 0)
+      return ret;
+  }
 
   string etag;
   map<string, bufferlist>::iterator iter = attrs.find(RGW_ATTR_ETAG);
@@ -3526,8 +3897,14 @@ int RGWRados::copy_obj_data(void *ctx,
   }
 
   ret = processor.complete(etag, mtime, set_mtime, attrs);
+  if (ret < 0)
+    return ret;
 
-  return ret;
+  utime_t elapsed = ceph_clock_now(cct) - start_time;
+  ldout(cct, 2) << "copied " << end + 1 << " bytes of " << src_obj << " to " << dest_obj << " in "
+                << elapsed << " s" << dendl;
+
+  return 0;
 }
 
 /**
@@ -3538,8 +3915,8 @@ int RGWRados::copy_obj_data(void *ctx,
 int RGWRados::delete_bucket(rgw_bucket& bucket, RGWObjVersionTracker& objv_tracker)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
@@ -3667,7 +4044,56 @@ int RGWRados::complete_atomic_overwrite(RGWRadosCtx *rctx, RGWObjState *state, r
   return ret;
 }
 
-int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx, string& bucket_oid)
+/*
+ * A bucket index is either a single .dir.<marker> object (shard id -1),
+ * or num_shards objects .dir.<marker>.<shard id>, with each entry kept
+ * in the shard picked by hashing its name.
+ */
+void RGWRados::get_bucket_index_objects(const string& bucket_oid_base, uint32_t num_shards,
+                                        map<int, string>& bucket_objs)
+{
+  if (!num_shards) {
+    bucket_objs[-1] = bucket_oid_base;
+    return;
+  }
+
+  char buf[bucket_oid_base.size() + 32];
+  for (uint32_t i = 0; i < num_shards; ++i) {
+    snprintf(buf, sizeof(buf), "%s.%d", bucket_oid_base.c_str(), i);
+    bucket_objs[i] = buf;
+  }
+}
+
+int RGWRados::get_bucket_index_shard_id(const string& obj_key, uint32_t num_shards)
+{
+  if (!num_shards)
+    return -1;
+
+  return ceph_str_hash_linux(obj_key.c_str(), obj_key.size()) % num_shards;
+}
+
+int RGWRados::get_bucket_index_num_shards(rgw_bucket& bucket, uint32_t *num_shards)
+{
+  RGWBucketInfo info;
+  string oid;
+  get_bucket_meta_oid(bucket, oid);
+  int r = get_bucket_instance_from_oid(NULL, oid, info, NULL, NULL);
+  if (r == -ENOENT) {
+    /* buckets that predate bucket instances have a single index object */
+    *num_shards = 0;
+    return 0;
+  }
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: could not read bucket info for " << bucket << ": r=" << r << dendl;
+    return r;
+  }
+
+  *num_shards = info.num_shards;
+  return 0;
+}
+
+int RGWRados::open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx& index_ctx,
+                                     string& bucket_oid_base, uint32_t *num_shards)
 {
   if (bucket_is_system(bucket))
     return -EINVAL;
@@ -3681,12 +4107,110 @@ int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
     return -EIO;
   }
 
-  bucket_oid = dir_oid_prefix;
-  bucket_oid.append(bucket.marker);
+  bucket_oid_base = dir_oid_prefix;
+  bucket_oid_base.append(bucket.marker);
+
+  return get_bucket_index_num_shards(bucket, num_shards);
+}
+
+int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
+                                map<int, string>& bucket_objs)
+{
+  string bucket_oid_base;
+  uint32_t num_shards;
+  int r = open_bucket_index_base(bucket, index_ctx, bucket_oid_base, &num_shards);
+  if (r < 0)
+    return r;
 
+  get_bucket_index_objects(bucket_oid_base, num_shards, bucket_objs);
   return 0;
 }
 
+int RGWRados::open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx& index_ctx,
+                                      const string& obj_key, string *bucket_obj)
+{
+  string bucket_oid_base;
+  uint32_t num_shards;
+  int r = open_bucket_index_base(bucket, index_ctx, bucket_oid_base, &num_shards);
+  if (r < 0)
+    return r;
+
+  int shard_id = get_bucket_index_shard_id(obj_key, num_shards);
+  if (shard_id < 0) {
+    *bucket_obj = bucket_oid_base;
+  } else {
+    char buf[bucket_oid_base.size() + 32];
+    snprintf(buf, sizeof(buf), "%s.%d", bucket_oid_base.c_str(), shard_id);
+    *bucket_obj = buf;
+  }
+  return 0;
+}
+
+/*
+ * bucket index log markers of a sharded bucket carry a marker per
+ * shard: "<shard id>#<marker>,<shard id>#<marker>,..."
+ */
+static void parse_bi_log_shard_markers(const string& marker, map<int, string>& markers)
+{
+  list<string> l;
+  get_str_list(marker, ",", l);
+  for (list<string>::iterator iter = l.begin(); iter != l.end(); ++iter) {
+    size_t pos = iter->find('#');
+    if (pos == string::npos)
+      continue;
+    int shard_id = atoi(iter->substr(0, pos).c_str());
+    markers[shard_id] = iter->substr(pos + 1);
+  }
+}
+
+static void compose_bi_log_shard_markers(const map<int, string>& markers, string& marker)
+{
+  marker.clear();
+  char buf[16];
+  for (map<int, string>::const_iterator iter = markers.begin(); iter != markers.end(); ++iter) {
+    if (iter->second.empty())
+      continue;
+    if (!marker.empty())
+      marker.append(",");
+    snprintf(buf, sizeof(buf), "%d#", iter->first);
+    marker.append(buf);
+    marker.append(iter->second);
+  }
+}
+
+static void add_dir_header_stats(rgw_bucket_dir_header& dest, rgw_bucket_dir_header& src)
+{
+  map<uint8_t, struct rgw_bucket_category_stats>::iterator iter;
+  for (iter = src.stats.begin(); iter != src.stats.end(); ++iter) {
+    struct rgw_bucket_category_stats& s = dest.stats[iter->first];
+    s.total_size += iter->second.total_size;
+    s.total_size_rounded += iter->second.total_size_rounded;
+    s.num_entries += iter->second.num_entries;
+  }
+}
+
+/* sum up the headers of all index shards into a single bucket header */
+static void merge_dir_headers(map<int, rgw_bucket_dir_header>& headers, rgw_bucket_dir_header& header)
+{
+  if (headers.size() == 1 && headers.begin()->first < 0) {
+    header = headers.begin()->second;
+    return;
+  }
+
+  header = rgw_bucket_dir_header();
+  map<int, string> max_markers;
+  map<int, rgw_bucket_dir_header>::iterator iter;
+  for (iter = headers.begin(); iter != headers.end(); ++iter) {
+    rgw_bucket_dir_header& h = iter->second;
+    add_dir_header_stats(header, h);
+    header.tag_timeout = h.tag_timeout;
+    header.ver += h.ver;
+    header.master_ver += h.master_ver;
+    max_markers[iter->first] = h.max_marker;
+  }
+  compose_bi_log_shard_markers(max_markers, header.max_marker);
+}
+
 static void translate_raw_stats(rgw_bucket_dir_header& header, map<RGWObjCategory, RGWStorageStats>& stats)
 {
   map<uint8_t, struct rgw_bucket_category_stats>::iterator iter = header.stats.begin();
@@ -3706,19 +4230,25 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 				 map<RGWObjCategory, RGWStorageStats> *calculated_stats)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  map<int, string> bucket_objs;
 
-  int ret = open_bucket_index(bucket, index_ctx, oid);
+  int ret = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (ret < 0)
     return ret;
 
-  rgw_bucket_dir_header existing_header;
-  rgw_bucket_dir_header calculated_header;
-
-  ret = cls_rgw_bucket_check_index_op(index_ctx, oid, &existing_header, &calculated_header);
+  map<int, rgw_cls_check_index_ret> results;
+  ret = cls_rgw_bucket_check_index_op(index_ctx, bucket_objs, results, cct->_conf->rgw_bucket_index_max_aio);
   if (ret < 0)
     return ret;
 
+  rgw_bucket_dir_header existing_header;
+  rgw_bucket_dir_header calculated_header;
+  map<int, rgw_cls_check_index_ret>::iterator iter;
+  for (iter = results.begin(); iter != results.end(); ++iter) {
+    add_dir_header_stats(existing_header, iter->second.existing_header);
+    add_dir_header_stats(calculated_header, iter->second.calculated_header);
+  }
+
   translate_raw_stats(existing_header, *existing_stats);
   translate_raw_stats(calculated_header, *calculated_stats);
 
@@ -3728,13 +4258,13 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 int RGWRados::bucket_rebuild_index(rgw_bucket& bucket)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  map<int, string> bucket_objs;
 
-  int ret = open_bucket_index(bucket, index_ctx, oid);
+  int ret = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (ret < 0)
     return ret;
 
-  return cls_rgw_bucket_rebuild_index_op(index_ctx, oid);
+  return cls_rgw_bucket_rebuild_index_op(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio);
 }
 
 
@@ -3837,7 +4367,7 @@ int RGWRados::delete_obj_impl(void *ctx, const string& bucket_owner, rgw_obj& ob
 
   if (state) {
     /* update quota cache */
-    quota_handler->update_stats(bucket_owner, bucket, -1, 0, state->size);
+    quota_handler->update_stats(bucket_owner, bucket, -1, 0, state->accounted_size());
   }
 
   return 0;
@@ -4230,6 +4760,7 @@ int RGWRados::prepare_get_obj(void *ctx, rgw_obj& obj,
   RGWObjState *astate = NULL;
   off_t ofs = 0;
   off_t end = -1;
+  uint64_t size;
 
   map<string, bufferlist>::iterator iter;
 
@@ -4321,22 +4852,24 @@ int RGWRados::prepare_get_obj(void *ctx, rgw_obj& obj,
   if (pend)
     end = *pend;
 
+  size = astate->accounted_size();
+
   if (ofs < 0) {
-    ofs += astate->size;
+    ofs += size;
     if (ofs < 0)
       ofs = 0;
-    end = astate->size - 1;
+    end = size - 1;
   } else if (end < 0) {
-    end = astate->size - 1;
+    end = size - 1;
   }
 
-  if (astate->size > 0) {
-    if (ofs >= (off_t)astate->size) {
+  if (size > 0) {
+    if (ofs >= (off_t)size) {
       r = -ERANGE;
       goto done_err;
     }
-    if (end >= (off_t)astate->size) {
-      end = astate->size - 1;
+    if (end >= (off_t)size) {
+      end = size - 1;
     }
   }
 
@@ -4347,7 +4880,7 @@ int RGWRados::prepare_get_obj(void *ctx, rgw_obj& obj,
   if (total_size)
     *total_size = (ofs <= end ? end + 1 - ofs : 0);
   if (obj_size)
-    *obj_size = astate->size;
+    *obj_size = size;
   if (lastmod)
     *lastmod = astate->mtime;
 
@@ -5033,9 +5566,41 @@ done_err:
   return r;
 }
 
+/*
+ * read [ofs, end] of the object's data; if it is stored compressed, just
+ * the blocks covering the range are read and decompressed
+ */
 int RGWRados::get_obj_iterate(void *ctx, void **handle, rgw_obj& obj,
                               off_t ofs, off_t end,
 			      RGWGetDataCB *cb)
+{
+  RGWRadosCtx *rctx = static_cast<RGWRadosCtx *>(ctx);
+  RGWRadosCtx new_ctx(this);
+  if (!rctx)
+    rctx = &new_ctx;
+
+  RGWObjState *astate = NULL;
+  int r = get_obj_state(rctx, obj, &astate, NULL);
+  if (r < 0)
+    return r;
+
+  if (!astate->has_manifest || !astate->manifest.is_compressed())
+    return get_obj_iterate_stored(rctx, handle, obj, ofs, end, cb);
+
+  RGWGetObj_Decompress decompress(cct, astate->manifest.get_compression(), ofs, end, cb);
+  decompress.get_stored_range(&ofs, &end);
+
+  r = get_obj_iterate_stored(rctx, handle, obj, ofs, end, &decompress);
+  if (r < 0)
+    return r;
+
+  return decompress.flush();
+}
+
+/* read [ofs, end] of the data as it is stored */
+int RGWRados::get_obj_iterate_stored(void *ctx, void **handle, rgw_obj& obj,
+                                     off_t ofs, off_t end,
+                                     RGWGetDataCB *cb)
 {
   struct get_obj_data *data = new get_obj_data(cct);
   bool done = false;
@@ -5638,6 +6203,61 @@ int RGWRados::omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bu
   return omap_get_vals(obj, header, start_after, (uint64_t)-1, m);
 }
 
+int RGWRados::omap_get_vals_concurrent(rgw_obj& obj, const vector<string>& markers, uint64_t count,
+                                       vector<map<string, bufferlist> >& results, uint32_t max_aio)
+{
+  rgw_rados_ref ref;
+  rgw_bucket bucket;
+  int r = get_obj_ref(obj, &ref, &bucket);
+  if (r < 0) {
+    return r;
+  }
+
+  if (!max_aio)
+    max_aio = 1;
+
+  /* sized up front, the ops below point into these */
+  results.clear();
+  results.resize(markers.size());
+  vector<int> rvals(markers.size(), 0);
+
+  list<pair<size_t, librados::AioCompletion *> > in_flight;
+  size_t next = 0;
+  int ret = 0;
+
+  while (true) {
+    if (!ret && next < markers.size() && in_flight.size() < max_aio) {
+      librados::ObjectReadOperation op;
+      op.omap_get_vals(markers[next], count, &results[next], &rvals[next]);
+      librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      r = ref.ioctx.aio_operate(ref.oid, c, &op, NULL);
+      if (r < 0) {
+        c->release();
+        ret = r;
+      } else {
+        in_flight.push_back(make_pair(next, c));
+      }
+      ++next;
+      continue;
+    }
+
+    if (in_flight.empty())
+      break;
+
+    pair<size_t, librados::AioCompletion *> front = in_flight.front();
+    in_flight.pop_front();
+    front.second->wait_for_complete();
+    r = front.second->get_return_value();
+    front.second->release();
+    if (r >= 0)
+      r = rvals[front.first];
+    if (r < 0 && !ret)
+      ret = r;
+  }
+
+  return ret;
+}
+
 int RGWRados::omap_set(rgw_obj& obj, std::string& key, bufferlist& bl)
 {
   rgw_rados_ref ref;
@@ -5714,7 +6334,8 @@ int RGWRados::update_containers_stats(map<string, RGWBucketEnt>& m)
   return m.size();
 }
 
-int RGWRados::append_async(rgw_obj& obj, size_t size, bufferlist& bl)
+int RGWRados::append_async(rgw_obj& obj, size_t size, bufferlist& bl,
+                           librados::AioCompletion *completion)
 {
   rgw_rados_ref ref;
   rgw_bucket bucket;
@@ -5722,7 +6343,10 @@ int RGWRados::append_async(rgw_obj& obj, size_t size, bufferlist& bl)
   if (r < 0) {
     return r;
   }
-  librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
+  if (completion)
+    return ref.ioctx.aio_append(ref.oid, completion, bl, size);
+
+  completion = rados->aio_create_completion(NULL, NULL, NULL);
 
   r = ref.ioctx.aio_append(ref.oid, completion, bl, size);
   completion->release();
@@ -5836,19 +6460,44 @@ int RGWRados::list_bi_log_entries(rgw_bucket& bucket, string& marker, uint32_t m
   result.clear();
 
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  std::list<rgw_bi_log_entry> entries;
-  int ret = cls_rgw_bi_log_list(index_ctx, oid, marker, max - result.size(), entries, truncated);
-  if (ret < 0)
-    return ret;
+  if (bucket_objs.size() == 1 && bucket_objs.begin()->first < 0) {
+    return cls_rgw_bi_log_list(index_ctx, bucket_objs.begin()->second, marker, max, result, truncated);
+  }
 
-  std::list<rgw_bi_log_entry>::iterator iter;
-  for (iter = entries.begin(); iter != entries.end(); ++iter) {
-    result.push_back(*iter);
+  /*
+   * go through the shards in order; each entry's id is the composite
+   * marker that resumes listing right after it
+   */
+  map<int, string> markers;
+  parse_bi_log_shard_markers(marker, markers);
+  *truncated = false;
+  map<int, string>::iterator oiter;
+  for (oiter = bucket_objs.begin(); oiter != bucket_objs.end(); ++oiter) {
+    if (result.size() >= max) {
+      *truncated = true;
+      break;
+    }
+    string& shard_marker = markers[oiter->first];
+    std::list<rgw_bi_log_entry> entries;
+    bool shard_truncated = false;
+    int ret = cls_rgw_bi_log_list(index_ctx, oiter->second, shard_marker, max - result.size(),
+                                  entries, &shard_truncated);
+    if (ret < 0)
+      return ret;
+
+    std::list<rgw_bi_log_entry>::iterator iter;
+    for (iter = entries.begin(); iter != entries.end(); ++iter) {
+      shard_marker = iter->id;
+      compose_bi_log_shard_markers(markers, iter->id);
+      result.push_back(*iter);
+    }
+    if (shard_truncated)
+      *truncated = true;
   }
 
   return 0;
@@ -5857,14 +6506,32 @@ int RGWRados::list_bi_log_entries(rgw_bucket& bucket, string& marker, uint32_t m
 int RGWRados::trim_bi_log_entries(rgw_bucket& bucket, string& start_marker, string& end_marker)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  int ret = cls_rgw_bi_log_trim(index_ctx, oid, start_marker, end_marker);
-  if (ret < 0)
-    return ret;
+  if (bucket_objs.size() == 1 && bucket_objs.begin()->first < 0) {
+    return cls_rgw_bi_log_trim(index_ctx, bucket_objs.begin()->second, start_marker, end_marker);
+  }
+
+  map<int, string> start_markers, end_markers;
+  parse_bi_log_shard_markers(start_marker, start_markers);
+  parse_bi_log_shard_markers(end_marker, end_markers);
+
+  map<int, string>::iterator oiter;
+  for (oiter = bucket_objs.begin(); oiter != bucket_objs.end(); ++oiter) {
+    string shard_end;
+    if (!end_marker.empty()) {
+      map<int, string>::iterator eiter = end_markers.find(oiter->first);
+      if (eiter == end_markers.end())
+        continue; /* nothing to trim on this shard */
+      shard_end = eiter->second;
+    }
+    int ret = cls_rgw_bi_log_trim(index_ctx, oiter->second, start_markers[oiter->first], shard_end);
+    if (ret < 0)
+      return ret;
+  }
 
   return 0;
 }
@@ -5897,21 +6564,13 @@ int RGWRados::process_gc()
   return gc->process();
 }
 
-int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWriteOperation& op, string& oid)
-{
-  bufferlist in;
-  cls_rgw_bucket_init(op);
-  int r = index_ctx.operate(oid, &op);
-  return r;
-}
-
 int RGWRados::cls_obj_prepare_op(rgw_bucket& bucket, RGWModifyOp op, string& tag,
                                  string& name, string& locator)
 {
   librados::IoCtx index_ctx;
   string oid;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index_shard(bucket, index_ctx, name, &oid);
   if (r < 0)
     return r;
 
@@ -5929,29 +6588,28 @@ int RGWRados::cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& ta
   librados::IoCtx index_ctx;
   string oid;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index_shard(bucket, index_ctx, ent.name, &oid);
   if (r < 0)
     return r;
 
-  ObjectWriteOperation o;
-  rgw_bucket_dir_entry_meta dir_meta;
-  dir_meta.size = ent.size;
-  dir_meta.mtime = utime_t(ent.mtime, 0);
-  dir_meta.etag = ent.etag;
-  dir_meta.owner = ent.owner;
-  dir_meta.owner_display_name = ent.owner_display_name;
-  dir_meta.content_type = ent.content_type;
-  dir_meta.category = category;
-
-  rgw_bucket_entry_ver ver;
-  ver.pool = pool;
-  ver.epoch = epoch;
-  cls_rgw_bucket_complete_op(o, op, tag, ver, ent.name, dir_meta, remove_objs, zone_public_config.log_data);
-
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-  r = index_ctx.aio_operate(oid, c, &o);
-  c->release();
-  return r;
+  rgw_cls_obj_complete_op call;
+  call.op = op;
+  call.tag = tag;
+  call.name = ent.name;
+  call.ver.pool = pool;
+  call.ver.epoch = epoch;
+  call.meta.size = ent.size;
+  call.meta.mtime = utime_t(ent.mtime, 0);
+  call.meta.etag = ent.etag;
+  call.meta.owner = ent.owner;
+  call.meta.owner_display_name = ent.owner_display_name;
+  call.meta.content_type = ent.content_type;
+  call.meta.category = category;
+  call.log_op = zone_public_config.log_data;
+  if (remove_objs)
+    call.remove_objs = *remove_objs;
+
+  return index_completion_batcher->complete(index_ctx, oid, call);
 }
 
 int RGWRados::cls_obj_complete_add(rgw_bucket& bucket, string& tag,
@@ -5981,43 +6639,73 @@ int RGWRados::cls_obj_complete_cancel(rgw_bucket& bucket, string& tag, string& n
 int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  map<int, string> bucket_objs;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  ObjectWriteOperation o;
-  cls_rgw_bucket_set_tag_timeout(o, timeout);
-
-  r = index_ctx.operate(oid, &o);
-
-  return r;
+  return cls_rgw_bucket_set_tag_timeout(index_ctx, bucket_objs, timeout, cct->_conf->rgw_bucket_index_max_aio);
 }
 
 int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
 		              uint32_t num, map<string, RGWObjEnt>& m,
 			      bool *is_truncated, string *last_entry,
-			      bool (*force_check_filter)(const string&  name))
+			      bool (*force_check_filter)(const string&  name),
+			      const string& delimiter)
 {
   ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start << " num " << num << dendl;
 
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  struct rgw_bucket_dir dir;
-  r = cls_rgw_list_op(index_ctx, oid, start, prefix, num, &dir, is_truncated);
+  map<int, rgw_cls_list_ret> list_results;
+  r = cls_rgw_list_op(index_ctx, bucket_objs, start, prefix, delimiter, num, list_results,
+                      cct->_conf->rgw_bucket_index_max_aio);
   if (r < 0)
     return r;
 
-  map<string, struct rgw_bucket_dir_entry>::iterator miter;
-  bufferlist updates;
-  for (miter = dir.m.begin(); miter != dir.m.end(); ++miter) {
+  /*
+   * every shard returned its first num entries after start; merge them
+   * in name order and keep the first num overall.  Common prefixes have
+   * no dir entry, and may come from more than one shard.
+   */
+  map<string, pair<int, rgw_bucket_dir_entry *> > merged;
+  *is_truncated = false;
+  map<int, rgw_cls_list_ret>::iterator riter;
+  for (riter = list_results.begin(); riter != list_results.end(); ++riter) {
+    if (riter->second.is_truncated)
+      *is_truncated = true;
+    map<string, struct rgw_bucket_dir_entry>& shard_m = riter->second.dir.m;
+    map<string, struct rgw_bucket_dir_entry>::iterator siter;
+    for (siter = shard_m.begin(); siter != shard_m.end(); ++siter) {
+      merged[siter->first] = make_pair(riter->first, &siter->second);
+    }
+    set<string>& prefixes = riter->second.common_prefixes;
+    for (set<string>::iterator piter = prefixes.begin(); piter != prefixes.end(); ++piter) {
+      merged[*piter] = make_pair(riter->first, (rgw_bucket_dir_entry *)NULL);
+    }
+  }
+  if (merged.size() > num) {
+    map<string, pair<int, rgw_bucket_dir_entry *> >::iterator end = merged.begin();
+    advance(end, num);
+    merged.erase(end, merged.end());
+    *is_truncated = true;
+  }
+
+  map<string, pair<int, rgw_bucket_dir_entry *> >::iterator miter;
+  map<int, bufferlist> updates;
+  for (miter = merged.begin(); miter != merged.end(); ++miter) {
     RGWObjEnt e;
-    rgw_bucket_dir_entry& dirent = miter->second;
+    if (!miter->second.second) {
+      e.name = miter->first;
+      m[e.name] = e;
+      continue;
+    }
+    rgw_bucket_dir_entry& dirent = *miter->second.second;
 
     // fill it in with initial values; we may correct later
     e.name = dirent.name;
@@ -6042,7 +6730,7 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates);
+      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[miter->second.first]);
       if (r < 0) {
         if (r == -ENOENT)
           continue;
@@ -6054,16 +6742,23 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
     ldout(cct, 10) << "RGWRados::cls_bucket_list: got " << e.name << dendl;
   }
 
-  if (dir.m.size()) {
-    *last_entry = dir.m.rbegin()->first;
+  if (merged.size()) {
+    *last_entry = merged.rbegin()->first;
+    if (!merged.rbegin()->second.second) {
+      /* continue past everything under the common prefix */
+      last_entry->append(1, (char)0xff);
+    }
   }
 
-  if (updates.length()) {
+  map<int, bufferlist>::iterator uiter;
+  for (uiter = updates.begin(); uiter != updates.end(); ++uiter) {
+    if (!uiter->second.length())
+      continue;
     ObjectWriteOperation o;
-    cls_rgw_suggest_changes(o, updates);
+    cls_rgw_suggest_changes(o, uiter->second);
     // we don't care if we lose suggested updates, send them off blindly
     AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-    r = index_ctx.aio_operate(oid, c, &o);
+    r = index_ctx.aio_operate(bucket_objs[uiter->first], c, &o);
     c->release();
   }
   return m.size();
@@ -6131,13 +6826,14 @@ int RGWRados::cls_obj_usage_log_trim(string& oid, string& user, uint64_t start_e
 int RGWRados::remove_objs_from_index(rgw_bucket& bucket, list<string>& oid_list)
 {
   librados::IoCtx index_ctx;
-  string dir_oid;
+  map<int, string> bucket_objs;
 
-  int r = open_bucket_index(bucket, index_ctx, dir_oid);
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  bufferlist updates;
+  uint32_t num_shards = (bucket_objs.begin()->first < 0 ? 0 : bucket_objs.size());
+  map<int, bufferlist> updates;
 
   list<string>::iterator iter;
 
@@ -6147,15 +6843,20 @@ int RGWRados::remove_objs_from_index(rgw_bucket& bucket, list<string>& oid_list)
     rgw_bucket_dir_entry entry;
     entry.ver.epoch = (uint64_t)-1; // ULLONG_MAX, needed to that objclass doesn't skip out request
     entry.name = oid;
-    updates.append(CEPH_RGW_REMOVE);
-    ::encode(entry, updates);
+    bufferlist& bl = updates[get_bucket_index_shard_id(oid, num_shards)];
+    bl.append(CEPH_RGW_REMOVE);
+    ::encode(entry, bl);
   }
 
-  bufferlist out;
-
-  r = index_ctx.exec(dir_oid, "rgw", "dir_suggest_changes", updates, out);
+  map<int, bufferlist>::iterator uiter;
+  for (uiter = updates.begin(); uiter != updates.end(); ++uiter) {
+    bufferlist out;
+    r = index_ctx.exec(bucket_objs[uiter->first], "rgw", "dir_suggest_changes", uiter->second, out);
+    if (r < 0)
+      return r;
+  }
 
-  return r;
+  return 0;
 }
 
 int RGWRados::check_disk_state(librados::IoCtx io_ctx,
@@ -6201,7 +6902,7 @@ int RGWRados::check_disk_state(librados::IoCtx io_ctx,
   string content_type;
   ACLOwner owner;
 
-  object.size = astate->size;
+  object.size = astate->accounted_size();
   object.mtime = utime_t(astate->mtime, 0);
 
   map<string, bufferlist>::iterator iter = astate->attrset.find(RGW_ATTR_ETAG);
@@ -6262,29 +6963,96 @@ int RGWRados::check_disk_state(librados::IoCtx io_ctx,
 int RGWRados::cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header(index_ctx, oid, &header);
+  map<int, rgw_bucket_dir_header> headers;
+  r = cls_rgw_get_dir_header(index_ctx, bucket_objs, headers, cct->_conf->rgw_bucket_index_max_aio);
   if (r < 0)
     return r;
 
+  merge_dir_headers(headers, header);
+
   return 0;
 }
 
+/*
+ * Collects the headers of all index shards and hands the merged header
+ * to the caller's callback once the last one is in.
+ */
+class RGWGetDirHeaderShards : public RefCountedObject {
+  Mutex lock;
+  RGWGetDirHeader_CB *cb;
+  map<int, rgw_bucket_dir_header> headers;
+  int pending;
+  int ret;
+
+public:
+  RGWGetDirHeaderShards(RGWGetDirHeader_CB *_cb, int num)
+    : lock("RGWGetDirHeaderShards::lock"), cb(_cb), pending(num), ret(0) {}
+
+  void handle_response(int shard_id, int r, rgw_bucket_dir_header& header) {
+    lock.Lock();
+    if (r < 0 && ret >= 0)
+      ret = r;
+    else if (r >= 0)
+      headers[shard_id] = header;
+    bool done = (--pending == 0);
+    lock.Unlock();
+
+    if (done) {
+      rgw_bucket_dir_header merged;
+      if (ret >= 0)
+        merge_dir_headers(headers, merged);
+      cb->handle_response(ret, merged);
+      cb->put();
+    }
+  }
+};
+
+class RGWGetDirHeaderShard_CB : public RGWGetDirHeader_CB {
+  RGWGetDirHeaderShards *shards;
+  int shard_id;
+
+public:
+  RGWGetDirHeaderShard_CB(RGWGetDirHeaderShards *_shards, int _shard_id)
+    : shards(_shards), shard_id(_shard_id) {
+    shards->get();
+  }
+  ~RGWGetDirHeaderShard_CB() {
+    shards->put();
+  }
+  void handle_response(int r, rgw_bucket_dir_header& header) {
+    shards->handle_response(shard_id, r, header);
+  }
+};
+
 int RGWRados::cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  map<int, string> bucket_objs;
+  int r = open_bucket_index(bucket, index_ctx, bucket_objs);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header_async(index_ctx, oid, ctx);
-  if (r < 0)
-    return r;
+  if (bucket_objs.size() == 1 && bucket_objs.begin()->first < 0) {
+    return cls_rgw_get_dir_header_async(index_ctx, bucket_objs.begin()->second, ctx);
+  }
+
+  RGWGetDirHeaderShards *shards = new RGWGetDirHeaderShards(ctx, bucket_objs.size());
+  map<int, string>::iterator iter;
+  for (iter = bucket_objs.begin(); iter != bucket_objs.end(); ++iter) {
+    RGWGetDirHeaderShard_CB *shard_cb = new RGWGetDirHeaderShard_CB(shards, iter->first);
+    r = cls_rgw_get_dir_header_async(index_ctx, iter->second, shard_cb);
+    if (r < 0) {
+      /* account for the shard ourselves, the caller gets the error through ctx */
+      rgw_bucket_dir_header empty;
+      shards->handle_response(iter->first, r, empty);
+    }
+  }
+  shards->put();
 
   return 0;
 }
@@ -6645,19 +7413,21 @@ int RGWRados::process_intent_log(rgw_bucket& bucket, string& oid,
         break;
       } else {
         librados::IoCtx index_ctx;
-        string oid;
-        int r = open_bucket_index(entry.obj.bucket, index_ctx, oid);
+        map<int, string> bucket_objs;
+        int r = open_bucket_index(entry.obj.bucket, index_ctx, bucket_objs);
         if (r < 0)
           return r;
-        ObjectWriteOperation op;
-        op.remove();
-        oid.append(entry.obj.bucket.marker);
-        librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
-        r = index_ctx.aio_operate(oid, completion, &op);
-        completion->release();
-        if (r < 0 && r != -ENOENT) {
-          cerr << "failed to remove bucket: " << entry.obj.bucket << std::endl;
-          complete = false;
+        map<int, string>::iterator oiter;
+        for (oiter = bucket_objs.begin(); oiter != bucket_objs.end(); ++oiter) {
+          ObjectWriteOperation op;
+          op.remove();
+          librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
+          r = index_ctx.aio_operate(oiter->second, completion, &op);
+          completion->release();
+          if (r < 0 && r != -ENOENT) {
+            cerr << "failed to remove bucket: " << entry.obj.bucket << std::endl;
+            complete = false;
+          }
         }
       }
       break;
@@ -21,6 +21,7 @@ class RGWWatcher;
 class SafeTimer;
 class ACLOwner;
 class RGWGC;
+class RGWIndexCompletionBatcher;
 
 /* flags for put_obj_meta() */
 #define PUT_OBJ_CREATE      0x01
@@ -173,6 +174,51 @@ struct RGWObjManifestRule {
 };
 WRITE_CLASS_ENCODER(RGWObjManifestRule)
 
+/*
+ * Layout of object data that is stored compressed.  The data is cut into
+ * blocks of block_size bytes (the last one may be shorter) that are
+ * compressed independently, and blocks[i] is where compressed block i
+ * starts in the stored data, so a range of the original data can be read
+ * by decompressing just the blocks it overlaps.
+ */
+struct RGWCompressionInfo {
+  string compression_type; /* empty if the data isn't compressed */
+  uint64_t orig_size;
+  uint64_t compressed_size;
+  uint64_t block_size;
+  vector<uint64_t> blocks;
+
+  RGWCompressionInfo() : orig_size(0), compressed_size(0), block_size(0) {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(compression_type, bl);
+    ::encode(orig_size, bl);
+    ::encode(compressed_size, bl);
+    ::encode(block_size, bl);
+    ::encode(blocks, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(compression_type, bl);
+    ::decode(orig_size, bl);
+    ::decode(compressed_size, bl);
+    ::decode(block_size, bl);
+    ::decode(blocks, bl);
+    DECODE_FINISH(bl);
+  }
+
+  bool is_compressed() const {
+    return !compression_type.empty();
+  }
+
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<RGWCompressionInfo*>& o);
+};
+WRITE_CLASS_ENCODER(RGWCompressionInfo)
+
 class RGWObjManifest {
 protected:
   bool explicit_objs; /* old manifest? */
@@ -188,6 +234,7 @@ protected:
   rgw_bucket tail_bucket; /* might be different than the original bucket,
                              as object might have been copied across buckets */
   map<uint64_t, RGWObjManifestRule> rules;
+  RGWCompressionInfo compression; /* set if the data described is stored compressed */
 
   void convert_to_explicit();
   int append_explicit(RGWObjManifest& m);
@@ -214,6 +261,7 @@ public:
     prefix = rhs.prefix;
     tail_bucket = rhs.tail_bucket;
     rules = rhs.rules;
+    compression = rhs.compression;
 
     begin_iter.set_manifest(this);
     end_iter.set_manifest(this);
@@ -251,7 +299,11 @@ public:
   }
 
   void encode(bufferlist& bl) const {
-    ENCODE_START(4, 3, bl);
+    /*
+     * gateways that don't know about compression must not take a
+     * compressed object's data for the object itself
+     */
+    ENCODE_START(5, (compression.is_compressed() ? 5 : 3), bl);
     ::encode(obj_size, bl);
     ::encode(objs, bl);
     ::encode(explicit_objs, bl);
@@ -261,11 +313,12 @@ public:
     ::encode(prefix, bl);
     ::encode(rules, bl);
     ::encode(tail_bucket, bl);
+    ::encode(compression, bl);
     ENCODE_FINISH(bl);
   }
 
   void decode(bufferlist::iterator& bl) {
-    DECODE_START_LEGACY_COMPAT_LEN_32(4, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN_32(5, 2, 2, bl);
     ::decode(obj_size, bl);
     ::decode(objs, bl);
     if (struct_v >= 3) {
@@ -283,6 +336,10 @@ public:
       ::decode(tail_bucket, bl);
     }
 
+    if (struct_v >= 5) {
+      ::decode(compression, bl);
+    }
+
     update_iterators();
     DECODE_FINISH(bl);
   }
@@ -366,6 +423,18 @@ public:
     return max_head_size;
   }
 
+  void set_compression(const RGWCompressionInfo& info) {
+    compression = info;
+  }
+
+  const RGWCompressionInfo& get_compression() {
+    return compression;
+  }
+
+  bool is_compressed() {
+    return compression.is_compressed();
+  }
+
   class obj_iterator {
     RGWObjManifest *manifest;
     uint64_t part_ofs; /* where current part starts */
@@ -634,6 +703,13 @@ class RGWPutObjProcessor_Atomic : public RGWPutObjProcessor_Aio
   bufferlist pending_data_bl;
   uint64_t max_chunk_size;
 
+  RGWCompressionInfo compression;
+  bool compress_data;
+  bufferlist compress_pending; /* data not making up a whole block yet */
+
+  int compress(bufferlist& bl, bool flush);
+  int queue_data(bufferlist& bl, void **phandle, bool *again);
+
 protected:
   rgw_bucket bucket;
   string obj_str;
@@ -665,6 +741,7 @@ public:
                                 data_ofs(0),
                                 extra_data_len(0),
                                 max_chunk_size(0),
+                                compress_data(false),
                                 bucket(_b),
                                 obj_str(_o),
                                 unique_tag(_t) {}
@@ -673,6 +750,10 @@ public:
   void set_extra_data_len(uint64_t len) {
     extra_data_len = len;
   }
+  /* compress the data with the given codec before it is stored */
+  void set_compression(const string& type, uint64_t block_size);
+  /* the data handed in is already compressed, with the given layout */
+  void set_compressed_data(const RGWCompressionInfo& info);
   virtual int handle_data(bufferlist& bl, off_t ofs, void **phandle, bool *again);
   bufferlist& get_extra_data() { return extra_data_bl; }
 };
@@ -698,6 +779,14 @@ struct RGWObjState {
   RGWObjVersionTracker objv_tracker;
 
   map<string, bufferlist> attrset;
+
+  /* size of the object's data as clients see it, it might be stored compressed */
+  uint64_t accounted_size() {
+    if (has_manifest && manifest.is_compressed())
+      return manifest.get_compression().orig_size;
+    return size;
+  }
+
   RGWObjState() : is_atomic(false), has_attrs(0), exists(false),
                   size(0), mtime(0), epoch(0), fake_tag(false), has_manifest(false),
                   has_data(false), prefetch_data(false), keep_tail(false) {}
@@ -794,22 +883,27 @@ struct RGWZonePlacementInfo {
   string index_pool;
   string data_pool;
   string data_extra_pool; /* if not set we should use data_pool */
+  string compression; /* codec object data is compressed with, empty for none */
 
   void encode(bufferlist& bl) const {
-    ENCODE_START(4, 1, bl);
+    ENCODE_START(5, 1, bl);
     ::encode(index_pool, bl);
     ::encode(data_pool, bl);
     ::encode(data_extra_pool, bl);
+    ::encode(compression, bl);
     ENCODE_FINISH(bl);
   }
 
   void decode(bufferlist::iterator& bl) {
-    DECODE_START(4, bl);
+    DECODE_START(5, bl);
     ::decode(index_pool, bl);
     ::decode(data_pool, bl);
     if (struct_v >= 4) {
       ::decode(data_extra_pool, bl);
     }
+    if (struct_v >= 5) {
+      ::decode(compression, bl);
+    }
     DECODE_FINISH(bl);
   }
   const string& get_data_extra_pool() {
@@ -1247,7 +1341,12 @@ class RGWRados
   int open_bucket_index_ctx(rgw_bucket& bucket, librados::IoCtx&  index_ctx);
   int open_bucket_data_ctx(rgw_bucket& bucket, librados::IoCtx&  io_ctx);
   int open_bucket_data_extra_ctx(rgw_bucket& bucket, librados::IoCtx&  io_ctx);
-  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx&  index_ctx, string& bucket_oid);
+  int get_bucket_index_num_shards(rgw_bucket& bucket, uint32_t *num_shards);
+  int open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx&  index_ctx,
+                             string& bucket_oid_base, uint32_t *num_shards);
+  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx&  index_ctx, map<int, string>& bucket_objs);
+  int open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx&  index_ctx,
+                              const string& obj_key, string *bucket_obj);
 
   struct GetObjState {
     librados::IoCtx io_ctx;
@@ -1269,6 +1368,7 @@ class RGWRados
   };
 
   RGWGC *gc;
+  RGWIndexCompletionBatcher *index_completion_batcher;
   bool use_gc_thread;
   bool quota_threads;
 
@@ -1345,7 +1445,8 @@ protected:
 
 public:
   RGWRados() : lock("rados_timer_lock"), timer(NULL),
-               gc(NULL), use_gc_thread(false), quota_threads(false),
+               gc(NULL), index_completion_batcher(NULL),
+               use_gc_thread(false), quota_threads(false),
                num_watchers(0), watchers(NULL), watch_handles(NULL),
                watch_initialized(false),
                bucket_id_lock("rados_bucket_id"), max_bucket_id(0),
@@ -1388,6 +1489,7 @@ public:
 
   int get_required_alignment(rgw_bucket& bucket, uint64_t *alignment);
   int get_max_chunk_size(rgw_bucket& bucket, uint64_t *max_chunk_size);
+  const string& get_compression_type(const string& placement_rule);
 
   int list_raw_objects(rgw_bucket& pool, const string& prefix_filter, int max,
                        RGWListRawObjsCtx& ctx, list<string>& oids,
@@ -1462,7 +1564,7 @@ public:
    * create a bucket with name bucket and the given list of attrs
    * returns 0 on success, -ERR# otherwise.
    */
-  virtual int init_bucket_index(rgw_bucket& bucket);
+  virtual int init_bucket_index(rgw_bucket& bucket, uint32_t num_shards);
   int select_bucket_placement(RGWUserInfo& user_info, const string& region_name, const std::string& rule,
                               const std::string& bucket_name, rgw_bucket& bucket, string *pselected_rule);
   int select_legacy_bucket_placement(const string& bucket_name, rgw_bucket& bucket);
@@ -1728,6 +1830,9 @@ public:
   int get_obj_iterate(void *ctx, void **handle, rgw_obj& obj,
                       off_t ofs, off_t end,
 	              RGWGetDataCB *cb);
+  int get_obj_iterate_stored(void *ctx, void **handle, rgw_obj& obj,
+                             off_t ofs, off_t end,
+                             RGWGetDataCB *cb);
 
   int flush_read_list(struct get_obj_data *d);
 
@@ -1750,11 +1855,16 @@ public:
   virtual bool supports_omap() { return true; }
   int omap_get_vals(rgw_obj& obj, bufferlist& header, const std::string& marker, uint64_t count, std::map<string, bufferlist>& m);
   virtual int omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bufferlist>& m);
+  /* read up to count entries after each of markers, with up to max_aio reads in flight */
+  int omap_get_vals_concurrent(rgw_obj& obj, const vector<string>& markers, uint64_t count,
+                               vector<map<string, bufferlist> >& results, uint32_t max_aio);
   virtual int omap_set(rgw_obj& obj, std::string& key, bufferlist& bl);
   virtual int omap_set(rgw_obj& obj, map<std::string, bufferlist>& m);
   virtual int omap_del(rgw_obj& obj, const std::string& key);
   virtual int update_containers_stats(map<string, RGWBucketEnt>& m);
-  virtual int append_async(rgw_obj& obj, size_t size, bufferlist& bl);
+  /* with a completion, it is up to the caller to wait for it and release it */
+  virtual int append_async(rgw_obj& obj, size_t size, bufferlist& bl,
+                           librados::AioCompletion *completion = NULL);
 
   virtual bool need_watch_notify() { return false; }
   virtual int init_watch();
@@ -1812,7 +1922,9 @@ public:
   virtual int put_linked_bucket_info(RGWBucketInfo& info, bool exclusive, time_t mtime, obj_version *pep_objv,
                                      map<string, bufferlist> *pattrs, bool create_entry_point);
 
-  int cls_rgw_init_index(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& op, string& oid);
+  static void get_bucket_index_objects(const string& bucket_oid_base, uint32_t num_shards,
+                                       map<int, string>& bucket_objs);
+  static int get_bucket_index_shard_id(const string& obj_key, uint32_t num_shards);
   int cls_obj_prepare_op(rgw_bucket& bucket, RGWModifyOp op, string& tag,
                          string& name, string& locator);
   int cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& tag, int64_t pool, uint64_t epoch,
@@ -1823,7 +1935,8 @@ public:
   int cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout);
   int cls_bucket_list(rgw_bucket& bucket, string start, string prefix, uint32_t num,
                       map<string, RGWObjEnt>& m, bool *is_truncated,
-                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL);
+                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL,
+                      const string& delimiter = string());
   int cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header);
   int cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx);
   int prepare_update_index(RGWObjState *state, rgw_bucket& bucket,
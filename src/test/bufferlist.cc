@@ -1122,6 +1122,27 @@ TEST(BufferList, contents_equal) {
   ASSERT_FALSE(bl1.contents_equal(bl3)); // same length different content
 }
 
+TEST(BufferList, is_provided_buffer) {
+  char buf[10];
+  {
+    bufferlist bl;
+    EXPECT_FALSE(bl.is_provided_buffer(buf));
+  }
+  {
+    bufferlist bl;
+    bl.push_back(buffer::create_static(sizeof(buf), buf));
+    EXPECT_TRUE(bl.is_provided_buffer(buf));
+    EXPECT_FALSE(bl.is_provided_buffer(buf + 1));
+    bl.append("A", 1);
+    EXPECT_FALSE(bl.is_provided_buffer(buf));
+  }
+  {
+    bufferlist bl;
+    bl.append("ABC", 3);
+    EXPECT_FALSE(bl.is_provided_buffer(buf));
+  }
+}
+
 TEST(BufferList, is_page_aligned) {
   {
     bufferlist bl;
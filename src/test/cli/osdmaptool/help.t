@@ -9,4 +9,8 @@
      --test-random           do random placements
      --test-map-pg <pgid>    map a pgid to osds
      --test-map-object <objectname> [--pool <poolid>] map an object to osds
+     --test-map-cache <epochs> [--map-cache-copy]
+                             build <epochs> successive maps from synthetic
+                             incrementals and report their memory use;
+                             --map-cache-copy gives each epoch a full copy
   [1]
@@ -40,6 +40,9 @@ using ::librbd::cls_client::dir_list;
 using ::librbd::cls_client::dir_add_image;
 using ::librbd::cls_client::dir_remove_image;
 using ::librbd::cls_client::dir_rename_image;
+using ::librbd::cls_client::object_map_load;
+using ::librbd::cls_client::object_map_update;
+using ::librbd::cls_client::object_map_resize;
 using ::librbd::parent_info;
 using ::librbd::parent_spec;
 using ::librbd::cls_client::get_protection_status;
@@ -917,3 +920,58 @@ TEST(cls_rbd, stripingv2)
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
+
+TEST(cls_rbd, object_map)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "rbd_object_map.foo";
+  ceph::BitVector<2> object_map;
+  ASSERT_EQ(-ENOENT, object_map_load(&ioctx, oid, 10, &object_map));
+
+  // updates create the object; entries past its end are nonexistent
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 2, 5, RBD_OBJECT_EXISTS, NULL));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, 10, &object_map));
+  ASSERT_EQ(10u, object_map.size());
+  for (uint64_t i = 0; i < object_map.size(); ++i) {
+    ASSERT_EQ(i >= 2 && i < 5 ? RBD_OBJECT_EXISTS : RBD_OBJECT_NONEXISTENT,
+	      object_map.get(i));
+  }
+
+  // conditional updates only touch matching entries
+  uint8_t current_state = RBD_OBJECT_EXISTS;
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 0, 10, RBD_OBJECT_EXISTS_CLEAN,
+				 &current_state));
+  current_state = RBD_OBJECT_NONEXISTENT;
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 9, 10, RBD_OBJECT_PENDING,
+				 &current_state));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, 10, &object_map));
+  ASSERT_EQ(RBD_OBJECT_NONEXISTENT, object_map.get(1));
+  ASSERT_EQ(RBD_OBJECT_EXISTS_CLEAN, object_map.get(4));
+  ASSERT_EQ(RBD_OBJECT_NONEXISTENT, object_map.get(8));
+  ASSERT_EQ(RBD_OBJECT_PENDING, object_map.get(9));
+
+  ASSERT_EQ(-EINVAL, object_map_update(&ioctx, oid, 5, 2, RBD_OBJECT_EXISTS,
+				       NULL));
+  ASSERT_EQ(-EINVAL, object_map_update(&ioctx, oid, 0, 1, 4, NULL));
+
+  // shrinking must not drop objects that may exist
+  ASSERT_EQ(-ESTALE, object_map_resize(&ioctx, oid, 3));
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 3, 10, RBD_OBJECT_NONEXISTENT,
+				 NULL));
+  ASSERT_EQ(0, object_map_resize(&ioctx, oid, 3));
+  ASSERT_EQ(0, object_map_resize(&ioctx, oid, 20));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, 20, &object_map));
+  for (uint64_t i = 0; i < object_map.size(); ++i) {
+    ASSERT_EQ(i == 2 ? RBD_OBJECT_EXISTS_CLEAN : RBD_OBJECT_NONEXISTENT,
+	      object_map.get(i));
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
@@ -8,8 +8,10 @@
 #include "test/librados/test.h"
 
 #include <errno.h>
+#include <iostream>
 #include <string>
 #include <vector>
+#include <sys/time.h>
 
 using namespace librados;
 
@@ -529,6 +531,394 @@ TEST(cls_rgw, gc_defer)
 }
 
 
+static void init_index_shards(const string& base, int num_shards, map<int, string>& bucket_objs)
+{
+  for (int i = 0; i < num_shards; i++) {
+    bucket_objs[i] = str_int(base, i);
+  }
+  ASSERT_EQ(0, cls_rgw_bucket_index_init_op(ioctx, bucket_objs, 8));
+}
+
+/* the objclass doesn't care how entries are placed, any stable hash will do */
+static int obj_shard(const string& obj, int num_shards)
+{
+  unsigned h = 0;
+  for (string::const_iterator p = obj.begin(); p != obj.end(); ++p)
+    h = h * 31 + (unsigned char)*p;
+  return h % num_shards;
+}
+
+TEST(cls_rgw, index_shards)
+{
+  map<int, string> bucket_objs;
+  int num_shards = 8;
+  init_index_shards("bucket-shards", num_shards, bucket_objs);
+
+  OpMgr mgr;
+  uint64_t obj_size = 1024;
+  int num_objs = 100;
+  for (int i = 0; i < num_objs; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc;
+    string& oid = bucket_objs[obj_shard(obj, num_shards)];
+
+    index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = obj_size;
+    index_complete(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+  }
+
+  /* entries are spread over the shards, and add up */
+  map<int, rgw_bucket_dir_header> headers;
+  ASSERT_EQ(0, cls_rgw_get_dir_header(ioctx, bucket_objs, headers, 3));
+  ASSERT_EQ((size_t)num_shards, headers.size());
+  uint64_t total = 0;
+  int used = 0;
+  for (map<int, rgw_bucket_dir_header>::iterator iter = headers.begin(); iter != headers.end(); ++iter) {
+    uint64_t n = iter->second.stats[0].num_entries;
+    total += n;
+    if (n)
+      used++;
+  }
+  ASSERT_EQ((uint64_t)num_objs, total);
+  ASSERT_LT(1, used);
+
+  /* every shard lists its own entries only */
+  string start, prefix;
+  map<int, rgw_cls_list_ret> list_results;
+  ASSERT_EQ(0, cls_rgw_list_op(ioctx, bucket_objs, start, prefix, string(), 1000, list_results, 3));
+  set<string> names;
+  for (map<int, rgw_cls_list_ret>::iterator iter = list_results.begin(); iter != list_results.end(); ++iter) {
+    ASSERT_FALSE(iter->second.is_truncated);
+    map<string, rgw_bucket_dir_entry>& m = iter->second.dir.m;
+    for (map<string, rgw_bucket_dir_entry>::iterator eiter = m.begin(); eiter != m.end(); ++eiter) {
+      ASSERT_EQ(iter->first, obj_shard(eiter->first, num_shards));
+      names.insert(eiter->first);
+    }
+  }
+  ASSERT_EQ((size_t)num_objs, names.size());
+
+  map<int, rgw_cls_check_index_ret> check_results;
+  ASSERT_EQ(0, cls_rgw_bucket_check_index_op(ioctx, bucket_objs, check_results, 3));
+  for (map<int, rgw_cls_check_index_ret>::iterator iter = check_results.begin(); iter != check_results.end(); ++iter) {
+    ASSERT_EQ(iter->second.existing_header.stats[0].num_entries,
+              iter->second.calculated_header.stats[0].num_entries);
+  }
+  ASSERT_EQ(0, cls_rgw_bucket_rebuild_index_op(ioctx, bucket_objs, 3));
+  ASSERT_EQ(0, cls_rgw_bucket_set_tag_timeout(ioctx, bucket_objs, 60, 3));
+}
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * index updates for PUTs of the given objects, keeping a window of
+ * them in flight, each to the shard its name hashes to
+ */
+static void index_add_entries(map<int, string>& bucket_objs, const vector<string>& names, size_t window)
+{
+  list<AioCompletion *> pending;
+  for (size_t i = 0; i < names.size(); i++) {
+    string obj = names[i];
+    string tag = str_int("tag", i);
+    string loc;
+    string& oid = bucket_objs[obj_shard(obj, bucket_objs.size())];
+
+    /* prepare and complete go to the same object, so they stay ordered */
+    ObjectWriteOperation prepare;
+    cls_rgw_bucket_prepare_op(prepare, CLS_RGW_OP_ADD, tag, obj, loc, true);
+    AioCompletion *c = Rados::aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate(oid, c, &prepare));
+    pending.push_back(c);
+
+    ObjectWriteOperation complete;
+    rgw_bucket_entry_ver ver;
+    ver.pool = ioctx.get_id();
+    ver.epoch = 1;
+    rgw_bucket_dir_entry_meta meta;
+    meta.size = 4096;
+    cls_rgw_bucket_complete_op(complete, CLS_RGW_OP_ADD, tag, ver, obj, meta, NULL, true);
+    c = Rados::aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate(oid, c, &complete));
+    pending.push_back(c);
+
+    while (pending.size() >= window || (i == names.size() - 1 && !pending.empty())) {
+      pending.front()->wait_for_safe();
+      ASSERT_EQ(0, pending.front()->get_return_value());
+      pending.front()->release();
+      pending.pop_front();
+    }
+  }
+}
+
+/*
+ * index updates of object PUTs into a single bucket, by shard count.
+ * Only run with --gtest_also_run_disabled_tests
+ */
+TEST(cls_rgw, DISABLED_index_shards_bench)
+{
+  int num_objs = 2000;
+  int shard_counts[] = { 1, 4, 16 };
+
+  vector<string> names;
+  for (int i = 0; i < num_objs; i++) {
+    names.push_back(str_int("obj", i));
+  }
+
+  for (size_t s = 0; s < sizeof(shard_counts) / sizeof(shard_counts[0]); s++) {
+    int num_shards = shard_counts[s];
+    map<int, string> bucket_objs;
+    init_index_shards(str_int("bucket-bench", num_shards), num_shards, bucket_objs);
+
+    double start = now();
+    index_add_entries(bucket_objs, names, 64);
+    double elapsed = now() - start;
+    std::cout << num_shards << " shards: " << (elapsed > 0 ? num_objs / elapsed : 0)
+              << " PUTs/s" << std::endl;
+  }
+}
+
+static void list_delim(map<int, string>& bucket_objs, string start, string prefix, string delim,
+                       uint32_t num, rgw_cls_list_ret *ret)
+{
+  map<int, rgw_cls_list_ret> list_results;
+  ASSERT_EQ(0, cls_rgw_list_op(ioctx, bucket_objs, start, prefix, delim, num, list_results, 1));
+  *ret = list_results.begin()->second;
+}
+
+TEST(cls_rgw, index_list_delimiter)
+{
+  map<int, string> bucket_objs;
+  init_index_shards("bucket-delim", 1, bucket_objs);
+
+  vector<string> names;
+  names.push_back("a/1");
+  names.push_back("a/2");
+  names.push_back("b");
+  names.push_back("c/d/1");
+  names.push_back("c/d/2");
+  names.push_back("c/e");
+  names.push_back("f");
+  index_add_entries(bucket_objs, names, 8);
+
+  rgw_cls_list_ret ret;
+  list_delim(bucket_objs, "", "", "/", 100, &ret);
+  ASSERT_FALSE(ret.is_truncated);
+  ASSERT_EQ(2u, ret.dir.m.size());
+  ASSERT_EQ(1u, ret.dir.m.count("b"));
+  ASSERT_EQ(1u, ret.dir.m.count("f"));
+  ASSERT_EQ(2u, ret.common_prefixes.size());
+  ASSERT_EQ(1u, ret.common_prefixes.count("a/"));
+  ASSERT_EQ(1u, ret.common_prefixes.count("c/"));
+
+  /* the delimiter is only looked for past the prefix */
+  list_delim(bucket_objs, "", "c/", "/", 100, &ret);
+  ASSERT_FALSE(ret.is_truncated);
+  ASSERT_EQ(1u, ret.dir.m.size());
+  ASSERT_EQ(1u, ret.dir.m.count("c/e"));
+  ASSERT_EQ(1u, ret.common_prefixes.size());
+  ASSERT_EQ(1u, ret.common_prefixes.count("c/d/"));
+
+  /* common prefixes count against the limit */
+  list_delim(bucket_objs, "", "", "/", 2, &ret);
+  ASSERT_TRUE(ret.is_truncated);
+  ASSERT_EQ(1u, ret.dir.m.size());
+  ASSERT_EQ(1u, ret.common_prefixes.size());
+
+  /* resuming past a common prefix */
+  list_delim(bucket_objs, "b", "", "/", 100, &ret);
+  ASSERT_EQ(1u, ret.dir.m.size());
+  ASSERT_EQ(1u, ret.common_prefixes.count("c/"));
+
+  /* no delimiter, everything */
+  list_delim(bucket_objs, "", "", "", 100, &ret);
+  ASSERT_EQ(names.size(), ret.dir.m.size());
+  ASSERT_TRUE(ret.common_prefixes.empty());
+}
+
+/*
+ * listing the top level of a bucket with a few big "directories".
+ * Only run with --gtest_also_run_disabled_tests
+ */
+TEST(cls_rgw, DISABLED_index_list_delimiter_bench)
+{
+  map<int, string> bucket_objs;
+  init_index_shards("bucket-delim-bench", 1, bucket_objs);
+
+  int num_dirs = 10;
+  int files_per_dir = 1000;
+  vector<string> names;
+  for (int d = 0; d < num_dirs; d++) {
+    for (int f = 0; f < files_per_dir; f++) {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "dir%d/sub%d/file%d", d, f % 10, f);
+      names.push_back(buf);
+    }
+  }
+  index_add_entries(bucket_objs, names, 64);
+
+  const char *delims[] = { "", "/" };
+  for (int i = 0; i < 2; i++) {
+    double start = now();
+    string marker;
+    size_t entries = 0;
+    int calls = 0;
+    rgw_cls_list_ret ret;
+    do {
+      list_delim(bucket_objs, marker, "", delims[i], 1000, &ret);
+      calls++;
+      entries += ret.dir.m.size() + ret.common_prefixes.size();
+      string last;
+      if (!ret.dir.m.empty())
+        last = ret.dir.m.rbegin()->first;
+      if (!ret.common_prefixes.empty() && *ret.common_prefixes.rbegin() > last) {
+        last = *ret.common_prefixes.rbegin();
+        last.append(1, (char)0xff);
+      }
+      marker = last;
+    } while (ret.is_truncated);
+    double elapsed = now() - start;
+    std::cout << "delimiter '" << delims[i] << "': " << entries << " entries in "
+              << calls << " calls, " << elapsed << " seconds" << std::endl;
+  }
+}
+
+static rgw_cls_obj_complete_op complete_add_op(const string& obj, const string& tag, uint64_t size)
+{
+  rgw_cls_obj_complete_op op;
+  op.op = CLS_RGW_OP_ADD;
+  op.name = obj;
+  op.tag = tag;
+  op.ver.pool = ioctx.get_id();
+  op.ver.epoch = 1;
+  op.meta.size = size;
+  op.log_op = true;
+  return op;
+}
+
+TEST(cls_rgw, index_complete_batch)
+{
+  map<int, string> bucket_objs;
+  init_index_shards("bucket-complete-batch", 1, bucket_objs);
+  string& oid = bucket_objs[0];
+
+  OpMgr mgr;
+  uint64_t obj_size = 1024;
+  int num_objs = 10;
+  list<rgw_cls_obj_complete_op> ops;
+  for (int i = 0; i < num_objs; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc;
+    index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+    ops.push_back(complete_add_op(obj, tag, obj_size));
+  }
+  /* an op with an unknown tag fails by itself, the rest still apply */
+  ops.push_back(complete_add_op("obj-none", "tag-none", obj_size));
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(oid, op));
+
+  test_stats(ioctx, oid, 0, num_objs, obj_size * num_objs);
+
+  rgw_cls_list_ret ret;
+  list_delim(bucket_objs, "", "", "", 100, &ret);
+  ASSERT_EQ((size_t)num_objs, ret.dir.m.size());
+  for (map<string, rgw_bucket_dir_entry>::iterator iter = ret.dir.m.begin(); iter != ret.dir.m.end(); ++iter) {
+    ASSERT_TRUE(iter->second.exists);
+    ASSERT_TRUE(iter->second.pending_map.empty());
+  }
+
+  /* every op in the batch got its own log entry, as if sent separately */
+  string marker;
+  list<rgw_bi_log_entry> entries;
+  bool truncated;
+  ASSERT_EQ(0, cls_rgw_bi_log_list(ioctx, oid, marker, 100, entries, &truncated));
+  int num_complete = 0;
+  for (list<rgw_bi_log_entry>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+    if (iter->state == CLS_RGW_STATE_COMPLETE)
+      num_complete++;
+  }
+  ASSERT_EQ(num_objs, num_complete);
+}
+
+/*
+ * completions of small PUTs into a single index object, sent one op per
+ * completion and batched the way rgw groups them while an op on the
+ * index object is in flight. Only run with --gtest_also_run_disabled_tests
+ */
+TEST(cls_rgw, DISABLED_index_complete_batch_bench)
+{
+  int num_objs = 4000;
+  size_t batch_sizes[] = { 1, 8, 32 };
+  size_t window = 64;
+
+  for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+    size_t batch_size = batch_sizes[b];
+    map<int, string> bucket_objs;
+    init_index_shards(str_int("bucket-complete-bench", batch_size), 1, bucket_objs);
+    string& oid = bucket_objs[0];
+
+    list<AioCompletion *> pending;
+    for (int i = 0; i < num_objs; i++) {
+      ObjectWriteOperation prepare;
+      string obj = str_int("obj", i);
+      string tag = str_int("tag", i);
+      string loc;
+      cls_rgw_bucket_prepare_op(prepare, CLS_RGW_OP_ADD, tag, obj, loc, true);
+      AioCompletion *c = Rados::aio_create_completion();
+      ASSERT_EQ(0, ioctx.aio_operate(oid, c, &prepare));
+      pending.push_back(c);
+      if (pending.size() >= window || i == num_objs - 1) {
+        while (!pending.empty()) {
+          pending.front()->wait_for_safe();
+          ASSERT_EQ(0, pending.front()->get_return_value());
+          pending.front()->release();
+          pending.pop_front();
+        }
+      }
+    }
+
+    double start = now();
+    list<rgw_cls_obj_complete_op> ops;
+    for (int i = 0; i < num_objs; i++) {
+      ops.push_back(complete_add_op(str_int("obj", i), str_int("tag", i), 4096));
+      if (ops.size() < batch_size && i < num_objs - 1)
+        continue;
+
+      ObjectWriteOperation complete;
+      if (ops.size() == 1)
+        cls_rgw_bucket_complete_op(complete, ops.front());
+      else
+        cls_rgw_bucket_complete_ops(complete, ops);
+      ops.clear();
+      AioCompletion *c = Rados::aio_create_completion();
+      ASSERT_EQ(0, ioctx.aio_operate(oid, c, &complete));
+      pending.push_back(c);
+
+      while (pending.size() >= window || (i == num_objs - 1 && !pending.empty())) {
+        pending.front()->wait_for_safe();
+        ASSERT_EQ(0, pending.front()->get_return_value());
+        pending.front()->release();
+        pending.pop_front();
+      }
+    }
+    double elapsed = now() - start;
+
+    test_stats(ioctx, oid, 0, num_objs, 4096 * num_objs);
+    std::cout << "batch " << batch_size << ": " << (elapsed > 0 ? num_objs / elapsed : 0)
+              << " completions/s" << std::endl;
+  }
+}
+
 /* must be last test! */
 
 TEST(cls_rgw, finalize)
@@ -0,0 +1,76 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * LGPL2.1 (see COPYING-LGPL2.1) or later
+ */
+
+#include <gtest/gtest.h>
+
+#include "common/Readahead.h"
+
+typedef Readahead::extent_t extent_t;
+
+#define ASSERT_EXTENT(off, len, extent) do {	\
+    extent_t e = (extent);			\
+    ASSERT_EQ((uint64_t)(off), e.first);		\
+    ASSERT_EQ((uint64_t)(len), e.second);		\
+  } while (0)
+
+TEST(Readahead, Sequential) {
+  Readahead r;
+  r.set_trigger_requests(4);
+  r.set_max_readahead_size(65536);
+
+  // nothing until trigger_requests sequential reads
+  ASSERT_EXTENT(0, 0, r.update(0, 4096, 1 << 30));
+  ASSERT_EXTENT(0, 0, r.update(4096, 4096, 1 << 30));
+  ASSERT_EXTENT(0, 0, r.update(8192, 4096, 1 << 30));
+
+  // the first prefetch is as large as the sequential run so far
+  ASSERT_EXTENT(16384, 16384, r.update(12288, 4096, 1 << 30));
+
+  // then nothing until halfway through it, then twice as much
+  ASSERT_EXTENT(0, 0, r.update(16384, 4096, 1 << 30));
+  ASSERT_EXTENT(32768, 32768, r.update(20480, 4096, 1 << 30));
+  ASSERT_EQ(8192u, r.get_hit_bytes());
+  ASSERT_EQ(0u, r.get_waste_bytes());
+
+  // a random read ends the run, wasting what was not read
+  ASSERT_EXTENT(0, 0, r.update(1 << 20, 4096, 1 << 30));
+  ASSERT_EQ(65536u - 24576u, r.get_waste_bytes());
+}
+
+TEST(Readahead, MaxSize) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_max_readahead_size(8192);
+  ASSERT_EXTENT(65536, 8192, r.update(0, 65536, 1 << 30));
+}
+
+TEST(Readahead, Limit) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  ASSERT_EXTENT(4096, 1000, r.update(0, 4096, 5096));
+  ASSERT_EQ(0u, r.update(4096, 1000, 5096).second);
+}
+
+TEST(Readahead, Alignment) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  std::vector<uint64_t> alignments;
+  alignments.push_back(8192);
+  r.set_alignments(alignments);
+
+  // 10000~10000 ends closer to 16384 than 24576
+  ASSERT_EXTENT(10000, 6384, r.update(0, 10000, 1 << 30));
+}
+
+TEST(Readahead, Pending) {
+  Readahead r;
+  r.inc_pending(2);
+  r.dec_pending();
+  r.dec_pending();
+  r.wait_for_pending();
+}
@@ -0,0 +1,84 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * LGPL2.1 (see COPYING-LGPL2.1) or later
+ */
+
+#include <gtest/gtest.h>
+
+#include "common/bit_vector.hpp"
+
+typedef ceph::BitVector<2> BitVector2;
+
+TEST(BitVector, GetSet) {
+  BitVector2 bv;
+  ASSERT_EQ(0u, bv.size());
+  bv.resize(11);
+  ASSERT_EQ(11u, bv.size());
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    ASSERT_EQ(0, bv.get(i));
+
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    bv.set(i, i % 4);
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    ASSERT_EQ(i % 4, bv.get(i));
+
+  bv.set(5, 0);
+  ASSERT_EQ(0, bv.get(5));
+  ASSERT_EQ(0, bv.get(4));
+  ASSERT_EQ(2, bv.get(6));
+}
+
+TEST(BitVector, Resize) {
+  BitVector2 bv;
+  bv.resize(8);
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    bv.set(i, 3);
+
+  // shrinking clears the bits past the end, so growing again
+  // yields zeroed elements
+  bv.resize(5);
+  bv.resize(8);
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    ASSERT_EQ(i < 5 ? 3 : 0, bv.get(i));
+
+  bv.clear();
+  ASSERT_EQ(0u, bv.size());
+}
+
+TEST(BitVector, EncodeDecode) {
+  BitVector2 bv;
+  bv.resize(10);
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    bv.set(i, (i * 7) % 4);
+
+  bufferlist bl;
+  bv.encode_data(bl);
+  ASSERT_EQ(BitVector2::get_byte_count(10), bl.length());
+  ASSERT_EQ(3u, bl.length());
+
+  BitVector2 bv2;
+  bv2.decode_data(bl, 10);
+  ASSERT_EQ(10u, bv2.size());
+  for (uint64_t i = 0; i < bv.size(); ++i)
+    ASSERT_EQ(bv.get(i), bv2.get(i));
+
+  // missing bytes decode as zero, extra ones are ignored
+  bv2.decode_data(bl, 16);
+  ASSERT_EQ(0, bv2.get(15));
+  ASSERT_EQ(bv.get(9), bv2.get(9));
+  bv2.decode_data(bl, 3);
+  ASSERT_EQ(3u, bv2.size());
+  ASSERT_EQ(bv.get(2), bv2.get(2));
+
+  // a byte range covers the elements it contains
+  bufferlist range;
+  bv.encode_data(range, BitVector2::get_byte_offset(5), 1);
+  ASSERT_EQ(1u, range.length());
+  BitVector2 bv3;
+  bv3.decode_data(range, 4);
+  for (uint64_t i = 0; i < 4; ++i)
+    ASSERT_EQ(bv.get(4 + i), bv3.get(i));
+}
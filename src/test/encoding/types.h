@@ -222,6 +222,7 @@ TYPE(EUpdate)
 #include "rgw/rgw_rados.h"
 TYPE(RGWObjManifestPart)
 TYPE(RGWObjManifest)
+TYPE(RGWCompressionInfo)
 
 #include "rgw/rgw_acl.h"
 TYPE(ACLPermission)
@@ -248,6 +249,7 @@ TYPE(rgw_bucket_entry_ver)
 #include "cls/rgw/cls_rgw_ops.h"
 TYPE(rgw_cls_obj_prepare_op)
 TYPE(rgw_cls_obj_complete_op)
+TYPE(rgw_cls_obj_complete_ops)
 TYPE(rgw_cls_list_op)
 TYPE(rgw_cls_list_ret)
 TYPE(cls_rgw_gc_defer_entry_op)
@@ -0,0 +1,105 @@
+#!/bin/bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source test/mon/mon-test-helpers.sh
+source test/osd/osd-test-helpers.sh
+
+function run() {
+    local dir=$1
+
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=127.0.0.1 "
+
+    setup $dir || return 1
+    run_mon $dir a --public-addr 127.0.0.1 || return 1
+    # overwrites must read the old stripes back from the shards
+    for id in $(seq 0 3) ; do
+        run_osd $dir $id \
+            --osd-ec-extent-cache-size=0 \
+            --filestore-debug-inject-read-err=true || return 1
+    done
+    FUNCTIONS=${FUNCTIONS:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for TEST_function in $FUNCTIONS ; do
+        if ! $TEST_function $dir ; then
+            cat $dir/a/log
+            return 1
+        fi
+    done
+    teardown $dir || return 1
+}
+
+function get_osds() {
+    local poolname=$1
+    local objectname=$2
+
+    ./ceph osd map $poolname $objectname | \
+       perl -p -e 's/.*up \(\[(.*?)\].*/$1/; s/,/ /g'
+}
+
+function set_inject_read_err() {
+    local value=$1
+    shift
+
+    for osd in "$@" ; do
+        ./ceph tell osd.$osd injectargs -- \
+            --filestore-debug-inject-read-err=$value || return 1
+    done
+}
+
+function TEST_rados_overwrite_shard_eio() {
+    local dir=$1
+    local poolname=pool-overwrite-eio
+
+    ./ceph osd erasure-code-profile set profile-eio \
+        ruleset-failure-domain=osd || return 1
+    ./ceph osd pool create $poolname 12 12 erasure profile-eio \
+        || return 1
+    ./ceph osd pool set $poolname ec_overwrites true || return 1
+
+    local stripe_width=$(./ceph-conf --show-config-value osd_pool_erasure_code_stripe_width)
+    dd if=/dev/urandom of=$dir/ORIGINAL bs=$stripe_width count=2
+    ./rados --pool $poolname put OBJ $dir/ORIGINAL || return 1
+
+    #
+    # the first OSD of the up set holds shard 0, which the overwrite of
+    # the first stripe would read: it must be read from the parity
+    # shard instead
+    #
+    local -a osds=($(get_osds $poolname OBJ))
+    ./ceph daemon osd.${osds[0]} injectdataerr $poolname OBJ 0 || return 1
+
+    echo -n OVERWRITTEN > $dir/PATCH
+    ./rados --pool $poolname put OBJ $dir/PATCH --offset 100 || return 1
+    dd if=$dir/PATCH of=$dir/ORIGINAL bs=1 seek=100 conv=notrunc
+    grep --quiet "failed to read .*OBJ" $dir/osd-${osds[0]}.log || return 1
+
+    # a client read of the same shard fails rather than taking the osd down
+    ! ./rados --pool $poolname get OBJ $dir/COPY || return 1
+    ./ceph osd dump | grep "osd.${osds[0]} up" || return 1
+
+    set_inject_read_err false ${osds[@]} || return 1
+    ./rados --pool $poolname get OBJ $dir/COPY || return 1
+    diff $dir/ORIGINAL $dir/COPY || return 1
+    set_inject_read_err true ${osds[@]} || return 1
+
+    rm $dir/ORIGINAL $dir/PATCH $dir/COPY
+    ./ceph osd pool delete $poolname $poolname --yes-i-really-really-mean-it
+    ./ceph osd erasure-code-profile rm profile-eio
+}
+
+main test-erasure-eio
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/erasure-code/test-erasure-eio.sh"
+# End:
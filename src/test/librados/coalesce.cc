@@ -0,0 +1,192 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "include/rados/librados.hpp"
+#include "test/librados/test.h"
+
+#include <errno.h>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include "gtest/gtest.h"
+
+using namespace librados;
+using std::map;
+using std::string;
+using std::vector;
+
+/**
+ * Bursts of small aio writes to one object, with and without
+ * objecter_coalesce_writes: each op must still get its own result and
+ * land in order, and the bench reports ops/s for each mode.
+ */
+
+static const int BENCH_OPS = 2000;
+static const int BURST_OPS = 100;
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+class LibRadosCoalesce : public ::testing::Test {
+protected:
+  Rados cluster;
+  IoCtx ioctx;
+  string pool_name;
+
+  void connect(bool coalesce) {
+    pool_name = get_temp_pool_name();
+    ASSERT_EQ(0, cluster.init(NULL));
+    ASSERT_EQ(0, cluster.conf_read_file(NULL));
+    ASSERT_EQ(0, cluster.conf_parse_env(NULL));
+    ASSERT_EQ(0, cluster.conf_set("objecter_coalesce_writes",
+				  coalesce ? "true" : "false"));
+    ASSERT_EQ(0, cluster.connect());
+    ASSERT_EQ(0, cluster.pool_create(pool_name.c_str()));
+    ASSERT_EQ(0, cluster.ioctx_create(pool_name.c_str(), ioctx));
+  }
+
+  virtual void TearDown() {
+    ioctx.close();
+    if (pool_name.length())
+      ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
+  }
+};
+
+static void omap_op(ObjectWriteOperation *op, int i)
+{
+  std::ostringstream key;
+  key << "key" << i;
+  map<string, bufferlist> m;
+  m[key.str()].append(key.str());
+  op->omap_set(m);
+}
+
+static double bench(IoCtx &ioctx, const string& oid)
+{
+  vector<AioCompletion*> c(BENCH_OPS);
+  double start = now();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    ObjectWriteOperation op;
+    omap_op(&op, i);
+    c[i] = Rados::aio_create_completion();
+    EXPECT_EQ(0, ioctx.aio_operate(oid, c[i], &op));
+  }
+  for (int i = 0; i < BENCH_OPS; i++) {
+    c[i]->wait_for_safe();
+    EXPECT_EQ(0, c[i]->get_return_value());
+    c[i]->release();
+  }
+  double elapsed = now() - start;
+  return elapsed > 0 ? BENCH_OPS / elapsed : 0;
+}
+
+TEST_F(LibRadosCoalesce, ResultsAndOrder) {
+  connect(true);
+  bufferlist v1;
+  v1.append("1");
+  ASSERT_EQ(0, ioctx.setxattr("obj", "ver", v1));
+
+  // every tenth op is guarded by a compare that fails
+  vector<AioCompletion*> c(BURST_OPS);
+  for (int i = 0; i < BURST_OPS; i++) {
+    ObjectWriteOperation op;
+    if (i % 10 == 5)
+      op.cmpxattr("ver", LIBRADOS_CMPXATTR_OP_EQ, bufferlist());
+    std::ostringstream data;
+    data << i << ",";
+    bufferlist bl;
+    bl.append(data.str());
+    op.append(bl);
+    omap_op(&op, i);
+    c[i] = Rados::aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate("obj", c[i], &op));
+  }
+
+  std::ostringstream expected;
+  for (int i = 0; i < BURST_OPS; i++) {
+    c[i]->wait_for_safe();
+    if (i % 10 == 5) {
+      ASSERT_EQ(-ECANCELED, c[i]->get_return_value());
+    } else {
+      ASSERT_EQ(0, c[i]->get_return_value());
+      expected << i << ",";
+    }
+    c[i]->release();
+  }
+
+  bufferlist bl;
+  ASSERT_EQ((int)expected.str().length(),
+	    ioctx.read("obj", bl, expected.str().length() + 1, 0));
+  ASSERT_EQ(expected.str(), string(bl.c_str(), bl.length()));
+
+  map<string, bufferlist> vals;
+  ASSERT_EQ(0, ioctx.omap_get_vals("obj", "", BURST_OPS * 2, &vals));
+  ASSERT_EQ((unsigned)(BURST_OPS - BURST_OPS / 10), vals.size());
+  ASSERT_EQ(0u, vals.count("key5"));
+}
+
+TEST_F(LibRadosCoalesce, FailingGuardInBurst) {
+  connect(true);
+  bufferlist v;
+  v.append("0");
+  ASSERT_EQ(0, ioctx.setxattr("obj", "ver", v));
+
+  // op i expects ver == i and bumps it; op GUARD_FAIL expects a value
+  // that is never set, so it and only it must fail, while the ops
+  // after it see the version left by the one before it
+  const int GUARD_FAIL = BURST_OPS / 2;
+  vector<AioCompletion*> c(BURST_OPS);
+  int ver = 0;
+  for (int i = 0; i < BURST_OPS; i++) {
+    ObjectWriteOperation op;
+    std::ostringstream cur, next;
+    cur << (i == GUARD_FAIL ? -1 : ver);
+    next << (i == GUARD_FAIL ? ver : ver + 1);
+    if (i != GUARD_FAIL)
+      ++ver;
+    bufferlist cmp, set;
+    cmp.append(cur.str());
+    set.append(next.str());
+    op.cmpxattr("ver", LIBRADOS_CMPXATTR_OP_EQ, cmp);
+    op.setxattr("ver", set);
+    omap_op(&op, i);
+    c[i] = Rados::aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate("obj", c[i], &op));
+  }
+
+  for (int i = 0; i < BURST_OPS; i++) {
+    c[i]->wait_for_safe();
+    ASSERT_EQ(i == GUARD_FAIL ? -ECANCELED : 0, c[i]->get_return_value());
+    c[i]->release();
+  }
+
+  std::ostringstream expected;
+  expected << ver;
+  bufferlist bl;
+  ASSERT_EQ((int)expected.str().length(), ioctx.getxattr("obj", "ver", bl));
+  ASSERT_EQ(expected.str(), string(bl.c_str(), bl.length()));
+
+  map<string, bufferlist> vals;
+  ASSERT_EQ(0, ioctx.omap_get_vals("obj", "", BURST_OPS * 2, &vals));
+  ASSERT_EQ((unsigned)(BURST_OPS - 1), vals.size());
+  std::ostringstream failed;
+  failed << "key" << GUARD_FAIL;
+  ASSERT_EQ(0u, vals.count(failed.str()));
+}
+
+TEST_F(LibRadosCoalesce, BenchOff) {
+  connect(false);
+  std::cout << "coalesce off: " << bench(ioctx, "bench") << " ops/s" << std::endl;
+}
+
+TEST_F(LibRadosCoalesce, BenchOn) {
+  connect(true);
+  std::cout << "coalesce on : " << bench(ioctx, "bench") << " ops/s" << std::endl;
+}
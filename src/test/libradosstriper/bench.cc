@@ -0,0 +1,68 @@
+#include "include/rados/librados.hpp"
+#include "include/radosstriper/libradosstriper.hpp"
+#include "test/librados/test.h"
+#include "test/libradosstriper/TestCase.h"
+
+#include <iostream>
+#include <sys/time.h>
+#include "gtest/gtest.h"
+
+using namespace librados;
+using namespace libradosstriper;
+using std::string;
+
+/**
+ * Small sequential writes then reads of a striped object, with and
+ * without rados_striper_lockless, reporting ops/s for each.
+ */
+
+static const int BENCH_OPS = 1000;
+static const size_t BENCH_IO_SIZE = 4096;
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double bench(RadosStriper &striper, const string& soid, bool write)
+{
+  char buf[BENCH_IO_SIZE];
+  memset(buf, 0xcc, sizeof(buf));
+  double start = now();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    bufferlist bl;
+    if (write) {
+      bl.append(buf, sizeof(buf));
+      EXPECT_EQ(0, striper.write(soid, bl, sizeof(buf), i * sizeof(buf)));
+    } else {
+      EXPECT_EQ((int)sizeof(buf), striper.read(soid, &bl, sizeof(buf), i * sizeof(buf)));
+    }
+  }
+  double elapsed = now() - start;
+  return elapsed > 0 ? BENCH_OPS / elapsed : 0;
+}
+
+static void run_bench(Rados &cluster, IoCtx &ioctx, const string& soid, bool lockless)
+{
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_lockless", lockless ? "true" : "false"));
+  RadosStriper striper;
+  int rc = RadosStriper::striper_create(ioctx, &striper);
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_lockless", "false"));
+  ASSERT_EQ(0, rc);
+  double write_ops = bench(striper, soid, true);
+  double read_ops = bench(striper, soid, false);
+  std::cout << (lockless ? "lockless" : "locked  ")
+	    << " : " << BENCH_IO_SIZE << " byte writes " << write_ops << " ops/s, "
+	    << "reads " << read_ops << " ops/s" << std::endl;
+  ASSERT_EQ(0, striper.remove(soid));
+}
+
+TEST_F(StriperTestPP, BenchLocked) {
+  run_bench(cluster, ioctx, "BenchLocked", false);
+}
+
+TEST_F(StriperTestPP, BenchLockless) {
+  run_bench(cluster, ioctx, "BenchLockless", true);
+}
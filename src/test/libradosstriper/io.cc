@@ -390,3 +390,34 @@ TEST_F(StriperTestPP, XattrListPP) {
     }
   }
 }
+
+TEST_F(StriperTestPP, LocklessPP) {
+  // a second client, in lockless mode
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_lockless", "true"));
+  RadosStriper lockless;
+  int rc = RadosStriper::striper_create(ioctx, &lockless);
+  ASSERT_EQ(0, cluster.conf_set("rados_striper_lockless", "false"));
+  ASSERT_EQ(0, rc);
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl;
+  bl.append(buf, sizeof(buf));
+  // writes update the size
+  ASSERT_EQ(0, lockless.write("LocklessPP", bl, sizeof(buf), 0));
+  ASSERT_EQ(0, lockless.write("LocklessPP", bl, sizeof(buf), sizeof(buf)));
+  uint64_t psize;
+  time_t pmtime;
+  ASSERT_EQ(0, striper.stat("LocklessPP", &psize, &pmtime));
+  ASSERT_EQ(2 * sizeof(buf), psize);
+  // growth by another client is seen
+  ASSERT_EQ(0, striper.append("LocklessPP", bl, sizeof(buf)));
+  bufferlist bl2;
+  ASSERT_EQ((int)(3 * sizeof(buf)), lockless.read("LocklessPP", &bl2, 4 * sizeof(buf), 0));
+  // truncation by another client invalidates the cached size
+  ASSERT_EQ(0, striper.trunc("LocklessPP", sizeof(buf) / 2));
+  bufferlist bl3;
+  ASSERT_EQ((int)(sizeof(buf) / 2), lockless.read("LocklessPP", &bl3, sizeof(buf), 0));
+  ASSERT_EQ(0, memcmp(bl3.c_str(), buf, sizeof(buf) / 2));
+  ASSERT_EQ(0, lockless.remove("LocklessPP"));
+  ASSERT_EQ(-ENOENT, striper.stat("LocklessPP", &psize, &pmtime));
+}
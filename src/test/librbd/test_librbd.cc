@@ -1855,6 +1855,62 @@ TEST(LibRBD, ZeroLengthRead)
   ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
 }
 
+TEST(LibRBD, CopyOnReadPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+  ASSERT_EQ(0, rados.conf_set("rbd_clone_copy_on_read", "true"));
+
+  {
+    librbd::RBD rbd;
+    librbd::Image parent;
+    int order = 0;
+    uint64_t features = RBD_FEATURE_LAYERING;
+    char test_data[] = "testdata";
+    bufferlist bl;
+    bl.append(test_data, strlen(test_data));
+
+    ASSERT_EQ(0, rbd.create2(ioctx, "parent", 4 << 20, features, &order));
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    ASSERT_EQ((ssize_t)bl.length(), parent.write(0, bl.length(), bl));
+    ASSERT_EQ(0, parent.snap_create("parent_snap"));
+    ASSERT_EQ(0, parent.snap_protect("parent_snap"));
+    ASSERT_EQ(0, rbd.clone(ioctx, "parent", "parent_snap", ioctx, "child",
+			   features, &order));
+
+    string oid;
+    uint64_t size;
+    time_t mtime;
+    {
+      librbd::Image child;
+      ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+      librbd::image_info_t info;
+      ASSERT_EQ(0, child.stat(info, sizeof(info)));
+      oid = string(info.block_name_prefix) + ".0000000000000000";
+      ASSERT_EQ(-ENOENT, ioctx.stat(oid, &size, &mtime));
+
+      // a read served by the parent copies the whole object up
+      read_test_data(child, test_data, 0, strlen(test_data));
+    }
+    // closing waited for the copyup
+    ASSERT_EQ(0, ioctx.stat(oid, &size, &mtime));
+    ASSERT_EQ(4u << 20, size);
+
+    {
+      librbd::Image child;
+      ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+      read_test_data(child, test_data, 0, strlen(test_data));
+    }
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
 int main(int argc, char **argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -200,17 +200,22 @@ class VarLenGenerator : public RandGenerator {
   uint64_t max_length;
   uint64_t min_stride_size;
   uint64_t max_stride_size;
+  uint64_t min_length;
 public:
   VarLenGenerator(
-    uint64_t length, uint64_t min_stride_size, uint64_t max_stride_size) :
+    uint64_t length, uint64_t min_stride_size, uint64_t max_stride_size,
+    uint64_t min_length = 0) :
     max_length(length),
     min_stride_size(min_stride_size),
-    max_stride_size(max_stride_size) {}
+    max_stride_size(max_stride_size),
+    min_length(min_length) {}
   void get_ranges_map(
     const ContDesc &cont, map<uint64_t, uint64_t> &out);
   uint64_t get_length(const ContDesc &in) {
     RandWrap rand(in.seqnum);
-    return (rand() % max_length);
+    if (max_length <= min_length)
+      return min_length;
+    return min_length + (rand() % (max_length - min_length));
   }
 };
 
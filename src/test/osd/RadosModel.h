@@ -177,6 +177,8 @@ public:
   const uint64_t max_stride_size;
   AttrGenerator attr_gen;
   const bool no_omap;
+  /// ec pools with overwrites still don't take truncate
+  const bool no_truncate;
   bool pool_snaps;
   int snapname_num;
 
@@ -186,6 +188,7 @@ public:
 		   uint64_t min_stride_size,
 		   uint64_t max_stride_size,
 		   bool no_omap,
+		   bool no_truncate,
 		   bool pool_snaps,
 		   const char *id = 0) :
     state_lock("Context Lock"),
@@ -201,6 +204,7 @@ public:
     min_stride_size(min_stride_size), max_stride_size(max_stride_size),
     attr_gen(2000),
     no_omap(no_omap),
+    no_truncate(no_truncate),
     pool_snaps(pool_snaps),
     snapname_num(0)
   {
@@ -732,6 +736,17 @@ public:
 	context->min_stride_size,
 	context->max_stride_size,
 	3);
+    } else if (context->no_truncate) {
+      // the object can't shrink, so the new contents must cover the
+      // old; everything below the old length is still checked on read
+      ObjectDesc old_value;
+      bool found = context->find_object(oid, &old_value);
+      uint64_t prev_length = found && old_value.has_contents() ?
+	old_value.most_recent_gen()->get_length(old_value.most_recent()) :
+	0;
+      cont_gen = new VarLenGenerator(
+	context->max_size, context->min_stride_size, context->max_stride_size,
+	prev_length);
     } else {
       cont_gen = new VarLenGenerator(
 	context->max_size, context->min_stride_size, context->max_stride_size);
@@ -793,7 +808,7 @@ public:
     waiting.insert(completion);
     waiting_on++;
     write_op.setxattr("_header", contbl);
-    if (!do_append) {
+    if (!do_append && !context->no_truncate) {
       write_op.truncate(cont_gen->get_length(cont));
     }
     context->io_ctx.aio_operate(
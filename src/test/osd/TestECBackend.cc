@@ -58,3 +58,210 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+
+TEST(ECUtil, partial_stripes)
+{
+  const uint64_t swidth = 4096;
+  ECUtil::stripe_info_t s(4, swidth);
+
+  ASSERT_TRUE(s.covers_stripe(swidth, 0, 2*swidth));
+  ASSERT_TRUE(s.covers_stripe(swidth, swidth, swidth));
+  ASSERT_FALSE(s.covers_stripe(swidth, swidth + 1, swidth));
+  ASSERT_FALSE(s.covers_stripe(0, 0, swidth - 1));
+
+  set<uint64_t> out;
+  // aligned overwrite needs no reads
+  s.get_partial_stripes(swidth, swidth, 4*swidth, &out);
+  ASSERT_TRUE(out.empty());
+
+  // small write inside one stripe
+  s.get_partial_stripes(swidth + 10, 20, 4*swidth, &out);
+  ASSERT_EQ(1u, out.size());
+  ASSERT_EQ(swidth, *out.begin());
+  out.clear();
+
+  // unaligned at both ends, the middle stripe is fully overwritten
+  s.get_partial_stripes(10, 2*swidth, 4*swidth, &out);
+  ASSERT_EQ(2u, out.size());
+  ASSERT_TRUE(out.count(0));
+  ASSERT_TRUE(out.count(2*swidth));
+  out.clear();
+
+  // nothing to read beyond the old size
+  s.get_partial_stripes(swidth + 10, 2*swidth, 2*swidth, &out);
+  ASSERT_EQ(1u, out.size());
+  ASSERT_EQ(swidth, *out.begin());
+}
+
+TEST(ECUtil, HashInfo_overwrite)
+{
+  ECUtil::HashInfo hinfo(3);
+  map<int, bufferlist> to_append;
+  for (int i = 0; i < 3; ++i)
+    to_append[i].append_zero(1024);
+  hinfo.append(0, to_append);
+  ASSERT_TRUE(hinfo.has_chunk_hash());
+
+  hinfo.set_total_chunk_size_clear_hash(2048);
+  ASSERT_FALSE(hinfo.has_chunk_hash());
+  ASSERT_EQ(2048u, hinfo.get_total_chunk_size());
+
+  // appends after an overwrite only track the size
+  hinfo.append(2048, to_append);
+  ASSERT_EQ(3072u, hinfo.get_total_chunk_size());
+  ASSERT_FALSE(hinfo.has_chunk_hash());
+
+  // a recreated object gets its hashes back
+  hinfo.clear();
+  ASSERT_TRUE(hinfo.has_chunk_hash());
+  ASSERT_EQ(0u, hinfo.get_total_chunk_size());
+}
+
+TEST(ECUtil, ExtentCache)
+{
+  const uint64_t swidth = 4096;
+  ECUtil::ExtentCache cache(4*swidth);
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  hobject_t b(sobject_t("b", CEPH_NOSNAP));
+
+  map<uint64_t, bufferlist> stripes;
+  stripes[0].append_zero(swidth);
+  stripes[swidth].append_zero(swidth);
+  cache.insert(a, stripes);
+  ASSERT_EQ(2*swidth, cache.get_bytes());
+
+  set<uint64_t> want;
+  want.insert(0);
+  want.insert(2*swidth);
+  map<uint64_t, bufferlist> out;
+  cache.lookup(a, &want, &out);
+  ASSERT_EQ(1u, out.size());
+  ASSERT_TRUE(out.count(0));
+  ASSERT_EQ(1u, want.size());
+  ASSERT_TRUE(want.count(2*swidth));
+
+  // pinned objects survive trimming
+  cache.pin(a);
+  map<uint64_t, bufferlist> more;
+  for (uint64_t off = 0; off < 4*swidth; off += swidth)
+    more[off].append_zero(swidth);
+  cache.insert(b, more);
+  ASSERT_EQ(2*swidth, cache.get_bytes());
+  ASSERT_TRUE(cache.is_pinned(a));
+
+  cache.unpin(a);
+  ASSERT_FALSE(cache.is_pinned(a));
+  cache.invalidate(a);
+  ASSERT_EQ(0u, cache.get_bytes());
+  ASSERT_TRUE(cache.empty());
+}
+
+TEST(ECUtil, logical_to_chunk_extent)
+{
+  const uint64_t swidth = 4096;
+  ECUtil::stripe_info_t s(4, swidth);
+  const uint64_t csize = s.get_chunk_size();
+  pair<uint64_t, uint64_t> out;
+
+  // within one chunk of the second stripe
+  ASSERT_TRUE(s.logical_to_chunk_extent(1, swidth + csize + 10, 20, &out));
+  ASSERT_EQ(make_pair(csize + 10, (uint64_t)20), out);
+  ASSERT_FALSE(s.logical_to_chunk_extent(0, swidth + csize + 10, 20, &out));
+  ASSERT_FALSE(s.logical_to_chunk_extent(2, swidth + csize + 10, 20, &out));
+
+  // across a stripe boundary: tail of chunk 3, head of chunk 0
+  ASSERT_TRUE(s.logical_to_chunk_extent(3, swidth - 10, 20, &out));
+  ASSERT_EQ(make_pair(csize - 10, (uint64_t)10), out);
+  ASSERT_TRUE(s.logical_to_chunk_extent(0, swidth - 10, 20, &out));
+  ASSERT_EQ(make_pair(csize, (uint64_t)10), out);
+  ASSERT_FALSE(s.logical_to_chunk_extent(1, swidth - 10, 20, &out));
+
+  // several stripes, chunk 1 is not touched in the last one
+  ASSERT_TRUE(s.logical_to_chunk_extent(1, csize + 5, 2*swidth - 10, &out));
+  ASSERT_EQ(make_pair((uint64_t)5, 2*csize - 5), out);
+  ASSERT_TRUE(s.logical_to_chunk_extent(0, csize + 5, 2*swidth - 10, &out));
+  ASSERT_EQ(make_pair(csize, 2*csize - 5), out);
+}
+
+TEST(ECUtil, reassemble)
+{
+  const uint64_t swidth = 4096;
+  ECUtil::stripe_info_t s(4, swidth);
+
+  bufferlist logical;
+  for (unsigned i = 0; i < 3*swidth; ++i)
+    logical.append((char)(i % 251));
+
+  // split into data chunks the way the encoder lays them out
+  map<unsigned, bufferlist> chunks;
+  for (uint64_t off = 0; off < logical.length(); off += s.get_chunk_size()) {
+    bufferlist bl;
+    bl.substr_of(logical, off, s.get_chunk_size());
+    chunks[(off % swidth) / s.get_chunk_size()].claim_append(bl);
+  }
+
+  uint64_t off = swidth - 100, len = swidth + 300;
+  map<unsigned, pair<uint64_t, bufferlist> > read;
+  for (unsigned i = 0; i < 4; ++i) {
+    pair<uint64_t, uint64_t> extent;
+    if (!s.logical_to_chunk_extent(i, off, len, &extent))
+      continue;
+    read[i].first = extent.first;
+    read[i].second.substr_of(chunks[i], extent.first, extent.second);
+  }
+  bufferlist out;
+  ECUtil::reassemble(s, read, off, len, &out);
+  bufferlist expected;
+  expected.substr_of(logical, off, len);
+  ASSERT_EQ(len, out.length());
+  ASSERT_TRUE(out.contents_equal(expected));
+}
+
+TEST(ECUtil, reassemble_past_eof)
+{
+  const uint64_t swidth = 4096;
+  ECUtil::stripe_info_t s(4, swidth);
+
+  bufferlist logical;
+  for (unsigned i = 0; i < 2*swidth; ++i)
+    logical.append((char)(i % 251));
+
+  map<unsigned, bufferlist> chunks;
+  for (uint64_t off = 0; off < logical.length(); off += s.get_chunk_size()) {
+    bufferlist bl;
+    bl.substr_of(logical, off, s.get_chunk_size());
+    chunks[(off % swidth) / s.get_chunk_size()].claim_append(bl);
+  }
+
+  // the shards only return what they hold, like copy-get reading out_max
+  uint64_t off = swidth + 100, len = 4*swidth;
+  map<unsigned, pair<uint64_t, bufferlist> > read;
+  for (unsigned i = 0; i < 4; ++i) {
+    pair<uint64_t, uint64_t> extent;
+    if (!s.logical_to_chunk_extent(i, off, len, &extent))
+      continue;
+    read[i].first = extent.first;
+    if (extent.first < chunks[i].length())
+      read[i].second.substr_of(
+	chunks[i], extent.first,
+	MIN(extent.second, chunks[i].length() - extent.first));
+  }
+  bufferlist out;
+  ECUtil::reassemble(s, read, off, len, &out);
+  bufferlist expected;
+  expected.substr_of(logical, off, logical.length() - off);
+  ASSERT_EQ(logical.length() - off, out.length());
+  ASSERT_TRUE(out.contents_equal(expected));
+
+  // starting beyond the end
+  read.clear();
+  out.clear();
+  off = 3*swidth;
+  for (unsigned i = 0; i < 4; ++i) {
+    pair<uint64_t, uint64_t> extent;
+    if (s.logical_to_chunk_extent(i, off, swidth, &extent))
+      read[i].first = extent.first;
+  }
+  ECUtil::reassemble(s, read, off, swidth, &out);
+  ASSERT_EQ(0u, out.length());
+}
@@ -400,3 +400,50 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
     osdmap.set_primary_affinity(1, 0x10000);
   }
 }
+
+TEST_F(OSDMapTest, ShallowCopySharesUnchanged) {
+  set_up_map();
+
+  pg_t rawpg(0, 0, -1);
+  pg_t pgid = osdmap.raw_pg_to_pg(rawpg);
+  vector<int> up_osds, acting_osds;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+
+  vector<int> new_acting_osds(acting_osds);
+  int first = new_acting_osds[0];
+  new_acting_osds[0] = *new_acting_osds.rbegin();
+  *new_acting_osds.rbegin() = first;
+
+  // next epoch only changes pg_temp
+  OSDMap next;
+  next.shallow_copy_from(osdmap);
+  OSDMap::Incremental pgtemp_map(osdmap.get_epoch() + 1);
+  pgtemp_map.new_pg_temp[pgid] = new_acting_osds;
+  next.apply_incremental(pgtemp_map);
+
+  EXPECT_EQ(osdmap.crush, next.crush);
+  EXPECT_EQ(&osdmap.get_pools(), &next.get_pools());
+  EXPECT_EQ(&osdmap.get_addr(0), &next.get_addr(0));
+
+  // ...and the previous epoch does not see the change
+  vector<int> old_acting_osds;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &old_acting_osds, &acting_primary);
+  EXPECT_EQ(acting_osds, old_acting_osds);
+  next.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                            &acting_osds, &acting_primary);
+  EXPECT_EQ(new_acting_osds, acting_osds);
+
+  // a pool change gives next its own pool map
+  OSDMap::Incremental pool_inc(next.get_epoch() + 1);
+  pg_pool_t *p = pool_inc.get_new_pool(0, next.get_pg_pool(0));
+  p->set_pg_num(p->get_pg_num() * 2);
+  OSDMap last;
+  last.shallow_copy_from(next);
+  last.apply_incremental(pool_inc);
+  EXPECT_NE(&next.get_pools(), &last.get_pools());
+  EXPECT_EQ(p->get_pg_num(), last.get_pg_pool(0)->get_pg_num());
+  EXPECT_NE(p->get_pg_num(), next.get_pg_pool(0)->get_pg_num());
+}
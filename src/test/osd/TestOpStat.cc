@@ -45,6 +45,7 @@ std::ostream & operator<<(std::ostream &out, TestOpStat &rhs)
     latency[50] = 0;
     latency[90] = 0;
     latency[99] = 0;
+    latency[100] = 0;
     i->second.export_latencies(latency);
     
     out << i->first << " latency: " << std::endl;
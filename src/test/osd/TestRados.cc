@@ -264,6 +264,7 @@ int main(int argc, char **argv)
   map<TestOpType, unsigned int> op_weights;
   string pool_name = "rbd";
   bool ec_pool = false;
+  bool ec_overwrites = false;
   bool no_omap = false;
 
   for (int i = 1; i < argc; ++i) {
@@ -294,6 +295,16 @@ int main(int argc, char **argv)
       }
       ec_pool = true;
       no_omap = true;
+    } else if (strcmp(argv[i], "--ec-pool-overwrites") == 0) {
+      // the pool must have been created with ec_overwrites set
+      if (!op_weights.empty()) {
+	cerr << "--ec-pool-overwrites must be specified prior to any ops"
+	     << std::endl;
+	exit(1);
+      }
+      ec_pool = true;
+      ec_overwrites = true;
+      no_omap = true;
     } else if (strcmp(argv[i], "--op") == 0) {
       i++;
       if (i == argc) {
@@ -320,7 +331,7 @@ int main(int argc, char **argv)
 	cerr << "Weights must be nonnegative." << std::endl;
 	return 1;
       } else if (weight > 0) {
-	if (ec_pool && !op_types[j].ec_pool_valid) {
+	if (ec_pool && !ec_overwrites && !op_types[j].ec_pool_valid) {
 	  cerr << "Error: cannot use op type " << op_types[j].name
 	       << " with --ec-pool" << std::endl;
 	  exit(1);
@@ -381,6 +392,7 @@ int main(int argc, char **argv)
     min_stride_size,
     max_stride_size,
     no_omap,
+    ec_overwrites,
     pool_snaps,
     id);
 
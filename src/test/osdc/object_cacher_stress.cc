@@ -11,7 +11,9 @@
 #include "common/ceph_argparse.h"
 #include "common/common_init.h"
 #include "common/config.h"
+#include "common/Clock.h"
 #include "common/Mutex.h"
+#include "common/Thread.h"
 #include "common/snap_types.h"
 #include "global/global_init.h"
 #include "include/atomic.h"
@@ -50,31 +52,120 @@ public:
   }
 };
 
+// an independently locked cache, as librbd uses with rbd_cache_shards
+struct cache_shard {
+  Mutex lock;
+  FakeWriteback writeback;
+  ObjectCacher obc;
+  ObjectCacher::ObjectSet object_set;
+
+  cache_shard(int i, uint64_t delay_ns, int num_shards)
+    : lock("object_cacher_stress::object_cacher"),
+      writeback(g_ceph_context, &lock, delay_ns),
+      obc(g_ceph_context, "test" + stringify(i), writeback, lock, NULL, NULL,
+	  g_conf->client_oc_size / num_shards,
+	  g_conf->client_oc_max_objects / num_shards + 1,
+	  g_conf->client_oc_max_dirty / num_shards,
+	  g_conf->client_oc_target_dirty / num_shards,
+	  g_conf->client_oc_max_dirty_age,
+	  true),
+      object_set(NULL, 0, 0) {}
+};
+
+struct stress_params {
+  uint64_t num_ops;
+  uint64_t num_objs;
+  uint64_t max_obj_size;
+  uint64_t max_op_len;
+  float percent_reads;
+  bool verbose;
+};
+
+class StressThread : public Thread {
+public:
+  StressThread(const stress_params &params,
+	       vector<cache_shard*> &shards, const ceph::bufferlist &bl,
+	       atomic_t *outstanding_reads)
+    : m_params(params), m_shards(shards), m_bl(bl),
+      m_outstanding_reads(outstanding_reads) {}
+
+  vector<ceph::shared_ptr<op_data> > ops;
+
+  void *entry() {
+    SnapContext snapc;
+    for (uint64_t i = 0; i < m_params.num_ops; ++i) {
+      uint64_t offset = random() % m_params.max_obj_size;
+      uint64_t max_len = MIN(m_params.max_obj_size - offset,
+			     m_params.max_op_len);
+      // no zero-length operations
+      uint64_t length = random() % (MAX(max_len - 1, 1)) + 1;
+      uint64_t obj = random() % m_params.num_objs;
+      std::string oid = "test" + stringify(obj);
+      bool is_read = random() < m_params.percent_reads * RAND_MAX;
+      ceph::shared_ptr<op_data> op(new op_data(oid, offset, length, is_read));
+      ops.push_back(op);
+      if (m_params.verbose)
+	std::cout << "op " << i << " " << (is_read ? "read" : "write")
+		  << " " << op->extent << "\n";
+
+      cache_shard *shard = m_shards[obj % m_shards.size()];
+      if (op->is_read) {
+	ObjectCacher::OSDRead *rd = shard->obc.prepare_read(CEPH_NOSNAP,
+							    &op->result, 0);
+	rd->extents.push_back(op->extent);
+	m_outstanding_reads->inc();
+	Context *completion = new C_Count(op.get(), m_outstanding_reads);
+	shard->lock.Lock();
+	int r = shard->obc.readx(rd, &shard->object_set, completion);
+	shard->lock.Unlock();
+	assert(r >= 0);
+	if ((uint64_t)r == length)
+	  completion->complete(r);
+	else
+	  assert(r == 0);
+      } else {
+	ObjectCacher::OSDWrite *wr = shard->obc.prepare_write(snapc, m_bl,
+							      utime_t(), 0);
+	wr->extents.push_back(op->extent);
+	shard->lock.Lock();
+	shard->obc.writex(wr, &shard->object_set, shard->lock, NULL);
+	shard->lock.Unlock();
+      }
+    }
+    return NULL;
+  }
+
+private:
+  const stress_params &m_params;
+  vector<cache_shard*> &m_shards;
+  ceph::bufferlist m_bl;
+  atomic_t *m_outstanding_reads;
+};
+
 int stress_test(uint64_t num_ops, uint64_t num_objs,
 		uint64_t max_obj_size, uint64_t delay_ns,
-		uint64_t max_op_len, float percent_reads)
+		uint64_t max_op_len, float percent_reads,
+		int num_threads, int num_shards)
 {
-  Mutex lock("object_cacher_stress::object_cacher");
-  FakeWriteback writeback(g_ceph_context, &lock, delay_ns);
-
-  ObjectCacher obc(g_ceph_context, "test", writeback, lock, NULL, NULL,
-		   g_conf->client_oc_size,
-		   g_conf->client_oc_max_objects,
-		   g_conf->client_oc_max_dirty,
-		   g_conf->client_oc_target_dirty,
-		   g_conf->client_oc_max_dirty_age,
-		   true);
-  obc.start();
+  vector<cache_shard*> shards;
+  for (int i = 0; i < num_shards; ++i) {
+    shards.push_back(new cache_shard(i, delay_ns, num_shards));
+    shards.back()->obc.start();
+  }
 
-  atomic_t outstanding_reads;
-  vector<ceph::shared_ptr<op_data> > ops;
-  ObjectCacher::ObjectSet object_set(NULL, 0, 0);
-  SnapContext snapc;
   ceph::buffer::ptr bp(max_op_len);
   ceph::bufferlist bl;
   bp.zero();
   bl.append(bp);
 
+  stress_params params;
+  params.num_ops = num_ops / num_threads;
+  params.num_objs = num_objs;
+  params.max_obj_size = max_obj_size;
+  params.max_op_len = max_op_len;
+  params.percent_reads = percent_reads;
+  params.verbose = (num_threads == 1);
+
   // schedule ops
   std::cout << "Test configuration:\n\n"
 	    << setw(10) << "ops: " << num_ops << "\n"
@@ -82,88 +173,83 @@ int stress_test(uint64_t num_ops, uint64_t num_objs,
 	    << setw(10) << "obj size: " << max_obj_size << "\n"
 	    << setw(10) << "delay: " << delay_ns << "\n"
 	    << setw(10) << "max op len: " << max_op_len << "\n"
-	    << setw(10) << "percent reads: " << percent_reads << "\n\n";
-
-  for (uint64_t i = 0; i < num_ops; ++i) {
-    uint64_t offset = random() % max_obj_size;
-    uint64_t max_len = MIN(max_obj_size - offset, max_op_len);
-    // no zero-length operations
-    uint64_t length = random() % (MAX(max_len - 1, 1)) + 1;
-    std::string oid = "test" + stringify(random() % num_objs);
-    bool is_read = random() < percent_reads * RAND_MAX;
-    ceph::shared_ptr<op_data> op(new op_data(oid, offset, length, is_read));
-    ops.push_back(op);
-    std::cout << "op " << i << " " << (is_read ? "read" : "write")
-	      << " " << op->extent << "\n";
-    if (op->is_read) {
-      ObjectCacher::OSDRead *rd = obc.prepare_read(CEPH_NOSNAP, &op->result, 0);
-      rd->extents.push_back(op->extent);
-      outstanding_reads.inc();
-      Context *completion = new C_Count(op.get(), &outstanding_reads);
-      lock.Lock();
-      int r = obc.readx(rd, &object_set, completion);
-      lock.Unlock();
-      assert(r >= 0);
-      if ((uint64_t)r == length)
-	completion->complete(r);
-      else
-	assert(r == 0);
-    } else {
-      ObjectCacher::OSDWrite *wr = obc.prepare_write(snapc, bl, utime_t(), 0);
-      wr->extents.push_back(op->extent);
-      lock.Lock();
-      obc.writex(wr, &object_set, lock, NULL);
-      lock.Unlock();
-    }
+	    << setw(10) << "percent reads: " << percent_reads << "\n"
+	    << setw(10) << "threads: " << num_threads << "\n"
+	    << setw(10) << "shards: " << num_shards << "\n\n";
+
+  atomic_t outstanding_reads;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  vector<StressThread*> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.push_back(new StressThread(params, shards, bl,
+				       &outstanding_reads));
+    threads.back()->create();
   }
+  for (int i = 0; i < num_threads; ++i)
+    threads[i]->join();
 
   // check that all reads completed
-  for (uint64_t i = 0; i < num_ops; ++i) {
-    if (!ops[i]->is_read)
-      continue;
-    std::cout << "waiting for read " << i << ops[i]->extent << std::endl;
-    uint64_t done = 0;
-    while (done == 0) {
-      done = ops[i]->done.read();
-      if (!done) {
-	usleep(500);
+  for (int t = 0; t < num_threads; ++t) {
+    vector<ceph::shared_ptr<op_data> > &ops = threads[t]->ops;
+    for (uint64_t i = 0; i < ops.size(); ++i) {
+      if (!ops[i]->is_read)
+	continue;
+      if (params.verbose)
+	std::cout << "waiting for read " << i << ops[i]->extent << std::endl;
+      uint64_t done = 0;
+      while (done == 0) {
+	done = ops[i]->done.read();
+	if (!done) {
+	  usleep(500);
+	}
+      }
+      if (done > 1) {
+	std::cout << "completion called more than once!\n" << std::endl;
+	return EXIT_FAILURE;
       }
-    }
-    if (done > 1) {
-      std::cout << "completion called more than once!\n" << std::endl;
-      return EXIT_FAILURE;
     }
   }
+  utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+  uint64_t total_ops = params.num_ops * num_threads;
+  std::cout << total_ops << " ops in " << elapsed << " seconds: "
+	    << (double)total_ops / (double)elapsed << " ops/sec" << std::endl;
 
-  lock.Lock();
-  obc.release_set(&object_set);
-  lock.Unlock();
-
-  int r = 0;
-  Mutex mylock("librbd::ImageCtx::flush_cache");
-  Cond cond;
-  bool done;
-  Context *onfinish = new C_SafeCond(&mylock, &cond, &done, &r);
-  lock.Lock();
-  bool already_flushed = obc.flush_set(&object_set, onfinish);
-  std::cout << "already flushed = " << already_flushed << std::endl;
-  lock.Unlock();
-  mylock.Lock();
-  while (!done) {
-    cond.Wait(mylock);
-  }
-  mylock.Unlock();
+  for (int t = 0; t < num_threads; ++t)
+    delete threads[t];
 
-  lock.Lock();
-  bool unclean = obc.release_set(&object_set);
-  lock.Unlock();
+  for (int i = 0; i < num_shards; ++i) {
+    cache_shard *shard = shards[i];
+    shard->lock.Lock();
+    shard->obc.release_set(&shard->object_set);
+    shard->lock.Unlock();
 
-  if (unclean) {
-    std::cout << "unclean buffers left over!" << std::endl;
-    return EXIT_FAILURE;
-  }
+    int r = 0;
+    Mutex mylock("librbd::ImageCtx::flush_cache");
+    Cond cond;
+    bool done;
+    Context *onfinish = new C_SafeCond(&mylock, &cond, &done, &r);
+    shard->lock.Lock();
+    bool already_flushed = shard->obc.flush_set(&shard->object_set, onfinish);
+    std::cout << "already flushed = " << already_flushed << std::endl;
+    shard->lock.Unlock();
+    mylock.Lock();
+    while (!done) {
+      cond.Wait(mylock);
+    }
+    mylock.Unlock();
+
+    shard->lock.Lock();
+    bool unclean = shard->obc.release_set(&shard->object_set);
+    shard->lock.Unlock();
+
+    if (unclean) {
+      std::cout << "unclean buffers left over!" << std::endl;
+      return EXIT_FAILURE;
+    }
 
-  obc.stop();
+    shard->obc.stop();
+    delete shard;
+  }
 
   std::cout << "Test completed successfully." << std::endl;
 
@@ -184,6 +270,8 @@ int main(int argc, const char **argv)
   long long num_objs = 10;
   float percent_reads = 0.90;
   int seed = time(0) % 100000;
+  int num_threads = 1;
+  int num_shards = 1;
   std::ostringstream err;
   std::vector<const char*>::iterator i;
   for (i = args.begin(); i != args.end();) {
@@ -222,12 +310,29 @@ int main(int argc, const char **argv)
 	cerr << argv[0] << ": " << err.str() << std::endl;
 	return EXIT_FAILURE;
       }
+    } else if (ceph_argparse_withint(args, i, &num_threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &num_shards, &err, "--shards", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
     } else {
       cerr << "unknown option " << *i << std::endl;
       return EXIT_FAILURE;
     }
   }
 
+  if (num_threads < 1 || num_shards < 1) {
+    cerr << argv[0] << ": --threads and --shards must be at least 1"
+	 << std::endl;
+    return EXIT_FAILURE;
+  }
+
   srandom(seed);
-  return stress_test(num_ops, num_objs, obj_bytes, delay_ns, max_len, percent_reads);
+  return stress_test(num_ops, num_objs, obj_bytes, delay_ns, max_len,
+		     percent_reads, num_threads, num_shards);
 }
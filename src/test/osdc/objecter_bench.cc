@@ -0,0 +1,260 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Multi-threaded op submission against a single client instance.
+ *
+ * Every thread shares one Rados handle, and so one Objecter, and keeps
+ * a window of small aio ops in flight across many objects.  This is
+ * the pattern that contends on the Objecter's locks on both the submit
+ * and the reply path; ops/s as the thread count grows shows how well
+ * it scales.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include "common/ceph_argparse.h"
+#include "common/errno.h"
+#include "common/Thread.h"
+#include "include/rados/librados.hpp"
+#include "include/utime.h"
+
+using namespace librados;
+
+enum bench_op_t {
+  BENCH_STAT,
+  BENCH_READ,
+  BENCH_WRITE,
+};
+
+struct bench_params {
+  long long num_ops;
+  long long num_objs;
+  long long op_size;
+  long long window;
+  bench_op_t op;
+};
+
+static utime_t now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return utime_t(&tv);
+}
+
+static std::string obj_name(long long i)
+{
+  std::ostringstream oss;
+  oss << "objecter_bench_" << i;
+  return oss.str();
+}
+
+class BenchThread : public Thread {
+public:
+  BenchThread(IoCtx &ioctx, const bench_params &params, int id)
+    : m_ioctx(ioctx), m_params(params), m_id(id), errors(0) {}
+
+  void *entry() {
+    bufferlist data;
+    data.append(std::string(m_params.op_size, 'x'));
+    std::vector<AioCompletion*> window(m_params.window, (AioCompletion*)NULL);
+    std::vector<bufferlist> bls(m_params.window);
+    std::vector<uint64_t> sizes(m_params.window);
+    std::vector<time_t> mtimes(m_params.window);
+
+    for (long long i = 0; i < m_params.num_ops; ++i) {
+      int slot = i % m_params.window;
+      if (window[slot]) {
+	reap(window[slot]);
+	window[slot] = NULL;
+      }
+      std::string oid = obj_name((i * 7919 + m_id) % m_params.num_objs);
+      AioCompletion *c = Rados::aio_create_completion();
+      int r;
+      switch (m_params.op) {
+      case BENCH_STAT:
+	r = m_ioctx.aio_stat(oid, c, &sizes[slot], &mtimes[slot]);
+	break;
+      case BENCH_READ:
+	bls[slot].clear();
+	r = m_ioctx.aio_read(oid, c, &bls[slot], m_params.op_size, 0);
+	break;
+      default:
+	r = m_ioctx.aio_write_full(oid, c, data);
+	break;
+      }
+      if (r < 0) {
+	c->release();
+	++errors;
+	continue;
+      }
+      window[slot] = c;
+    }
+    for (size_t i = 0; i < window.size(); ++i) {
+      if (window[i])
+	reap(window[i]);
+    }
+    return NULL;
+  }
+
+private:
+  void reap(AioCompletion *c) {
+    if (m_params.op == BENCH_WRITE)
+      c->wait_for_safe();
+    else
+      c->wait_for_complete();
+    if (c->get_return_value() < 0)
+      ++errors;
+    c->release();
+  }
+
+  IoCtx &m_ioctx;
+  const bench_params &m_params;
+  int m_id;
+
+public:
+  long long errors;
+};
+
+static void usage(const char *name)
+{
+  std::cerr << "usage: " << name << " [options]\n"
+	    << "  --pool <pool>        pool to use (default rbd)\n"
+	    << "  --threads <n>        submitting threads (default 1)\n"
+	    << "  --ops <n>            ops per thread (default 10000)\n"
+	    << "  --objects <n>        objects to spread ops over (default 1000)\n"
+	    << "  --op-size <bytes>    read/write size (default 4096)\n"
+	    << "  --window <n>         ops in flight per thread (default 16)\n"
+	    << "  --op <stat|read|write>\n"
+	    << "                       op type (default stat)\n"
+	    << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  std::string pool_name = "rbd";
+  std::string op_name = "stat";
+  long long num_threads = 1;
+  bench_params params;
+  params.num_ops = 10000;
+  params.num_objs = 1000;
+  params.op_size = 4096;
+  params.window = 16;
+
+  std::string val;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pool", (char*)NULL)) {
+      pool_name = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--op", (char*)NULL)) {
+      op_name = val;
+    } else if (ceph_argparse_withlonglong(args, i, &num_threads, &err, "--threads", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &params.num_ops, &err, "--ops", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &params.num_objs, &err, "--objects", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &params.op_size, &err, "--op-size", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &params.window, &err, "--window", (char*)NULL)) {
+      if (!err.str().empty()) {
+	std::cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      ++i;
+    }
+  }
+
+  if (op_name == "stat") {
+    params.op = BENCH_STAT;
+  } else if (op_name == "read") {
+    params.op = BENCH_READ;
+  } else if (op_name == "write") {
+    params.op = BENCH_WRITE;
+  } else {
+    std::cerr << argv[0] << ": unknown op '" << op_name << "'" << std::endl;
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (num_threads < 1 || params.num_ops < 1 || params.num_objs < 1 ||
+      params.op_size < 1 || params.window < 1) {
+    std::cerr << argv[0] << ": numeric options must be positive" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Rados rados;
+  int r = rados.init(NULL);
+  if (r == 0)
+    r = rados.conf_read_file(NULL);
+  if (r == 0)
+    r = rados.conf_parse_env(NULL);
+  if (r == 0)
+    r = rados.conf_parse_argv(argc, argv);
+  if (r == 0)
+    r = rados.connect();
+  if (r < 0) {
+    std::cerr << "error connecting to cluster: " << cpp_strerror(r) << std::endl;
+    return EXIT_FAILURE;
+  }
+  IoCtx ioctx;
+  r = rados.ioctx_create(pool_name.c_str(), ioctx);
+  if (r < 0) {
+    std::cerr << "error opening pool " << pool_name << ": "
+	      << cpp_strerror(r) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // stat and read need the objects to exist
+  if (params.op != BENCH_WRITE) {
+    bufferlist bl;
+    bl.append(std::string(params.op_size, 'x'));
+    for (long long o = 0; o < params.num_objs; ++o) {
+      r = ioctx.write_full(obj_name(o), bl);
+      if (r < 0) {
+	std::cerr << "error writing " << obj_name(o) << ": "
+		  << cpp_strerror(r) << std::endl;
+	return EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::vector<BenchThread*> threads;
+  utime_t start = now();
+  for (long long t = 0; t < num_threads; ++t) {
+    threads.push_back(new BenchThread(ioctx, params, t));
+    threads.back()->create();
+  }
+  long long errors = 0;
+  for (long long t = 0; t < num_threads; ++t) {
+    threads[t]->join();
+    errors += threads[t]->errors;
+    delete threads[t];
+  }
+  utime_t elapsed = now() - start;
+
+  long long total_ops = params.num_ops * num_threads;
+  std::cout << op_name << ": " << num_threads << " threads, "
+	    << total_ops << " ops in " << elapsed << " seconds: "
+	    << (double)total_ops / (double)elapsed << " ops/sec";
+  if (errors)
+    std::cout << ", " << errors << " errors";
+  std::cout << std::endl;
+
+  for (long long o = 0; o < params.num_objs; ++o)
+    ioctx.remove(obj_name(o));
+  ioctx.close();
+  rados.shutdown();
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Request latency and throughput of a radosgw frontend while it holds
+ * many other client connections open.
+ *
+ * A number of "idle" connections each send an incomplete request header
+ * and then go quiet, the way slow or stalled clients do; meanwhile a few
+ * threads issue keep-alive requests as fast as they are answered.  With
+ * a frontend that ties a thread to every connection the idle ones starve
+ * the active ones once they outnumber the thread pool; compare e.g.
+ *
+ *   rgw frontends = civetweb port=8000
+ *   rgw frontends = epoll port=8000
+ *
+ * at --idle 10000 (raise the fd limit with ulimit -n first).
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/errno.h"
+#include "common/Thread.h"
+#include "include/utime.h"
+
+struct bench_params {
+  std::string host;
+  long long port;
+  std::string uri;
+  long long num_requests;
+  long long timeout;
+};
+
+static utime_t now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return utime_t(&tv);
+}
+
+static int connect_to(const bench_params &params)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -errno;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(params.port);
+  if (inet_pton(AF_INET, params.host.c_str(), &addr.sin_addr) != 1) {
+    ::close(fd);
+    return -EINVAL;
+  }
+  if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    int err = errno;
+    ::close(fd);
+    return -err;
+  }
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  struct timeval tv;
+  tv.tv_sec = params.timeout;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+static int send_all(int fd, const std::string &s)
+{
+  size_t ofs = 0;
+  while (ofs < s.size()) {
+    ssize_t r = ::send(fd, s.data() + ofs, s.size() - ofs, MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EINTR)
+	continue;
+      return -errno;
+    }
+    ofs += r;
+  }
+  return 0;
+}
+
+class BenchThread : public Thread {
+public:
+  BenchThread(const bench_params &params)
+    : m_params(params), m_fd(-1), completed(0), errors(0),
+      total_usec(0), max_usec(0) {}
+
+  void *entry() {
+    std::ostringstream req;
+    req << "GET " << m_params.uri << " HTTP/1.1\r\n"
+	<< "Host: " << m_params.host << "\r\n\r\n";
+
+    for (long long i = 0; i < m_params.num_requests; ++i) {
+      utime_t start = now();
+      if (do_request(req.str()) < 0) {
+	++errors;
+	close_conn();
+	continue;
+      }
+      uint64_t usec = (now() - start).to_nsec() / 1000;
+      ++completed;
+      total_usec += usec;
+      if (usec > max_usec)
+	max_usec = usec;
+    }
+    close_conn();
+    return NULL;
+  }
+
+private:
+  void close_conn() {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+    m_buf.clear();
+  }
+
+  int fill() {
+    char buf[16384];
+    ssize_t r = ::recv(m_fd, buf, sizeof(buf), 0);
+    if (r < 0)
+      return -errno;
+    if (r == 0)
+      return -EPIPE;
+    m_buf.append(buf, r);
+    return 0;
+  }
+
+  int do_request(const std::string &req) {
+    if (m_fd < 0) {
+      m_fd = connect_to(m_params);
+      if (m_fd < 0)
+	return m_fd;
+    }
+    int r = send_all(m_fd, req);
+    if (r < 0)
+      return r;
+
+    /* rgw ends its header lines with a bare \n */
+    size_t end;
+    while ((end = m_buf.find("\n\r\n")) == std::string::npos &&
+	   (end = m_buf.find("\n\n")) == std::string::npos) {
+      r = fill();
+      if (r < 0)
+	return r;
+    }
+    size_t body_start = m_buf.find('\n', end + 1) + 1;
+    std::string header = m_buf.substr(0, end + 1);
+
+    long long content_length = 0;
+    bool close = false;
+    std::istringstream lines(header);
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (strncasecmp(line.c_str(), "content-length:", 15) == 0)
+	content_length = atoll(line.c_str() + 15);
+      else if (strncasecmp(line.c_str(), "connection:", 11) == 0 &&
+	       line.find("close") != std::string::npos)
+	close = true;
+    }
+
+    while (m_buf.size() < body_start + content_length) {
+      r = fill();
+      if (r < 0)
+	return r;
+    }
+    m_buf.erase(0, body_start + content_length);
+    if (close)
+      close_conn();
+    return 0;
+  }
+
+  const bench_params &m_params;
+  int m_fd;
+  std::string m_buf;
+
+public:
+  long long completed;
+  long long errors;
+  uint64_t total_usec;
+  uint64_t max_usec;
+};
+
+static void usage(const char *name)
+{
+  std::cerr << "usage: " << name << " [options]\n"
+	    << "  --host <addr>        gateway address (default 127.0.0.1)\n"
+	    << "  --port <port>        gateway port (default 80)\n"
+	    << "  --uri <uri>          resource to request (default /)\n"
+	    << "  --idle <n>           idle connections to hold open (default 0)\n"
+	    << "  --threads <n>        requesting threads (default 4)\n"
+	    << "  --requests <n>       requests per thread (default 1000)\n"
+	    << "  --timeout <secs>     per request timeout (default 30)\n"
+	    << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  bench_params params;
+  params.host = "127.0.0.1";
+  params.port = 80;
+  params.uri = "/";
+  params.num_requests = 1000;
+  params.timeout = 30;
+  long long num_idle = 0;
+  long long num_threads = 4;
+
+  std::string val;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else if (ceph_argparse_witharg(args, i, &val, "--host", (char*)NULL)) {
+      params.host = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--uri", (char*)NULL)) {
+      params.uri = val;
+    } else if (ceph_argparse_withlonglong(args, i, &params.port, &err, "--port", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &num_idle, &err, "--idle", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &num_threads, &err, "--threads", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &params.num_requests, &err, "--requests", (char*)NULL) ||
+	       ceph_argparse_withlonglong(args, i, &params.timeout, &err, "--timeout", (char*)NULL)) {
+      if (!err.str().empty()) {
+	std::cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      ++i;
+    }
+  }
+
+  if (num_idle < 0 || num_threads < 1 || params.num_requests < 1 ||
+      params.timeout < 1) {
+    std::cerr << argv[0] << ": invalid numeric option" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ostringstream partial;
+  partial << "GET " << params.uri << " HTTP/1.1\r\n"
+	  << "Host: " << params.host << "\r\n";
+
+  std::vector<int> idle;
+  for (long long n = 0; n < num_idle; ++n) {
+    int fd = connect_to(params);
+    if (fd >= 0 && send_all(fd, partial.str()) < 0) {
+      ::close(fd);
+      fd = -EPIPE;
+    }
+    if (fd < 0) {
+      std::cerr << "opened " << n << " idle connections, then: "
+		<< cpp_strerror(fd) << std::endl;
+      break;
+    }
+    idle.push_back(fd);
+  }
+
+  std::vector<BenchThread*> threads;
+  utime_t start = now();
+  for (long long t = 0; t < num_threads; ++t) {
+    threads.push_back(new BenchThread(params));
+    threads.back()->create();
+  }
+  long long completed = 0, errors = 0;
+  uint64_t total_usec = 0, max_usec = 0;
+  for (long long t = 0; t < num_threads; ++t) {
+    threads[t]->join();
+    completed += threads[t]->completed;
+    errors += threads[t]->errors;
+    total_usec += threads[t]->total_usec;
+    if (threads[t]->max_usec > max_usec)
+      max_usec = threads[t]->max_usec;
+    delete threads[t];
+  }
+  utime_t elapsed = now() - start;
+
+  for (std::vector<int>::iterator p = idle.begin(); p != idle.end(); ++p)
+    ::close(*p);
+
+  std::cout << idle.size() << " idle connections, " << num_threads << " threads: "
+	    << completed << " requests in " << elapsed << " seconds: "
+	    << (double)completed / (double)elapsed << " req/sec, latency avg "
+	    << (completed ? total_usec / completed : 0) << " max " << max_usec
+	    << " usec";
+  if (errors)
+    std::cout << ", " << errors << " errors";
+  std::cout << std::endl;
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+#include <iostream>
+#include <stdlib.h>
+#include "common/ceph_context.h"
+#include "common/Clock.h"
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_compression.h"
+#include <gtest/gtest.h>
+
+using namespace std;
+
+static CephContext *cct = new CephContext(CEPH_ENTITY_TYPE_CLIENT);
+
+/* text-like data, so that it actually compresses */
+static void gen_data(uint64_t len, bufferlist *bl)
+{
+  static const char *words[] = { "bucket ", "object ", "gateway ", "index ", "placement ", "rados " };
+  string s;
+  srand(len);
+  while (s.size() < len) {
+    s.append(words[rand() % 6]);
+  }
+  s.resize(len);
+  bl->append(s);
+}
+
+/* lay out data the way RGWPutObjProcessor_Atomic does */
+static void compress_obj(bufferlist& data, uint64_t block_size, RGWCompressionInfo *info, bufferlist *stored)
+{
+  info->compression_type = "snappy";
+  info->block_size = block_size;
+  info->orig_size = data.length();
+
+  for (uint64_t ofs = 0; ofs < data.length(); ofs += block_size) {
+    bufferlist in;
+    in.substr_of(data, ofs, MIN(block_size, data.length() - ofs));
+    info->blocks.push_back(stored->length());
+    ASSERT_EQ(0, rgw_compress(info->compression_type, in, *stored));
+  }
+  info->compressed_size = stored->length();
+}
+
+class CollectCB : public RGWGetDataCB {
+public:
+  bufferlist bl;
+
+  int handle_data(bufferlist& in, off_t bl_ofs, off_t bl_len) {
+    bufferlist part;
+    part.substr_of(in, bl_ofs, bl_len);
+    bl.claim_append(part);
+    return 0;
+  }
+};
+
+/* read [ofs, end] of the object, handing the stored data in chunk sized pieces */
+static int read_range(RGWCompressionInfo& info, bufferlist& stored, off_t ofs, off_t end,
+                      uint64_t chunk, bufferlist *out)
+{
+  CollectCB cb;
+  RGWGetObj_Decompress decompress(cct, info, ofs, end, &cb);
+
+  off_t stored_ofs, stored_end;
+  decompress.get_stored_range(&stored_ofs, &stored_end);
+
+  for (off_t cur = stored_ofs; cur <= stored_end; cur += chunk) {
+    bufferlist bl;
+    bl.substr_of(stored, cur, MIN((off_t)chunk, stored_end - cur + 1));
+    int r = decompress.handle_data(bl, 0, bl.length());
+    if (r < 0)
+      return r;
+  }
+  int r = decompress.flush();
+  if (r < 0)
+    return r;
+
+  out->claim(cb.bl);
+  return 0;
+}
+
+TEST(TestRGWCompression, round_trip) {
+  bufferlist data, stored, out;
+  gen_data(1024 * 1024, &data);
+
+  ASSERT_EQ(0, rgw_compress("snappy", data, stored));
+  ASSERT_LT(stored.length(), data.length());
+  ASSERT_EQ(0, rgw_decompress("snappy", stored, out));
+  ASSERT_TRUE(out.contents_equal(data));
+
+  ASSERT_TRUE(rgw_compression_supported("snappy"));
+  ASSERT_FALSE(rgw_compression_supported("lz77"));
+  bufferlist dummy;
+  ASSERT_EQ(-EOPNOTSUPP, rgw_compress("lz77", data, dummy));
+}
+
+TEST(TestRGWCompression, corrupt) {
+  bufferlist garbage, out;
+  garbage.append("\xff\xff\xff\xff\xff\xff\xff\xff", 8);
+  ASSERT_EQ(-EIO, rgw_decompress("snappy", garbage, out));
+}
+
+TEST(TestRGWCompression, ranges) {
+  uint64_t block_size = 64 * 1024;
+  uint64_t obj_size = 10 * block_size + 1234;
+  bufferlist data, stored;
+  gen_data(obj_size, &data);
+
+  RGWCompressionInfo info;
+  compress_obj(data, block_size, &info, &stored);
+  ASSERT_EQ(11u, info.blocks.size());
+
+  off_t ranges[][2] = {
+    { 0, (off_t)obj_size - 1 },
+    { 0, 0 },
+    { 1, 100 },
+    { (off_t)block_size - 1, (off_t)block_size },
+    { (off_t)block_size, 2 * (off_t)block_size - 1 },
+    { 12345, 5 * (off_t)block_size + 17 },
+    { 10 * (off_t)block_size, (off_t)obj_size - 1 },
+    { (off_t)obj_size - 1, (off_t)obj_size - 1 },
+  };
+  uint64_t chunks[] = { 1000, 4096, block_size, 4 * 1024 * 1024 };
+
+  for (unsigned i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+    off_t ofs = ranges[i][0], end = ranges[i][1];
+    bufferlist expected;
+    expected.substr_of(data, ofs, end - ofs + 1);
+
+    for (unsigned j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+      bufferlist out;
+      ASSERT_EQ(0, read_range(info, stored, ofs, end, chunks[j], &out));
+      ASSERT_TRUE(out.contents_equal(expected)) << "ofs=" << ofs << " end=" << end << " chunk=" << chunks[j];
+    }
+  }
+}
+
+TEST(TestRGWCompression, truncated) {
+  uint64_t block_size = 4096;
+  bufferlist data, stored;
+  gen_data(3 * block_size, &data);
+
+  RGWCompressionInfo info;
+  compress_obj(data, block_size, &info, &stored);
+
+  CollectCB cb;
+  RGWGetObj_Decompress decompress(cct, info, 0, data.length() - 1, &cb);
+  bufferlist bl;
+  bl.substr_of(stored, 0, stored.length() - 1);
+  ASSERT_EQ(0, decompress.handle_data(bl, 0, bl.length()));
+  ASSERT_EQ(-EIO, decompress.flush());
+}
+
+TEST(TestRGWCompression, bench) {
+  uint64_t block_size = 512 * 1024;
+  bufferlist data;
+  gen_data(64 * 1024 * 1024, &data);
+
+  bufferlist stored;
+  RGWCompressionInfo info;
+  utime_t start = ceph_clock_now(NULL);
+  compress_obj(data, block_size, &info, &stored);
+  utime_t compress_time = ceph_clock_now(NULL) - start;
+
+  bufferlist out;
+  start = ceph_clock_now(NULL);
+  ASSERT_EQ(0, read_range(info, stored, 0, data.length() - 1, 4 * 1024 * 1024, &out));
+  utime_t decompress_time = ceph_clock_now(NULL) - start;
+  ASSERT_TRUE(out.contents_equal(data));
+
+  double mb = (double)data.length() / (1024 * 1024);
+  cout << "snappy, " << block_size << " byte blocks: ratio "
+       << (double)stored.length() / (double)data.length()
+       << ", compress " << mb / (double)compress_time << " MB/s"
+       << ", decompress " << mb / (double)decompress_time << " MB/s" << std::endl;
+}
@@ -13,12 +13,14 @@
  */
 
 #include "common/escape.h"
+#include "common/Formatter.h"
 #include "gtest/gtest.h"
 #include <stdint.h>
 #include <boost/foreach.hpp>
 #include <cstdarg>
 #include "rbd_replay/Deser.hpp"
 #include "rbd_replay/ImageNameMap.hpp"
+#include "rbd_replay/IOStats.hpp"
 #include "rbd_replay/ios.hpp"
 #include "rbd_replay/rbd_loc.hpp"
 #include "rbd_replay/Ser.hpp"
@@ -223,3 +225,23 @@ TEST(RBDReplay, batch_unreachable_from) {
   EXPECT_EQ(0U, unreachable.count(io8));
   EXPECT_EQ(0U, unreachable.count(io9));
 }
+
+TEST(RBDReplay, IOStats) {
+  IOStats stats;
+  stats.start();
+  stats.add_io(IO_READ, 4096, 100);
+  stats.add_io(IO_READ, 4096, 300);
+  stats.add_io(IO_ASYNC_WRITE, 8192, 1000);
+  stats.add_lag(5);
+  stats.finish();
+
+  JSONFormatter f(false);
+  stats.dump(&f);
+  std::ostringstream out;
+  f.flush(out);
+  std::string json(out.str());
+  EXPECT_NE(std::string::npos, json.find("\"type\":\"read\",\"count\":2,\"bytes\":8192"));
+  EXPECT_NE(std::string::npos, json.find("\"avg\":200,\"min\":100,\"max\":300"));
+  EXPECT_NE(std::string::npos, json.find("\"type\":\"aio_write\",\"count\":1,\"bytes\":8192"));
+  EXPECT_NE(std::string::npos, json.find("\"dispatch_lag_usec\":{\"count\":1"));
+}
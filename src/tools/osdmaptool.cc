@@ -17,6 +17,7 @@
 
 #include "common/ceph_argparse.h"
 #include "common/errno.h"
+#include "common/MemoryModel.h"
 
 #include "global/global_init.h"
 #include "osd/OSDMap.h"
@@ -35,6 +36,10 @@ void usage()
   cout << "   --test-map-pg <pgid>    map a pgid to osds" << std::endl;
   cout << "   --test-map-object <objectname> [--pool <poolid>] map an object to osds"
        << std::endl;
+  cout << "   --test-map-cache <epochs> [--map-cache-copy]" << std::endl;
+  cout << "                           build <epochs> successive maps from synthetic" << std::endl;
+  cout << "                           incrementals and report their memory use;" << std::endl;
+  cout << "                           --map-cache-copy gives each epoch a full copy" << std::endl;
   exit(1);
 }
 
@@ -70,6 +75,8 @@ int main(int argc, const char **argv)
   bool clear_temp = false;
   bool test_map_pgs = false;
   bool test_random = false;
+  int test_map_cache = 0;
+  bool map_cache_copy = false;
 
   std::string val;
   std::ostringstream err;
@@ -100,6 +107,13 @@ int main(int argc, const char **argv)
       test_map_pgs = true;
     } else if (ceph_argparse_flag(args, i, "--test-random", (char*)NULL)) {
       test_random = true;
+    } else if (ceph_argparse_withint(args, i, &test_map_cache, &err, "--test-map-cache", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
+    } else if (ceph_argparse_flag(args, i, "--map-cache-copy", (char*)NULL)) {
+      map_cache_copy = true;
     } else if (ceph_argparse_flag(args, i, "--clobber", (char*)NULL)) {
       clobber = true;
     } else if (ceph_argparse_withint(args, i, &pg_bits, &err, "--pg_bits", (char*)NULL)) {
@@ -412,6 +426,70 @@ int main(int argc, const char **argv)
       cout << "size " << i << "\t" << size[i] << std::endl;
     }
   }
+  if (test_map_cache > 0) {
+    // mimic what the OSD keeps in its map cache while peering: a run of
+    // consecutive epochs that each differ by a few pg_temp entries, a
+    // reweight, and the odd osd (re)boot.
+    if (!osdmap.have_pg_pool(0)) {
+      cerr << "There is no pool 0" << std::endl;
+      exit(1);
+    }
+    int n = osdmap.get_max_osd();
+    unsigned pg_num = osdmap.get_pg_pool(0)->get_pg_num();
+    srand(getpid());
+
+    MemoryModel mm(g_ceph_context);
+    MemoryModel::snap before, after;
+    mm.sample(&before);
+    utime_t start = ceph_clock_now(g_ceph_context);
+
+    vector<OSDMap*> maps;
+    const OSDMap *prev = &osdmap;
+    for (int e = 0; e < test_map_cache; ++e) {
+      OSDMap::Incremental inc(prev->get_epoch() + 1);
+      inc.fsid = prev->get_fsid();
+      for (int j = 0; j < 16; ++j) {
+	pg_t pgid(rand() % pg_num, 0, -1);
+	vector<int> acting;
+	if (rand() % 2)
+	  for (int k = 0; k < 3; ++k)
+	    acting.push_back(rand() % n);
+	inc.new_pg_temp[pgid] = acting;
+      }
+      inc.new_weight[rand() % n] = CEPH_OSD_IN / (1 + rand() % 4);
+      if (e % 50 == 0) {
+	entity_addr_t a;
+	a.nonce = e;
+	int o = rand() % n;
+	inc.new_up_client[o] = a;
+	inc.new_up_cluster[o] = a;
+      }
+
+      OSDMap *o = new OSDMap;
+      if (map_cache_copy) {
+	bufferlist obl;
+	prev->encode(obl);
+	o->decode(obl);
+      } else {
+	o->shallow_copy_from(*prev);
+      }
+      o->apply_incremental(inc);
+      maps.push_back(o);
+      prev = o;
+    }
+
+    utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+    mm.sample(&after);
+    cout << "built " << maps.size() << " epochs of a " << n << " osd map ("
+	 << (map_cache_copy ? "full copies" : "shared") << ") in "
+	 << elapsed << "s: rss " << before.get_rss() << " -> "
+	 << after.get_rss() << " kB, "
+	 << (double)(after.get_rss() - before.get_rss()) / (double)maps.size()
+	 << " kB/epoch" << std::endl;
+
+    for (vector<OSDMap*>::iterator p = maps.begin(); p != maps.end(); ++p)
+      delete *p;
+  }
   if (test_crush) {
     int pass = 0;
     while (1) {
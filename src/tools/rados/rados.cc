@@ -68,7 +68,8 @@ void usage(ostream& out)
 "\n"
 "OBJECT COMMANDS\n"
 "   get <obj-name> [outfile]         fetch object\n"
-"   put <obj-name> [infile]          write object\n"
+"   put <obj-name> [infile] [--offset offset]\n"
+"                                    write object, or a part of it\n"
 "   truncate <obj-name> length       truncate object\n"
 "   create <obj-name> [category]     create object\n"
 "   rm <obj-name> ...                remove object(s)\n"
@@ -402,7 +403,8 @@ static int do_copy_pool(Rados& rados, const char *src_pool, const char *target_p
   return 0;
 }
 
-static int do_put(IoCtx& io_ctx, const char *objname, const char *infile, int op_size)
+static int do_put(IoCtx& io_ctx, const char *objname, const char *infile, int op_size,
+		  uint64_t obj_offset, bool use_offset)
 {
   string oid(objname);
   bufferlist indata;
@@ -420,7 +422,7 @@ static int do_put(IoCtx& io_ctx, const char *objname, const char *infile, int op
   }
   char *buf = new char[op_size];
   int count = op_size;
-  uint64_t offset = 0;
+  uint64_t offset = obj_offset;
   while (count != 0) {
     count = read(fd, buf, op_size);
     if (count < 0) {
@@ -429,7 +431,7 @@ static int do_put(IoCtx& io_ctx, const char *objname, const char *infile, int op
       goto out;
     }
     if (count == 0) {
-      if (!offset) {
+      if (!offset && !use_offset) {
 	ret = io_ctx.create(oid, true);
 	if (ret < 0) {
 	  cerr << "WARNING: could not create object: " << oid << std::endl;
@@ -439,7 +441,7 @@ static int do_put(IoCtx& io_ctx, const char *objname, const char *infile, int op
       continue;
     }
     indata.append(buf, count);
-    if (offset == 0)
+    if (offset == 0 && !use_offset)
       ret = io_ctx.write_full(oid, indata);
     else
       ret = io_ctx.write(oid, indata, count, offset);
@@ -856,6 +858,11 @@ protected:
   }
 
   int aio_read(const std::string& oid, int slot, bufferlist *pbl, size_t len) {
+    // preallocate, so the messenger can receive the data straight into it
+    if (pbl->length() < len) {
+      pbl->clear();
+      pbl->push_back(buffer::create(len));
+    }
     return io_ctx.aio_read(oid, completions[slot], pbl, len, 0);
   }
 
@@ -1176,6 +1183,8 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   string oloc, target_oloc, nspace;
   int concurrent_ios = 16;
   int op_size = 1 << 22;
+  uint64_t obj_offset = 0;
+  bool obj_offset_specified = false;
   bool cleanup = true;
   const char *snapname = NULL;
   snap_t snapid = CEPH_NOSNAP;
@@ -1244,6 +1253,11 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   if (i != opts.end()) {
     op_size = strtol(i->second.c_str(), NULL, 10);
   }
+  i = opts.find("offset");
+  if (i != opts.end()) {
+    obj_offset = strtoll(i->second.c_str(), NULL, 10);
+    obj_offset_specified = true;
+  }
   i = opts.find("snap");
   if (i != opts.end()) {
     snapname = i->second.c_str();
@@ -1615,7 +1629,8 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   else if (strcmp(nargs[0], "put") == 0) {
     if (!pool_name || nargs.size() < 3)
       usage_exit();
-    ret = do_put(io_ctx, nargs[1], nargs[2], op_size);
+    ret = do_put(io_ctx, nargs[1], nargs[2], op_size, obj_offset,
+		 obj_offset_specified);
     if (ret < 0) {
       cerr << "error putting " << pool_name << "/" << nargs[1] << ": " << cpp_strerror(ret) << std::endl;
       goto out;
@@ -2606,6 +2621,8 @@ int main(int argc, const char **argv)
       opts["block-size"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-b", (char*)NULL)) {
       opts["block-size"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--offset", (char*)NULL)) {
+      opts["offset"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-s", "--snap", (char*)NULL)) {
       opts["snap"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-S", "--snapid", (char*)NULL)) {
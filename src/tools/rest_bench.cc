@@ -20,6 +20,7 @@
 #include "common/ceph_argparse.h"
 #include "common/debug.h"
 #include "common/obj_bencher.h"
+#include "common/strtol.h"
 #include "common/WorkQueue.h"
 
 #include "include/types.h"
@@ -28,6 +29,8 @@
 #include "global/global_init.h"
 #include "msg/Message.h"
 
+#include "rest_bench_mixed.h"
+
 #define DEFAULT_USER_AGENT "rest-bench"
 #define DEFAULT_BUCKET "rest-bench-bucket"
 
@@ -36,6 +39,7 @@ void usage(ostream& out)
   out <<					\
 "usage: rest-bench [options] <write|seq>\n"
 "       rest-bench [options] cleanup [--run-name run_name] [--prefix prefix]\n"
+"       rest-bench [options] mixed\n"
 "BENCHMARK OPTIONS\n"
 "   --seconds\n"
 "        benchmak length (default: 60)\n"
@@ -61,7 +65,31 @@ void usage(ostream& out)
 "   --protocol=<http|https>\n"
 "        protocol to be used (default: http)\n"
 "   --uri_style=<path|vhost>\n"
-"        uri style in requests (default: path)\n";
+"        uri style in requests (default: path)\n"
+"MIXED WORKLOAD OPTIONS\n"
+"   --api=<s3|swift>\n"
+"        api to use (default: s3); for swift the access key and secret\n"
+"        are the swift user and key\n"
+"   --auth-url=url\n"
+"        swift auth url (default: <protocol>://<api-host>/auth/v1.0)\n"
+"   --mix=op:weight[,...]\n"
+"        relative frequency of put, get, range-get, list, delete and\n"
+"        multipart (default: put:25,get:40,range-get:15,list:5,delete:10,multipart:5)\n"
+"   --obj-sizes=size[-size]:weight[,...]\n"
+"        object size distribution, sizes may be ranges and take K/M/G\n"
+"        suffixes (default: 4K:50,64K:25,1M:20,16M:5)\n"
+"   --part-size=size\n"
+"        multipart part or swift segment size (default: 5M)\n"
+"   --range-size=size\n"
+"        length of ranged gets (default: 64K)\n"
+"   --prefixes=n\n"
+"        objects are spread over n prefixes, listed with a delimiter (default: 16)\n"
+"   --list-max=n\n"
+"        max entries per listing (default: 1000)\n"
+"   --prefill=n\n"
+"        objects to write before the timed run (default: 0)\n"
+"   --json-out=file\n"
+"        write the per op type results there rather than to stdout\n";
 }
 
 static void usage_exit()
@@ -77,6 +105,7 @@ enum OpType {
   OP_DELETE_OBJ = 3,
   OP_LIST_BUCKET = 4,
   OP_CLEANUP = 5,
+  OP_MIXED = 6,
 };
 
 struct req_context : public RefCountedObject {
@@ -679,6 +708,8 @@ int main(int argc, const char **argv)
   bool cleanup = true;
   std::string run_name;
   std::string prefix;
+  rest_bench_mixed_params mixed;
+  std::string err;
 
 
   for (i = args.begin(); i != args.end(); ) {
@@ -705,7 +736,7 @@ int main(int argc, const char **argv)
     } else if (ceph_argparse_witharg(args, i, &proto_str, "--protocol", (char*)NULL)) {
       if (strcasecmp(proto_str.c_str(), "http") == 0) {
         protocol = S3ProtocolHTTP;
-      } else if (strcasecmp(proto_str.c_str(), "http") == 0) {
+      } else if (strcasecmp(proto_str.c_str(), "https") == 0) {
         protocol = S3ProtocolHTTPS;
       } else {
         cerr << "bad protocol" << std::endl;
@@ -731,6 +762,41 @@ int main(int argc, const char **argv)
       seconds = strtol(val.c_str(), NULL, 10);
     } else if (ceph_argparse_witharg(args, i, &val, "-b", "--block-size", (char*)NULL)) {
       op_size = strtol(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--api", (char*)NULL)) {
+      if (strcasecmp(val.c_str(), "s3") == 0) {
+        mixed.api = MIXED_API_S3;
+      } else if (strcasecmp(val.c_str(), "swift") == 0) {
+        mixed.api = MIXED_API_SWIFT;
+      } else {
+        cerr << "bad api" << std::endl;
+        usage_exit();
+      }
+    } else if (ceph_argparse_witharg(args, i, &mixed.auth_url, "--auth-url", (char*)NULL)) {
+      /* nothing */
+    } else if (ceph_argparse_witharg(args, i, &mixed.mix, "--mix", (char*)NULL)) {
+      /* nothing */
+    } else if (ceph_argparse_witharg(args, i, &mixed.obj_sizes, "--obj-sizes", (char*)NULL)) {
+      /* nothing */
+    } else if (ceph_argparse_witharg(args, i, &mixed.json_out, "--json-out", (char*)NULL)) {
+      /* nothing */
+    } else if (ceph_argparse_witharg(args, i, &val, "--part-size", (char*)NULL)) {
+      mixed.part_size = strict_sistrtoll(val.c_str(), &err);
+      if (!err.empty()) {
+        cerr << "bad part size: " << err << std::endl;
+        usage_exit();
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--range-size", (char*)NULL)) {
+      mixed.range_size = strict_sistrtoll(val.c_str(), &err);
+      if (!err.empty()) {
+        cerr << "bad range size: " << err << std::endl;
+        usage_exit();
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--prefixes", (char*)NULL)) {
+      mixed.num_prefixes = strtol(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--list-max", (char*)NULL)) {
+      mixed.list_max = strtol(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--prefill", (char*)NULL)) {
+      mixed.prefill = strtoll(val.c_str(), NULL, 10);
     } else {
       if (val[0] == '-')
         usage_exit();
@@ -753,6 +819,8 @@ int main(int argc, const char **argv)
     operation = OP_RAND_READ;
   else if (strcmp(args[0], "cleanup") == 0) {
     operation = OP_CLEANUP;
+  } else if (strcmp(args[0], "mixed") == 0) {
+    operation = OP_MIXED;
   } else
     usage_exit();
 
@@ -773,6 +841,24 @@ int main(int argc, const char **argv)
   if (user_agent.empty())
     user_agent = DEFAULT_USER_AGENT;
 
+  if (operation == OP_MIXED) {
+    mixed.host = host;
+    mixed.https = (protocol == S3ProtocolHTTPS);
+    mixed.access_key = access_key;
+    mixed.secret = secret;
+    mixed.bucket = bucket;
+    mixed.run_name = run_name;
+    mixed.concurrent_ios = concurrent_ios;
+    mixed.seconds = seconds;
+    mixed.cleanup = cleanup;
+    int ret = rest_bench_mixed(g_ceph_context, mixed);
+    if (ret < 0) {
+      cerr << "error during benchmark: " << ret << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+
   RESTDispatcher dispatcher(g_ceph_context, concurrent_ios);
 
   RESTBencher bencher(&dispatcher);
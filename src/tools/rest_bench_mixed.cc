@@ -0,0 +1,961 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * The mixed workload of rest-bench.  Unlike the write/seq/rand benchmarks
+ * it does not go through libs3, whose API has no multipart uploads and no
+ * swift counterpart, but sends its requests with curl, signing them
+ * itself for S3 or using a token from the swift auth for Swift.  Each
+ * thread keeps its own connection alive across requests.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/armor.h"
+#include "common/ceph_context.h"
+#include "common/ceph_crypto.h"
+#include "common/Clock.h"
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "common/strtol.h"
+#include "common/Thread.h"
+#include "include/str_list.h"
+
+#include "rest_bench_mixed.h"
+
+using namespace std;
+
+enum MixedOpType {
+  MIXED_OP_PUT,
+  MIXED_OP_GET,
+  MIXED_OP_RANGE_GET,
+  MIXED_OP_LIST,
+  MIXED_OP_DELETE,
+  MIXED_OP_MULTIPART,
+  MIXED_OP_NUM,
+};
+
+static const char *mixed_op_names[MIXED_OP_NUM] = {
+  "put",
+  "get",
+  "range-get",
+  "list",
+  "delete",
+  "multipart",
+};
+
+struct size_range {
+  uint64_t min;
+  uint64_t max;
+  int weight;
+};
+
+struct op_stats {
+  uint64_t ops;
+  uint64_t errors;
+  uint64_t bytes;
+  vector<double> latencies; /* in ms, of the successful ops */
+
+  op_stats() : ops(0), errors(0), bytes(0) {}
+
+  void add(const op_stats& o) {
+    ops += o.ops;
+    errors += o.errors;
+    bytes += o.bytes;
+    latencies.insert(latencies.end(), o.latencies.begin(), o.latencies.end());
+  }
+};
+
+static int parse_weights(const string& s, int *weights)
+{
+  for (int i = 0; i < MIXED_OP_NUM; i++)
+    weights[i] = 0;
+
+  list<string> entries;
+  get_str_list(s, ",", entries);
+  for (list<string>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+    size_t pos = iter->find(':');
+    if (pos == string::npos)
+      return -EINVAL;
+    string name = iter->substr(0, pos);
+    string err;
+    int weight = strict_strtol(iter->c_str() + pos + 1, 10, &err);
+    if (!err.empty() || weight < 0)
+      return -EINVAL;
+
+    int i;
+    for (i = 0; i < MIXED_OP_NUM; i++) {
+      if (name == mixed_op_names[i])
+        break;
+    }
+    if (i == MIXED_OP_NUM)
+      return -EINVAL;
+    weights[i] = weight;
+  }
+  return 0;
+}
+
+static int parse_sizes(const string& s, vector<size_range>& sizes)
+{
+  list<string> entries;
+  get_str_list(s, ",", entries);
+  for (list<string>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+    size_t pos = iter->find(':');
+    string range = iter->substr(0, pos);
+    size_range r;
+    string err;
+    r.weight = 1;
+    if (pos != string::npos) {
+      r.weight = strict_strtol(iter->c_str() + pos + 1, 10, &err);
+      if (!err.empty() || r.weight < 0)
+        return -EINVAL;
+    }
+    size_t dash = range.find('-');
+    r.min = strict_sistrtoll(range.substr(0, dash).c_str(), &err);
+    if (!err.empty())
+      return -EINVAL;
+    r.max = r.min;
+    if (dash != string::npos) {
+      r.max = strict_sistrtoll(range.substr(dash + 1).c_str(), &err);
+      if (!err.empty() || r.max < r.min)
+        return -EINVAL;
+    }
+    sizes.push_back(r);
+  }
+  return sizes.empty() ? -EINVAL : 0;
+}
+
+static string http_date()
+{
+  char buf[64];
+  struct tm tm;
+  time_t t = time(NULL);
+  gmtime_r(&t, &tm);
+  strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return buf;
+}
+
+static string s3_signature(const string& secret, const string& str)
+{
+  unsigned char hmac[CEPH_CRYPTO_HMACSHA1_DIGESTSIZE];
+  ceph::crypto::HMACSHA1 h((const unsigned char *)secret.c_str(), secret.size());
+  h.Update((const unsigned char *)str.c_str(), str.size());
+  h.Final(hmac);
+
+  char b64[64];
+  int len = ceph_armor(b64, b64 + sizeof(b64), (const char *)hmac, (const char *)hmac + sizeof(hmac));
+  return string(b64, len);
+}
+
+/* a simple tag lookup, good enough for the few responses that are parsed */
+static string xml_tag(const string& xml, const string& tag)
+{
+  string open = "<" + tag + ">";
+  size_t start = xml.find(open);
+  if (start == string::npos)
+    return "";
+  start += open.size();
+  size_t end = xml.find("</" + tag + ">", start);
+  if (end == string::npos)
+    return "";
+  return xml.substr(start, end - start);
+}
+
+/*
+ * A connection to the gateway, used by one thread.
+ */
+class BenchClient {
+  rest_bench_mixed_params& params;
+  CURL *curl;
+
+  string storage_url; /* swift */
+  string token;
+
+  /* the request in progress */
+  const char *send_buf;
+  uint64_t send_len;
+  uint64_t send_ofs;
+  string *recv_body;
+  uint64_t recv_len;
+  map<string, string> resp_headers;
+
+  static size_t read_cb(char *ptr, size_t size, size_t nmemb, void *arg) {
+    BenchClient *c = static_cast<BenchClient *>(arg);
+    size_t len = std::min((uint64_t)(size * nmemb), c->send_len - c->send_ofs);
+    memcpy(ptr, c->send_buf + c->send_ofs, len);
+    c->send_ofs += len;
+    return len;
+  }
+
+  static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *arg) {
+    BenchClient *c = static_cast<BenchClient *>(arg);
+    size_t len = size * nmemb;
+    if (c->recv_body)
+      c->recv_body->append(ptr, len);
+    c->recv_len += len;
+    return len;
+  }
+
+  static size_t header_cb(char *ptr, size_t size, size_t nmemb, void *arg) {
+    BenchClient *c = static_cast<BenchClient *>(arg);
+    size_t len = size * nmemb;
+    string line(ptr, len);
+    size_t pos = line.find(':');
+    if (pos != string::npos) {
+      string name = line.substr(0, pos);
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      size_t start = line.find_first_not_of(" \t", pos + 1);
+      size_t end = line.find_last_not_of(" \t\r\n");
+      c->resp_headers[name] = (start == string::npos || end < start ? "" : line.substr(start, end - start + 1));
+    }
+    return len;
+  }
+
+  string base_url() {
+    return string(params.https ? "https://" : "http://") + params.host;
+  }
+
+public:
+  BenchClient(rest_bench_mixed_params& _params)
+    : params(_params), curl(NULL), send_buf(NULL), send_len(0), send_ofs(0),
+      recv_body(NULL), recv_len(0) {}
+  ~BenchClient() {
+    if (curl)
+      curl_easy_cleanup(curl);
+  }
+
+  int init();
+
+  /*
+   * Send a request for bucket/key, with subres the signed S3 subresource
+   * (e.g. "uploads") and query any further parameters.  Returns the HTTP
+   * status, or a negative error if there was no response.
+   */
+  int request(const char *method, const string& bucket, const string& key,
+              const string& subres, const string& query, list<string>& headers,
+              const char *data, uint64_t len, string *body, uint64_t *received);
+
+  const string& get_header(const string& name) {
+    return resp_headers[name];
+  }
+};
+
+int BenchClient::init()
+{
+  curl = curl_easy_init();
+  if (!curl)
+    return -ENOMEM;
+
+  if (params.api != MIXED_API_SWIFT)
+    return 0;
+
+  string url = params.auth_url;
+  if (url.empty())
+    url = base_url() + "/auth/v1.0";
+
+  struct curl_slist *h = NULL;
+  h = curl_slist_append(h, ("X-Auth-User: " + params.access_key).c_str());
+  h = curl_slist_append(h, ("X-Auth-Key: " + params.secret).c_str());
+
+  resp_headers.clear();
+  recv_body = NULL;
+  curl_easy_reset(curl);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, h);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)this);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)this);
+  CURLcode ret = curl_easy_perform(curl);
+  curl_slist_free_all(h);
+
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  if (ret != CURLE_OK || status / 100 != 2) {
+    cerr << "swift auth at " << url << " failed: "
+         << (ret != CURLE_OK ? curl_easy_strerror(ret) : "") << " status=" << status << std::endl;
+    return -EACCES;
+  }
+
+  storage_url = resp_headers["x-storage-url"];
+  token = resp_headers["x-auth-token"];
+  if (storage_url.empty() || token.empty()) {
+    cerr << "swift auth response has no storage url or token" << std::endl;
+    return -EACCES;
+  }
+  return 0;
+}
+
+int BenchClient::request(const char *method, const string& bucket, const string& key,
+                         const string& subres, const string& query, list<string>& headers,
+                         const char *data, uint64_t len, string *body, uint64_t *received)
+{
+  string path = "/" + bucket;
+  if (!key.empty())
+    path += "/" + key;
+
+  string url;
+  struct curl_slist *h = NULL;
+
+  if (params.api == MIXED_API_SWIFT) {
+    url = storage_url + path;
+    h = curl_slist_append(h, ("X-Auth-Token: " + token).c_str());
+  } else {
+    url = base_url() + path;
+
+    string date = http_date();
+    string resource = path;
+    if (!subres.empty())
+      resource += "?" + subres;
+    string to_sign = string(method) + "\n\n\n" + date + "\n" + resource;
+    h = curl_slist_append(h, ("Date: " + date).c_str());
+    h = curl_slist_append(h, ("Authorization: AWS " + params.access_key + ":" +
+                              s3_signature(params.secret, to_sign)).c_str());
+  }
+
+  string q = subres;
+  if (!query.empty())
+    q += (q.empty() ? "" : "&") + query;
+  if (!q.empty())
+    url += "?" + q;
+
+  for (list<string>::iterator iter = headers.begin(); iter != headers.end(); ++iter)
+    h = curl_slist_append(h, iter->c_str());
+  /* no 100-continue round trip, and no content type that would have to be signed */
+  h = curl_slist_append(h, "Expect:");
+  h = curl_slist_append(h, "Content-Type:");
+
+  send_buf = data;
+  send_len = len;
+  send_ofs = 0;
+  recv_body = body;
+  recv_len = 0;
+  resp_headers.clear();
+
+  /* keeps the connection */
+  curl_easy_reset(curl);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, h);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *)this);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)this);
+  if (strcmp(method, "PUT") == 0 || strcmp(method, "POST") == 0) {
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_cb);
+    curl_easy_setopt(curl, CURLOPT_READDATA, (void *)this);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)len);
+  }
+  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+
+  CURLcode ret = curl_easy_perform(curl);
+  curl_slist_free_all(h);
+  if (ret != CURLE_OK) {
+    cerr << method << " " << url << ": " << curl_easy_strerror(ret) << std::endl;
+    return -EIO;
+  }
+
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  if (received)
+    *received = recv_len;
+  return status;
+}
+
+/*
+ * The objects written so far, that reads and deletes pick from.
+ */
+class BenchObjects {
+  Mutex lock;
+  vector<pair<string, uint64_t> > objs;
+
+public:
+  BenchObjects() : lock("BenchObjects::lock") {}
+
+  void add(const string& name, uint64_t size) {
+    Mutex::Locker l(lock);
+    objs.push_back(make_pair(name, size));
+  }
+
+  bool pick(unsigned *seed, bool remove, string *name, uint64_t *size) {
+    Mutex::Locker l(lock);
+    if (objs.empty())
+      return false;
+    size_t i = rand_r(seed) % objs.size();
+    *name = objs[i].first;
+    *size = objs[i].second;
+    if (remove) {
+      objs[i] = objs.back();
+      objs.pop_back();
+    }
+    return true;
+  }
+
+  size_t size() {
+    Mutex::Locker l(lock);
+    return objs.size();
+  }
+};
+
+class MixedBench;
+
+class MixedWorker : public Thread {
+public:
+  enum Mode {
+    PREFILL,
+    RUN,
+    REMOVE,
+  };
+
+private:
+  MixedBench *bench;
+  int id;
+  Mode mode;
+  unsigned seed;
+  uint64_t counter;
+  BenchClient client;
+
+  uint64_t rand64() {
+    return ((uint64_t)rand_r(&seed) << 32) ^ (uint64_t)rand_r(&seed);
+  }
+
+  uint64_t pick_size();
+  string new_name();
+  bool success(int status) { return status >= 200 && status < 300; }
+
+  int do_put(uint64_t *bytes);
+  int do_get(bool ranged, uint64_t *bytes);
+  int do_list();
+  int do_delete();
+  int do_multipart(uint64_t *bytes);
+
+public:
+  op_stats stats[MIXED_OP_NUM];
+  int init_ret;
+
+  MixedWorker(MixedBench *_bench, int _id, Mode _mode);
+
+  void *entry();
+};
+
+class MixedBench {
+public:
+  CephContext *cct;
+  rest_bench_mixed_params& params;
+  string segments_bucket; /* swift */
+  int weights[MIXED_OP_NUM];
+  int total_weight;
+  vector<size_range> sizes;
+  int total_size_weight;
+  string data;   /* what is written, sliced as needed */
+  BenchObjects objects;
+  utime_t finish;
+
+  /* prefill */
+  Mutex lock;
+  long long prefill_left;
+
+  MixedBench(CephContext *_cct, rest_bench_mixed_params& _params)
+    : cct(_cct), params(_params), total_weight(0), total_size_weight(0),
+      lock("MixedBench::lock"), prefill_left(0) {}
+
+  int init();
+  int create_bucket(const string& name);
+  int run_workers(MixedWorker::Mode mode, op_stats *stats);
+  void dump(Formatter *f, op_stats *stats, double elapsed);
+};
+
+MixedWorker::MixedWorker(MixedBench *_bench, int _id, Mode _mode)
+  : bench(_bench), id(_id), mode(_mode), counter(0),
+    client(_bench->params), init_ret(0)
+{
+  seed = (unsigned)(ceph_clock_now(bench->cct).to_nsec() + id * 7919);
+}
+
+uint64_t MixedWorker::pick_size()
+{
+  int w = rand_r(&seed) % bench->total_size_weight;
+  vector<size_range>::iterator iter;
+  for (iter = bench->sizes.begin(); iter != bench->sizes.end(); ++iter) {
+    if (w < iter->weight)
+      break;
+    w -= iter->weight;
+  }
+  if (iter->max == iter->min)
+    return iter->min;
+  return iter->min + rand64() % (iter->max - iter->min + 1);
+}
+
+string MixedWorker::new_name()
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "p%03d/", rand_r(&seed) % bench->params.num_prefixes);
+  ostringstream oss;
+  oss << buf << bench->params.run_name << "_" << id << "_" << counter++;
+  return oss.str();
+}
+
+int MixedWorker::do_put(uint64_t *bytes)
+{
+  uint64_t size = pick_size();
+  string name = new_name();
+  list<string> headers;
+  int r = client.request("PUT", bench->params.bucket, name, "", "", headers,
+                         bench->data.c_str(), size, NULL, NULL);
+  if (!success(r))
+    return (r < 0 ? r : -EIO);
+  bench->objects.add(name, size);
+  *bytes = size;
+  return 0;
+}
+
+int MixedWorker::do_get(bool ranged, uint64_t *bytes)
+{
+  string name;
+  uint64_t size;
+  if (!bench->objects.pick(&seed, false, &name, &size))
+    return -ENOENT;
+
+  list<string> headers;
+  if (ranged && size > 0) {
+    uint64_t len = std::min(bench->params.range_size, size);
+    uint64_t ofs = rand64() % (size - len + 1);
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Range: bytes=%llu-%llu",
+             (unsigned long long)ofs, (unsigned long long)(ofs + len - 1));
+    headers.push_back(buf);
+  }
+  int r = client.request("GET", bench->params.bucket, name, "", "", headers,
+                         NULL, 0, NULL, bytes);
+  if (!success(r))
+    return (r < 0 ? r : -EIO);
+  return 0;
+}
+
+int MixedWorker::do_list()
+{
+  /* one in num_prefixes + 1 lists the top level, i.e. the common prefixes */
+  int p = rand_r(&seed) % (bench->params.num_prefixes + 1);
+  string prefix;
+  if (p < bench->params.num_prefixes) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "p%03d/", p);
+    prefix = buf;
+  }
+
+  ostringstream query;
+  if (bench->params.api == MIXED_API_SWIFT)
+    query << "format=json&limit=" << bench->params.list_max;
+  else
+    query << "max-keys=" << bench->params.list_max;
+  query << "&delimiter=/";
+  if (!prefix.empty())
+    query << "&prefix=" << prefix;
+
+  list<string> headers;
+  int r = client.request("GET", bench->params.bucket, "", "", query.str(), headers,
+                         NULL, 0, NULL, NULL);
+  if (!success(r))
+    return (r < 0 ? r : -EIO);
+  return 0;
+}
+
+int MixedWorker::do_delete()
+{
+  string name;
+  uint64_t size;
+  if (!bench->objects.pick(&seed, true, &name, &size))
+    return -ENOENT;
+
+  list<string> headers;
+  int r = client.request("DELETE", bench->params.bucket, name, "", "", headers,
+                         NULL, 0, NULL, NULL);
+  if (!success(r))
+    return (r < 0 ? r : -EIO);
+  return 0;
+}
+
+/*
+ * An S3 multipart upload, or for swift a dynamic large object: segments
+ * in a separate container and a manifest pointing at them.
+ */
+int MixedWorker::do_multipart(uint64_t *bytes)
+{
+  uint64_t size = pick_size();
+  uint64_t part_size = bench->params.part_size;
+  string name = new_name();
+  list<string> headers;
+  string upload_id;
+  string complete;
+  int r;
+
+  if (bench->params.api == MIXED_API_S3) {
+    string body;
+    r = client.request("POST", bench->params.bucket, name, "uploads", "", headers,
+                       NULL, 0, &body, NULL);
+    if (!success(r))
+      return (r < 0 ? r : -EIO);
+    upload_id = xml_tag(body, "UploadId");
+    if (upload_id.empty())
+      return -EIO;
+    complete = "<CompleteMultipartUpload>";
+  }
+
+  uint64_t ofs = 0;
+  int num = 1;
+  do {
+    uint64_t len = std::min(part_size, size - ofs);
+    char buf[32];
+    if (bench->params.api == MIXED_API_S3) {
+      ostringstream subres;
+      subres << "partNumber=" << num << "&uploadId=" << upload_id;
+      r = client.request("PUT", bench->params.bucket, name, subres.str(), "", headers,
+                         bench->data.c_str(), len, NULL, NULL);
+      if (!success(r))
+        return (r < 0 ? r : -EIO);
+      snprintf(buf, sizeof(buf), "%d", num);
+      complete += string("<Part><PartNumber>") + buf + "</PartNumber><ETag>" +
+                  client.get_header("etag") + "</ETag></Part>";
+    } else {
+      snprintf(buf, sizeof(buf), "/%08d", num);
+      r = client.request("PUT", bench->segments_bucket, name + buf, "", "", headers,
+                         bench->data.c_str(), len, NULL, NULL);
+      if (!success(r))
+        return (r < 0 ? r : -EIO);
+    }
+    ofs += len;
+    num++;
+  } while (ofs < size);
+
+  if (bench->params.api == MIXED_API_S3) {
+    complete += "</CompleteMultipartUpload>";
+    r = client.request("POST", bench->params.bucket, name, "uploadId=" + upload_id, "", headers,
+                       complete.c_str(), complete.size(), NULL, NULL);
+  } else {
+    headers.push_back("X-Object-Manifest: " + bench->segments_bucket + "/" + name + "/");
+    r = client.request("PUT", bench->params.bucket, name, "", "", headers,
+                       NULL, 0, NULL, NULL);
+  }
+  if (!success(r))
+    return (r < 0 ? r : -EIO);
+
+  bench->objects.add(name, size);
+  *bytes = size;
+  return 0;
+}
+
+void *MixedWorker::entry()
+{
+  init_ret = client.init();
+  if (init_ret < 0)
+    return NULL;
+
+  if (mode == PREFILL) {
+    while (true) {
+      {
+        Mutex::Locker l(bench->lock);
+        if (bench->prefill_left <= 0)
+          break;
+        --bench->prefill_left;
+      }
+      uint64_t bytes;
+      if (do_put(&bytes) < 0)
+        ++stats[MIXED_OP_PUT].errors;
+    }
+    return NULL;
+  }
+
+  if (mode == REMOVE) {
+    while (do_delete() != -ENOENT) ;
+    return NULL;
+  }
+
+  while (ceph_clock_now(bench->cct) < bench->finish) {
+    int w = rand_r(&seed) % bench->total_weight;
+    int op;
+    for (op = 0; op < MIXED_OP_NUM - 1; op++) {
+      if (w < bench->weights[op])
+        break;
+      w -= bench->weights[op];
+    }
+
+    utime_t start = ceph_clock_now(bench->cct);
+    uint64_t bytes = 0;
+    int r;
+    switch (op) {
+    case MIXED_OP_GET:
+    case MIXED_OP_RANGE_GET:
+    case MIXED_OP_DELETE:
+      r = (op == MIXED_OP_DELETE ? do_delete() : do_get(op == MIXED_OP_RANGE_GET, &bytes));
+      if (r == -ENOENT) {
+        /* nothing to read or delete yet */
+        op = MIXED_OP_PUT;
+        r = do_put(&bytes);
+      }
+      break;
+    case MIXED_OP_LIST:
+      r = do_list();
+      break;
+    case MIXED_OP_MULTIPART:
+      r = do_multipart(&bytes);
+      break;
+    default:
+      r = do_put(&bytes);
+      break;
+    }
+    utime_t lat = ceph_clock_now(bench->cct) - start;
+
+    op_stats& s = stats[op];
+    s.ops++;
+    if (r < 0) {
+      s.errors++;
+      continue;
+    }
+    s.bytes += bytes;
+    s.latencies.push_back((double)lat * 1000.0);
+  }
+  return NULL;
+}
+
+int MixedBench::init()
+{
+  if (parse_weights(params.mix, weights) < 0) {
+    cerr << "invalid --mix: " << params.mix << std::endl;
+    return -EINVAL;
+  }
+  for (int i = 0; i < MIXED_OP_NUM; i++)
+    total_weight += weights[i];
+  if (!total_weight) {
+    cerr << "--mix has no op with a weight" << std::endl;
+    return -EINVAL;
+  }
+
+  if (parse_sizes(params.obj_sizes, sizes) < 0) {
+    cerr << "invalid --obj-sizes: " << params.obj_sizes << std::endl;
+    return -EINVAL;
+  }
+  uint64_t max_size = params.part_size;
+  for (vector<size_range>::iterator iter = sizes.begin(); iter != sizes.end(); ++iter) {
+    total_size_weight += iter->weight;
+    if (iter->max > max_size)
+      max_size = iter->max;
+  }
+  if (!total_size_weight) {
+    cerr << "--obj-sizes has no size with a weight" << std::endl;
+    return -EINVAL;
+  }
+
+  if (params.num_prefixes < 1 || params.part_size < 1 || params.concurrent_ios < 1) {
+    cerr << "invalid numeric option" << std::endl;
+    return -EINVAL;
+  }
+
+  data.resize(max_size);
+  unsigned seed = time(NULL);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (char)rand_r(&seed);
+
+  int r = create_bucket(params.bucket);
+  if (r < 0)
+    return r;
+
+  if (params.api == MIXED_API_SWIFT) {
+    segments_bucket = params.bucket + "_segments";
+    r = create_bucket(segments_bucket);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+int MixedBench::create_bucket(const string& name)
+{
+  BenchClient client(params);
+  int r = client.init();
+  if (r < 0)
+    return r;
+
+  list<string> headers;
+  r = client.request("PUT", name, "", "", "", headers, NULL, 0, NULL, NULL);
+  if (r < 0 || (r / 100 != 2 && r != 409)) {
+    cerr << "failed to create bucket " << name << ": status=" << r << std::endl;
+    return -EIO;
+  }
+  return 0;
+}
+
+int MixedBench::run_workers(MixedWorker::Mode mode, op_stats *stats)
+{
+  vector<MixedWorker *> workers;
+  for (int i = 0; i < params.concurrent_ios; i++) {
+    workers.push_back(new MixedWorker(this, i, mode));
+    workers.back()->create();
+  }
+
+  int ret = 0;
+  for (int i = 0; i < params.concurrent_ios; i++) {
+    workers[i]->join();
+    if (workers[i]->init_ret < 0)
+      ret = workers[i]->init_ret;
+    if (stats) {
+      for (int op = 0; op < MIXED_OP_NUM; op++)
+        stats[op].add(workers[i]->stats[op]);
+    }
+    delete workers[i];
+  }
+  return ret;
+}
+
+static double percentile(const vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+void MixedBench::dump(Formatter *f, op_stats *stats, double elapsed)
+{
+  f->open_object_section("rest_bench");
+
+  f->open_object_section("config");
+  f->dump_string("api", params.api == MIXED_API_SWIFT ? "swift" : "s3");
+  f->dump_int("concurrent_ios", params.concurrent_ios);
+  f->dump_int("seconds", params.seconds);
+  f->dump_string("mix", params.mix);
+  f->dump_string("obj_sizes", params.obj_sizes);
+  f->dump_unsigned("part_size", params.part_size);
+  f->dump_unsigned("range_size", params.range_size);
+  f->dump_int("num_prefixes", params.num_prefixes);
+  f->close_section();
+
+  f->dump_float("elapsed", elapsed);
+
+  op_stats total;
+  f->open_array_section("ops");
+  for (int op = 0; op < MIXED_OP_NUM; op++) {
+    op_stats& s = stats[op];
+    total.ops += s.ops;
+    total.errors += s.errors;
+    total.bytes += s.bytes;
+
+    vector<double>& lat = s.latencies;
+    sort(lat.begin(), lat.end());
+    double sum = 0;
+    for (vector<double>::iterator iter = lat.begin(); iter != lat.end(); ++iter)
+      sum += *iter;
+
+    f->open_object_section("op");
+    f->dump_string("type", mixed_op_names[op]);
+    f->dump_unsigned("ops", s.ops);
+    f->dump_unsigned("errors", s.errors);
+    f->dump_unsigned("bytes", s.bytes);
+    f->dump_float("ops_per_sec", (double)(s.ops - s.errors) / elapsed);
+    f->dump_float("mb_per_sec", (double)s.bytes / elapsed / (1024 * 1024));
+    f->open_object_section("latency_ms");
+    f->dump_float("avg", lat.empty() ? 0 : sum / lat.size());
+    f->dump_float("min", lat.empty() ? 0 : lat.front());
+    f->dump_float("p50", percentile(lat, 50));
+    f->dump_float("p90", percentile(lat, 90));
+    f->dump_float("p95", percentile(lat, 95));
+    f->dump_float("p99", percentile(lat, 99));
+    f->dump_float("p99.9", percentile(lat, 99.9));
+    f->dump_float("max", lat.empty() ? 0 : lat.back());
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+
+  f->open_object_section("total");
+  f->dump_unsigned("ops", total.ops);
+  f->dump_unsigned("errors", total.errors);
+  f->dump_unsigned("bytes", total.bytes);
+  f->dump_float("ops_per_sec", (double)(total.ops - total.errors) / elapsed);
+  f->dump_float("mb_per_sec", (double)total.bytes / elapsed / (1024 * 1024));
+  f->close_section();
+
+  f->close_section();
+}
+
+int rest_bench_mixed(CephContext *cct, rest_bench_mixed_params& params)
+{
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  if (params.run_name.empty()) {
+    ostringstream oss;
+    oss << "rest_bench_" << getpid();
+    params.run_name = oss.str();
+  }
+
+  MixedBench bench(cct, params);
+  int r = bench.init();
+  if (r < 0)
+    return r;
+
+  if (params.prefill > 0) {
+    cerr << "writing " << params.prefill << " objects" << std::endl;
+    bench.prefill_left = params.prefill;
+    r = bench.run_workers(MixedWorker::PREFILL, NULL);
+    if (r < 0)
+      return r;
+  }
+
+  cerr << "running for " << params.seconds << " seconds" << std::endl;
+  op_stats stats[MIXED_OP_NUM];
+  utime_t start = ceph_clock_now(cct);
+  bench.finish = start;
+  bench.finish += params.seconds;
+  r = bench.run_workers(MixedWorker::RUN, stats);
+  if (r < 0)
+    return r;
+  double elapsed = (double)(ceph_clock_now(cct) - start);
+
+  JSONFormatter f(true);
+  bench.dump(&f, stats, elapsed);
+  if (params.json_out.empty()) {
+    f.flush(cout);
+    cout << std::endl;
+  } else {
+    ofstream out(params.json_out.c_str());
+    f.flush(out);
+    out << std::endl;
+    if (!out) {
+      cerr << "failed to write " << params.json_out << std::endl;
+      r = -EIO;
+    }
+  }
+
+  if (params.cleanup) {
+    cerr << "removing " << bench.objects.size() << " objects" << std::endl;
+    int ret = bench.run_workers(MixedWorker::REMOVE, NULL);
+    if (ret < 0)
+      return ret;
+  }
+  return r;
+}
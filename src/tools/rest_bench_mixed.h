@@ -0,0 +1,62 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_REST_BENCH_MIXED_H
+#define CEPH_REST_BENCH_MIXED_H
+
+#include <string>
+
+class CephContext;
+
+enum MixedAPI {
+  MIXED_API_S3,
+  MIXED_API_SWIFT,
+};
+
+struct rest_bench_mixed_params {
+  MixedAPI api;
+  std::string host;          /* host[:port] */
+  bool https;
+  std::string auth_url;      /* swift only; defaults to <proto>://<host>/auth/v1.0 */
+  std::string access_key;    /* swift: the user */
+  std::string secret;        /* swift: the key */
+  std::string bucket;
+  std::string run_name;
+
+  int concurrent_ios;
+  int seconds;
+  std::string mix;           /* op:weight,... */
+  std::string obj_sizes;     /* size[-size]:weight,... */
+  uint64_t part_size;
+  uint64_t range_size;
+  int num_prefixes;
+  int list_max;
+  long long prefill;         /* objects written before the timed run */
+  bool cleanup;
+  std::string json_out;      /* file, stdout if empty */
+
+  rest_bench_mixed_params()
+    : api(MIXED_API_S3), https(false), concurrent_ios(16), seconds(60),
+      mix("put:25,get:40,range-get:15,list:5,delete:10,multipart:5"),
+      obj_sizes("4K:50,64K:25,1M:20,16M:5"),
+      part_size(5 << 20), range_size(64 << 10), num_prefixes(16),
+      list_max(1000), prefill(0), cleanup(true) {}
+};
+
+/*
+ * Run a mixed workload of PUTs, GETs, ranged GETs, delimited listings,
+ * DELETEs and multipart uploads against a radosgw endpoint for the given
+ * time, then print per op type throughput and latency percentiles as JSON.
+ */
+int rest_bench_mixed(CephContext *cct, rest_bench_mixed_params& params);
+
+#endif